@@ -0,0 +1,246 @@
+/*
+ * Hash aggregation: count and sum values per key in one pass.
+ *
+ * Groups are few next to the rows that feed them, so the table stays small
+ * and hot, and open addressing keeps a group's key and running totals in one
+ * slot.  The parallel build partitions by the top bits of the hash while the
+ * slot comes from the bottom bits, so partitioning doesn't crowd any table.
+ *
+ * It isn't built on struct hashtable.  Totals on the chain nodes would
+ * double every list_t, for every user of the plain table and its pool, to
+ * serve this one; and a lookup per row down a chain is a pointer chase per
+ * row, where here the key and its totals share a slot.  Nor can it load
+ * through build_from_array(), which wants distinct keys, and rows repeat
+ * keys by nature.  What it takes from that is the idea: agg_build() sizes
+ * the table once, and the merged partitions, distinct by construction, are
+ * poured in without looking anything up.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hashfunc.h"
+#include "aggtable.h"
+
+#define AGG_SMALL 8
+
+#define PART(H) ((H) >> (32 - __builtin_ctz(AGG_PARTS)))
+
+static void growtable(struct aggtable *table);
+
+void agg_build(struct aggtable *table, int m)
+{
+    int size = AGG_SMALL;
+
+    while (size * AGG_MAX_LOAD < m) {
+        size <<= 1;
+    }
+
+    table->n = 0;
+    table->m = size;
+    table->g = size * AGG_MAX_LOAD;
+    table->slots = calloc(size, sizeof(aggslot_t));
+
+    return;
+}
+
+/* the slot holding key, or the empty one it would go in. */
+static inline aggslot_t *probe(struct aggtable *table, int key, uint32_t h)
+{
+    int mask = table->m - 1;
+    int i = h & mask;
+
+    while (table->slots[i].used && table->slots[i].key != key) {
+        i = (i + 1) & mask;
+    }
+
+    return &table->slots[i];
+}
+
+static void addhash(struct aggtable *table, int key, uint32_t h, long count,
+        long sum)
+{
+    aggslot_t *slot = probe(table, key, h);
+
+    if (!slot->used) {
+        slot->used = 1;
+        slot->key = key;
+        table->n++;
+    }
+
+    slot->count += count;
+    slot->sum += sum;
+
+    if (table->n > table->g) {
+        growtable(table);
+    }
+}
+
+/* for a group known not to be in the table yet. */
+static void put(struct aggtable *table, const aggslot_t *group)
+{
+    int mask = table->m - 1;
+    int i = murmurmix((uint32_t)group->key) & mask;
+
+    while (table->slots[i].used) {
+        i = (i + 1) & mask;
+    }
+
+    table->slots[i] = *group;
+    table->n++;
+}
+
+static void growtable(struct aggtable *table)
+{
+    int i;
+    struct aggtable old = *table;
+
+    agg_build(table, (old.m << 1) * AGG_MAX_LOAD);
+
+    for (i = 0; i < old.m; i++) {
+        if (old.slots[i].used) {
+            put(table, &old.slots[i]);
+        }
+    }
+
+    agg_free(&old);
+
+    return;
+}
+
+void agg_add(struct aggtable *table, int key, long value)
+{
+    addhash(table, key, murmurmix((uint32_t)key), 1, value);
+}
+
+void agg_many(struct aggtable *table, const int *keys, const int *values,
+        int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        agg_add(table, keys[i], values ? values[i] : 0);
+    }
+}
+
+aggslot_t *agg_find(struct aggtable *table, int key)
+{
+    aggslot_t *slot = probe(table, key, murmurmix((uint32_t)key));
+
+    return slot->used ? slot : NULL;
+}
+
+struct aggjob {
+    const int *keys;
+    const int *values;
+    int n;
+    int id;
+    int threads;
+    pthread_barrier_t *barrier;
+    struct aggtable *local; /* [threads][AGG_PARTS], all of them. */
+    struct aggtable *merged; /* [AGG_PARTS] */
+};
+
+static void *aggworker(void *arg)
+{
+    struct aggjob *job = arg;
+    struct aggtable *mine = &job->local[job->id * AGG_PARTS];
+    int i, t, p;
+
+    for (p = 0; p < AGG_PARTS; p++) {
+        agg_build(&mine[p], AGG_SMALL);
+    }
+
+    for (i = 0; i < job->n; i++) {
+        uint32_t h = murmurmix((uint32_t)job->keys[i]);
+        addhash(&mine[PART(h)], job->keys[i], h, 1,
+                job->values ? job->values[i] : 0);
+    }
+
+    pthread_barrier_wait(job->barrier);
+
+    /* partition p is ours alone now; fold every thread's copy of it in. */
+    for (p = job->id; p < AGG_PARTS; p += job->threads) {
+        struct aggtable *into = &job->merged[p];
+
+        *into = job->local[p];
+        for (t = 1; t < job->threads; t++) {
+            struct aggtable *from = &job->local[t * AGG_PARTS + p];
+
+            for (i = 0; i < from->m; i++) {
+                aggslot_t *s = &from->slots[i];
+                if (s->used) {
+                    addhash(into, s->key, murmurmix((uint32_t)s->key),
+                            s->count, s->sum);
+                }
+            }
+            agg_free(from);
+        }
+    }
+
+    return NULL;
+}
+
+void agg_parallel(struct aggtable *table, const int *keys, const int *values,
+        int n, int threads)
+{
+    int i, t, p, groups = 0;
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    struct aggjob *jobs = malloc(sizeof(struct aggjob) * threads);
+    struct aggtable *local = malloc(sizeof(struct aggtable) * threads *
+            AGG_PARTS);
+    struct aggtable merged[AGG_PARTS];
+    pthread_barrier_t barrier;
+
+    assert(table->n == 0);
+
+    pthread_barrier_init(&barrier, NULL, threads);
+
+    for (t = 0; t < threads; t++) {
+        int lo = (long)n * t / threads;
+        int hi = (long)n * (t + 1) / threads;
+
+        jobs[t].keys = keys + lo;
+        jobs[t].values = values ? values + lo : NULL;
+        jobs[t].n = hi - lo;
+        jobs[t].id = t;
+        jobs[t].threads = threads;
+        jobs[t].barrier = &barrier;
+        jobs[t].local = local;
+        jobs[t].merged = merged;
+        pthread_create(&tids[t], NULL, aggworker, &jobs[t]);
+    }
+    for (t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    /* the partitions share no keys, so no group needs looking up. */
+    for (p = 0; p < AGG_PARTS; p++) {
+        groups += merged[p].n;
+    }
+    if (groups > table->g) {
+        agg_free(table);
+        agg_build(table, groups);
+    }
+    for (p = 0; p < AGG_PARTS; p++) {
+        for (i = 0; i < merged[p].m; i++) {
+            if (merged[p].slots[i].used) {
+                put(table, &merged[p].slots[i]);
+            }
+        }
+        agg_free(&merged[p]);
+    }
+
+    pthread_barrier_destroy(&barrier);
+    free(local);
+    free(jobs);
+    free(tids);
+}
+
+void agg_free(struct aggtable *table)
+{
+    free(table->slots);
+}
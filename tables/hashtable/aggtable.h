@@ -0,0 +1,46 @@
+
+#ifndef _AGGTABLE_H
+#define _AGGTABLE_H
+
+/* grows past this load. */
+#define AGG_MAX_LOAD 0.75
+/* the parallel build splits keys this many ways by hash (a power of two). */
+#define AGG_PARTS 64
+
+/* one group: how many times key was seen, and the sum of its values. */
+typedef struct aggslot {
+    int key;
+    int used;
+    long count;
+    long sum;
+} aggslot_t;
+
+/* group-by table, linear probing. */
+struct aggtable {
+    int n; /* number of groups. */
+    int m; /* size of table, a power of two. */
+    int g; /* n that triggers growth. */
+    aggslot_t *slots;
+};
+
+/* sized for m groups without growing. */
+void agg_build(struct aggtable *table, int m);
+/* count key once more and add value to its sum. */
+void agg_add(struct aggtable *table, int key, long value);
+/* agg_add every keys[i] with values[i], or 0 if values is NULL. */
+void agg_many(struct aggtable *table, const int *keys, const int *values,
+        int n);
+/* @return key's group, or NULL if it was never added. */
+aggslot_t *agg_find(struct aggtable *table, int key);
+/*
+ * agg_many, split over threads.  Each thread aggregates its share of the
+ * input into private tables, one per hash partition; then each partition is
+ * merged across threads by one thread, no locks, and the merged partitions
+ * (disjoint by construction) are poured into table, which must be built and
+ * empty.
+ */
+void agg_parallel(struct aggtable *table, const int *keys, const int *values,
+        int n, int threads);
+void agg_free(struct aggtable *table);
+
+#endif
@@ -0,0 +1,878 @@
+/*
+ * Hashtable benchmarks.
+ *
+ * usage: ./bench [n [threads]]
+ *
+ * n keys (default 1M) are inserted one at a time from an empty table, so the
+ * numbers include growth.  The concurrent runs go from 1 up to threads
+ * (default twice the cpu count) doubling each time.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hashtable.h"
+#include "conchashtable.h"
+#include "robinhood.h"
+#include "cuckoo.h"
+#include "hashfile.h"
+#include "aggtable.h"
+#include "hashjoin.h"
+
+#define NUM_ELEMENTS(X) (sizeof(X)/sizeof(*X))
+
+/* prime step for visiting keys out of insertion order. */
+#define SCATTER 7919
+
+enum keyset {
+    KEYS_SEQUENTIAL,
+    KEYS_STRIDED,
+    KEYS_RANDOM,
+    KEYSETS,
+};
+
+static const char *keynames[KEYSETS] = {
+    [KEYS_SEQUENTIAL] = "sequential",
+    [KEYS_STRIDED] = "strided",
+    [KEYS_RANDOM] = "random",
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t
+xorshift(uint64_t *x)
+{
+    *x ^= *x >> 12;
+    *x ^= *x << 25;
+    *x ^= *x >> 27;
+
+    return *x * 0x2545f4914f6cdd1dull;
+}
+
+/* hits are keys, misses are keys that can't be in the table. */
+static void
+makekeys(int *keys, int *misses, int n, enum keyset set)
+{
+    int i;
+    uint64_t x = 88172645463325252ull;
+
+    for (i = 0; i < n; i++) {
+        switch (set) {
+        case KEYS_SEQUENTIAL:
+            keys[i] = i;
+            misses[i] = n + i;
+            break;
+        case KEYS_STRIDED:
+            /* a stride of 64 keeps the low 6 bits the same. */
+            keys[i] = i * 64;
+            misses[i] = i * 64 + 1;
+            break;
+        default:
+            /* even and odd halves, so hits and misses never overlap. */
+            keys[i] = (int)(xorshift(&x) >> 32) & ~1;
+            misses[i] = keys[i] | 1;
+            break;
+        }
+    }
+}
+
+static void
+benchhash(enum hashkind kind, enum keyset set, int *keys, int *misses, int n)
+{
+    int i;
+    int found = 0;
+    double start, ins, hit, miss;
+    struct hashtable ht;
+    struct hashstats stats;
+
+    buildhashtable(&ht, SMALL_TABLE);
+    sethash(&ht, kind);
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        insert(&ht, keys[i]);
+    }
+    ins = (now() - start) / n;
+
+    /* leave no resize in flight, so the lookups are all alike. */
+    while (ht.old) {
+        search(&ht, 0);
+    }
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        found += search(&ht, keys[i]);
+    }
+    hit = (now() - start) / n;
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        found += search(&ht, misses[i]);
+    }
+    miss = (now() - start) / n;
+
+    /* every key hit (random keys can repeat), every miss missed. */
+    assert(found == n);
+
+    hashstats(&ht, &stats);
+
+    printf("%-11s %-11s %8.1f %8.1f %8.1f %5d |",
+            keynames[set], hashnames[kind], ins, hit, miss, stats.maxchain);
+    for (i = 0; i < STATS_HIST; i++) {
+        printf(" %5.1f", 100.0 * stats.chains[i] / ht.m);
+    }
+    printf("\n");
+
+    freetable(&ht);
+}
+
+/* search_many/insert_many against the one-at-a-time loops. */
+static void
+benchbatch(int *keys, int *misses, int n)
+{
+    int i;
+    int found = 0;
+    int *out = malloc(sizeof(int) * n);
+    double start, scalar, batched;
+    struct hashtable ht;
+
+    buildhashtable(&ht, SMALL_TABLE);
+    start = now();
+    for (i = 0; i < n; i++) {
+        insert(&ht, keys[i]);
+    }
+    scalar = now() - start;
+    freetable(&ht);
+
+    buildhashtable(&ht, SMALL_TABLE);
+    start = now();
+    insert_many(&ht, keys, n);
+    batched = now() - start;
+
+    printf("%-12s %10.2f %10.2f %7.2fx\n", "insert",
+            n / scalar * 1e3, n / batched * 1e3, scalar / batched);
+
+    while (ht.old) {
+        search(&ht, 0);
+    }
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        out[i] = search(&ht, keys[i]);
+    }
+    scalar = now() - start;
+
+    start = now();
+    search_many(&ht, keys, n, out);
+    batched = now() - start;
+
+    for (i = 0; i < n; i++) {
+        found += out[i];
+    }
+    assert(found == n);
+
+    printf("%-12s %10.2f %10.2f %7.2fx\n", "search hit",
+            n / scalar * 1e3, n / batched * 1e3, scalar / batched);
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        out[i] = search(&ht, misses[i]);
+    }
+    scalar = now() - start;
+
+    start = now();
+    search_many(&ht, misses, n, out);
+    batched = now() - start;
+
+    printf("%-12s %10.2f %10.2f %7.2fx\n", "search miss",
+            n / scalar * 1e3, n / batched * 1e3, scalar / batched);
+
+    freetable(&ht);
+    free(out);
+}
+
+/*
+ * Robin hood against the chained table at a fixed load.  Both are built at
+ * size m and filled to load * m; the chained table's g is raised so it
+ * doesn't grow out from under the target load.
+ */
+static void
+benchload(int *keys, int *misses, int n)
+{
+    int i, l, count, maxpsl;
+    int found;
+    int m = SMALL_TABLE;
+    double loads[] = {0.5, 0.75, 0.9};
+    double start, hit[2], miss[2], churn[2];
+    struct hashtable ht;
+    struct rhtable rt;
+
+    /* the first half of keys fill it, the second half is for churn. */
+    while (m * 2 <= n / 2) {
+        m <<= 1;
+    }
+
+    printf("\nrobin hood vs chained, m = %d, ns/op\n\n", m);
+    printf("%-6s %10s %10s %10s %10s %10s %10s %7s\n", "load",
+            "chain hit", "rh hit", "chain miss", "rh miss",
+            "chain chrn", "rh churn", "rh psl");
+
+    for (l = 0; l < NUM_ELEMENTS(loads); l++) {
+        count = loads[l] * m;
+
+        buildhashtable(&ht, m);
+        ht.g = INT_MAX;
+        rh_buildhashtable(&rt, m);
+        assert(count <= rt.g);
+
+        for (i = 0; i < count; i++) {
+            insert(&ht, keys[i]);
+            rh_insert(&rt, keys[i]);
+        }
+
+        /*
+         * Hits in a scattered order; in insert order the chained table's
+         * nodes come out of the pool sequentially and the prefetcher hides
+         * its misses.
+         */
+        found = 0;
+        start = now();
+        for (i = 0; i < count; i++) {
+            found += search(&ht, keys[(long)i * SCATTER % count]);
+        }
+        hit[0] = (now() - start) / count;
+        start = now();
+        for (i = 0; i < count; i++) {
+            found += rh_search(&rt, keys[(long)i * SCATTER % count]);
+        }
+        hit[1] = (now() - start) / count;
+        assert(found == 2 * count);
+
+        start = now();
+        for (i = 0; i < count; i++) {
+            found += search(&ht, misses[i]);
+        }
+        miss[0] = (now() - start) / count;
+        start = now();
+        for (i = 0; i < count; i++) {
+            found += rh_search(&rt, misses[i]);
+        }
+        miss[1] = (now() - start) / count;
+        assert(found == 2 * count);
+
+        /* delete one, insert one, the load stays put. */
+        start = now();
+        for (i = 0; i < count; i++) {
+            delete(&ht, keys[i]);
+            insert(&ht, keys[count + i]);
+        }
+        churn[0] = (now() - start) / count;
+        start = now();
+        for (i = 0; i < count; i++) {
+            rh_delete(&rt, keys[i]);
+            rh_insert(&rt, keys[count + i]);
+        }
+        churn[1] = (now() - start) / count;
+
+        maxpsl = 0;
+        for (i = 0; i < rt.m; i++) {
+            if (rt.slots[i].dist > maxpsl) {
+                maxpsl = rt.slots[i].dist;
+            }
+        }
+
+        printf("%-6.2f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %7d\n",
+                (double)rt.n / rt.m, hit[0], hit[1], miss[0], miss[1],
+                churn[0], churn[1], maxpsl - 1);
+
+        freetable(&ht);
+        rh_freetable(&rt);
+    }
+}
+
+static int
+cmplong(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void
+printtail(const char *name, long *lat, int count)
+{
+    int i;
+    double pcts[] = {50, 90, 99, 99.9, 99.99};
+
+    qsort(lat, count, sizeof(long), cmplong);
+
+    printf("%-14s", name);
+    for (i = 0; i < NUM_ELEMENTS(pcts); i++) {
+        printf(" %8ld", lat[(int)(count * pcts[i] / 100)]);
+    }
+    printf(" %8ld\n", lat[count - 1]);
+}
+
+/* cost of the clock itself, taken off every sample. */
+static long
+clockcost(void)
+{
+    int i;
+    long best = 1000000;
+    struct timespec a, b;
+
+    for (i = 0; i < 10000; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        long d = (b.tv_sec - a.tv_sec) * 1000000000L + (b.tv_nsec - a.tv_nsec);
+        if (d < best) {
+            best = d;
+        }
+    }
+
+    return best;
+}
+
+#define TIMED(LAT, EXPR) \
+    do { \
+        struct timespec a_, b_; \
+        clock_gettime(CLOCK_MONOTONIC, &a_); \
+        found += (EXPR); \
+        clock_gettime(CLOCK_MONOTONIC, &b_); \
+        (LAT) = (b_.tv_sec - a_.tv_sec) * 1000000000L + \
+            (b_.tv_nsec - a_.tv_nsec) - overhead; \
+    } while (0)
+
+/*
+ * Per lookup latency distribution, cuckoo against chained.  Every lookup is
+ * timed on its own, so these are the tails a caller actually sees.
+ */
+static void
+benchtail(int *keys, int *misses, int n)
+{
+    int i, found = 0;
+    long overhead = clockcost();
+    long *lat = malloc(sizeof(long) * n);
+    struct hashtable ht;
+    struct cktable ct;
+
+    buildhashtable(&ht, SMALL_TABLE);
+    ck_buildhashtable(&ct, SMALL_TABLE);
+    for (i = 0; i < n; i++) {
+        insert(&ht, keys[i]);
+        ck_insert(&ct, keys[i]);
+    }
+    while (ht.old) {
+        search(&ht, 0);
+    }
+
+    printf("\nlookup latency, %d keys, ns (clock cost %ld ns removed)\n\n",
+            n, overhead);
+    printf("%-14s %8s %8s %8s %8s %8s %8s\n", "", "p50", "p90", "p99",
+            "p99.9", "p99.99", "max");
+
+    for (i = 0; i < n; i++) {
+        TIMED(lat[i], search(&ht, keys[(long)i * SCATTER % n]));
+    }
+    printtail("chained hit", lat, n);
+    for (i = 0; i < n; i++) {
+        TIMED(lat[i], ck_search(&ct, keys[(long)i * SCATTER % n]));
+    }
+    printtail("cuckoo hit", lat, n);
+    for (i = 0; i < n; i++) {
+        TIMED(lat[i], search(&ht, misses[(long)i * SCATTER % n]));
+    }
+    printtail("chained miss", lat, n);
+    for (i = 0; i < n; i++) {
+        TIMED(lat[i], ck_search(&ct, misses[(long)i * SCATTER % n]));
+    }
+    printtail("cuckoo miss", lat, n);
+
+    assert(found == 2 * n);
+
+    freetable(&ht);
+    ck_freetable(&ct);
+    free(lat);
+}
+
+/* drop path from the page cache, so the next open really is cold. */
+static void
+dropcache(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/*
+ * The bloom filter in front of the chained table: what misses save, what
+ * hits pay, and how the false positive rate drifts as deleted keys leave
+ * their bits behind.
+ */
+static void
+benchfilter(int *keys, int *misses, int n)
+{
+    int i, f, found = 0;
+    double start, ins, hit, miss;
+    struct hashtable ht;
+    struct filterstats fs;
+
+    printf("\nbloom filter front, %d random keys, ns/op\n\n", n);
+    printf("%-10s %8s %8s %8s %9s %9s %8s\n", "", "insert", "hit", "miss",
+            "fpr", "estimate", "KiB");
+
+    for (f = 0; f < 2; f++) {
+        buildhashtable(&ht, SMALL_TABLE);
+        setfilter(&ht, f);
+
+        start = now();
+        for (i = 0; i < n; i++) {
+            insert(&ht, keys[i]);
+        }
+        ins = (now() - start) / n;
+        while (ht.old) {
+            search(&ht, keys[0]);
+        }
+
+        start = now();
+        for (i = 0; i < n; i++) {
+            found += search(&ht, keys[(long)i * SCATTER % n]);
+        }
+        hit = (now() - start) / n;
+
+        start = now();
+        for (i = 0; i < n; i++) {
+            found += search(&ht, misses[(long)i * SCATTER % n]);
+        }
+        miss = (now() - start) / n;
+
+        filterstats(&ht, &fs);
+        printf("%-10s %8.1f %8.1f %8.1f %8.3f%% %8.3f%% %8ld\n",
+                f ? "filtered" : "plain", ins, hit, miss, 100 * fs.fpr,
+                100 * fs.estimate, fs.bytes >> 10);
+
+        if (f) {
+            /*
+             * Delete short of a shrink; the bits stay behind, so the keys
+             * just deleted now read as false positives.
+             */
+            struct filterstats before;
+
+            for (i = 0; i < n / 5; i++) {
+                delete(&ht, keys[i]);
+            }
+            filterstats(&ht, &before);
+            start = now();
+            for (i = 0; i < n; i++) {
+                found += search(&ht, misses[(long)i * SCATTER % n]);
+            }
+            for (i = 0; i < n / 5; i++) {
+                found += search(&ht, keys[i]);
+            }
+            miss = (now() - start) / (n + n / 5);
+            filterstats(&ht, &fs);
+            fs.fpr = (double)(fs.falsepos - before.falsepos) /
+                (fs.falsepos - before.falsepos + fs.rejected - before.rejected);
+            printf("%-10s %8s %8s %8.1f %8.3f%% %8.3f%% %8ld\n",
+                    "-20% keys", "", "", miss, 100 * fs.fpr,
+                    100 * fs.estimate, fs.bytes >> 10);
+        }
+
+        freetable(&ht);
+    }
+
+    assert(found == 2 * n);
+}
+
+/*
+ * What a saved table buys at startup: mapping it against inserting every key
+ * again.  The mapped numbers start from a cold page cache; the first lookups
+ * pay the page faults the open didn't.
+ */
+static void
+benchfile(int *keys, int n)
+{
+    int i, found = 0;
+    const char *path = "bench.tbl";
+    double t, rebuild, mapped, first, verify, all, warm;
+    struct hashtable ht;
+    struct hashfile hf;
+
+    t = now();
+    buildhashtable(&ht, SMALL_TABLE);
+    for (i = 0; i < n; i++) {
+        insert(&ht, keys[i]);
+    }
+    while (ht.old) {
+        search(&ht, 0);
+    }
+    rebuild = now() - t;
+
+    if (hashfile_save(&ht, path) != 0) {
+        perror("hashfile_save");
+        freetable(&ht);
+        return;
+    }
+
+    dropcache(path);
+    t = now();
+    hashfile_open(&hf, path);
+    mapped = now() - t;
+    t = now();
+    found += hashfile_search(&hf, keys[0]);
+    first = now() - t;
+    t = now();
+    for (i = 0; i < n; i++) {
+        found += hashfile_search(&hf, keys[(long)i * SCATTER % n]);
+    }
+    all = now() - t;
+    t = now();
+    for (i = 0; i < n; i++) {
+        found += hashfile_search(&hf, keys[(long)i * SCATTER % n]);
+    }
+    warm = now() - t;
+    hashfile_close(&hf);
+
+    dropcache(path);
+    t = now();
+    hashfile_open(&hf, path);
+    found += hashfile_verify(&hf);
+    verify = now() - t;
+    hashfile_close(&hf);
+
+    assert(found == 2 * n + 2);
+
+    printf("\nstartup, %d keys, %.1f MiB file, ms\n\n", n,
+            (double)hf.size / (1 << 20));
+    printf("%-28s %10.3f\n", "rebuild by insert", rebuild / 1e6);
+    printf("%-28s %10.3f\n", "cold open", mapped / 1e6);
+    printf("%-28s %10.3f\n", "cold open + first lookup", (mapped + first) / 1e6);
+    printf("%-28s %10.3f\n", "cold open + verify", verify / 1e6);
+    printf("%-28s %10.3f\n", "cold open + every key", (mapped + first + all) / 1e6);
+    printf("%-28s %10.3f\n", "mapped, warm, every key", warm / 1e6);
+
+    unlink(path);
+    freetable(&ht);
+}
+
+/*
+ * Loading distinct keys presized and unchecked against insert's one at a
+ * time, then group-by over the same keys folded into fewer groups, serial
+ * and split over threads.
+ */
+static void
+benchbulk(int *keys, int n, int threads)
+{
+    int i, t, g, groups;
+    int *rows = malloc(sizeof(int) * n);
+    double start, loop, bulk, serial;
+    struct hashtable ht;
+    struct aggtable at;
+
+    start = now();
+    buildhashtable(&ht, SMALL_TABLE);
+    for (i = 0; i < n; i++) {
+        insert(&ht, keys[i]);
+    }
+    while (ht.old) {
+        search(&ht, 0);
+    }
+    loop = now() - start;
+    freetable(&ht);
+
+    start = now();
+    buildhashtable(&ht, SMALL_TABLE);
+    build_from_array(&ht, keys, n);
+    bulk = now() - start;
+    freetable(&ht);
+
+    printf("\nbulk load, %d keys, ms\n\n", n);
+    printf("%-20s %10.2f\n", "insert loop", loop / 1e6);
+    printf("%-20s %10.2f %6.2fx\n", "build_from_array", bulk / 1e6,
+            loop / bulk);
+
+    printf("\ngroup-by count/sum, %d rows, Mrows/s\n\n", n);
+    printf("%-10s %10s", "groups", "serial");
+    for (t = 1; t <= threads; t <<= 1) {
+        printf(" %7dt", t);
+    }
+    printf("\n");
+
+    for (g = 16; g <= n; g *= 64) {
+        for (i = 0; i < n; i++) {
+            rows[i] = ((unsigned)keys[i] >> 1) % g;
+        }
+
+        start = now();
+        agg_build(&at, 0);
+        agg_many(&at, rows, keys, n);
+        serial = now() - start;
+        groups = at.n;
+        agg_free(&at);
+
+        printf("%-10d %10.1f", g, n / serial * 1e3);
+        for (t = 1; t <= threads; t <<= 1) {
+            start = now();
+            agg_build(&at, 0);
+            agg_parallel(&at, rows, keys, n, t);
+            printf(" %8.1f", n / (now() - start) * 1e3);
+            assert(at.n == groups);
+            agg_free(&at);
+        }
+        printf("\n");
+    }
+
+    free(rows);
+}
+
+/*
+ * Joining two columns: the old way (insert one side into the chained table,
+ * search it for every row of the other) against the radix partitioned join.
+ * Half the probe rows match.
+ */
+static void
+benchjoin(int *keys, int *misses, int n, int threads)
+{
+    int i, t, type, found = 0;
+    int *probe = malloc(sizeof(int) * n);
+    double start, naive;
+    struct hashtable ht;
+    struct joinresult jr;
+    static const char *names[] = { "inner", "semi", "anti" };
+
+    for (i = 0; i < n; i++) {
+        probe[i] = i & 1 ? keys[(long)i * SCATTER % n] : misses[i];
+    }
+
+    start = now();
+    buildhashtable(&ht, SMALL_TABLE);
+    for (i = 0; i < n; i++) {
+        insert(&ht, keys[i]);
+    }
+    for (i = 0; i < n; i++) {
+        found += search(&ht, probe[i]);
+    }
+    naive = now() - start;
+    freetable(&ht);
+
+    hashjoin(JOIN_SEMI, keys, n, probe, n, 1, &jr);
+    assert(jr.n == found);
+    printf("\nhash join, %d x %d rows, %d partitions, ms\n\n", n, n,
+            jr.parts);
+    joinresult_free(&jr);
+
+    printf("%-8s %10s", "", "chained");
+    for (t = 1; t <= threads; t <<= 1) {
+        printf(" %8dt", t);
+    }
+    printf("\n");
+
+    for (type = JOIN_INNER; type <= JOIN_ANTI; type++) {
+        printf("%-8s %10.1f", names[type], naive / 1e6);
+        for (t = 1; t <= threads; t <<= 1) {
+            start = now();
+            hashjoin(type, keys, n, probe, n, t, &jr);
+            printf(" %9.1f", (now() - start) / 1e6);
+            joinresult_free(&jr);
+        }
+        printf("\n");
+    }
+
+    free(probe);
+}
+
+/*
+ * Concurrent scaling: the striped table against the chained table behind one
+ * global mutex, which is what sharing a table looked like before.
+ */
+struct concrun {
+    int conc; /* striped table, or the locked chained one. */
+    int keyspace;
+    int ops;
+    int readpct;
+    int seed;
+};
+
+static struct conchashtable benchctable;
+static struct hashtable benchlocked;
+static pthread_mutex_t benchlock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *
+concworker(void *arg)
+{
+    struct concrun *run = arg;
+    uint64_t x = 0x9e3779b97f4a7c15ull * (run->seed + 1);
+    int i;
+
+    for (i = 0; i < run->ops; i++) {
+        uint64_t r = xorshift(&x);
+        int key = (int)((r >> 32) % run->keyspace);
+        int op = (int)(r % 100);
+
+        if (run->conc) {
+            if (op < run->readpct) {
+                conc_search(&benchctable, key);
+            } else if (op & 1) {
+                conc_insert(&benchctable, key);
+            } else {
+                conc_delete(&benchctable, key);
+            }
+        } else {
+            pthread_mutex_lock(&benchlock);
+            if (op < run->readpct) {
+                search(&benchlocked, key);
+            } else if (op & 1) {
+                insert(&benchlocked, key);
+            } else {
+                delete(&benchlocked, key);
+            }
+            pthread_mutex_unlock(&benchlock);
+        }
+    }
+
+    return NULL;
+}
+
+static double
+benchconcone(int conc, int threads, int readpct, int keyspace, int ops)
+{
+    int i;
+    double start, elapsed;
+    pthread_t tids[threads];
+    struct concrun runs[threads];
+
+    /* half full, so inserts and deletes both mostly do something. */
+    if (conc) {
+        conc_buildhashtable(&benchctable, SMALL_TABLE);
+    } else {
+        buildhashtable(&benchlocked, SMALL_TABLE);
+    }
+    for (i = 0; i < keyspace; i += 2) {
+        if (conc) {
+            conc_insert(&benchctable, i);
+        } else {
+            insert(&benchlocked, i);
+        }
+    }
+
+    start = now();
+    for (i = 0; i < threads; i++) {
+        runs[i].conc = conc;
+        runs[i].keyspace = keyspace;
+        runs[i].ops = ops / threads;
+        runs[i].readpct = readpct;
+        runs[i].seed = i;
+        pthread_create(&tids[i], NULL, concworker, &runs[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    elapsed = now() - start;
+
+    if (conc) {
+        conc_freetable(&benchctable);
+    } else {
+        freetable(&benchlocked);
+    }
+
+    return ops / elapsed * 1e3;
+}
+
+static void
+benchconc(int n, int maxthreads)
+{
+    int t, r;
+    int readpcts[] = {50, 90, 99};
+    int ops = n * 4;
+
+    printf("\nconcurrent, %d keys, %d ops, Mops/s (locked = one global mutex)\n\n",
+            n, ops);
+    printf("%-8s", "threads");
+    for (r = 0; r < NUM_ELEMENTS(readpcts); r++) {
+        printf("   %2d%% locked  %2d%% striped", readpcts[r], readpcts[r]);
+    }
+    printf("\n");
+
+    for (t = 1; t <= maxthreads; t <<= 1) {
+        printf("%-8d", t);
+        for (r = 0; r < NUM_ELEMENTS(readpcts); r++) {
+            printf("   %10.2f  %11.2f",
+                    benchconcone(0, t, readpcts[r], n, ops),
+                    benchconcone(1, t, readpcts[r], n, ops));
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int k, s, n = 1 << 20;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+
+    if (argc > 1) {
+        n = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        threads = atoi(argv[2]);
+    }
+
+    int *keys = malloc(sizeof(int) * n);
+    int *misses = malloc(sizeof(int) * n);
+
+    printf("n = %d, ns/op; chain length histogram as %% of buckets\n\n", n);
+    printf("%-11s %-11s %8s %8s %8s %5s |", "keys", "hash",
+            "insert", "hit", "miss", "max");
+    for (k = 0; k < STATS_HIST - 1; k++) {
+        printf(" %5d", k);
+    }
+    printf(" %4d+\n", STATS_HIST - 1);
+
+    for (s = 0; s < KEYSETS; s++) {
+        makekeys(keys, misses, n, s);
+
+        for (k = 0; k < HASH_KINDS; k++) {
+            benchhash(k, s, keys, misses, n);
+        }
+    }
+
+    printf("\nbatched (window %d), random keys, Mops/s\n\n", BATCH_WINDOW);
+    printf("%-12s %10s %10s %8s\n", "", "scalar", "batched", "gain");
+    makekeys(keys, misses, n, KEYS_RANDOM);
+    benchbatch(keys, misses, n);
+
+    /* (almost always) distinct, so churn rarely re-inserts a live key. */
+    for (k = 0; k < n; k++) {
+        keys[k] = (int)murmurmix(k) & ~1;
+        misses[k] = keys[k] | 1;
+    }
+    benchload(keys, misses, n);
+    benchtail(keys, misses, n);
+    benchfilter(keys, misses, n);
+    benchfile(keys, n);
+    benchbulk(keys, n, threads);
+    benchjoin(keys, misses, n, threads);
+
+    benchconc(n, threads);
+
+    free(keys);
+    free(misses);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+
+#ifndef _BLOOM_H
+#define _BLOOM_H
+
+#include <stdint.h>
+
+/* a key's bits all land in one block, one cache line. */
+#define BLOOM_BLOCK 64
+#define BLOOM_WORDS (BLOOM_BLOCK / sizeof(uint64_t))
+/* bits set per key. */
+#define BLOOM_K 6
+/* sized for about this many bits per key at the expected count. */
+#define BLOOM_BITS 10
+
+/*
+ * Blocked Bloom filter over int keys.  No deletes: removing a key leaves its
+ * bits behind, which only costs false positives, so whoever owns one throws
+ * it away and starts over from time to time.
+ */
+struct bloom {
+    int nblocks; /* a power of two. */
+    long added;
+    uint64_t *blocks; /* nblocks * BLOOM_WORDS, line aligned. */
+};
+
+/* sized for nkeys keys, at least one block. */
+void bloom_build(struct bloom *filter, int nkeys);
+void bloom_add(struct bloom *filter, int key);
+/* @return 0 if key was never added, 1 if it may have been. */
+int bloom_maybe(const struct bloom *filter, int key);
+/* false positive rate expected from the bits now set; reads every block. */
+double bloom_estimate(const struct bloom *filter);
+long bloom_bytes(const struct bloom *filter);
+void bloom_free(struct bloom *filter);
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ * Concurrent chained hashtable: lock striping for writers, no locks at all
+ * for readers.
+ *
+ * A reader walks a chain with nothing but acquire loads, so a writer can
+ * never free a node in place; anything unlinked (by delete, or every node of
+ * the old array by a resize) goes on a retired list and is only freed once
+ * the epoch says no reader can still be holding it.
+ *
+ * Resizing takes every stripe lock, builds the new array out of fresh copies
+ * of the nodes and publishes it with a single store.  Readers already part
+ * way down an old chain carry on down the old (still intact) nodes.  Copying
+ * rather than relinking matters: relinking a node into its new chain would
+ * send an old reader off into the wrong chain and it could miss a key.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hashfunc.h"
+#include "conchashtable.h"
+
+/* retirements between attempts to move the epoch on. */
+#define RETIRE_BATCH 64
+
+#define SLOT(B, V) (murmurmix((uint32_t)(V)) & ((B)->m - 1))
+#define STRIPE(T, V) \
+    (&(T)->stripes[murmurmix((uint32_t)(V)) & (CONC_STRIPES - 1)])
+
+/* slots ever handed out; epochadvance() looks at no more than these. */
+static atomic_int nexttid;
+static _Thread_local int tid = -1;
+
+/* slots of threads that have exited, to hand out again. */
+static pthread_mutex_t tidlock = PTHREAD_MUTEX_INITIALIZER;
+static int freetids[CONC_THREADS];
+static int nfreetids;
+static pthread_once_t tidonce = PTHREAD_ONCE_INIT;
+static pthread_key_t tidkey;
+
+/* thread exit: the slot's reader is gone, so its local is 0. */
+static void
+puttid(void *arg)
+{
+    pthread_mutex_lock(&tidlock);
+    freetids[nfreetids++] = (int)(intptr_t)arg - 1;
+    pthread_mutex_unlock(&tidlock);
+}
+
+static void
+maketidkey(void)
+{
+    int ret = pthread_key_create(&tidkey, puttid);
+
+    assert(ret == 0);
+    (void)ret;
+}
+
+static int
+threadid(void)
+{
+    if (tid < 0) {
+        pthread_once(&tidonce, maketidkey);
+
+        pthread_mutex_lock(&tidlock);
+        if (nfreetids > 0) {
+            tid = freetids[--nfreetids];
+        } else {
+            tid = atomic_fetch_add(&nexttid, 1);
+        }
+        pthread_mutex_unlock(&tidlock);
+        assert(tid < CONC_THREADS);
+
+        /* +1: a NULL value wouldn't get its destructor called. */
+        pthread_setspecific(tidkey, (void *)(intptr_t)(tid + 1));
+    }
+
+    return tid;
+}
+
+/******************************************************************************
+ * Epochs
+ *****************************************************************************/
+
+static void
+epochenter(struct cepoch *ep)
+{
+    /*
+     * acquire: seeing epoch e means seeing every unlink retired in e - 1,
+     * which is what lets the epoch after e free them.
+     */
+    unsigned long e = atomic_load_explicit(&ep->global, memory_order_acquire);
+
+    atomic_store_explicit(&ep->slots[threadid()].local, (e << 1) | 1,
+            memory_order_relaxed);
+    /* the announcement must be visible before we load any pointer. */
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+static void
+epochexit(struct cepoch *ep)
+{
+    atomic_store_explicit(&ep->slots[tid].local, 0, memory_order_release);
+}
+
+static void
+freeretired(struct cepoch *ep, int i)
+{
+    cnode_t *node, *nnext;
+    struct cbuckets *b, *bnext;
+
+    for (node = ep->nodes[i]; node; node = nnext) {
+        nnext = node->limbo;
+        free(node);
+    }
+    for (b = ep->buckets[i]; b; b = bnext) {
+        bnext = b->limbo;
+        free(b);
+    }
+
+    ep->nodes[i] = NULL;
+    ep->buckets[i] = NULL;
+}
+
+/*
+ * Called with ep->lock held.  If every active reader has seen the current
+ * epoch e, move to e + 1; whatever was retired in e - 1 is now unreachable.
+ */
+static void
+epochadvance(struct cepoch *ep)
+{
+    int i;
+    int threads = atomic_load(&nexttid);
+    unsigned long e = atomic_load_explicit(&ep->global, memory_order_relaxed);
+
+    /* pairs with the fence in epochenter; our unlinks happened before. */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    for (i = 0; i < threads && i < CONC_THREADS; i++) {
+        /* acquire, so a finished reader's loads happen before our frees. */
+        unsigned long v = atomic_load_explicit(&ep->slots[i].local,
+                memory_order_acquire);
+        if ((v & 1) && (v >> 1) != e) {
+            return;
+        }
+    }
+
+    atomic_store_explicit(&ep->global, e + 1, memory_order_release);
+    freeretired(ep, (e + 2) % 3);
+    ep->pending = 0;
+}
+
+/* retire a list of nodes (linked through limbo) and optionally an array. */
+static void
+retire(struct cepoch *ep, cnode_t *first, cnode_t *last, int count,
+        struct cbuckets *b)
+{
+    pthread_mutex_lock(&ep->lock);
+
+    int i = atomic_load_explicit(&ep->global, memory_order_relaxed) % 3;
+
+    if (first) {
+        last->limbo = ep->nodes[i];
+        ep->nodes[i] = first;
+    }
+    if (b) {
+        b->limbo = ep->buckets[i];
+        ep->buckets[i] = b;
+    }
+
+    ep->pending += count;
+    if (ep->pending >= RETIRE_BATCH) {
+        epochadvance(ep);
+    }
+
+    pthread_mutex_unlock(&ep->lock);
+}
+
+/******************************************************************************
+ * Table
+ *****************************************************************************/
+
+static struct cbuckets *
+newbuckets(int m)
+{
+    int i;
+    struct cbuckets *b = malloc(sizeof(struct cbuckets) +
+            sizeof(_Atomic(cnode_t *)) * m);
+
+    b->m = m;
+    b->limbo = NULL;
+    for (i = 0; i < m; i++) {
+        atomic_init(&b->heads[i], NULL);
+    }
+
+    return b;
+}
+
+void conc_buildhashtable(struct conchashtable *table, int m)
+{
+    int i;
+    int size = CONC_STRIPES;
+
+    while (size < m) {
+        size <<= 1;
+    }
+
+    for (i = 0; i < CONC_STRIPES; i++) {
+        pthread_mutex_init(&table->stripes[i].lock, NULL);
+        table->stripes[i].n = 0;
+    }
+
+    memset(&table->epoch, 0x00, sizeof(table->epoch));
+    pthread_mutex_init(&table->epoch.lock, NULL);
+    atomic_init(&table->epoch.global, 0);
+
+    atomic_init(&table->buckets, newbuckets(size));
+
+    return;
+}
+
+/* Is the key in the table?  Lock-free. */
+int conc_search(struct conchashtable *table, int value)
+{
+    struct cbuckets *b;
+    cnode_t *curr;
+
+    epochenter(&table->epoch);
+
+    b = atomic_load_explicit(&table->buckets, memory_order_acquire);
+    curr = atomic_load_explicit(&b->heads[SLOT(b, value)],
+            memory_order_acquire);
+
+    while (curr && curr->value != value) {
+        curr = atomic_load_explicit(&curr->next, memory_order_acquire);
+    }
+
+    epochexit(&table->epoch);
+
+    return curr != NULL;
+}
+
+static void
+lockall(struct conchashtable *table)
+{
+    int i;
+
+    for (i = 0; i < CONC_STRIPES; i++) {
+        pthread_mutex_lock(&table->stripes[i].lock);
+    }
+}
+
+static void
+unlockall(struct conchashtable *table)
+{
+    int i;
+
+    for (i = CONC_STRIPES - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&table->stripes[i].lock);
+    }
+}
+
+/*
+ * Stop-the-world for writers only.  The caller saw its stripe over (or
+ * under) the threshold; by the time we hold every lock another writer may
+ * already have resized, so check again on the exact count.
+ */
+static void growtable(struct conchashtable *table, int grow)
+{
+    int i, n = 0;
+    cnode_t *curr, *copy, *first = NULL, *last = NULL;
+
+    lockall(table);
+
+    struct cbuckets *old = atomic_load_explicit(&table->buckets,
+            memory_order_relaxed);
+
+    for (i = 0; i < CONC_STRIPES; i++) {
+        n += table->stripes[i].n;
+    }
+
+    if ((grow && n <= old->m * 0.75) ||
+            (!grow && (n >= old->m * 0.25 || old->m <= CONC_STRIPES))) {
+        unlockall(table);
+        return;
+    }
+
+    struct cbuckets *b = newbuckets(grow ? old->m << 1 : old->m >> 1);
+
+    for (i = 0; i < old->m; i++) {
+        curr = atomic_load_explicit(&old->heads[i], memory_order_relaxed);
+        while (curr) {
+            int slot = SLOT(b, curr->value);
+
+            copy = malloc(sizeof(cnode_t));
+            copy->value = curr->value;
+            atomic_init(&copy->next, atomic_load_explicit(&b->heads[slot],
+                    memory_order_relaxed));
+            atomic_store_explicit(&b->heads[slot], copy, memory_order_relaxed);
+
+            /* chain the old node onto the retired list as we go. */
+            curr->limbo = first;
+            first = curr;
+            if (!last) {
+                last = curr;
+            }
+
+            curr = atomic_load_explicit(&curr->next, memory_order_relaxed);
+        }
+    }
+
+    atomic_store_explicit(&table->buckets, b, memory_order_release);
+    retire(&table->epoch, first, last, n + 1, old);
+
+    unlockall(table);
+}
+
+void conc_insert(struct conchashtable *table, int value)
+{
+    struct cstripe *stripe = STRIPE(table, value);
+    cnode_t *curr;
+    int grow;
+
+    pthread_mutex_lock(&stripe->lock);
+
+    struct cbuckets *b = atomic_load_explicit(&table->buckets,
+            memory_order_relaxed);
+    _Atomic(cnode_t *) *head = &b->heads[SLOT(b, value)];
+
+    for (curr = atomic_load_explicit(head, memory_order_relaxed); curr;
+            curr = atomic_load_explicit(&curr->next, memory_order_relaxed)) {
+        if (curr->value == value) {
+            pthread_mutex_unlock(&stripe->lock);
+            return;
+        }
+    }
+
+    /* fully built before a reader can reach it. */
+    curr = malloc(sizeof(cnode_t));
+    curr->value = value;
+    curr->limbo = NULL;
+    atomic_init(&curr->next, atomic_load_explicit(head, memory_order_relaxed));
+    atomic_store_explicit(head, curr, memory_order_release);
+
+    stripe->n++;
+    grow = stripe->n > (b->m / CONC_STRIPES) * 0.75;
+
+    pthread_mutex_unlock(&stripe->lock);
+
+    if (grow) {
+        growtable(table, 1);
+    }
+
+    return;
+}
+
+void conc_delete(struct conchashtable *table, int value)
+{
+    struct cstripe *stripe = STRIPE(table, value);
+    cnode_t *curr;
+    int shrink;
+
+    pthread_mutex_lock(&stripe->lock);
+
+    struct cbuckets *b = atomic_load_explicit(&table->buckets,
+            memory_order_relaxed);
+    _Atomic(cnode_t *) *link = &b->heads[SLOT(b, value)];
+
+    while ((curr = atomic_load_explicit(link, memory_order_relaxed))) {
+        if (curr->value == value) {
+            break;
+        }
+        link = &curr->next;
+    }
+
+    if (!curr) {
+        pthread_mutex_unlock(&stripe->lock);
+        return;
+    }
+
+    /* readers on curr still see its next, so they finish the chain. */
+    atomic_store_explicit(link, atomic_load_explicit(&curr->next,
+            memory_order_relaxed), memory_order_release);
+
+    stripe->n--;
+    /* b can be retired the moment we unlock, decide now. */
+    shrink = b->m > CONC_STRIPES && stripe->n < (b->m / CONC_STRIPES) * 0.25;
+
+    pthread_mutex_unlock(&stripe->lock);
+
+    retire(&table->epoch, curr, curr, 1, NULL);
+
+    if (shrink) {
+        growtable(table, 0);
+    }
+
+    return;
+}
+
+int conc_count(struct conchashtable *table)
+{
+    int i, n = 0;
+
+    for (i = 0; i < CONC_STRIPES; i++) {
+        n += table->stripes[i].n;
+    }
+
+    return n;
+}
+
+int conc_size(struct conchashtable *table)
+{
+    return atomic_load(&table->buckets)->m;
+}
+
+void conc_freetable(struct conchashtable *table)
+{
+    int i;
+    cnode_t *curr, *next;
+    struct cbuckets *b = atomic_load(&table->buckets);
+
+    for (i = 0; i < b->m; i++) {
+        for (curr = atomic_load(&b->heads[i]); curr; curr = next) {
+            next = atomic_load(&curr->next);
+            free(curr);
+        }
+    }
+    free(b);
+
+    for (i = 0; i < 3; i++) {
+        freeretired(&table->epoch, i);
+    }
+
+    for (i = 0; i < CONC_STRIPES; i++) {
+        pthread_mutex_destroy(&table->stripes[i].lock);
+    }
+    pthread_mutex_destroy(&table->epoch.lock);
+}
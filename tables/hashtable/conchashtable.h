@@ -0,0 +1,81 @@
+
+#ifndef _CONCHASHTABLE_H
+#define _CONCHASHTABLE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Writers lock one of CONC_STRIPES stripes; bucket i belongs to stripe
+ * i % CONC_STRIPES.  The table is never smaller than this, so a key's stripe
+ * doesn't change when the table is resized.
+ */
+#define CONC_STRIPES 64
+
+/*
+ * most threads that can use concurrent tables at once; a thread's slot is
+ * handed on when it exits.
+ */
+#define CONC_THREADS 128
+
+/* epoch slots and stripes each get their own line. */
+#define CONC_LINE 64
+
+typedef struct cnode {
+    _Atomic(struct cnode *) next;
+    int value;
+    struct cnode *limbo; /* retired list; next stays valid for readers. */
+} cnode_t;
+
+struct cbuckets {
+    int m; /* size of the bucket array, a power of two. */
+    struct cbuckets *limbo; /* retired list. */
+    _Atomic(cnode_t *) heads[];
+};
+
+struct cstripe {
+    pthread_mutex_t lock;
+    int n; /* keys in this stripe's buckets, guarded by lock. */
+} __attribute__((aligned(CONC_LINE)));
+
+struct cepochslot {
+    /* (epoch << 1) | 1 while the thread is reading, 0 otherwise. */
+    _Atomic unsigned long local;
+} __attribute__((aligned(CONC_LINE)));
+
+/*
+ * Epoch based reclamation: anything unlinked in epoch e is freed once the
+ * global epoch reaches e + 2, because by then every reader that could have
+ * seen it has finished.
+ */
+struct cepoch {
+    _Atomic unsigned long global;
+    pthread_mutex_t lock; /* guards the retired lists. */
+    cnode_t *nodes[3]; /* retired in epoch e, at [e % 3]. */
+    struct cbuckets *buckets[3];
+    int pending; /* retirements since we last tried to advance. */
+    struct cepochslot slots[CONC_THREADS];
+};
+
+struct conchashtable {
+    _Atomic(struct cbuckets *) buckets;
+    struct cstripe stripes[CONC_STRIPES];
+    struct cepoch epoch;
+};
+
+/*
+ * Same contract as the chained table.  Any number of threads may call
+ * search, insert and delete at once; search never takes a lock.  Build and
+ * free must not race with anything.
+ */
+void conc_buildhashtable(struct conchashtable *table, int m);
+int conc_search(struct conchashtable *table, int value);
+void conc_insert(struct conchashtable *table, int value);
+void conc_delete(struct conchashtable *table, int value);
+void conc_freetable(struct conchashtable *table);
+/* sum of the stripe counts, only exact when nothing is writing. */
+int conc_count(struct conchashtable *table);
+/* current size of the bucket array. */
+int conc_size(struct conchashtable *table);
+
+#endif
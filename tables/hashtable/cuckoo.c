@@ -0,0 +1,297 @@
+/*
+ * Bucketized cuckoo hashing: every key has exactly two candidate buckets of
+ * CK_WAYS slots, so a lookup is two bucket reads, worst case, not expected
+ * case.  Inserts pay for that; if both buckets are full, a random key from
+ * one of them is kicked to its other bucket, which may kick another, and so
+ * on for at most CK_MAX_KICKS steps.  Whatever is left holding the bag goes
+ * into a small stash that lookups check only while it's non-empty, and if
+ * that fills up too the table grows.
+ *
+ * The second bucket is the first xor a hash of the key, so either bucket can
+ * be found from the other without knowing which one a key is sitting in.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hashfunc.h"
+#include "cuckoo.h"
+
+#define CK_SMALL 2
+
+#define FULL ((1 << CK_WAYS) - 1)
+
+static void growtable(struct cktable *table, int m, const int *homeless);
+
+static inline uint32_t
+bucket1(struct cktable *table, int value)
+{
+    return murmurmix((uint32_t)value) & (table->m - 1);
+}
+
+/* never equal to b, as long as there are two buckets. */
+static inline uint32_t
+altbucket(struct cktable *table, uint32_t b, int value)
+{
+    return b ^ ((tabulation((uint32_t)value) | 1) & (table->m - 1));
+}
+
+/* @return mask of the ways in bucket holding value. */
+#if defined(__SSE2__)
+static inline unsigned
+matchways(const ckbucket_t *bucket, int value)
+{
+    __m128i keys = _mm_load_si128((const __m128i *)bucket->keys);
+    __m128i eq = _mm_cmpeq_epi32(keys, _mm_set1_epi32(value));
+
+    return _mm_movemask_ps(_mm_castsi128_ps(eq)) & bucket->used;
+}
+#else
+static inline unsigned
+matchways(const ckbucket_t *bucket, int value)
+{
+    int i;
+    unsigned mask = 0;
+
+    for (i = 0; i < CK_WAYS; i++) {
+        if (bucket->keys[i] == value) {
+            mask |= 1u << i;
+        }
+    }
+
+    return mask & bucket->used;
+}
+#endif
+
+static uint64_t
+xorshift(uint64_t *x)
+{
+    *x ^= *x >> 12;
+    *x ^= *x << 25;
+    *x ^= *x >> 27;
+
+    return *x * 0x2545f4914f6cdd1dull;
+}
+
+void ck_buildhashtable(struct cktable *table, int m)
+{
+    int size = CK_SMALL;
+
+    while (size * CK_WAYS < m) {
+        size <<= 1;
+    }
+
+    hashinit();
+
+    table->n = 0;
+    table->m = size;
+    table->g = size * CK_WAYS * CK_MAX_LOAD;
+    table->s = size * CK_WAYS * 0.25;
+    table->buckets = aligned_alloc(sizeof(ckbucket_t),
+            sizeof(ckbucket_t) * size);
+    memset(table->buckets, 0x00, sizeof(ckbucket_t) * size);
+    table->stashn = 0;
+    table->rng = 0x9e3779b97f4a7c15ull;
+
+    return;
+}
+
+/* Is the key in the table?  Two buckets, then the stash if it's in use. */
+int ck_search(struct cktable *table, int value)
+{
+    int i;
+    uint32_t b1 = bucket1(table, value);
+    uint32_t b2 = altbucket(table, b1, value);
+
+    if (matchways(&table->buckets[b1], value) ||
+            matchways(&table->buckets[b2], value)) {
+        return 1;
+    }
+
+    for (i = 0; i < table->stashn; i++) {
+        if (table->stash[i] == value) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* put value in the first free way of bucket, if there is one. */
+static int
+tryput(ckbucket_t *bucket, int value)
+{
+    unsigned avail = ~bucket->used & FULL;
+
+    if (!avail) {
+        return 0;
+    }
+
+    int way = __builtin_ctz(avail);
+    bucket->keys[way] = value;
+    bucket->used |= 1u << way;
+
+    return 1;
+}
+
+/*
+ * Place value, which isn't in the table.
+ * @return 1, or 0 with *homeless set to the key (value, or one it kicked
+ * out) that couldn't go anywhere.
+ */
+static int
+place(struct cktable *table, int value, int *homeless)
+{
+    int kicks;
+    uint32_t b = bucket1(table, value);
+    uint32_t b2 = altbucket(table, b, value);
+
+    if (tryput(&table->buckets[b], value) ||
+            tryput(&table->buckets[b2], value)) {
+        return 1;
+    }
+
+    /* both full; start kicking from either one. */
+    if (xorshift(&table->rng) & 1) {
+        b = b2;
+    }
+
+    for (kicks = 0; kicks < CK_MAX_KICKS; kicks++) {
+        ckbucket_t *bucket = &table->buckets[b];
+        int way = xorshift(&table->rng) % CK_WAYS;
+        int victim = bucket->keys[way];
+
+        bucket->keys[way] = value;
+        value = victim;
+
+        b = altbucket(table, b, value);
+        if (tryput(&table->buckets[b], value)) {
+            return 1;
+        }
+    }
+
+    if (table->stashn < CK_STASH) {
+        table->stash[table->stashn++] = value;
+        return 1;
+    }
+
+    *homeless = value;
+    return 0;
+}
+
+/*
+ * Move everything into a table of m slots, plus the key left homeless by a
+ * failed place if there is one.  If the new table can't hold it all either,
+ * try again twice as large.
+ */
+static void growtable(struct cktable *table, int m, const int *homeless)
+{
+    int i, w, ok, lost;
+    int n = table->n;
+    struct cktable old = *table;
+
+    for (;;) {
+        ck_buildhashtable(table, m);
+        table->rng = old.rng;
+        ok = 1;
+
+        for (i = 0; ok && i < old.m; i++) {
+            for (w = 0; ok && w < CK_WAYS; w++) {
+                if (old.buckets[i].used & (1u << w)) {
+                    ok = place(table, old.buckets[i].keys[w], &lost);
+                }
+            }
+        }
+        for (i = 0; ok && i < old.stashn; i++) {
+            ok = place(table, old.stash[i], &lost);
+        }
+        if (ok && homeless) {
+            ok = place(table, *homeless, &lost);
+        }
+
+        if (ok) {
+            break;
+        }
+
+        ck_freetable(table);
+        m <<= 1;
+    }
+
+    table->n = n;
+
+    ck_freetable(&old);
+
+    return;
+}
+
+void ck_insert(struct cktable *table, int value)
+{
+    int homeless;
+
+    if (ck_search(table, value)) {
+        return;
+    }
+
+    table->n++;
+
+    if (!place(table, value, &homeless)) {
+        growtable(table, table->m * CK_WAYS * 2, &homeless);
+    } else if (table->n > table->g) {
+        growtable(table, table->m * CK_WAYS * 2, NULL);
+    }
+
+    return;
+}
+
+void ck_delete(struct cktable *table, int value)
+{
+    int i;
+    uint32_t b1 = bucket1(table, value);
+    uint32_t b2 = altbucket(table, b1, value);
+    unsigned match;
+
+    if ((match = matchways(&table->buckets[b1], value))) {
+        table->buckets[b1].used &= ~match;
+    } else if ((match = matchways(&table->buckets[b2], value))) {
+        table->buckets[b2].used &= ~match;
+    } else {
+        for (i = 0; i < table->stashn; i++) {
+            if (table->stash[i] == value) {
+                break;
+            }
+        }
+        if (i == table->stashn) {
+            return;
+        }
+        table->stash[i] = table->stash[--table->stashn];
+    }
+
+    table->n--;
+
+    /*
+     * A stashed key may fit now; it's cheap to try while we're small, and it
+     * keeps lookups off the stash.
+     */
+    if (table->stashn) {
+        int homeless;
+        /* that frees a stash slot, so this can't fail. */
+        place(table, table->stash[--table->stashn], &homeless);
+    }
+
+    if (table->n < table->s && table->m > CK_SMALL) {
+        growtable(table, table->m * CK_WAYS / 2, NULL);
+    }
+
+    return;
+}
+
+void ck_freetable(struct cktable *table)
+{
+    free(table->buckets);
+}
@@ -0,0 +1,46 @@
+
+#ifndef _CUCKOO_H
+#define _CUCKOO_H
+
+#include <stdint.h>
+
+/* keys per bucket. */
+#define CK_WAYS 4
+/* keys that couldn't be placed; checked only while it isn't empty. */
+#define CK_STASH 8
+/* longest kick-out path before a key is sent to the stash. */
+#define CK_MAX_KICKS 128
+/* grows past this fraction of slots filled. */
+#define CK_MAX_LOAD 0.9
+
+/*
+ * 32 bytes and aligned to that, so a bucket never straddles a cache line and
+ * a lookup touches at most two lines: one per candidate bucket.
+ */
+typedef struct ckbucket {
+    int keys[CK_WAYS];
+    uint8_t used; /* bit i set if keys[i] is live. */
+} __attribute__((aligned(32))) ckbucket_t;
+
+struct cktable {
+    int n; /* number of keys, stash included. */
+    int m; /* number of buckets, a power of two. */
+    int g; /* n that triggers growth. */
+    int s; /* n that triggers shrink. */
+    ckbucket_t *buckets;
+    int stashn;
+    int stash[CK_STASH];
+    uint64_t rng; /* picks kick victims. */
+};
+
+/*
+ * Same contract as the chained table.  m is the number of slots wanted; it's
+ * rounded up to a power of two number of buckets.
+ */
+void ck_buildhashtable(struct cktable *table, int m);
+int ck_search(struct cktable *table, int value);
+void ck_insert(struct cktable *table, int value);
+void ck_delete(struct cktable *table, int value);
+void ck_freetable(struct cktable *table);
+
+#endif
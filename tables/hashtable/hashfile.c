@@ -0,0 +1,243 @@
+/*
+ * Saving a chained table to a file that can be mapped and searched without
+ * rebuilding it.
+ *
+ * The chains are flattened into one array of keys grouped by bucket, with an
+ * array of bucket offsets in front, so opening a file is an mmap and a
+ * header check, and a lookup touches the offsets and then one contiguous run
+ * of keys instead of chasing next pointers.  Pages are only faulted in as
+ * the buckets they hold are searched.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hashfile.h"
+
+#define BODY(H) ((const char *)(H) + sizeof(struct hashfileheader))
+
+/* keys are filed under their bucket in the current table, wherever they sit. */
+static void addchain(struct hashtable *table, list_t *curr, uint32_t *offsets,
+        int32_t *values)
+{
+    for (; curr; curr = curr->next) {
+        int slot = table->hash(curr->value, table->m);
+        if (values) {
+            values[offsets[slot]++] = curr->value;
+        } else {
+            offsets[slot + 1]++;
+        }
+    }
+}
+
+/*
+ * Walk every chain, both tables if a resize is still under way, either
+ * counting keys per bucket (values NULL) or dropping them in place.
+ */
+static void flatten(struct hashtable *table, uint32_t *offsets,
+        int32_t *values)
+{
+    int i;
+
+    for (i = 0; i < table->m; i++) {
+        addchain(table, table->table[i], offsets, values);
+    }
+    if (table->old) {
+        for (i = table->migrate; i < table->oldm; i++) {
+            addchain(table, table->old[i], offsets, values);
+        }
+    }
+}
+
+static int writeall(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += w;
+        len -= w;
+    }
+
+    return 0;
+}
+
+int hashfile_save(struct hashtable *table, const char *path)
+{
+    int i, fd, err;
+    size_t osize = sizeof(uint32_t) * (table->m + 1);
+    size_t vsize = sizeof(int32_t) * table->n;
+    size_t total = sizeof(struct hashfileheader) + osize + vsize;
+    struct hashfileheader *hdr;
+    uint32_t *offsets, *cursor;
+    int32_t *values;
+    char *buf, *tmp;
+
+    /* built in memory, so the checksum is one pass over the body. */
+    buf = calloc(1, total);
+    cursor = malloc(osize);
+    tmp = malloc(strlen(path) + sizeof(".tmp"));
+    if (!buf || !cursor || !tmp) {
+        free(tmp);
+        free(cursor);
+        free(buf);
+        errno = ENOMEM;
+        return -1;
+    }
+    hdr = (struct hashfileheader *)buf;
+    offsets = (uint32_t *)(buf + sizeof(*hdr));
+    values = (int32_t *)(buf + sizeof(*hdr) + osize);
+
+    flatten(table, offsets, NULL);
+    for (i = 0; i < table->m; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    memcpy(cursor, offsets, osize);
+    flatten(table, cursor, values);
+
+    hdr->magic = HASHFILE_MAGIC;
+    hdr->version = HASHFILE_VERSION;
+    hdr->kind = table->kind;
+    hdr->m = table->m;
+    hdr->n = table->n;
+    hdr->checksum = hashbytes(BODY(hdr), osize + vsize);
+
+    snprintf(tmp, strlen(path) + sizeof(".tmp"), "%s.tmp", path);
+
+    err = -1;
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (writeall(fd, buf, total) == 0 && fsync(fd) == 0) {
+            err = 0;
+        }
+        if (close(fd) != 0) {
+            err = -1;
+        }
+        if (err == 0) {
+            err = rename(tmp, path);
+        }
+        if (err != 0) {
+            int saved = errno;
+            unlink(tmp);
+            errno = saved;
+        }
+    }
+
+    free(tmp);
+    free(cursor);
+    free(buf);
+
+    return err;
+}
+
+int hashfile_open(struct hashfile *file, const char *path)
+{
+    int fd, saved;
+    struct stat st;
+    const struct hashfileheader *hdr;
+    void *map;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        goto fail;
+    }
+    if ((size_t)st.st_size < sizeof(*hdr)) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        goto fail;
+    }
+    close(fd);
+
+    hdr = map;
+    if (hdr->magic != HASHFILE_MAGIC || hdr->version != HASHFILE_VERSION ||
+            hdr->kind >= HASH_KINDS || hdr->m < SMALL_TABLE ||
+            (hdr->m & (hdr->m - 1)) ||
+            (size_t)st.st_size != sizeof(*hdr) +
+            sizeof(uint32_t) * ((size_t)hdr->m + 1) +
+            sizeof(int32_t) * (size_t)hdr->n) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    hashinit();
+
+    file->hdr = hdr;
+    file->offsets = (const uint32_t *)BODY(hdr);
+    file->values = (const int32_t *)(file->offsets + hdr->m + 1);
+    file->size = st.st_size;
+    file->m = hdr->m;
+    file->hash = hashfuncs[hdr->kind];
+
+    return 0;
+
+fail:
+    saved = errno;
+    close(fd);
+    errno = saved;
+
+    return -1;
+}
+
+int hashfile_verify(struct hashfile *file)
+{
+    uint32_t i;
+    const struct hashfileheader *hdr = file->hdr;
+
+    if (hashbytes(BODY(hdr), file->size - sizeof(*hdr)) != hdr->checksum) {
+        return 0;
+    }
+
+    /* a matching checksum on a file we didn't write still shouldn't crash. */
+    if (file->offsets[0] != 0 || file->offsets[hdr->m] != hdr->n) {
+        return 0;
+    }
+    for (i = 0; i < hdr->m; i++) {
+        if (file->offsets[i] > file->offsets[i + 1]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int hashfile_search(struct hashfile *file, int value)
+{
+    int slot = file->hash(value, file->m);
+    uint32_t i;
+    uint32_t end = file->offsets[slot + 1];
+
+    for (i = file->offsets[slot]; i < end; i++) {
+        if (file->values[i] == value) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void hashfile_close(struct hashfile *file)
+{
+    munmap((void *)file->hdr, file->size);
+    file->hdr = NULL;
+}
@@ -0,0 +1,60 @@
+
+#ifndef _HASHFILE_H
+#define _HASHFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashtable.h"
+
+#define HASHFILE_MAGIC 0x48534854 /* "THSH" on disk. */
+#define HASHFILE_VERSION 1
+
+/*
+ * On disk a table is flattened: no pointers anywhere, so the file can be
+ * mapped at any address and searched in place.
+ *
+ *   header
+ *   uint32_t offsets[m + 1]  bucket i's keys are values[offsets[i]] up to
+ *                            (not including) values[offsets[i + 1]]
+ *   int32_t values[n]        grouped by bucket
+ *
+ * Everything is little endian, host order on the machines we care about.
+ */
+struct hashfileheader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind; /* enum hashkind the table was built with. */
+    uint32_t m; /* number of buckets, a power of two, >= SMALL_TABLE. */
+    uint32_t n; /* number of keys. */
+    uint32_t pad;
+    uint64_t checksum; /* hashbytes() of everything after the header. */
+};
+
+struct hashfile {
+    const struct hashfileheader *hdr;
+    const uint32_t *offsets;
+    const int32_t *values;
+    size_t size; /* of the mapping. */
+    int m;
+    hash_t hash;
+};
+
+/*
+ * Write table to path (via a temporary file and rename, so readers never see
+ * half a file).
+ * @return 0, or -1 with errno set.
+ */
+int hashfile_save(struct hashtable *table, const char *path);
+/*
+ * Map path read-only; nothing is read until it's searched.  The header and
+ * sizes are checked, the contents aren't, see hashfile_verify.
+ * @return 0, or -1 with errno set (EINVAL if it isn't a table file).
+ */
+int hashfile_open(struct hashfile *file, const char *path);
+/* @return 1 if the checksum matches, reads the whole file. */
+int hashfile_verify(struct hashfile *file);
+int hashfile_search(struct hashfile *file, int value);
+void hashfile_close(struct hashfile *file);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Hash functions for the power of two tables.
+ *
+ * With m == 2**r, k mod m is the low r bits of k, so plain division keeps
+ * whatever pattern the keys had in their low bits (even keys only ever use
+ * half the table, stride 64 keys use 1/64th of it).  The others spread every
+ * bit of the key across the bits we keep.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hashfunc.h"
+
+/* 2**32 / phi, odd. */
+#define FIBONACCI 2654435769u
+
+/* fixed seed so a table hashes the same way in every process. */
+#define HASH_SEED 0x9e3779b97f4a7c15ull
+
+static uint32_t tables[4][256];
+static int tablesready = 0;
+
+uint32_t murmurmix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+uint32_t tabulation(uint32_t k)
+{
+    return tables[0][k & 0xff] ^
+        tables[1][(k >> 8) & 0xff] ^
+        tables[2][(k >> 16) & 0xff] ^
+        tables[3][k >> 24];
+}
+
+/* MurmurHash64A, one 8 byte word at a time then the tail. */
+uint64_t hashbytes(const void *key, size_t len)
+{
+    const uint64_t mul = 0xc6a4a7935bd1e995ull;
+    const uint8_t *p = key;
+    const uint8_t *end = p + (len & ~(size_t)7);
+    uint64_t h = HASH_SEED ^ (len * mul);
+    uint64_t k;
+
+    for (; p != end; p += 8) {
+        memcpy(&k, p, sizeof(k));
+        k *= mul;
+        k ^= k >> 47;
+        k *= mul;
+        h ^= k;
+        h *= mul;
+    }
+
+    switch (len & 7) {
+    case 7: h ^= (uint64_t)p[6] << 48; /* fall through */
+    case 6: h ^= (uint64_t)p[5] << 40; /* fall through */
+    case 5: h ^= (uint64_t)p[4] << 32; /* fall through */
+    case 4: h ^= (uint64_t)p[3] << 24; /* fall through */
+    case 3: h ^= (uint64_t)p[2] << 16; /* fall through */
+    case 2: h ^= (uint64_t)p[1] << 8; /* fall through */
+    case 1: h ^= (uint64_t)p[0];
+        h *= mul;
+    }
+
+    h ^= h >> 47;
+    h *= mul;
+    h ^= h >> 47;
+
+    return h;
+}
+
+void hashinit(void)
+{
+    int i, j;
+    uint64_t x = HASH_SEED;
+
+    if (tablesready) {
+        return;
+    }
+
+    /* xorshift64*, good enough to fill the tables. */
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 256; j++) {
+            x ^= x >> 12;
+            x ^= x << 25;
+            x ^= x >> 27;
+            tables[i][j] = (uint32_t)((x * 0x2545f4914f6cdd1dull) >> 32);
+        }
+    }
+
+    tablesready = 1;
+}
+
+static int
+division(int key, int m)
+{
+    return (unsigned)key & (m - 1);
+}
+
+/*
+ * the top bits of the product are the well mixed ones.  They're shifted up
+ * out of a 64 bit word rather than down, so m of 1 takes none of them
+ * instead of shifting by 32.
+ */
+static int
+fibonacci(int key, int m)
+{
+    return ((uint64_t)((uint32_t)key * FIBONACCI) << __builtin_ctz(m)) >> 32;
+}
+
+static int
+murmur(int key, int m)
+{
+    return murmurmix((uint32_t)key) & (m - 1);
+}
+
+static int
+tabulate(int key, int m)
+{
+    return tabulation((uint32_t)key) & (m - 1);
+}
+
+const hash_t hashfuncs[HASH_KINDS] = {
+    [HASH_DIVISION] = division,
+    [HASH_FIBONACCI] = fibonacci,
+    [HASH_MURMUR] = murmur,
+    [HASH_TABULATION] = tabulate,
+};
+
+const char *hashnames[HASH_KINDS] = {
+    [HASH_DIVISION] = "division",
+    [HASH_FIBONACCI] = "fibonacci",
+    [HASH_MURMUR] = "murmur",
+    [HASH_TABULATION] = "tabulation",
+};
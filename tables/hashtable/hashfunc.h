@@ -0,0 +1,36 @@
+
+#ifndef _HASHFUNC_H
+#define _HASHFUNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The hash functions a table can be built with.  Tables are always a power of
+ * two in size, so none of these divide.
+ */
+enum hashkind {
+    HASH_DIVISION, /* k mod m, which for m == 2**r is just the low r bits. */
+    HASH_FIBONACCI, /* k * 2**32/phi, keep the top r bits. */
+    HASH_MURMUR, /* murmur3's finalizer, then the low r bits. */
+    HASH_TABULATION, /* xor of four random tables indexed by byte. */
+    HASH_KINDS,
+};
+
+/* slot for key k in a table of size m, m must be a power of two. */
+typedef int (*hash_t)(int k, int m);
+
+extern const hash_t hashfuncs[HASH_KINDS];
+extern const char *hashnames[HASH_KINDS];
+
+/* the full 32-bit mixes, for code that wants to pick its own bits. */
+uint32_t murmurmix(uint32_t k);
+uint32_t tabulation(uint32_t k);
+
+/* 64-bit hash of a byte string (murmur64a). */
+uint64_t hashbytes(const void *key, size_t len);
+
+/* fill the tabulation tables; cheap to call more than once. */
+void hashinit(void);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * Radix partitioned hash join.
+ *
+ * A join that builds one big table over the build side misses the cache on
+ * nearly every probe once the table outgrows it.  So both sides are first
+ * scattered into partitions by the low bits of the key's hash (a histogram
+ * pass to size them, then one write pass), with enough partitions that each
+ * build partition and its table stay in L2.  The join proper is then lots of
+ * small ones, each built and probed while it's hot.
+ *
+ * The per-partition table is chained through arrays (bucket heads and a next
+ * index per build tuple) rather than nodes, and buckets use the hash bits
+ * above the partition bits, since those below are the same for everything
+ * in the partition.
+ *
+ * Threads each partition a slice of the input, writing to offsets computed
+ * from everyone's histograms so no two threads share a slot, and then take
+ * whole partitions to join off a shared counter.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hashfunc.h"
+#include "hashjoin.h"
+
+/* bytes of L2 a build tuple costs: itself, a next index and a bucket head. */
+#define TUPLE_COST 16
+
+typedef struct tuple {
+    int key;
+    int row;
+} tuple_t;
+
+struct joinbuf {
+    long n;
+    long cap;
+    int *left;
+    int *right;
+};
+
+struct joinshared {
+    enum jointype type;
+    const int *build;
+    const int *probe;
+    int nbuild;
+    int nprobe;
+    int threads;
+    int bits;
+    int parts;
+    long *bhist; /* [threads][parts], counts then write cursors. */
+    long *phist;
+    long *bstart; /* [parts + 1] */
+    long *pstart;
+    long maxpart; /* largest build partition. */
+    tuple_t *btuples;
+    tuple_t *ptuples;
+    atomic_int next; /* next partition to join. */
+    pthread_barrier_t barrier;
+};
+
+struct joinjob {
+    struct joinshared *sh;
+    int id;
+    struct joinbuf out;
+};
+
+static void emit(struct joinbuf *buf, int left, int right, int pairs)
+{
+    if (buf->n == buf->cap) {
+        buf->cap = buf->cap ? buf->cap * 2 : 1024;
+        buf->right = realloc(buf->right, sizeof(int) * buf->cap);
+        if (pairs) {
+            buf->left = realloc(buf->left, sizeof(int) * buf->cap);
+        }
+    }
+
+    if (pairs) {
+        buf->left[buf->n] = left;
+    }
+    buf->right[buf->n++] = right;
+}
+
+static int radixbits(int nbuild)
+{
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    int bits = 0;
+
+    if (l2 <= 0) {
+        l2 = JOIN_L2;
+    }
+
+    while (bits < JOIN_MAX_BITS &&
+            ((long)nbuild >> bits) * TUPLE_COST > l2 / 2) {
+        bits++;
+    }
+
+    return bits;
+}
+
+static void histogram(const int *keys, int lo, int hi, int parts, long *hist)
+{
+    int i;
+
+    for (i = lo; i < hi; i++) {
+        hist[murmurmix((uint32_t)keys[i]) & (parts - 1)]++;
+    }
+}
+
+static void scatter(const int *keys, int lo, int hi, int parts, long *cursor,
+        tuple_t *tuples)
+{
+    int i;
+
+    for (i = lo; i < hi; i++) {
+        tuple_t *t = &tuples[cursor[murmurmix((uint32_t)keys[i]) &
+                (parts - 1)]++];
+        t->key = keys[i];
+        t->row = i;
+    }
+}
+
+/*
+ * Turn every thread's histogram into where it writes in the partitioned
+ * array: partition p's tuples from thread 0, then thread 1's, and so on.
+ */
+static void offsets(long *hist, long *start, int parts, int threads)
+{
+    int p, t;
+    long at = 0;
+
+    for (p = 0; p < parts; p++) {
+        start[p] = at;
+        for (t = 0; t < threads; t++) {
+            long count = hist[t * parts + p];
+            hist[t * parts + p] = at;
+            at += count;
+        }
+    }
+    start[parts] = at;
+}
+
+static void joinpart(struct joinshared *sh, int p, int *heads, int *next,
+        struct joinbuf *out)
+{
+    long i, j;
+    int b, found;
+    tuple_t *build = sh->btuples + sh->bstart[p];
+    tuple_t *probe = sh->ptuples + sh->pstart[p];
+    long nb = sh->bstart[p + 1] - sh->bstart[p];
+    long np = sh->pstart[p + 1] - sh->pstart[p];
+    int mask = 1;
+
+    while (mask < nb) {
+        mask <<= 1;
+    }
+    mask--;
+
+    for (i = 0; i <= mask; i++) {
+        heads[i] = -1;
+    }
+    for (i = 0; i < nb; i++) {
+        b = (murmurmix((uint32_t)build[i].key) >> sh->bits) & mask;
+        next[i] = heads[b];
+        heads[b] = i;
+    }
+
+    for (j = 0; j < np; j++) {
+        b = (murmurmix((uint32_t)probe[j].key) >> sh->bits) & mask;
+        found = 0;
+
+        for (i = heads[b]; i >= 0; i = next[i]) {
+            if (build[i].key != probe[j].key) {
+                continue;
+            }
+            if (sh->type != JOIN_INNER) {
+                found = 1;
+                break;
+            }
+            emit(out, build[i].row, probe[j].row, 1);
+        }
+
+        if ((sh->type == JOIN_SEMI && found) ||
+                (sh->type == JOIN_ANTI && !found)) {
+            emit(out, 0, probe[j].row, 0);
+        }
+    }
+}
+
+static void *joinworker(void *arg)
+{
+    struct joinjob *job = arg;
+    struct joinshared *sh = job->sh;
+    int p, t = job->id;
+    int blo = (long)sh->nbuild * t / sh->threads;
+    int bhi = (long)sh->nbuild * (t + 1) / sh->threads;
+    int plo = (long)sh->nprobe * t / sh->threads;
+    int phi = (long)sh->nprobe * (t + 1) / sh->threads;
+    long size = 1;
+    int *heads, *next;
+
+    histogram(sh->build, blo, bhi, sh->parts, &sh->bhist[t * sh->parts]);
+    histogram(sh->probe, plo, phi, sh->parts, &sh->phist[t * sh->parts]);
+
+    if (pthread_barrier_wait(&sh->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+        offsets(sh->bhist, sh->bstart, sh->parts, sh->threads);
+        offsets(sh->phist, sh->pstart, sh->parts, sh->threads);
+        sh->maxpart = 1;
+        for (p = 0; p < sh->parts; p++) {
+            if (sh->bstart[p + 1] - sh->bstart[p] > sh->maxpart) {
+                sh->maxpart = sh->bstart[p + 1] - sh->bstart[p];
+            }
+        }
+    }
+    pthread_barrier_wait(&sh->barrier);
+
+    scatter(sh->build, blo, bhi, sh->parts, &sh->bhist[t * sh->parts],
+            sh->btuples);
+    scatter(sh->probe, plo, phi, sh->parts, &sh->phist[t * sh->parts],
+            sh->ptuples);
+
+    pthread_barrier_wait(&sh->barrier);
+
+    while (size < sh->maxpart) {
+        size <<= 1;
+    }
+    heads = malloc(sizeof(int) * size);
+    next = malloc(sizeof(int) * sh->maxpart);
+
+    while ((p = atomic_fetch_add(&sh->next, 1)) < sh->parts) {
+        joinpart(sh, p, heads, next, &job->out);
+    }
+
+    free(heads);
+    free(next);
+
+    return NULL;
+}
+
+void hashjoin(enum jointype type, const int *build, int nbuild,
+        const int *probe, int nprobe, int threads, struct joinresult *out)
+{
+    int t;
+    long at;
+    struct joinshared sh;
+    struct joinjob *jobs = calloc(threads, sizeof(struct joinjob));
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+
+    assert(threads > 0);
+
+    sh.type = type;
+    sh.build = build;
+    sh.probe = probe;
+    sh.nbuild = nbuild;
+    sh.nprobe = nprobe;
+    sh.threads = threads;
+    sh.bits = radixbits(nbuild);
+    sh.parts = 1 << sh.bits;
+    sh.bhist = calloc((long)threads * sh.parts, sizeof(long));
+    sh.phist = calloc((long)threads * sh.parts, sizeof(long));
+    sh.bstart = malloc(sizeof(long) * (sh.parts + 1));
+    sh.pstart = malloc(sizeof(long) * (sh.parts + 1));
+    sh.btuples = malloc(sizeof(tuple_t) * (nbuild ? nbuild : 1));
+    sh.ptuples = malloc(sizeof(tuple_t) * (nprobe ? nprobe : 1));
+    atomic_init(&sh.next, 0);
+    pthread_barrier_init(&sh.barrier, NULL, threads);
+
+    for (t = 0; t < threads; t++) {
+        jobs[t].sh = &sh;
+        jobs[t].id = t;
+        pthread_create(&tids[t], NULL, joinworker, &jobs[t]);
+    }
+
+    out->n = 0;
+    for (t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        out->n += jobs[t].out.n;
+    }
+
+    out->parts = sh.parts;
+    out->left = type == JOIN_INNER ? malloc(sizeof(int) * (out->n + 1)) : NULL;
+    out->right = malloc(sizeof(int) * (out->n + 1));
+    for (t = 0, at = 0; t < threads; t++) {
+        struct joinbuf *buf = &jobs[t].out;
+
+        if (buf->n) {
+            if (out->left) {
+                memcpy(out->left + at, buf->left, sizeof(int) * buf->n);
+            }
+            memcpy(out->right + at, buf->right, sizeof(int) * buf->n);
+            at += buf->n;
+        }
+        free(buf->left);
+        free(buf->right);
+    }
+
+    pthread_barrier_destroy(&sh.barrier);
+    free(sh.bhist);
+    free(sh.phist);
+    free(sh.bstart);
+    free(sh.pstart);
+    free(sh.btuples);
+    free(sh.ptuples);
+    free(tids);
+    free(jobs);
+}
+
+void joinresult_free(struct joinresult *out)
+{
+    free(out->left);
+    free(out->right);
+    out->left = out->right = NULL;
+}
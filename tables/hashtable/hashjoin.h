@@ -0,0 +1,38 @@
+
+#ifndef _HASHJOIN_H
+#define _HASHJOIN_H
+
+/* assumed L2 size when the system won't say. */
+#define JOIN_L2 (256 * 1024)
+/* most radix bits used; past this one pass thrashes the TLB. */
+#define JOIN_MAX_BITS 12
+
+enum jointype {
+    JOIN_INNER, /* every (build row, probe row) pair with equal keys. */
+    JOIN_SEMI, /* probe rows with at least one match. */
+    JOIN_ANTI, /* probe rows with none. */
+};
+
+/*
+ * Matches as row numbers into the inputs, in no particular order.  left is
+ * only filled in for JOIN_INNER.
+ */
+struct joinresult {
+    long n;
+    int *left;
+    int *right;
+    int parts; /* partitions the inputs were split into. */
+};
+
+/*
+ * Join build[nbuild] with probe[nprobe] on equal values.  Both sides are
+ * radix partitioned on a hash of the key, enough ways that one partition's
+ * build side and its table fit in half the L2, and then each partition is
+ * built and probed on its own.  Partitions are handed out to threads as
+ * they finish the last one.
+ */
+void hashjoin(enum jointype type, const int *build, int nbuild,
+        const int *probe, int nprobe, int threads, struct joinresult *out);
+void joinresult_free(struct joinresult *out);
+
+#endif
@@ -14,50 +14,96 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "hashtable.h"
 
-static void growtable(struct hashtable *table, int grow);
+/*
+ * STAT(x) does x only in a stats build; everything else compiles exactly as
+ * if the counters didn't exist.
+ */
+#ifdef HASHTABLE_STATS
+#define STAT(X) do { X; } while (0)
 
-/* division */
-static int
-division(struct hashtable *table, int key)
+static long nsnow(void)
 {
-    /* 
-     * Doesn't work well if both are even, and we can do better
-     */
-    return key % table->m;
-}
+    struct timespec ts;
 
-#if 0 /* revisit when done with design. */
-#define ARCH_BITS (sizeof(int) * 8)
-#define POWER (1 << ARCH_BITS)
-#define RIGHT_SHIFT (ARCH_BITS - TABLE_POWER);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-/* random integer within w bits, selected ahead of time, must be odd */
-static int a = 0;
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
 
-static void mulsetup() {
-    a = random(); /* between 2**r-1 and 2**r */
+static void countwalk(struct hashtable *table, int walked)
+{
+    table->stats.walks++;
+    table->stats.walked += walked;
+    if (walked > table->stats.maxwalk) {
+        table->stats.maxwalk = walked;
+    }
 }
 
-/* table size is power of 2, 2**r */
-static int
-multiplication(struct hashtable *table, int key) 
+static void countlookup(struct hashtable *table, int found)
 {
-    int i = (a * key);
-    int v = (i % POWER) >> (ARCH_BITS - TABLE_POWER);
-    return v;
+    table->stats.lookups++;
+    if (found) {
+        table->stats.hits++;
+    } else {
+        table->stats.misses++;
+    }
 }
+#else
+#define STAT(X) do { } while (0)
 #endif
 
-void buildhashtable(struct hashtable *table, int m)
+static void growtable(struct hashtable *table, int grow);
+static void migrate(struct hashtable *table, int count);
+
+/*
+ * Node allocation, the table owns a slab of chunks and recycles nodes through
+ * a free list, so in steady state insert and delete never touch malloc.
+ */
+static list_t *nodealloc(struct nodepool *pool)
+{
+    int i;
+    list_t *node;
+
+    if (!pool->free) {
+        struct poolchunk *chunk = malloc(sizeof(struct poolchunk));
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+        pool->nchunks++;
+
+        /* thread it backwards so nodes come out in address order. */
+        for (i = POOL_CHUNK - 1; i >= 0; i--) {
+            chunk->nodes[i].next = pool->free;
+            pool->free = &chunk->nodes[i];
+        }
+        pool->nfree += POOL_CHUNK;
+    }
+
+    node = pool->free;
+    pool->free = node->next;
+    pool->nfree--;
+    pool->live++;
+
+    return node;
+}
+
+static void nodefree(struct nodepool *pool, list_t *node)
+{
+    node->next = pool->free;
+    pool->free = node;
+    pool->nfree++;
+    pool->live--;
+}
+
+/* (re)allocate the bucket array, leaves n and any resize state alone. */
+static void buildbuckets(struct hashtable *table, int m)
 {
-    table->n = 0;
     table->m = m;
     table->g = m * 0.75;
     table->s = m * 0.25;
-    table->hash = division;
 
     int size = sizeof(list_t *) * table->m;
 
@@ -67,54 +113,282 @@ void buildhashtable(struct hashtable *table, int m)
     return;
 }
 
+void buildhashtable(struct hashtable *table, int m)
+{
+    int size = SMALL_TABLE;
+
+    while (size < m) {
+        size <<= 1;
+    }
+
+    hashinit();
+
+    table->n = 0;
+    table->hash = hashfuncs[HASH_FIBONACCI];
+    table->kind = HASH_FIBONACCI;
+    table->old = NULL;
+    table->oldm = 0;
+    table->migrate = 0;
+    memset(&table->pool, 0x00, sizeof(table->pool));
+    table->filter = NULL;
+    table->oldfilter = NULL;
+    table->rejected = 0;
+    table->falsepos = 0;
+    memset(&table->stats, 0x00, sizeof(table->stats));
+
+    buildbuckets(table, size);
+
+    return;
+}
+
+void sethash(struct hashtable *table, enum hashkind kind)
+{
+    assert(table->n == 0 && table->old == NULL);
+    table->hash = hashfuncs[kind];
+    table->kind = kind;
+}
+
+/*
+ * @return the link (bucket head or a next pointer) that points at value's
+ * node, or NULL if it isn't in either table.
+ */
+static list_t **findlink(struct hashtable *table, int value)
+{
+    list_t **link = &table->table[table->hash(value, table->m)];
+#ifdef HASHTABLE_STATS
+    int walked = 0;
+#endif
+
+    while (*link) {
+        STAT(walked++);
+        if ((*link)->value == value) {
+            STAT(countwalk(table, walked));
+            return link;
+        }
+        link = &(*link)->next;
+    }
+
+    if (table->old) {
+        int slot = table->hash(value, table->oldm);
+
+        /* below migrate the bucket is already empty. */
+        if (slot >= table->migrate) {
+            link = &table->old[slot];
+            while (*link) {
+                STAT(walked++);
+                if ((*link)->value == value) {
+                    STAT(countwalk(table, walked));
+                    return link;
+                }
+                link = &(*link)->next;
+            }
+        }
+    }
+
+    STAT(countwalk(table, walked));
+
+    return NULL;
+}
+
+static struct bloom *newfilter(struct hashtable *table)
+{
+    struct bloom *filter = malloc(sizeof(struct bloom));
+
+    bloom_build(filter, table->g);
+
+    return filter;
+}
+
+static void dropfilter(struct bloom **filter)
+{
+    if (*filter) {
+        bloom_free(*filter);
+        free(*filter);
+        *filter = NULL;
+    }
+}
+
+static void filterchains(struct bloom *filter, list_t **buckets, int m)
+{
+    int i;
+    list_t *curr;
+
+    for (i = 0; i < m; i++) {
+        for (curr = buckets[i]; curr; curr = curr->next) {
+            bloom_add(filter, curr->value);
+        }
+    }
+}
+
+/*
+ * A fresh filter over every key, in table and what's left of old, so old
+ * needs none of its own.
+ */
+static void fillfilter(struct hashtable *table)
+{
+    dropfilter(&table->filter);
+    dropfilter(&table->oldfilter);
+
+    table->filter = newfilter(table);
+    filterchains(table->filter, table->table, table->m);
+    if (table->old) {
+        filterchains(table->filter, table->old + table->migrate,
+                table->oldm - table->migrate);
+    }
+}
+
+/*
+ * Deletes leave their keys' bits set, so churn at a steady size fills the
+ * filter as surely as growth does, but never resizes to start a new one.
+ * Once it's taken twice the keys the table holds, and more than it was sized
+ * for, start over from the chains: O(n), after at least g inserts.
+ */
+static inline void agefilter(struct hashtable *table)
+{
+    long added = table->filter->added;
+
+    if (added > 2L * table->n && added > table->g) {
+        fillfilter(table);
+    }
+}
+
+/* @return 0 if value is certainly not in the table. */
+static inline int filtermaybe(struct hashtable *table, int value)
+{
+    if (bloom_maybe(table->filter, value) ||
+            (table->oldfilter && bloom_maybe(table->oldfilter, value))) {
+        return 1;
+    }
+
+    table->rejected++;
+
+    return 0;
+}
+
+/* findlink, behind the filter when there is one. */
+static list_t **lookup(struct hashtable *table, int value)
+{
+    list_t **link;
+
+    if (!table->filter) {
+        return findlink(table, value);
+    }
+
+    /* a hit needs the bucket too; don't make it wait on the filter first. */
+    __builtin_prefetch(&table->table[table->hash(value, table->m)]);
+
+    if (!filtermaybe(table, value)) {
+        return NULL;
+    }
+
+    link = findlink(table, value);
+    if (!link) {
+        table->falsepos++;
+    }
+
+    return link;
+}
+
 /* Is the key in the table? */
 int search(struct hashtable *table, int value)
 {
-    int found = 0;
-    int slot = table->hash(table, value);
-    list_t *curr = table->table[slot];
-
-    while (curr && !found) {
-        if (curr->value == value) {
-            found++;
-        } else {
-            curr = curr->next;
-        } /* could improve by sorted linkedlist, but meh, these should be shallow. */
+    if (table->old) {
+        migrate(table, MIGRATE_STEP);
     }
 
+#ifdef HASHTABLE_STATS
+    int found = lookup(table, value) != NULL;
+    countlookup(table, found);
     return found;
+#else
+    return lookup(table, value) != NULL;
+#endif
 }
 
-static void growtable(struct hashtable *table, int grow)
+/*
+ * Move up to count buckets from the old table into the new one.  Nodes are
+ * relinked, not copied, so this never allocates.
+ */
+static void migrate(struct hashtable *table, int count)
 {
-    int i, m2;
     list_t *curr, *next;
+    int slot;
+#ifdef HASHTABLE_STATS
+    long start = nsnow();
+#endif
+
+    while (table->old && count-- > 0) {
+        curr = table->old[table->migrate];
+        while (curr) {
+            next = curr->next;
+            slot = table->hash(curr->value, table->m);
+            curr->next = table->table[slot];
+            table->table[slot] = curr;
+            if (table->filter) {
+                bloom_add(table->filter, curr->value);
+            }
+            curr = next;
+        }
 
+        table->old[table->migrate++] = NULL;
+
+        if (table->migrate == table->oldm) {
+            free(table->old);
+            table->old = NULL;
+            table->oldm = 0;
+            table->migrate = 0;
+            dropfilter(&table->oldfilter);
+        }
+    }
+
+    STAT(table->stats.resizens += nsnow() - start);
+
+    return;
+}
+
+/*
+ * Start a resize; the actual rehashing is spread over the next operations
+ * MIGRATE_STEP buckets at a time.  Between two triggers there are at least
+ * m/8 operations, which at MIGRATE_STEP == 8 is enough to drain the old
+ * table, so normally we never find one still in flight; if we do, finish it
+ * here rather than juggle three tables.
+ */
+static void growtable(struct hashtable *table, int grow)
+{
     int m = table->m;
+    int m2;
+#ifdef HASHTABLE_STATS
+    long start;
+#endif
+
+    if (table->old) {
+        migrate(table, table->oldm);
+    }
+
+    STAT(start = nsnow());
+    STAT(grow ? table->stats.grows++ : table->stats.shrinks++);
 
-    /* so double m, then rehash everything into a new table. */
+    /* so double m (or halve it); everything moves across incrementally. */
     if (grow) {
         m2 = m << 1;
     } else {
         m2 = m >> 1;
     }
 
-    list_t **oldTable = table->table;
+    table->old = table->table;
+    table->oldm = m;
+    table->migrate = 0;
 
-    /* to make this easy, lets us use insert directly. */
-    buildhashtable(table, m2);
+    buildbuckets(table, m2);
 
-    for (i = 0; i < m; i++) {
-        curr = oldTable[i];
-        while (curr) {
-            next = curr->next;
-            insert(table, curr->value);
-            free(curr); /* free memory as we go. */
-            curr = next;
-        }
+    /* keys join the new filter as they're moved, leaving deleted ones behind. */
+    if (table->filter) {
+        table->oldfilter = table->filter;
+        table->filter = newfilter(table);
     }
 
-    free(oldTable);
+    STAT(table->stats.resizens += nsnow() - start);
+    migrate(table, MIGRATE_STEP);
 
     return;
 }
@@ -122,35 +396,30 @@ static void growtable(struct hashtable *table, int grow)
 /* theta(alpha + 1), keep alpha low, because it's related to chain length */
 void insert(struct hashtable *table, int value)
 {
-    list_t *prev = NULL;
-
-    int found = search(table, value);
-    if (found) {
-        return;
+    if (table->old) {
+        migrate(table, MIGRATE_STEP);
     }
 
-    int slot = table->hash(table, value);
-    list_t *curr = table->table[slot];
-
-    while (curr) {
-        prev = curr;
-        curr = curr->next;
+    if (lookup(table, value)) {
+        return;
     }
 
-    /* curr is NULL, prev points to the previous entry. */
-    curr = malloc(sizeof(list_t));
+    /* new entries always go in the new table, at the head of the chain. */
+    int slot = table->hash(value, table->m);
+    list_t *curr = nodealloc(&table->pool);
     curr->value = value;
-    curr->next = NULL;
-
-    if (prev == NULL) {
-        /* 0th entry in the slot */
-        table->table[slot] = curr;
-    } else {
-        prev->next = curr;
+    curr->next = table->table[slot];
+    table->table[slot] = curr;
+    if (table->filter) {
+        bloom_add(table->filter, value);
     }
 
     table->n++;
 
+    if (table->filter) {
+        agefilter(table);
+    }
+
     if (table->n > table->g) {
         growtable(table, 1);
     }
@@ -160,54 +429,241 @@ void insert(struct hashtable *table, int value)
 
 void delete(struct hashtable *table, int value)
 {
-    list_t *prev = NULL;
+    if (table->old) {
+        migrate(table, MIGRATE_STEP);
+    }
 
-    int found = search(table, value);
-    if (!found) {
+    list_t **link = lookup(table, value);
+    if (!link) {
         return;
     }
 
-    int slot = table->hash(table, value);
-    list_t *curr = table->table[slot];
+    list_t *curr = *link;
+    *link = curr->next;
+    nodefree(&table->pool, curr);
+
+    table->n--;
+
+    if (table->n < table->s && table->m > SMALL_TABLE) {
+        growtable(table, 0);
+    }
+
+    return;
+}
+
+/*
+ * Two prefetch passes over the window: first the bucket heads, then (once
+ * those have had a chance to arrive) the first node of each chain.
+ */
+static void prefetchwindow(struct hashtable *table, const int *keys, int n,
+        int *slots)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        slots[i] = table->hash(keys[i], table->m);
+        __builtin_prefetch(&table->table[slots[i]]);
+    }
+
+    for (i = 0; i < n; i++) {
+        __builtin_prefetch(table->table[slots[i]]);
+    }
+}
+
+void search_many(struct hashtable *table, const int *keys, int n, int *out)
+{
+    int i, j, w;
+    int slots[BATCH_WINDOW];
+    list_t *curr;
+
+    for (i = 0; i < n; i += BATCH_WINDOW) {
+        w = n - i < BATCH_WINDOW ? n - i : BATCH_WINDOW;
 
-    while (curr) {
-        if (curr->value == value) {
-            if (prev == NULL) {
-                table->table[slot] = curr->next;
-            } else {
-                prev = curr->next;
+        /* same migration work the scalar calls would have done. */
+        if (table->old) {
+            migrate(table, MIGRATE_STEP * w);
+        }
+
+        prefetchwindow(table, &keys[i], w, slots);
+
+        for (j = 0; j < w; j++) {
+            if (table->old || table->filter) {
+                out[i + j] = lookup(table, keys[i + j]) != NULL;
+                STAT(countlookup(table, out[i + j]));
+                continue;
             }
+#ifdef HASHTABLE_STATS
+            int walked = 0;
+#endif
 
-            free(curr);
-            break;
-        } else {
-            prev = curr;
-            curr = curr->next;
+            for (curr = table->table[slots[j]]; curr; curr = curr->next) {
+                STAT(walked++);
+                if (curr->value == keys[i + j]) {
+                    break;
+                }
+            }
+            out[i + j] = curr != NULL;
+            STAT(countwalk(table, walked));
+            STAT(countlookup(table, out[i + j]));
         }
     }
+}
 
-    table->n--;
+/*
+ * Inserts can grow the table part way through a window, so these resolve
+ * through insert() itself; the prefetches have warmed the same lines.
+ */
+void insert_many(struct hashtable *table, const int *keys, int n)
+{
+    int i, j, w;
+    int slots[BATCH_WINDOW];
 
-    if (table->n < table->s) {
-        growtable(table, 0);
+    for (i = 0; i < n; i += BATCH_WINDOW) {
+        w = n - i < BATCH_WINDOW ? n - i : BATCH_WINDOW;
+
+        prefetchwindow(table, &keys[i], w, slots);
+
+        for (j = 0; j < w; j++) {
+            insert(table, keys[i + j]);
+        }
     }
+}
 
-    return;
+void build_from_array(struct hashtable *table, const int *keys, int n)
+{
+    int i, slot, size = table->m;
+    list_t *curr;
+
+    assert(table->n == 0 && table->old == NULL);
+
+    /* under g, so the last key doesn't start a resize. */
+    while (size * 0.75 < n) {
+        size <<= 1;
+    }
+    if (size != table->m) {
+        free(table->table);
+        buildbuckets(table, size);
+        if (table->filter) {
+            dropfilter(&table->filter);
+            table->filter = newfilter(table);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        slot = table->hash(keys[i], table->m);
+        curr = nodealloc(&table->pool);
+        curr->value = keys[i];
+        curr->next = table->table[slot];
+        table->table[slot] = curr;
+        if (table->filter) {
+            bloom_add(table->filter, keys[i]);
+        }
+    }
+
+    table->n = n;
 }
 
+/* the nodes all live in the pool's chunks, so this is O(chunks). */
 void freetable(struct hashtable *table)
 {
-    int i;
-    list_t *curr, *next;
+    struct poolchunk *chunk, *next;
 
-    for (i = 0; i < table->m; i++) {
-        curr = table->table[i];
-        while (curr) {
-            next = curr->next;
-            free(curr);
-            curr = next;
-        }
+    for (chunk = table->pool.chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
     }
+    memset(&table->pool, 0x00, sizeof(table->pool));
 
     free(table->table);
+
+    if (table->old) {
+        free(table->old);
+        table->old = NULL;
+    }
+
+    dropfilter(&table->filter);
+    dropfilter(&table->oldfilter);
+}
+
+void poolstats(struct hashtable *table, struct poolstats *stats)
+{
+    stats->chunks = table->pool.nchunks;
+    stats->live = table->pool.live;
+    stats->free = table->pool.nfree;
+    stats->bytes = (long)table->pool.nchunks * sizeof(struct poolchunk);
+}
+
+void setfilter(struct hashtable *table, int on)
+{
+    if (!on) {
+        dropfilter(&table->filter);
+        dropfilter(&table->oldfilter);
+        return;
+    }
+
+    if (table->filter) {
+        return;
+    }
+
+    fillfilter(table);
+    table->rejected = 0;
+    table->falsepos = 0;
+}
+
+void filterstats(struct hashtable *table, struct filterstats *stats)
+{
+    long asked = table->rejected + table->falsepos;
+
+    memset(stats, 0x00, sizeof(*stats));
+    if (!table->filter) {
+        return;
+    }
+
+    stats->rejected = table->rejected;
+    stats->falsepos = table->falsepos;
+    stats->fpr = asked ? (double)table->falsepos / asked : 0;
+    stats->estimate = bloom_estimate(table->filter);
+    stats->bytes = bloom_bytes(table->filter);
+    if (table->oldfilter) {
+        stats->bytes += bloom_bytes(table->oldfilter);
+    }
+}
+
+static void chainhist(list_t **buckets, int m, struct hashstats *stats)
+{
+    int i, len;
+    list_t *curr;
+
+    for (i = 0; i < m; i++) {
+        len = 0;
+        for (curr = buckets[i]; curr; curr = curr->next) {
+            len++;
+        }
+
+        stats->chains[len < STATS_HIST ? len : STATS_HIST - 1]++;
+        if (len > stats->maxchain) {
+            stats->maxchain = len;
+        }
+    }
+}
+
+/* the histogram walks every chain, O(n + m); it's for looking, not polling. */
+void hashstats(struct hashtable *table, struct hashstats *stats)
+{
+#ifdef HASHTABLE_STATS
+    *stats = table->stats;
+    stats->avgwalk = stats->walks ? (double)stats->walked / stats->walks : 0;
+#else
+    memset(stats, 0x00, sizeof(*stats));
+#endif
+
+    stats->maxchain = 0;
+    memset(stats->chains, 0x00, sizeof(stats->chains));
+
+    chainhist(table->table, table->m, stats);
+    /* the unmigrated part of old, mid-resize; the rest is empty anyway. */
+    if (table->old) {
+        chainhist(table->old + table->migrate, table->oldm - table->migrate,
+                stats);
+    }
 }
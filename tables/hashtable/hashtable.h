@@ -3,20 +3,82 @@
 #ifndef _HASHTABLE_H
 #define _HASHTABLE_H
 
-#define SMALL_TABLE 8
+#include "hashfunc.h"
+#include "bloom.h"
 
-/* m (table size) == 2**r; maybe make variable */
-#define TABLE_POWER 16
+/* m (table size) is always a power of two, and never below this. */
+#define SMALL_TABLE 8
 
-struct hashtable; /* forward declare. */
+/* buckets moved out of the old table per operation while resizing. */
+#define MIGRATE_STEP 8
 
-typedef int (*hash_t)(struct hashtable *t, int k);
+/* keys hashed and prefetched ahead of resolving them in the batched calls. */
+#define BATCH_WINDOW 16
 
 typedef struct list {
     struct list *next;
     int value;
 } list_t;
 
+/* chain nodes are carved out of chunks this many at a time (4 KiB). */
+#define POOL_CHUNK 256
+
+struct poolchunk {
+    struct poolchunk *next;
+    list_t nodes[POOL_CHUNK];
+};
+
+/*
+ * The table's node allocator; nodes on the free list are threaded through
+ * their own next pointers.
+ */
+struct nodepool {
+    struct poolchunk *chunks; /* every chunk we've allocated. */
+    list_t *free; /* nodes ready to hand out. */
+    int nchunks;
+    int live; /* nodes currently in a chain. */
+    int nfree; /* nodes on the free list. */
+};
+
+struct poolstats {
+    int chunks;
+    int live;
+    int free;
+    long bytes; /* held by the chunks. */
+};
+
+/* chains this long or longer share the last histogram column. */
+#define STATS_HIST 8
+
+/*
+ * Operation counters are only kept when built with -DHASHTABLE_STATS, and
+ * read as zero otherwise; without it the operations don't touch them.
+ * The chain histogram is taken from the buckets when asked for, so it's
+ * there either way.
+ */
+struct hashstats {
+    long lookups; /* keys through search and search_many. */
+    long hits;
+    long misses;
+    long walks; /* chains walked, by lookups, insert and delete. */
+    long walked; /* nodes visited on those walks. */
+    int maxwalk; /* most nodes visited on one. */
+    double avgwalk;
+    long grows;
+    long shrinks;
+    long resizens; /* in growtable and migration, all told. */
+    int maxchain; /* longest chain right now. */
+    long chains[STATS_HIST]; /* buckets by chain length right now. */
+};
+
+struct filterstats {
+    long rejected; /* lookups the filter answered on its own. */
+    long falsepos; /* let through, then not found. */
+    double fpr; /* falsepos / (falsepos + rejected), as measured. */
+    double estimate; /* what the bits set now predict. */
+    long bytes;
+};
+
 struct hashtable {
     int n; /* number of filled slots. */
     int m; /* size of table. */
@@ -24,12 +86,62 @@ struct hashtable {
     int s; /* n that triggers shrink. */
     list_t **table; /* the table. */
     hash_t hash; /* the method. */
+    enum hashkind kind; /* which one hash is. */
+    /*
+     * While resizing, the previous table; buckets below migrate have already
+     * been moved into table.  NULL when no resize is in progress.
+     */
+    list_t **old;
+    int oldm; /* size of old. */
+    int migrate; /* next bucket in old to move. */
+    struct nodepool pool; /* where the list_t nodes come from. */
+    /*
+     * Optional front for misses: every key in table is in filter, and while
+     * resizing every key still in old is in oldfilter.  Deleted keys linger
+     * until the next resize starts a fresh filter, or inserts have added
+     * twice the keys the table holds and it's built again from the chains.
+     */
+    struct bloom *filter;
+    struct bloom *oldfilter;
+    long rejected;
+    long falsepos;
+    /*
+     * There whatever the build, so the layout doesn't depend on the flag;
+     * only a stats build ever counts anything in it.
+     */
+    struct hashstats stats;
 };
 
+/* m is rounded up to a power of two, at least SMALL_TABLE. */
 void buildhashtable(struct hashtable *table, int m);
+/* pick the hash function, only while the table is empty. */
+void sethash(struct hashtable *table, enum hashkind kind);
 int search(struct hashtable *table, int value);
 void insert(struct hashtable *table, int value);
 void delete(struct hashtable *table, int value);
 void freetable(struct hashtable *table);
+/*
+ * Batched versions, out[i] = search(table, keys[i]).  A window of keys is
+ * hashed and their buckets prefetched before any is resolved, so the cache
+ * misses overlap instead of queueing one after another.
+ */
+void search_many(struct hashtable *table, const int *keys, int n, int *out);
+void insert_many(struct hashtable *table, const int *keys, int n);
+/*
+ * Load n distinct keys into an empty table (sethash first if you like).  The
+ * buckets are sized for n once, and nothing is searched for: duplicates in
+ * keys would be stored twice, so dedupe first if they aren't known distinct.
+ */
+void build_from_array(struct hashtable *table, const int *keys, int n);
+/*
+ * Turn the bloom filter in front of the chains on (built from whatever is in
+ * the table) or off.
+ */
+void setfilter(struct hashtable *table, int on);
+void filterstats(struct hashtable *table, struct filterstats *stats);
+/* snapshot of the node allocator. */
+void poolstats(struct hashtable *table, struct poolstats *stats);
+/* snapshot of the counters and chain lengths, see struct hashstats. */
+void hashstats(struct hashtable *table, struct hashstats *stats);
 
 #endif
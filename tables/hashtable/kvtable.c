@@ -0,0 +1,178 @@
+/*
+ * Chained key/value table over byte string keys.
+ *
+ * Like the int table, a slot is the low bits of the hash, but here the hash
+ * is computed once per key (on the way in) and cached in the entry.  Lookups
+ * skip any entry whose cached hash differs, so memcmp only runs on what is
+ * almost certainly the key, and growing relinks entries using the cached
+ * hash without touching the key bytes at all.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hashfunc.h"
+#include "kvtable.h"
+
+#define KV_SMALL 8
+
+#define KEYBYTES(E) \
+    ((E)->len <= KV_INLINE ? (E)->key.bytes : (E)->key.ptr)
+
+static void buildbuckets(struct kvtable *table, int m)
+{
+    table->m = m;
+    table->g = m * 0.75;
+    table->s = m * 0.25;
+
+    table->table = calloc(m, sizeof(kventry_t *));
+}
+
+void kv_buildtable(struct kvtable *table, int m)
+{
+    int size = KV_SMALL;
+
+    while (size < m) {
+        size <<= 1;
+    }
+
+    table->n = 0;
+    buildbuckets(table, size);
+
+    return;
+}
+
+/* @return the link pointing at key's entry, or NULL. */
+static kventry_t **findlink(struct kvtable *table, const void *key,
+        size_t len, uint64_t h)
+{
+    kventry_t **link = &table->table[h & (table->m - 1)];
+    kventry_t *curr;
+
+    while ((curr = *link)) {
+        if (curr->hash == h && curr->len == len &&
+                memcmp(KEYBYTES(curr), key, len) == 0) {
+            return link;
+        }
+        link = &curr->next;
+    }
+
+    return NULL;
+}
+
+/* relink every entry into a table of size m, by the cached hash. */
+static void growtable(struct kvtable *table, int m)
+{
+    int i;
+    kventry_t *curr, *next;
+    kventry_t **old = table->table;
+    int oldm = table->m;
+
+    buildbuckets(table, m);
+
+    for (i = 0; i < oldm; i++) {
+        for (curr = old[i]; curr; curr = next) {
+            kventry_t **head = &table->table[curr->hash & (m - 1)];
+
+            next = curr->next;
+            curr->next = *head;
+            *head = curr;
+        }
+    }
+
+    free(old);
+
+    return;
+}
+
+void **kv_lookup(struct kvtable *table, const void *key, size_t len)
+{
+    kventry_t **link = findlink(table, key, len, hashbytes(key, len));
+
+    if (!link) {
+        return NULL;
+    }
+
+    return &(*link)->value;
+}
+
+int kv_upsert(struct kvtable *table, const void *key, size_t len, void *value)
+{
+    uint64_t h = hashbytes(key, len);
+    kventry_t **link = findlink(table, key, len, h);
+
+    if (link) {
+        (*link)->value = value;
+        return 0;
+    }
+
+    kventry_t *entry = malloc(sizeof(kventry_t));
+    entry->hash = h;
+    entry->len = len;
+    entry->value = value;
+
+    if (len <= KV_INLINE) {
+        memcpy(entry->key.bytes, key, len);
+    } else {
+        entry->key.ptr = malloc(len);
+        memcpy(entry->key.ptr, key, len);
+    }
+
+    kventry_t **head = &table->table[h & (table->m - 1)];
+    entry->next = *head;
+    *head = entry;
+
+    table->n++;
+
+    if (table->n > table->g) {
+        growtable(table, table->m << 1);
+    }
+
+    return 1;
+}
+
+static void freeentry(kventry_t *entry)
+{
+    if (entry->len > KV_INLINE) {
+        free(entry->key.ptr);
+    }
+    free(entry);
+}
+
+int kv_erase(struct kvtable *table, const void *key, size_t len)
+{
+    kventry_t **link = findlink(table, key, len, hashbytes(key, len));
+
+    if (!link) {
+        return 0;
+    }
+
+    kventry_t *curr = *link;
+    *link = curr->next;
+    freeentry(curr);
+
+    table->n--;
+
+    if (table->n < table->s && table->m > KV_SMALL) {
+        growtable(table, table->m >> 1);
+    }
+
+    return 1;
+}
+
+void kv_freetable(struct kvtable *table)
+{
+    int i;
+    kventry_t *curr, *next;
+
+    for (i = 0; i < table->m; i++) {
+        for (curr = table->table[i]; curr; curr = next) {
+            next = curr->next;
+            freeentry(curr);
+        }
+    }
+
+    free(table->table);
+}
@@ -0,0 +1,47 @@
+
+#ifndef _KVTABLE_H
+#define _KVTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* keys up to this many bytes live in the entry, longer ones are malloc'd. */
+#define KV_INLINE 16
+
+/*
+ * The full 64-bit hash is kept in the entry: a chain walk only compares keys
+ * whose hash already matched, and growing the table never rehashes a key.
+ */
+typedef struct kventry {
+    struct kventry *next;
+    uint64_t hash;
+    size_t len;
+    union {
+        uint8_t bytes[KV_INLINE];
+        uint8_t *ptr;
+    } key;
+    void *value;
+} kventry_t;
+
+struct kvtable {
+    int n; /* number of entries. */
+    int m; /* size of table, a power of two. */
+    int g; /* n that triggers growth. */
+    int s; /* n that triggers shrink. */
+    kventry_t **table;
+};
+
+void kv_buildtable(struct kvtable *table, int m);
+/* @return where key's value is stored, or NULL if it isn't in the table. */
+void **kv_lookup(struct kvtable *table, const void *key, size_t len);
+/*
+ * Insert key, or replace its value if it's already there; the key bytes are
+ * copied.
+ * @return 1 if it was inserted, 0 if replaced.
+ */
+int kv_upsert(struct kvtable *table, const void *key, size_t len, void *value);
+/* @return 1 if key was removed, 0 if it wasn't there. */
+int kv_erase(struct kvtable *table, const void *key, size_t len);
+void kv_freetable(struct kvtable *table);
+
+#endif
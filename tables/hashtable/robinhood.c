@@ -0,0 +1,182 @@
+/*
+ * Robin Hood hashing, linear probing where an insert takes the slot of any
+ * key that is closer to its home than the new key is to its own.
+ *
+ * That keeps every run of slots sorted by distance from home, which buys
+ * two things:
+ *
+ *  - a lookup can stop as soon as it reaches a slot whose key is closer to
+ *    home than we'd be at that point; had we been in the table, we'd have
+ *    taken that slot.  Misses end early instead of running to an empty slot.
+ *  - delete needs no tombstones; the keys after the hole shift back one slot
+ *    each (they all get closer to home) until we hit an empty slot or a key
+ *    already at home.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hashfunc.h"
+#include "robinhood.h"
+
+#define RH_SMALL 8
+
+#define HOME(T, V) (murmurmix((uint32_t)(V)) & ((T)->m - 1))
+
+static void rehash(struct rhtable *table, int m);
+
+void rh_buildhashtable(struct rhtable *table, int m)
+{
+    int size = RH_SMALL;
+
+    while (size < m) {
+        size <<= 1;
+    }
+
+    table->n = 0;
+    table->m = size;
+    table->g = size * RH_MAX_LOAD;
+    table->s = size * 0.25;
+    table->slots = calloc(size, sizeof(rhslot_t));
+
+    return;
+}
+
+/* @return the slot holding value, or -1 */
+static int findslot(struct rhtable *table, int value)
+{
+    int mask = table->m - 1;
+    int i = HOME(table, value);
+    int dist = 1;
+
+    for (;;) {
+        rhslot_t *slot = &table->slots[i];
+
+        /* empty (0) or a richer key: we'd have been placed before it. */
+        if (slot->dist < dist) {
+            return -1;
+        }
+        if (slot->dist == dist && slot->value == value) {
+            return i;
+        }
+
+        i = (i + 1) & mask;
+        dist++;
+    }
+}
+
+int rh_search(struct rhtable *table, int value)
+{
+    return findslot(table, value) >= 0;
+}
+
+/*
+ * Place value, unless it's already there.  Until the first swap we're still
+ * walking value's own probe sequence, so the lookup and the insert share one
+ * pass; once we've swapped, value can't be further along.
+ *
+ * @return 1 if placed, 0 if it was already in the table.
+ */
+static int place(struct rhtable *table, int value)
+{
+    int mask = table->m - 1;
+    int i = HOME(table, value);
+    rhslot_t carry = { value, 1 };
+
+    for (;;) {
+        rhslot_t *slot = &table->slots[i];
+
+        if (slot->dist == 0) {
+            *slot = carry;
+            return 1;
+        }
+
+        if (slot->dist == carry.dist && slot->value == carry.value) {
+            return 0;
+        }
+
+        /* take from the rich; the displaced key carries on probing. */
+        if (slot->dist < carry.dist) {
+            rhslot_t tmp = *slot;
+            *slot = carry;
+            carry = tmp;
+        }
+
+        i = (i + 1) & mask;
+        carry.dist++;
+    }
+}
+
+static void rehash(struct rhtable *table, int m)
+{
+    int i;
+    struct rhtable old = *table;
+
+    rh_buildhashtable(table, m);
+
+    for (i = 0; i < old.m; i++) {
+        if (old.slots[i].dist) {
+            place(table, old.slots[i].value);
+        }
+    }
+
+    table->n = old.n;
+
+    rh_freetable(&old);
+
+    return;
+}
+
+void rh_insert(struct rhtable *table, int value)
+{
+    if (!place(table, value)) {
+        return;
+    }
+
+    table->n++;
+
+    if (table->n > table->g) {
+        rehash(table, table->m << 1);
+    }
+
+    return;
+}
+
+void rh_delete(struct rhtable *table, int value)
+{
+    int mask = table->m - 1;
+    int i = findslot(table, value);
+    int next;
+
+    if (i < 0) {
+        return;
+    }
+
+    /* backward shift: pull the followers one step closer to home. */
+    for (;;) {
+        next = (i + 1) & mask;
+        if (table->slots[next].dist <= 1) {
+            break;
+        }
+
+        table->slots[i] = table->slots[next];
+        table->slots[i].dist--;
+        i = next;
+    }
+
+    table->slots[i].dist = 0;
+    table->n--;
+
+    if (table->n < table->s && table->m > RH_SMALL) {
+        rehash(table, table->m >> 1);
+    }
+
+    return;
+}
+
+void rh_freetable(struct rhtable *table)
+{
+    free(table->slots);
+}
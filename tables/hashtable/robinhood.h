@@ -0,0 +1,28 @@
+
+#ifndef _ROBINHOOD_H
+#define _ROBINHOOD_H
+
+/* grows past this load; robin hood keeps probes short right up to it. */
+#define RH_MAX_LOAD 0.9
+
+typedef struct rhslot {
+    int value;
+    int dist; /* probe sequence length + 1, 0 if the slot is empty. */
+} rhslot_t;
+
+struct rhtable {
+    int n; /* number of filled slots. */
+    int m; /* size of table, a power of two. */
+    int g; /* n that triggers growth. */
+    int s; /* n that triggers shrink. */
+    rhslot_t *slots;
+};
+
+/* same contract as the chained table; m is rounded up to a power of two. */
+void rh_buildhashtable(struct rhtable *table, int m);
+int rh_search(struct rhtable *table, int value);
+void rh_insert(struct rhtable *table, int value);
+void rh_delete(struct rhtable *table, int value);
+void rh_freetable(struct rhtable *table);
+
+#endif
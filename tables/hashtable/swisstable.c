@@ -0,0 +1,272 @@
+/*
+ * Open addressing hashtable, swiss table style.
+ *
+ * The hash is split in two: h1 picks the group of 16 slots to start probing
+ * at, and the low 7 bits (h2) are stored in the slot's control byte.  A probe
+ * compares h2 against all 16 control bytes at once, so we only ever touch a
+ * key whose control byte already matched, and an empty byte in the group
+ * ends the search.  The control bytes for a whole group sit in 16 bytes, so a
+ * lookup is usually one line of control bytes plus one line of keys.
+ *
+ * Groups are aligned (slot 0, 16, 32, ...) rather than starting at h1 itself;
+ * that keeps the loads aligned and lets delete tell if a probe could ever
+ * have walked past a group (see swiss_delete).
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hashfunc.h"
+#include "swisstable.h"
+
+/* the table must be larger than this before we'll shrink it. */
+#define SWISS_MIN (SWISS_GROUP * 2)
+
+static void rehash(struct swisstable *table, int m);
+
+#define H1(H) ((H) >> 7)
+#define H2(H) ((int8_t)((H) & 0x7f))
+
+/*
+ * Group match helpers, each returns a 16-bit mask with bit i set if control
+ * byte i matches.
+ */
+#if defined(__SSE2__)
+static inline unsigned
+matchbyte(const int8_t *group, int8_t b)
+{
+    __m128i ctrl = _mm_load_si128((const __m128i *)group);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(b)));
+}
+
+/* empty or deleted, both have the high bit set. */
+static inline unsigned
+matchfree(const int8_t *group)
+{
+    __m128i ctrl = _mm_load_si128((const __m128i *)group);
+    return (unsigned)_mm_movemask_epi8(ctrl);
+}
+#else
+static inline unsigned
+matchbyte(const int8_t *group, int8_t b)
+{
+    int i;
+    unsigned mask = 0;
+
+    for (i = 0; i < SWISS_GROUP; i++) {
+        if (group[i] == b) {
+            mask |= 1u << i;
+        }
+    }
+
+    return mask;
+}
+
+static inline unsigned
+matchfree(const int8_t *group)
+{
+    int i;
+    unsigned mask = 0;
+
+    for (i = 0; i < SWISS_GROUP; i++) {
+        if (group[i] < 0) {
+            mask |= 1u << i;
+        }
+    }
+
+    return mask;
+}
+#endif
+
+/*
+ * Triangular probing over groups; with a power of two group count this
+ * visits every group once before repeating.
+ */
+#define GROUPS(T) ((T)->m / SWISS_GROUP)
+
+/* @return slot index holding value, or -1 */
+static int
+findslot(struct swisstable *table, int value, uint32_t h)
+{
+    int mask = GROUPS(table) - 1;
+    int grp = H1(h) & mask;
+    int step = 0;
+    int8_t h2 = H2(h);
+
+    for (;;) {
+        int base = grp * SWISS_GROUP;
+        const int8_t *ctrl = &table->ctrl[base];
+        unsigned match = matchbyte(ctrl, h2);
+
+        while (match) {
+            int i = __builtin_ctz(match);
+            if (table->slots[base + i] == value) {
+                return base + i;
+            }
+            match &= match - 1;
+        }
+
+        if (matchbyte(ctrl, SWISS_EMPTY)) {
+            return -1;
+        }
+
+        /* every group full and no match; can't happen below the load factor. */
+        if (++step > mask) {
+            return -1;
+        }
+
+        grp = (grp + step) & mask;
+    }
+}
+
+/* first empty or deleted slot in value's probe sequence. */
+static int
+findfree(struct swisstable *table, uint32_t h)
+{
+    int mask = GROUPS(table) - 1;
+    int grp = H1(h) & mask;
+    int step = 0;
+
+    for (;;) {
+        int base = grp * SWISS_GROUP;
+        unsigned avail = matchfree(&table->ctrl[base]);
+
+        if (avail) {
+            return base + __builtin_ctz(avail);
+        }
+
+        step++;
+        assert(step <= mask);
+        grp = (grp + step) & mask;
+    }
+}
+
+void swiss_buildhashtable(struct swisstable *table, int m)
+{
+    int size = SWISS_GROUP;
+
+    while (size < m) {
+        size <<= 1;
+    }
+
+    table->n = 0;
+    table->dead = 0;
+    table->m = size;
+    table->g = size - (size >> 3); /* 7/8 full, counting tombstones. */
+    table->s = size >> 3;
+
+    table->ctrl = aligned_alloc(SWISS_GROUP, size);
+    memset(table->ctrl, SWISS_EMPTY, size);
+    table->slots = malloc(sizeof(int) * size);
+
+    return;
+}
+
+/* Is the key in the table? */
+int swiss_search(struct swisstable *table, int value)
+{
+    return findslot(table, value, murmurmix((uint32_t)value)) >= 0;
+}
+
+/*
+ * Build a fresh table of size m and move everything across; nothing in it is
+ * a duplicate so we skip straight to the free slot search.
+ */
+static void rehash(struct swisstable *table, int m)
+{
+    int i;
+    struct swisstable old = *table;
+
+    swiss_buildhashtable(table, m);
+
+    for (i = 0; i < old.m; i++) {
+        if (old.ctrl[i] >= 0) {
+            int value = old.slots[i];
+            uint32_t h = murmurmix((uint32_t)value);
+            int slot = findfree(table, h);
+
+            table->ctrl[slot] = H2(h);
+            table->slots[slot] = value;
+        }
+    }
+
+    table->n = old.n;
+
+    swiss_freetable(&old);
+
+    return;
+}
+
+void swiss_insert(struct swisstable *table, int value)
+{
+    uint32_t h = murmurmix((uint32_t)value);
+
+    if (findslot(table, value, h) >= 0) {
+        return;
+    }
+
+    int slot = findfree(table, h);
+
+    if (table->ctrl[slot] == SWISS_DELETED) {
+        table->dead--;
+    }
+
+    table->ctrl[slot] = H2(h);
+    table->slots[slot] = value;
+    table->n++;
+
+    if (table->n + table->dead > table->g) {
+        /*
+         * If it's mostly tombstones, the same size clears them out,
+         * otherwise it's really full.
+         */
+        if (table->n > (table->g >> 1)) {
+            rehash(table, table->m << 1);
+        } else {
+            rehash(table, table->m);
+        }
+    }
+
+    return;
+}
+
+void swiss_delete(struct swisstable *table, int value)
+{
+    int slot = findslot(table, value, murmurmix((uint32_t)value));
+    if (slot < 0) {
+        return;
+    }
+
+    /*
+     * Probes only move past a group that has no empty bytes; if this group
+     * still has one, it was never full, so no probe can have walked through
+     * it and the slot can go straight back to empty.
+     */
+    int base = slot & ~(SWISS_GROUP - 1);
+    if (matchbyte(&table->ctrl[base], SWISS_EMPTY)) {
+        table->ctrl[slot] = SWISS_EMPTY;
+    } else {
+        table->ctrl[slot] = SWISS_DELETED;
+        table->dead++;
+    }
+
+    table->n--;
+
+    if (table->n < table->s && table->m > SWISS_MIN) {
+        rehash(table, table->m >> 1);
+    }
+
+    return;
+}
+
+void swiss_freetable(struct swisstable *table)
+{
+    free(table->ctrl);
+    free(table->slots);
+}
@@ -0,0 +1,34 @@
+
+#ifndef _SWISSTABLE_H
+#define _SWISSTABLE_H
+
+#include <stdint.h>
+
+/*
+ * Open addressing with one control byte per slot; slots are probed a group
+ * of 16 at a time (one SSE2 compare per group), swiss table style.
+ */
+#define SWISS_GROUP 16
+
+/* control byte states, anything in [0, 127] is a full slot holding h2. */
+#define SWISS_EMPTY ((int8_t)0x80)
+#define SWISS_DELETED ((int8_t)0xFE)
+
+struct swisstable {
+    int n; /* number of filled slots. */
+    int m; /* size of table, power of two and at least SWISS_GROUP. */
+    int g; /* n + dead that triggers growth (or a rehash in place). */
+    int s; /* n that triggers shrink. */
+    int dead; /* number of tombstones. */
+    int8_t *ctrl; /* m control bytes, 16-byte aligned. */
+    int *slots; /* the keys, slot i is described by ctrl[i]. */
+};
+
+/* same contract as the chained table; m is rounded up to a power of two. */
+void swiss_buildhashtable(struct swisstable *table, int m);
+int swiss_search(struct swisstable *table, int value);
+void swiss_insert(struct swisstable *table, int value);
+void swiss_delete(struct swisstable *table, int value);
+void swiss_freetable(struct swisstable *table);
+
+#endif
@@ -1,14 +1,26 @@
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "hashtable.h"
+#include "swisstable.h"
+#include "conchashtable.h"
+#include "kvtable.h"
+#include "robinhood.h"
+#include "cuckoo.h"
+#include "hashfile.h"
+#include "aggtable.h"
+#include "hashjoin.h"
 
 #define NUM_ELEMENTS(X) (sizeof(X)/sizeof(*X))
 
-int main(void)
+static void test_chained(void)
 {
     int i;
     int input[] = {1, 4, 6, 100, 1000, 234, 12312, 1435, 166, 132409, 111111, 12, 0, 1};
@@ -29,6 +41,851 @@ int main(void)
     assert(ht.n == NUM_ELEMENTS(input)-2);
 
     freetable(&ht);
+}
+
+/* a resize should be spread across the following operations. */
+static void test_incremental(void)
+{
+    int i;
+    struct hashtable ht;
+
+    buildhashtable(&ht, 64);
+
+    for (i = 0; i <= 64 * 0.75; i++) {
+        insert(&ht, i);
+    }
+
+    /* that insert crossed g, so both tables are live for a little while. */
+    assert(ht.m == 128);
+    assert(ht.old != NULL);
+    assert(ht.migrate == MIGRATE_STEP);
+
+    for (i = 0; i <= 64 * 0.75; i++) {
+        assert(search(&ht, i) == 1);
+    }
+    assert(ht.old == NULL);
+
+    for (i = 0; i < 100000; i++) {
+        insert(&ht, i);
+        /* never more than one resize in flight, and it drains on time. */
+        assert(ht.old == NULL || ht.migrate < ht.oldm);
+    }
+    assert(ht.n == 100000);
+
+    for (i = 0; i < 100000; i++) {
+        assert(search(&ht, i) == 1);
+    }
+
+    for (i = 0; i < 100000; i++) {
+        delete(&ht, i);
+    }
+    assert(ht.n == 0);
+    assert(ht.m < 1024);
+
+    freetable(&ht);
+}
+
+/* keys m apart share a chain; unlink from the middle of it. */
+static void test_chaindelete(void)
+{
+    struct hashtable ht;
+
+    buildhashtable(&ht, 64);
+    sethash(&ht, HASH_DIVISION);
+
+    insert(&ht, 5);
+    insert(&ht, 5 + 64);
+    insert(&ht, 5 + 128);
+
+    delete(&ht, 5 + 64);
+    assert(search(&ht, 5 + 64) == 0);
+    assert(search(&ht, 5) == 1);
+    assert(search(&ht, 5 + 128) == 1);
+
+    delete(&ht, 5 + 128);
+    delete(&ht, 5);
+    assert(ht.n == 0);
+    assert(ht.table[5] == NULL);
+
+    freetable(&ht);
+}
+
+/* nodes get recycled rather than going back to malloc. */
+static void test_pool(void)
+{
+    int i;
+    struct hashtable ht;
+    struct poolstats stats;
+
+    buildhashtable(&ht, SMALL_TABLE);
+
+    poolstats(&ht, &stats);
+    assert(stats.chunks == 0);
+
+    for (i = 0; i < POOL_CHUNK; i++) {
+        insert(&ht, i);
+    }
+
+    poolstats(&ht, &stats);
+    assert(stats.chunks == 1);
+    assert(stats.live == POOL_CHUNK);
+    assert(stats.free == 0);
+
+    insert(&ht, POOL_CHUNK);
+    poolstats(&ht, &stats);
+    assert(stats.chunks == 2);
+    assert(stats.free == POOL_CHUNK - 1);
+
+    /* churn inside what's already allocated. */
+    for (i = 0; i < 10 * POOL_CHUNK; i++) {
+        delete(&ht, i);
+        insert(&ht, i + POOL_CHUNK + 1);
+    }
+
+    poolstats(&ht, &stats);
+    assert(stats.chunks == 2);
+    assert(stats.live == ht.n);
+    assert(stats.live + stats.free == 2 * POOL_CHUNK);
+
+    freetable(&ht);
+}
+
+/* every hash function stays in range and gives a working table. */
+static void test_hashkinds(void)
+{
+    int i, k;
+    struct hashtable ht;
+
+    for (k = 0; k < HASH_KINDS; k++) {
+        buildhashtable(&ht, 100);
+        assert(ht.m == 128);
+        sethash(&ht, k);
+
+        for (i = -5000; i < 5000; i++) {
+            int slot = ht.hash(i * 37, ht.m);
+            assert(slot >= 0 && slot < ht.m);
+            insert(&ht, i * 37);
+        }
+        for (i = -5000; i < 5000; i++) {
+            assert(search(&ht, i * 37) == 1);
+            assert(search(&ht, i * 37 + 1) == 0);
+        }
+
+        freetable(&ht);
+    }
+}
+
+/* batched calls agree with the scalar ones, across resizes too. */
+static void test_batch(void)
+{
+    int i;
+    int keys[1000], out[1000];
+    struct hashtable ht;
+
+    for (i = 0; i < NUM_ELEMENTS(keys); i++) {
+        keys[i] = i * 3;
+    }
+
+    buildhashtable(&ht, SMALL_TABLE);
+    insert_many(&ht, keys, 500);
+    assert(ht.n == 500);
+
+    /* 500..999 go in one at a time, half of keys are now duplicates. */
+    for (i = 500; i < NUM_ELEMENTS(keys); i++) {
+        insert(&ht, keys[i]);
+    }
+    insert_many(&ht, keys, NUM_ELEMENTS(keys));
+    assert(ht.n == NUM_ELEMENTS(keys));
+
+    for (i = 0; i < NUM_ELEMENTS(keys); i += 2) {
+        delete(&ht, keys[i]);
+    }
+
+    /* odd counts leave a partial window at the end. */
+    search_many(&ht, keys, NUM_ELEMENTS(keys) - 3, out);
+    for (i = 0; i < NUM_ELEMENTS(keys) - 3; i++) {
+        assert(out[i] == (i & 1));
+        assert(out[i] == search(&ht, keys[i]));
+    }
+
+    freetable(&ht);
+}
+
+static void test_swiss(void)
+{
+    int i;
+    int input[] = {1, 4, 6, 100, 1000, 234, 12312, 1435, 166, 132409, 111111, 12, 0, 1};
+    struct swisstable st;
+
+    swiss_buildhashtable(&st, SMALL_TABLE);
+    assert(st.m == SWISS_GROUP); /* never smaller than a group. */
+
+    for (i = 0; i < NUM_ELEMENTS(input); i++) {
+        swiss_insert(&st, input[i]);
+        assert(swiss_search(&st, input[i]) == 1);
+    }
+
+    assert(st.n == NUM_ELEMENTS(input)-1);
+    assert(st.m == SWISS_GROUP); /* 13 fits under 7/8 of 16. */
+
+    swiss_delete(&st, 4);
+    assert(st.n == NUM_ELEMENTS(input)-2);
+    assert(swiss_search(&st, 4) == 0);
+    assert(swiss_search(&st, 6) == 1);
+
+    /* enough to wrap the probe sequences and leave tombstones behind. */
+    for (i = 0; i < 10000; i++) {
+        swiss_insert(&st, i * 7);
+    }
+    for (i = 0; i < 10000; i += 2) {
+        swiss_delete(&st, i * 7);
+    }
+    for (i = 0; i < 10000; i++) {
+        assert(swiss_search(&st, i * 7) == (i & 1));
+    }
+
+    /* and back down, shrinking as we go. */
+    for (i = 1; i < 10000; i += 2) {
+        swiss_delete(&st, i * 7);
+    }
+    for (i = 0; i < NUM_ELEMENTS(input); i++) {
+        swiss_delete(&st, input[i]);
+    }
+    assert(st.n == 0);
+    assert(st.m < 10000);
+
+    swiss_freetable(&st);
+}
+
+static void test_kv(void)
+{
+    int i;
+    char key[64];
+    long payloads[2000];
+    struct kvtable kt;
+    const char *longkey = "a key that is well past the inline limit";
+
+    kv_buildtable(&kt, 0);
+
+    /* short keys sit inline, long ones out of line; exercise both. */
+    assert(kv_upsert(&kt, "short", 5, &payloads[0]) == 1);
+    assert(kv_upsert(&kt, longkey, strlen(longkey), &payloads[1]) == 1);
+    assert(*kv_lookup(&kt, "short", 5) == &payloads[0]);
+    assert(*kv_lookup(&kt, longkey, strlen(longkey)) == &payloads[1]);
+
+    /* prefixes and empty keys are their own keys. */
+    assert(kv_lookup(&kt, "shor", 4) == NULL);
+    assert(kv_lookup(&kt, longkey, KV_INLINE) == NULL);
+    assert(kv_upsert(&kt, "", 0, &payloads[2]) == 1);
+    assert(*kv_lookup(&kt, "", 0) == &payloads[2]);
+
+    /* upsert replaces, and the pointer lookup hands back can be written. */
+    assert(kv_upsert(&kt, "short", 5, &payloads[3]) == 0);
+    assert(*kv_lookup(&kt, "short", 5) == &payloads[3]);
+    *kv_lookup(&kt, "short", 5) = &payloads[4];
+    assert(*kv_lookup(&kt, "short", 5) == &payloads[4]);
+    assert(kt.n == 3);
+
+    /* enough to grow a few times, half long keys. */
+    for (i = 0; i < NUM_ELEMENTS(payloads); i++) {
+        int len = snprintf(key, sizeof(key),
+                (i & 1) ? "key %d, padded out to a long one" : "k%d", i);
+        payloads[i] = i;
+        assert(kv_upsert(&kt, key, len, &payloads[i]) == 1);
+    }
+    for (i = 0; i < NUM_ELEMENTS(payloads); i++) {
+        int len = snprintf(key, sizeof(key),
+                (i & 1) ? "key %d, padded out to a long one" : "k%d", i);
+        void **v = kv_lookup(&kt, key, len);
+        assert(v && *(long *)*v == i);
+    }
+
+    for (i = 0; i < NUM_ELEMENTS(payloads); i++) {
+        int len = snprintf(key, sizeof(key),
+                (i & 1) ? "key %d, padded out to a long one" : "k%d", i);
+        assert(kv_erase(&kt, key, len) == 1);
+        assert(kv_erase(&kt, key, len) == 0);
+    }
+    assert(kt.n == 3);
+    assert(kv_erase(&kt, longkey, strlen(longkey)) == 1);
+
+    kv_freetable(&kt);
+}
+
+/* every key's dist is its real distance from home, and none can be richer. */
+static void test_rhverify(struct rhtable *rt)
+{
+    int i, n = 0;
+    int mask = rt->m - 1;
+
+    for (i = 0; i < rt->m; i++) {
+        rhslot_t *slot = &rt->slots[i];
+        rhslot_t *prev = &rt->slots[(i - 1) & mask];
+
+        if (!slot->dist) {
+            continue;
+        }
+
+        n++;
+        assert(rh_search(rt, slot->value) == 1);
+        /* a key off its home slot follows one at most one step closer. */
+        assert(slot->dist == 1 || prev->dist >= slot->dist - 1);
+    }
+
+    assert(n == rt->n);
+}
+
+static void test_robinhood(void)
+{
+    int i;
+    struct rhtable rt;
+
+    rh_buildhashtable(&rt, SMALL_TABLE);
+
+    for (i = 0; i < 5000; i++) {
+        rh_insert(&rt, i * 3);
+        rh_insert(&rt, i * 3);
+    }
+    assert(rt.n == 5000);
+    assert(rt.n <= rt.m * RH_MAX_LOAD);
+    test_rhverify(&rt);
+
+    for (i = 0; i < 5000; i++) {
+        assert(rh_search(&rt, i * 3) == 1);
+        assert(rh_search(&rt, i * 3 + 1) == 0);
+    }
+
+    /* churn at a fixed size, deletes shift the clusters back. */
+    for (i = 0; i < 5000; i += 2) {
+        rh_delete(&rt, i * 3);
+        rh_insert(&rt, -i - 1);
+    }
+    test_rhverify(&rt);
+    for (i = 0; i < 5000; i++) {
+        assert(rh_search(&rt, i * 3) == (i & 1));
+    }
+
+    for (i = 0; i < 5000; i++) {
+        rh_delete(&rt, i * 3);
+        rh_delete(&rt, -i - 1);
+    }
+    assert(rt.n == 0);
+    assert(rt.m == SMALL_TABLE);
+
+    rh_freetable(&rt);
+}
+
+static void test_cuckoo(void)
+{
+    int i, b, w, n;
+    struct cktable ct;
+
+    ck_buildhashtable(&ct, SMALL_TABLE);
+    assert(ct.m == SMALL_TABLE / CK_WAYS);
+    assert(sizeof(ckbucket_t) == 32);
+
+    for (i = 0; i < 20000; i++) {
+        ck_insert(&ct, i * 5);
+        ck_insert(&ct, i * 5);
+    }
+    assert(ct.n == 20000);
+
+    /* everything is in one of its two buckets or the stash, once. */
+    n = ct.stashn;
+    for (b = 0; b < ct.m; b++) {
+        for (w = 0; w < CK_WAYS; w++) {
+            n += (ct.buckets[b].used >> w) & 1;
+        }
+    }
+    assert(n == ct.n);
+
+    for (i = 0; i < 20000; i++) {
+        assert(ck_search(&ct, i * 5) == 1);
+        assert(ck_search(&ct, i * 5 + 2) == 0);
+    }
+
+    /*
+     * With growth held off, filling every slot pushes keys into the stash,
+     * and once that's full the homeless key forces the table to grow.
+     */
+    struct cktable small;
+    int stashed = 0;
+    ck_buildhashtable(&small, 64);
+    small.g = 1 << 30;
+    for (i = 0; i < 1000; i++) {
+        ck_insert(&small, i << 16);
+        assert(ck_search(&small, i << 16) == 1);
+        if (small.stashn) {
+            stashed = 1;
+        }
+    }
+    assert(stashed);
+    assert(small.m > 64 / CK_WAYS);
+    for (i = 0; i < 1000; i++) {
+        assert(ck_search(&small, i << 16) == 1);
+        ck_delete(&small, i << 16);
+        assert(ck_search(&small, i << 16) == 0);
+    }
+    assert(small.n == 0);
+    ck_freetable(&small);
+
+    for (i = 0; i < 20000; i += 2) {
+        ck_delete(&ct, i * 5);
+    }
+    for (i = 0; i < 20000; i++) {
+        assert(ck_search(&ct, i * 5) == (i & 1));
+    }
+    for (i = 1; i < 20000; i += 2) {
+        ck_delete(&ct, i * 5);
+    }
+    assert(ct.n == 0);
+    assert(ct.m == 2);
+
+    ck_freetable(&ct);
+}
+
+#define CONC_KEYS 20000
+#define CONC_WRITERS 4
+
+static struct conchashtable ctable;
+static atomic_int writersdone;
+
+/* a saved table answers the same from its file, even saved mid-resize. */
+static void test_hashfile(void)
+{
+    int i, fd;
+    struct hashtable ht;
+    struct hashfile hf;
+    const char *path = "test_hashfile.tbl";
+    uint32_t junk = 0x12345678;
+    uint32_t offsets[2] = {0, 0};
+    struct hashfileheader hdr;
+
+    buildhashtable(&ht, 64);
+    sethash(&ht, HASH_TABULATION);
+
+    for (i = 0; i <= 64 * 0.75; i++) {
+        insert(&ht, i * 3);
+    }
+    assert(ht.old != NULL);
+
+    assert(hashfile_save(&ht, path) == 0);
+    assert(hashfile_open(&hf, path) == 0);
+    assert(hashfile_verify(&hf) == 1);
+    assert(hf.hdr->n == ht.n && hf.m == ht.m);
+
+    for (i = 0; i <= 64 * 0.75 * 3; i++) {
+        assert(hashfile_search(&hf, i) == search(&ht, i));
+    }
+    hashfile_close(&hf);
+
+    /* flip a key; the header still looks right, the checksum doesn't. */
+    fd = open(path, O_WRONLY);
+    assert(pwrite(fd, &junk, sizeof(junk),
+                sizeof(struct hashfileheader) + 4 * (ht.m + 1)) == 4);
+    close(fd);
+    assert(hashfile_open(&hf, path) == 0);
+    assert(hashfile_verify(&hf) == 0);
+    hashfile_close(&hf);
+
+    /* and a truncated file isn't opened at all. */
+    assert(truncate(path, 20) == 0);
+    assert(hashfile_open(&hf, path) == -1 && errno == EINVAL);
+
+    /* nor is a table smaller than any we save, checksum and all. */
+    memset(&hdr, 0x00, sizeof(hdr));
+    hdr.magic = HASHFILE_MAGIC;
+    hdr.version = HASHFILE_VERSION;
+    hdr.kind = HASH_FIBONACCI;
+    hdr.m = 1;
+    hdr.checksum = hashbytes(offsets, sizeof(offsets));
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(write(fd, &hdr, sizeof(hdr)) == sizeof(hdr));
+    assert(write(fd, offsets, sizeof(offsets)) == sizeof(offsets));
+    close(fd);
+    assert(hashfile_open(&hf, path) == -1 && errno == EINVAL);
+    assert(hashfuncs[HASH_FIBONACCI](-1, 1) == 0);
+
+    unlink(path);
+    freetable(&ht);
+}
+
+/* the histogram is always there; the counters only in a stats build. */
+static void test_stats(void)
+{
+    int i, out[4];
+    int keys[] = {0, 8, 16, 99};
+    struct hashtable ht;
+    struct hashstats stats;
+
+    buildhashtable(&ht, SMALL_TABLE);
+    sethash(&ht, HASH_DIVISION);
+
+    /* one chain of three, one of one, the rest empty. */
+    insert(&ht, 0);
+    insert(&ht, 8);
+    insert(&ht, 16);
+    insert(&ht, 3);
+
+    hashstats(&ht, &stats);
+    assert(stats.maxchain == 3);
+    assert(stats.chains[0] == SMALL_TABLE - 2);
+    assert(stats.chains[1] == 1 && stats.chains[3] == 1);
+
+#ifdef HASHTABLE_STATS
+    assert(stats.lookups == 0 && stats.grows == 0);
+    /* each insert walked the chain it went on. */
+    assert(stats.walks == 4 && stats.walked == 0 + 1 + 2 + 0);
+#endif
+
+    assert(search(&ht, 0) == 1); /* at the tail, 3 nodes. */
+    assert(search(&ht, 24) == 0); /* whole chain, 3 nodes. */
+    search_many(&ht, keys, NUM_ELEMENTS(keys), out);
+    assert(out[0] && out[1] && out[2] && !out[3]);
+
+#ifdef HASHTABLE_STATS
+    hashstats(&ht, &stats);
+    assert(stats.lookups == 6 && stats.hits == 4 && stats.misses == 2);
+    /* the inserts' 3, then 0 and 24 both walk 3, and 3+2+1 and 1 for 99. */
+    assert(stats.walks == 10 && stats.walked == 3 + 3 + 3 + 3 + 2 + 1 + 1);
+    assert(stats.maxwalk == 3);
+#endif
+
+    for (i = 100; i < 100 + SMALL_TABLE; i++) {
+        insert(&ht, i);
+    }
+    for (i = 100; i < 100 + SMALL_TABLE; i++) {
+        delete(&ht, i);
+    }
+    delete(&ht, 0); /* down to 3 of 16, under s. */
+
+    hashstats(&ht, &stats);
+#ifdef HASHTABLE_STATS
+    assert(stats.avgwalk == (double)stats.walked / stats.walks);
+    assert(stats.grows == 1 && stats.shrinks == 1);
+    assert(stats.resizens > 0);
+#else
+    assert(stats.lookups == 0 && stats.walks == 0 && stats.resizens == 0);
+#endif
+
+    freetable(&ht);
+}
+
+/* the filter may let a miss through but must never turn a hit away. */
+static void test_filter(void)
+{
+    int i, out[64];
+    int keys[64];
+    struct hashtable ht;
+    struct filterstats fs;
+
+    buildhashtable(&ht, SMALL_TABLE);
+    for (i = 0; i < 100; i++) {
+        insert(&ht, i);
+    }
+
+    /* turned on part way, and grown through while on. */
+    setfilter(&ht, 1);
+    for (i = 100; i < 5000; i++) {
+        insert(&ht, i);
+        assert(search(&ht, i - 100) == 1);
+    }
+    for (i = 0; i < 5000; i++) {
+        assert(search(&ht, i) == 1);
+    }
+
+    /* shrink it back down through the deletes. */
+    for (i = 0; i < 4900; i++) {
+        delete(&ht, i);
+        assert(search(&ht, i) == 0);
+        assert(search(&ht, i + 1) == 1);
+    }
+    assert(ht.n == 100 && ht.m < 1024);
+
+    for (i = 0; i < 64; i++) {
+        keys[i] = 4900 + i * 3;
+    }
+    search_many(&ht, keys, 64, out);
+    for (i = 0; i < 64; i++) {
+        assert(out[i] == (keys[i] < 5000));
+    }
+
+    setfilter(&ht, 0);
+    setfilter(&ht, 1);
+    for (i = 10000; i < 20000; i++) {
+        assert(search(&ht, i) == 0);
+    }
+
+    filterstats(&ht, &fs);
+    assert(fs.rejected + fs.falsepos == 10000);
+    assert(fs.fpr < 0.05 && fs.estimate < 0.05);
+    assert(fs.bytes >= BLOOM_BLOCK);
+
+    /* churn at a steady size never resizes, but mustn't clog the filter. */
+    for (i = 0; i < 200000; i++) {
+        insert(&ht, 100000 + i);
+        delete(&ht, 100000 + i - (i >= 50 ? 50 : 0));
+    }
+    filterstats(&ht, &fs);
+    assert(fs.estimate < 0.05);
+    assert(ht.filter->added <= 2L * ht.n || ht.filter->added <= ht.g);
+    for (i = 0; i < 100; i++) {
+        assert(search(&ht, 4900 + i) == 1);
+    }
+
+    freetable(&ht);
+}
+
+/* presized once, nothing left to grow or migrate. */
+static void test_buildarray(void)
+{
+    int i, keys[1000];
+    struct hashtable ht;
+
+    for (i = 0; i < 1000; i++) {
+        keys[i] = i * 7;
+    }
+
+    buildhashtable(&ht, SMALL_TABLE);
+    sethash(&ht, HASH_MURMUR);
+    build_from_array(&ht, keys, 1000);
+    assert(ht.n == 1000 && ht.m == 2048 && ht.old == NULL);
+
+    for (i = 0; i < 7000; i++) {
+        assert(search(&ht, i) == (i % 7 == 0));
+    }
+
+    /* and it's an ordinary table afterwards. */
+    insert(&ht, 1);
+    delete(&ht, 0);
+    assert(ht.n == 1000 && search(&ht, 1) && !search(&ht, 0));
+
+    freetable(&ht);
+}
+
+static void test_agg(void)
+{
+    int i, t, n = 100000;
+    int *keys = malloc(sizeof(int) * n);
+    int *values = malloc(sizeof(int) * n);
+    struct aggtable serial, par;
+    aggslot_t *a, *b;
+
+    /* key k shows up for rows k, k + 1000, ...; value is the row. */
+    for (i = 0; i < n; i++) {
+        keys[i] = (i % 1000) * 13;
+        values[i] = i;
+    }
+
+    agg_build(&serial, 0);
+    agg_many(&serial, keys, values, n);
+    assert(serial.n == 1000);
+    a = agg_find(&serial, 13 * 5);
+    assert(a->count == n / 1000);
+    /* 5 + 1005 + ... + 99005 */
+    assert(a->sum == 5L * 100 + 1000L * (99 * 100 / 2));
+    assert(agg_find(&serial, 1) == NULL);
+
+    for (t = 1; t <= 5; t += 2) {
+        agg_build(&par, 0);
+        agg_parallel(&par, keys, values, n, t);
+        assert(par.n == serial.n);
+        for (i = 0; i < 1000; i++) {
+            a = agg_find(&serial, i * 13);
+            b = agg_find(&par, i * 13);
+            assert(b && b->count == a->count && b->sum == a->sum);
+        }
+        agg_free(&par);
+    }
+
+    /* counting only. */
+    agg_build(&par, 0);
+    agg_parallel(&par, keys, NULL, n, 4);
+    assert(agg_find(&par, 0)->count == 100 && agg_find(&par, 0)->sum == 0);
+    agg_free(&par);
+
+    agg_free(&serial);
+    free(keys);
+    free(values);
+}
+
+static int cmppair(const void *a, const void *b)
+{
+    const long *x = a, *y = b;
+
+    return (*x > *y) - (*x < *y);
+}
+
+/* every join type and thread count against the nested loop answer. */
+static void test_join(void)
+{
+    int i, j, t, type, nb = 3000, np = 5000;
+    int *build = malloc(sizeof(int) * nb);
+    int *probe = malloc(sizeof(int) * np);
+    long *want = malloc(sizeof(long) * np * 4);
+    long *got;
+    long nwant;
+    struct joinresult jr;
+
+    /* build keys repeat (0..999, three times); half the probes miss. */
+    for (i = 0; i < nb; i++) {
+        build[i] = (i % 1000) * 2;
+    }
+    for (i = 0; i < np; i++) {
+        probe[i] = i % 4000;
+    }
+
+    for (type = JOIN_INNER; type <= JOIN_ANTI; type++) {
+        nwant = 0;
+        for (j = 0; j < np; j++) {
+            int found = 0;
+            for (i = 0; i < nb; i++) {
+                if (build[i] == probe[j]) {
+                    found++;
+                    if (type == JOIN_INNER) {
+                        want[nwant++] = (long)i * np + j;
+                    }
+                }
+            }
+            if ((type == JOIN_SEMI && found) || (type == JOIN_ANTI && !found)) {
+                want[nwant++] = j;
+            }
+        }
+        qsort(want, nwant, sizeof(long), cmppair);
+
+        for (t = 1; t <= 4; t++) {
+            hashjoin(type, build, nb, probe, np, t, &jr);
+            assert(jr.n == nwant);
+
+            got = malloc(sizeof(long) * (jr.n + 1));
+            for (i = 0; i < jr.n; i++) {
+                got[i] = type == JOIN_INNER ?
+                    (long)jr.left[i] * np + jr.right[i] : jr.right[i];
+            }
+            qsort(got, jr.n, sizeof(long), cmppair);
+            assert(memcmp(got, want, sizeof(long) * jr.n) == 0);
+
+            free(got);
+            joinresult_free(&jr);
+        }
+    }
+
+    /* an empty build side: nothing joins, everything is anti. */
+    hashjoin(JOIN_INNER, build, 0, probe, np, 2, &jr);
+    assert(jr.n == 0);
+    joinresult_free(&jr);
+    hashjoin(JOIN_ANTI, build, 0, probe, np, 2, &jr);
+    assert(jr.n == np);
+    joinresult_free(&jr);
+
+    free(build);
+    free(probe);
+    free(want);
+}
+
+/* each writer owns its own range; grows and shrinks the table. */
+static void *test_concwriter(void *arg)
+{
+    int i, round;
+    int base = (int)(long)arg * CONC_KEYS;
+
+    for (round = 0; round < 3; round++) {
+        for (i = 0; i < CONC_KEYS; i++) {
+            conc_insert(&ctable, base + i);
+        }
+        for (i = 0; i < CONC_KEYS; i++) {
+            assert(conc_search(&ctable, base + i) == 1);
+        }
+        for (i = 0; i < CONC_KEYS; i += 2) {
+            conc_delete(&ctable, base + i);
+        }
+        for (i = 0; i < CONC_KEYS; i++) {
+            assert(conc_search(&ctable, base + i) == (i & 1));
+        }
+        for (i = 1; i < CONC_KEYS; i += 2) {
+            conc_delete(&ctable, base + i);
+        }
+    }
+
+    atomic_fetch_add(&writersdone, 1);
+    return NULL;
+}
+
+/* the negative keys are never touched, they must never go missing. */
+static void *test_concreader(void *arg)
+{
+    int i;
+
+    while (atomic_load(&writersdone) < CONC_WRITERS) {
+        for (i = 1; i <= 1000; i++) {
+            assert(conc_search(&ctable, -i) == 1);
+        }
+    }
+
+    return NULL;
+}
+
+/* one lookup from a thread that then exits, giving up its slot. */
+static void *test_concshort(void *arg)
+{
+    assert(conc_search(&ctable, -1) == 1);
+
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    int i;
+    pthread_t threads[CONC_WRITERS + 2];
+
+    conc_buildhashtable(&ctable, SMALL_TABLE);
+    assert(conc_size(&ctable) == CONC_STRIPES);
+
+    for (i = 1; i <= 1000; i++) {
+        conc_insert(&ctable, -i);
+    }
+
+    for (i = 0; i < CONC_WRITERS; i++) {
+        pthread_create(&threads[i], NULL, test_concwriter, (void *)(long)i);
+    }
+    for (; i < NUM_ELEMENTS(threads); i++) {
+        pthread_create(&threads[i], NULL, test_concreader, NULL);
+    }
+    for (i = 0; i < NUM_ELEMENTS(threads); i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    assert(conc_count(&ctable) == 1000);
+    assert(conc_size(&ctable) < CONC_WRITERS * CONC_KEYS);
+
+    /* far more threads than slots, so long as they come and go. */
+    for (i = 0; i < 4 * CONC_THREADS; i++) {
+        pthread_create(&threads[0], NULL, test_concshort, NULL);
+        pthread_join(threads[0], NULL);
+    }
+
+    conc_freetable(&ctable);
+}
+
+int main(void)
+{
+    test_chained();
+    test_incremental();
+    test_chaindelete();
+    test_pool();
+    test_hashkinds();
+    test_batch();
+    test_concurrent();
+    test_kv();
+    test_robinhood();
+    test_cuckoo();
+    test_swiss();
+    test_hashfile();
+    test_stats();
+    test_filter();
+    test_buildarray();
+    test_agg();
+    test_join();
 
     return 0;
 }
@@ -0,0 +1,566 @@
+/*
+ * YCSB style workloads against every single threaded engine.
+ *
+ * usage: ./ycsb [-e engines] [-w workloads] [-d distributions] [-s sizes]
+ *               [-n ops] [-z theta]
+ *
+ *   -e  chained,swiss,robinhood,cuckoo           (default all)
+ *   -w  any of ABCDEF                            (default ABCDEF)
+ *   -d  uniform,zipfian,sequential               (default all)
+ *   -s  l1,l2,llc,10llc                          (default l1,l2,llc)
+ *   -n  operations per run                       (default 1M)
+ *   -z  zipfian skew                             (default 0.99)
+ *
+ * A size is how many records fill that cache level at YCSB_KEY_BYTES each,
+ * from sysconf, so l1 is cache resident and 10llc is mostly DRAM.  Records
+ * are numbered, and a record's key is murmurmix of its number (a bijection,
+ * so keys are distinct), the way YCSB hashes its keys.  The distribution
+ * picks record numbers.  Bytes per key are taken at the end of the run, over
+ * the records there are by then.
+ *
+ * The mixes, a set having nothing to update in place:
+ *
+ *   A  50% read, 50% update            update is delete + re-insert
+ *   B  95% read, 5% update
+ *   C  100% read
+ *   D  95% read, 5% insert             reads lean to the newest records
+ *   E  95% scan, 5% insert             scan is YCSB_SCAN reads of
+ *                                      consecutive records, no order here
+ *   F  50% read, 50% read-modify-write search, delete, re-insert
+ *
+ * Each run loads the records, then plays the same pregenerated operations
+ * twice on fresh tables: once untimed for throughput, once timing every
+ * operation for the percentiles (clock cost removed).
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hashtable.h"
+#include "swisstable.h"
+#include "robinhood.h"
+#include "cuckoo.h"
+
+#define NUM_ELEMENTS(X) (sizeof(X)/sizeof(*X))
+
+/* what a record is assumed to cost when sizing runs by cache level. */
+#define YCSB_KEY_BYTES 16
+/* records per scan in workload E. */
+#define YCSB_SCAN 10
+
+enum optype {
+    OP_READ,
+    OP_UPDATE,
+    OP_INSERT,
+    OP_SCAN,
+    OP_RMW,
+};
+
+typedef struct op {
+    int type;
+    int record;
+} op_t;
+
+struct workload {
+    char name;
+    int readpct; /* the rest is other. */
+    enum optype other;
+    int latest; /* reads pick from the newest records. */
+};
+
+static const struct workload workloads[] = {
+    { 'A', 50, OP_UPDATE, 0 },
+    { 'B', 95, OP_UPDATE, 0 },
+    { 'C', 100, OP_READ, 0 },
+    { 'D', 95, OP_INSERT, 1 },
+    { 'E', 0, OP_INSERT, 0 }, /* 95% scans, below. */
+    { 'F', 50, OP_RMW, 0 },
+};
+
+enum dist {
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_SEQUENTIAL,
+    DISTS,
+};
+
+static const char *distnames[DISTS] = {
+    [DIST_UNIFORM] = "uniform",
+    [DIST_ZIPFIAN] = "zipfian",
+    [DIST_SEQUENTIAL] = "sequential",
+};
+
+/*
+ * Every engine behind the same calls, so the runs are identical but for the
+ * table.  bytes is what the table holds right now, whatever it's for.
+ */
+struct engine {
+    const char *name;
+    void (*build)(void *table);
+    int (*search)(void *table, int key);
+    void (*insert)(void *table, int key);
+    void (*delete)(void *table, int key);
+    long (*bytes)(void *table);
+    void (*free)(void *table);
+};
+
+static void chained_build(void *t) { buildhashtable(t, SMALL_TABLE); }
+static int chained_search(void *t, int k) { return search(t, k); }
+static void chained_insert(void *t, int k) { insert(t, k); }
+static void chained_delete(void *t, int k) { delete(t, k); }
+static void chained_free(void *t) { freetable(t); }
+
+static long chained_bytes(void *t)
+{
+    struct hashtable *ht = t;
+    struct poolstats ps;
+
+    poolstats(ht, &ps);
+
+    return ps.bytes + sizeof(list_t *) * ((long)ht->m + ht->oldm);
+}
+
+static void swiss_build(void *t) { swiss_buildhashtable(t, SWISS_GROUP); }
+static int swiss_search_(void *t, int k) { return swiss_search(t, k); }
+static void swiss_insert_(void *t, int k) { swiss_insert(t, k); }
+static void swiss_delete_(void *t, int k) { swiss_delete(t, k); }
+static void swiss_free(void *t) { swiss_freetable(t); }
+
+static long swiss_bytes(void *t)
+{
+    return (long)((struct swisstable *)t)->m * (sizeof(int8_t) + sizeof(int));
+}
+
+static void rh_build(void *t) { rh_buildhashtable(t, 8); }
+static int rh_search_(void *t, int k) { return rh_search(t, k); }
+static void rh_insert_(void *t, int k) { rh_insert(t, k); }
+static void rh_delete_(void *t, int k) { rh_delete(t, k); }
+static void rh_free(void *t) { rh_freetable(t); }
+
+static long rh_bytes(void *t)
+{
+    return (long)((struct rhtable *)t)->m * sizeof(rhslot_t);
+}
+
+static void ck_build(void *t) { ck_buildhashtable(t, 8); }
+static int ck_search_(void *t, int k) { return ck_search(t, k); }
+static void ck_insert_(void *t, int k) { ck_insert(t, k); }
+static void ck_delete_(void *t, int k) { ck_delete(t, k); }
+static void ck_free(void *t) { ck_freetable(t); }
+
+static long ck_bytes(void *t)
+{
+    return (long)((struct cktable *)t)->m * sizeof(ckbucket_t);
+}
+
+static const struct engine engines[] = {
+    { "chained", chained_build, chained_search, chained_insert,
+        chained_delete, chained_bytes, chained_free },
+    { "swiss", swiss_build, swiss_search_, swiss_insert_, swiss_delete_,
+        swiss_bytes, swiss_free },
+    { "robinhood", rh_build, rh_search_, rh_insert_, rh_delete_, rh_bytes,
+        rh_free },
+    { "cuckoo", ck_build, ck_search_, ck_insert_, ck_delete_, ck_bytes,
+        ck_free },
+};
+
+/* big enough for any of them. */
+union anytable {
+    struct hashtable chained;
+    struct swisstable swiss;
+    struct rhtable rh;
+    struct cktable ck;
+};
+
+struct size {
+    const char *name;
+    int level; /* sysconf cache level, 3 for the last one. */
+    int times;
+};
+
+static const struct size sizes[] = {
+    { "l1", 1, 1 },
+    { "l2", 2, 1 },
+    { "llc", 3, 1 },
+    { "10llc", 3, 10 },
+};
+
+static uint64_t
+xorshift(uint64_t *x)
+{
+    *x ^= *x >> 12;
+    *x ^= *x << 25;
+    *x ^= *x >> 27;
+
+    return *x * 0x2545f4914f6cdd1dull;
+}
+
+/* uniform in [0, 1) */
+static double
+unit(uint64_t *x)
+{
+    return (xorshift(x) >> 11) * (1.0 / (1ull << 53));
+}
+
+static inline int
+keyof(int record)
+{
+    return (int)murmurmix((uint32_t)record);
+}
+
+/*
+ * Zipfian over [0, n), Gray et al.'s method as YCSB does it: zeta(n) is a
+ * sum over every item, paid once per n, then each draw is O(1).
+ */
+struct zipf {
+    long n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double half; /* 1 + 0.5^theta */
+};
+
+static double
+zeta(long n, double theta)
+{
+    long i;
+    double sum = 0;
+
+    for (i = 1; i <= n; i++) {
+        sum += 1 / pow(i, theta);
+    }
+
+    return sum;
+}
+
+static void
+zipfinit(struct zipf *z, long n, double theta)
+{
+    double zeta2 = zeta(2, theta);
+
+    z->n = n;
+    z->theta = theta;
+    z->zetan = zeta(n, theta);
+    z->alpha = 1 / (1 - theta);
+    z->eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / z->zetan);
+    z->half = 1 + pow(0.5, theta);
+}
+
+/*
+ * The record count grows under D and E, but draws stay over the original n;
+ * a few percent more records barely moves the skew.
+ */
+static long
+zipfnext(struct zipf *z, uint64_t *x)
+{
+    double u = unit(x);
+    double uz = u * z->zetan;
+
+    if (uz < 1) {
+        return 0;
+    }
+    if (uz < z->half) {
+        return 1;
+    }
+
+    return (long)(z->n * pow(z->eta * u - z->eta + 1, z->alpha));
+}
+
+/* a record number in [0, records) */
+static int
+pick(enum dist dist, struct zipf *z, long *seq, int records, uint64_t *x)
+{
+    switch (dist) {
+    case DIST_ZIPFIAN:
+        return zipfnext(z, x) % records;
+    case DIST_SEQUENTIAL:
+        return (*seq)++ % records;
+    default:
+        return xorshift(x) % records;
+    }
+}
+
+/*
+ * The whole run's operations, so generating them isn't what we time.
+ * @return records in the table once they've all been played.
+ */
+static int
+makeops(op_t *ops, int nops, const struct workload *w, enum dist dist,
+        struct zipf *z, int records)
+{
+    int i, r;
+    long seq = 0;
+    uint64_t x = 88172645463325252ull;
+    int total = records;
+
+    for (i = 0; i < nops; i++) {
+        int roll = xorshift(&x) % 100;
+
+        if (w->name == 'E') {
+            ops[i].type = roll < 95 ? OP_SCAN : OP_INSERT;
+        } else {
+            ops[i].type = roll < w->readpct ? OP_READ : w->other;
+        }
+
+        if (ops[i].type == OP_INSERT) {
+            ops[i].record = total++;
+            continue;
+        }
+
+        r = pick(dist, z, &seq, total, &x);
+        if (w->latest) {
+            r = total - 1 - r;
+        }
+        if (ops[i].type == OP_SCAN && r > total - YCSB_SCAN) {
+            r = total - YCSB_SCAN;
+        }
+        ops[i].record = r;
+    }
+
+    return total;
+}
+
+static int
+play(const struct engine *e, void *t, const op_t *op)
+{
+    int i, found = 0;
+    int key = keyof(op->record);
+
+    switch (op->type) {
+    case OP_READ:
+        return e->search(t, key);
+    case OP_UPDATE:
+        e->delete(t, key);
+        e->insert(t, key);
+        return 1;
+    case OP_INSERT:
+        e->insert(t, key);
+        return 1;
+    case OP_SCAN:
+        for (i = 0; i < YCSB_SCAN; i++) {
+            found += e->search(t, keyof(op->record + i));
+        }
+        return found == YCSB_SCAN;
+    default:
+        found = e->search(t, key);
+        e->delete(t, key);
+        e->insert(t, key);
+        return found;
+    }
+}
+
+static void
+load(const struct engine *e, void *t, int records)
+{
+    int i;
+
+    e->build(t);
+    for (i = 0; i < records; i++) {
+        e->insert(t, keyof(i));
+    }
+}
+
+static long
+clockcost(void)
+{
+    int i;
+    long best = 1000000;
+    struct timespec a, b;
+
+    for (i = 0; i < 10000; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        long d = (b.tv_sec - a.tv_sec) * 1000000000L + (b.tv_nsec - a.tv_nsec);
+        if (d < best) {
+            best = d;
+        }
+    }
+
+    return best;
+}
+
+static int
+cmplong(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void
+run(const struct engine *e, const struct workload *w, enum dist dist,
+        const struct size *size, int records, int final, const op_t *ops,
+        int nops, long *lat, long overhead)
+{
+    int i, found = 0;
+    double pcts[] = {50, 90, 99, 99.9};
+    union anytable t;
+    struct timespec a, b;
+    double secs;
+    long bytes;
+
+    load(e, &t, records);
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (i = 0; i < nops; i++) {
+        found += play(e, &t, &ops[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    secs = (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+    bytes = e->bytes(&t);
+    e->free(&t);
+
+    load(e, &t, records);
+    for (i = 0; i < nops; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        found -= play(e, &t, &ops[i]);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        lat[i] = (b.tv_sec - a.tv_sec) * 1000000000L +
+            (b.tv_nsec - a.tv_nsec) - overhead;
+    }
+    e->free(&t);
+
+    /* both passes saw the same table, so the same answers. */
+    assert(found == 0);
+
+    qsort(lat, nops, sizeof(long), cmplong);
+
+    printf("%-10s %c %-10s %-6s %10d %8.2f", e->name, w->name,
+            distnames[dist], size->name, records, nops / secs / 1e6);
+    for (i = 0; i < NUM_ELEMENTS(pcts); i++) {
+        printf(" %7ld", lat[(int)(nops * pcts[i] / 100)]);
+    }
+    printf(" %8ld %6.1f\n", lat[nops - 1], (double)bytes / final);
+}
+
+static long
+cachebytes(int level)
+{
+    long b = -1;
+
+    switch (level) {
+    case 1:
+        b = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+        break;
+    case 2:
+        b = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        break;
+    default:
+        b = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (b <= 0) {
+            b = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        }
+        break;
+    }
+
+    /* the usual sizes, when the system won't say. */
+    if (b <= 0) {
+        b = level == 1 ? 32 << 10 : level == 2 ? 1 << 20 : 32 << 20;
+    }
+
+    return b;
+}
+
+/* is name in the comma separated list? */
+static int
+listed(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = list;
+
+    while ((p = strstr(p, name))) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || !p[len])) {
+            return 1;
+        }
+        p += len;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, d, s, w, records, final;
+    int nops = 1 << 20;
+    double theta = 0.99;
+    const char *elist = "chained,swiss,robinhood,cuckoo";
+    const char *wlist = "ABCDEF";
+    const char *dlist = "uniform,zipfian,sequential";
+    const char *slist = "l1,l2,llc";
+    long overhead = clockcost();
+
+    while ((c = getopt(argc, argv, "e:w:d:s:n:z:")) != -1) {
+        switch (c) {
+        case 'e': elist = optarg; break;
+        case 'w': wlist = optarg; break;
+        case 'd': dlist = optarg; break;
+        case 's': slist = optarg; break;
+        case 'n': nops = atoi(optarg); break;
+        case 'z': theta = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-e engines] [-w workloads] "
+                    "[-d distributions] [-s sizes] [-n ops] [-z theta]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    op_t *ops = malloc(sizeof(op_t) * nops);
+    long *lat = malloc(sizeof(long) * nops);
+
+    printf("%d ops per run, latency in ns (clock cost %ld ns removed)\n\n",
+            nops, overhead);
+    printf("%-10s %c %-10s %-6s %10s %8s %7s %7s %7s %7s %8s %6s\n",
+            "engine", 'W', "dist", "size", "records", "Mops/s", "p50", "p90",
+            "p99", "p99.9", "max", "B/key");
+
+    for (s = 0; s < NUM_ELEMENTS(sizes); s++) {
+        if (!listed(slist, sizes[s].name)) {
+            continue;
+        }
+
+        long want = cachebytes(sizes[s].level) * sizes[s].times /
+            YCSB_KEY_BYTES;
+        records = want > INT_MAX / 4 ? INT_MAX / 4 : want;
+        if (records < YCSB_SCAN) {
+            records = YCSB_SCAN;
+        }
+
+        struct zipf z = { 0 };
+        if (listed(dlist, distnames[DIST_ZIPFIAN])) {
+            zipfinit(&z, records, theta);
+        }
+
+        for (w = 0; w < NUM_ELEMENTS(workloads); w++) {
+            if (!strchr(wlist, workloads[w].name)) {
+                continue;
+            }
+            for (d = 0; d < DISTS; d++) {
+                if (!listed(dlist, distnames[d])) {
+                    continue;
+                }
+
+                final = makeops(ops, nops, &workloads[w], d, &z, records);
+
+                for (i = 0; i < NUM_ELEMENTS(engines); i++) {
+                    if (listed(elist, engines[i].name)) {
+                        run(&engines[i], &workloads[w], d, &sizes[s],
+                                records, final, ops, nops, lat, overhead);
+                    }
+                }
+            }
+        }
+    }
+
+    free(ops);
+    free(lat);
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Per-tree block arena.
+ *
+ * Every block in a tree is the same size, so there's no need for malloc to
+ * find one, keep a header on it, or be told about each one when the tree
+ * goes.  Blocks come out of ARENA_CHUNK sized chunks in order, and the ones
+ * given back are kept on a stack of slot numbers.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+void arenaInit(struct arena *arena, size_t size)
+{
+    memset(arena, 0x00, sizeof(*arena));
+
+    arena->size = (size + 7) & ~(size_t)7;
+    arena->perChunk = ARENA_CHUNK / arena->size;
+    if (arena->perChunk < ARENA_MIN) {
+        arena->perChunk = ARENA_MIN;
+    }
+}
+
+void *arenaAlloc(struct arena *arena, int *id)
+{
+    void *blk;
+
+    if (arena->nfreed) {
+        *id = arena->freed[--arena->nfreed];
+    } else {
+        if (arena->slots == arena->nchunks * arena->perChunk) {
+            size_t bytes = arena->size * arena->perChunk;
+
+            if (arena->nchunks == arena->cap) {
+                arena->cap = arena->cap ? arena->cap * 2 : 16;
+                arena->chunks = realloc(arena->chunks,
+                        sizeof(char *) * arena->cap);
+            }
+
+            /* aligned_alloc wants a multiple of the alignment. */
+            bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+            arena->chunks[arena->nchunks++] = aligned_alloc(ARENA_ALIGN, bytes);
+        }
+
+        *id = arena->slots++;
+    }
+
+    blk = arenaBlock(arena, *id);
+    memset(blk, 0x00, arena->size);
+    arena->live++;
+
+    return blk;
+}
+
+void arenaFree(struct arena *arena, int id)
+{
+    assert(id >= 0 && id < arena->slots);
+
+    if (arena->nfreed == arena->freedCap) {
+        arena->freedCap = arena->freedCap ? arena->freedCap * 2 : 64;
+        arena->freed = realloc(arena->freed, sizeof(int) * arena->freedCap);
+    }
+
+    arena->freed[arena->nfreed++] = id;
+    arena->live--;
+}
+
+size_t arenaBytes(struct arena *arena)
+{
+    return (size_t)arena->nchunks * arena->perChunk * arena->size +
+        sizeof(char *) * arena->cap + sizeof(int) * arena->freedCap;
+}
+
+void arenaRelease(struct arena *arena)
+{
+    int i;
+
+    for (i = 0; i < arena->nchunks; i++) {
+        free(arena->chunks[i]);
+    }
+
+    free(arena->chunks);
+    free(arena->freed);
+    memset(arena, 0x00, sizeof(*arena));
+}
@@ -0,0 +1,49 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+/* bytes asked of malloc at a time, unless that's fewer than ARENA_MIN blocks. */
+#define ARENA_CHUNK (1 << 20)
+#define ARENA_MIN 16
+/* blocks start on a cache line when their size is a multiple of it. */
+#define ARENA_ALIGN 64
+
+/*
+ * Fixed size blocks for one tree, carved out of big chunks.  A block is named
+ * by its slot, counting from 0 across the chunks, so slots double as ids
+ * that only mean something within the tree.  Blocks that are given back are
+ * handed out again before any new slot is; the chunks themselves are only
+ * freed all at once.
+ */
+struct arena {
+    size_t size; /* of a block, rounded up to a multiple of 8. */
+    int perChunk;
+    char **chunks;
+    int nchunks;
+    int cap; /* room in chunks[]. */
+    int slots; /* handed out from the chunks so far. */
+    int *freed; /* slots given back, a stack. */
+    int nfreed;
+    int freedCap;
+    long live; /* blocks in use. */
+};
+
+void arenaInit(struct arena *arena, size_t size);
+/* @return a zeroed block, and its slot in *id. */
+void *arenaAlloc(struct arena *arena, int *id);
+void arenaFree(struct arena *arena, int id);
+
+/* the block in slot id. */
+static inline void *arenaBlock(struct arena *arena, int id)
+{
+    return arena->chunks[id / arena->perChunk] +
+        (size_t)(id % arena->perChunk) * arena->size;
+}
+
+/* bytes held from malloc. */
+size_t arenaBytes(struct arena *arena);
+/* free every block at once: one free per chunk, not per block. */
+void arenaRelease(struct arena *arena);
+
+#endif
@@ -0,0 +1,1009 @@
+/*
+ * B-tree fanout benchmark.
+ *
+ * usage: ./bench [max]
+ *
+ * For 1M keys, then ten times as many up to max (default 10M; 100M wants a
+ * few GB with small blocks), build a tree one insert at a time from shuffled
+ * keys and then look up shuffled keys, at each block size from a cache line
+ * to a 16K page.
+ *
+ * Then the same for the B+tree, with range queries of RANGE keys: a seek and
+ * a walk along the leaves, against the B-tree looking up each key in the
+ * range, which is all it can do.
+ *
+ * Then building a tree of max sorted keys with bulkLoad() against inserting
+ * them one at a time.
+ *
+ * Then each in-block search kernel the cpu runs: on its own, over one full
+ * block that stays in L1, and doing the searching for lookups in a tree of
+ * 1M keys.
+ *
+ * Then a tree of 1M keys in 4K pages of a file in /tmp, opened with buffer
+ * pools from all of it down to a sliver: lookups, then inserts, with what
+ * the pool did for them.
+ *
+ * Then durable inserts into a logged paged tree, from 1 to 64 writer
+ * threads each committing every so many inserts: how many fsyncs group
+ * commit saves.
+ *
+ * Then 1 to 64 threads sharing a tree of 1M keys, with read-mostly and
+ * write-heavy mixes: the optimistic lock coupling tree against the B-tree
+ * behind a reader-writer lock.
+ *
+ * Then the copy-on-write tree: what path copying costs inserts when there
+ * are snapshots to copy for, and a writer while another thread scans the
+ * whole tree over and over, from snapshots, against the B-tree with the
+ * scans holding its reader-writer lock.
+ *
+ * Last, building a tree of 1M shuffled keys in 4K pages, the B-epsilon tree
+ * against the paged B-tree, with pools from all of it down to a sliver, and
+ * the B-tree in memory for scale: inserts, the pages they read and wrote,
+ * and lookups after.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "betree.h"
+#include "btree.h"
+#include "bplustree.h"
+#include "cowtree.h"
+#include "olctree.h"
+#include "pagedtree.h"
+
+#define NUM_ELEMENTS(X) (sizeof(X)/sizeof(*X))
+
+/* enough lookups to time, without waiting on a full pass at 100M. */
+#define LOOKUPS (4 << 20)
+/* keys per range query, and how many queries. */
+#define RANGE 100
+#define RANGES (64 << 10)
+/* searches of one block per kernel. */
+#define SEARCHES (8 << 20)
+/* the paged tree's pages, and the most inserts timed for each pool. */
+#define PAGE_SIZE 4096
+#define PAGED_INSERTS (128 << 10)
+/* inserts per run of the logged tree, split between the writers. */
+#define WAL_OPS (32 << 10)
+/* ops per run of the shared trees, split between the threads. */
+#define SHARED_OPS (4 << 20)
+/* writes timed against scans. */
+#define SCANNED_OPS (1 << 20)
+
+static const size_t blockSizes[] = {64, 256, 1024, 4096, 16384};
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t
+xorshift(uint64_t *x)
+{
+    *x ^= *x >> 12;
+    *x ^= *x << 25;
+    *x ^= *x >> 27;
+
+    return *x * 0x2545f4914f6cdd1dull;
+}
+
+static void
+shuffle(int *keys, long n, uint64_t *x)
+{
+    long i, j;
+    int t;
+
+    for (i = n - 1; i > 0; i--) {
+        j = xorshift(x) % (i + 1);
+        t = keys[i];
+        keys[i] = keys[j];
+        keys[j] = t;
+    }
+}
+
+static void
+benchFanout(size_t bytes, const int *keys, const int *probes, long n,
+        long lookups)
+{
+    int order = orderForBytes(bytes);
+    struct btree *tree = newTree(order);
+    block_t *b;
+    double start, insertNs, searchNs;
+    long i, found = 0, blocks;
+    int depth;
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        insert(tree, keys[i]);
+    }
+    insertNs = now() - start;
+
+    start = now();
+    for (i = 0; i < lookups; i++) {
+        found += NULL != search(tree, probes[i]);
+    }
+    searchNs = now() - start;
+    assert(found == lookups);
+
+    blocks = tree->arena.live;
+    for (depth = 1, b = tree->root; blockPtrs(b)[0]; depth++) {
+        b = blockPtrs(b)[0];
+    }
+
+    printf("%10ld %6zu %6d %6d %6.0f%% %8.0f %10.2f %10.2f\n",
+            n, bytes, order, depth,
+            100.0 * n / ((double)blocks * (order - 1)),
+            (double)arenaBytes(&tree->arena) / (1 << 20),
+            n / insertNs * 1e3, lookups / searchNs * 1e3);
+
+    depthFirstFree(tree);
+}
+
+static void
+benchRange(size_t bytes, const int *keys, const int *probes, long n)
+{
+    int order = orderForBytes(bytes);
+    struct btree *root = newTree(order);
+    struct bptree tree;
+    bpcursor_t c;
+    double start, insertNs, plusNs, pointNs;
+    long i, j, plusKeys = 0, pointKeys = 0;
+
+    bpInit(&tree, order);
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        bpInsert(&tree, keys[i]);
+    }
+    insertNs = now() - start;
+
+    for (i = 0; i < n; i++) {
+        insert(root, keys[i]);
+    }
+
+    /* keys are the even numbers below 2n. */
+    start = now();
+    for (i = 0; i < RANGES; i++) {
+        bpSeek(&tree, &c, probes[i]);
+        for (j = 0; j < RANGE && bpValid(&c); j++, bpNext(&c)) {
+            plusKeys++;
+        }
+    }
+    plusNs = now() - start;
+
+    start = now();
+    for (i = 0; i < RANGES; i++) {
+        for (j = 0; j < RANGE && probes[i] + 2 * j < 2 * n; j++) {
+            pointKeys += NULL != search(root, probes[i] + 2 * j);
+        }
+    }
+    pointNs = now() - start;
+    assert(plusKeys == pointKeys);
+
+    printf("%10ld %6zu %6d %10.2f %10.2f %10.2f\n",
+            n, bytes, order, n / insertNs * 1e3,
+            plusKeys / plusNs * 1e3, pointKeys / pointNs * 1e3);
+
+    bpFree(&tree);
+    depthFirstFree(root);
+}
+
+static void
+benchBulk(size_t bytes, const int *sorted, long n)
+{
+    int order = orderForBytes(bytes);
+    struct btree *root;
+    double start, insertNs, bulkNs, packedNs;
+    long i;
+
+    start = now();
+    root = newTree(order);
+    for (i = 0; i < n; i++) {
+        insert(root, sorted[i]);
+    }
+    insertNs = now() - start;
+    depthFirstFree(root);
+
+    start = now();
+    root = bulkLoad(order, sorted, n, 0.7);
+    bulkNs = now() - start;
+    depthFirstFree(root);
+
+    start = now();
+    root = bulkLoad(order, sorted, n, 1.0);
+    packedNs = now() - start;
+    assert(search(root, sorted[n / 2]));
+    depthFirstFree(root);
+
+    printf("%10ld %6zu %6d %10.2f %10.2f %10.2f %7.1fx\n",
+            n, bytes, order, n / insertNs * 1e3, n / bulkNs * 1e3,
+            n / packedNs * 1e3, insertNs / bulkNs);
+}
+
+static void
+benchSearch(size_t bytes, const int *keys, const int *probes, long n)
+{
+    int order = orderForBytes(bytes);
+    int used = order - 1;
+    int *block = malloc(sizeof(int) * used);
+    int *values = malloc(sizeof(int) * SEARCHES);
+    double kernelNs[SEARCH_KINDS], lookupNs[SEARCH_KINDS];
+    struct btree *tree = newTree(order);
+    uint64_t x = 1;
+    long i, sum;
+    int kind;
+
+    /* a full block of the even numbers, searched for anything in range. */
+    for (i = 0; i < used; i++) {
+        block[i] = i * 2;
+    }
+    for (i = 0; i < SEARCHES; i++) {
+        values[i] = xorshift(&x) % (2 * used + 1);
+    }
+    for (i = 0; i < n; i++) {
+        insert(tree, keys[i]);
+    }
+
+    for (kind = 0; kind < SEARCH_KINDS; kind++) {
+        nodesearch_t fn = searchKernel(kind);
+        double start;
+
+        if (!searchSupported(kind)) {
+            continue;
+        }
+
+        start = now();
+        for (i = 0, sum = 0; i < SEARCHES; i++) {
+            sum += fn(block, used, values[i]);
+        }
+        kernelNs[kind] = (now() - start) / SEARCHES;
+        assert(sum > 0);
+
+        searchUse(kind);
+        start = now();
+        for (i = 0; i < LOOKUPS; i++) {
+            sum += NULL != search(tree, probes[i]);
+        }
+        lookupNs[kind] = now() - start;
+    }
+    searchUse(searchBest());
+
+    printf("%6zu %6d |", bytes, order);
+    for (kind = 0; kind < SEARCH_KINDS; kind++) {
+        if (searchSupported(kind)) {
+            printf(" %8.1f", kernelNs[kind]);
+        } else {
+            printf(" %8s", "-");
+        }
+    }
+    printf(" |");
+    for (kind = 0; kind < SEARCH_KINDS; kind++) {
+        if (searchSupported(kind)) {
+            printf(" %8.2f", LOOKUPS / lookupNs[kind] * 1e3);
+        } else {
+            printf(" %8s", "-");
+        }
+    }
+    printf("\n");
+
+    depthFirstFree(tree);
+    free(values);
+    free(block);
+}
+
+static void
+benchPagedPool(const char *path, uint32_t npages, int frames,
+        const int *probes, long lookups, const int *adds, long inserts)
+{
+    struct ptree tree;
+    struct poolstats l, w;
+    double start, lookupNs, insertNs;
+    long i, found = 0, added = 0;
+
+    if (ptreeOpen(&tree, path, PAGE_SIZE, frames)) {
+        perror(path);
+        exit(1);
+    }
+
+    /* warm up, so the hit rate is the pool's steady state. */
+    for (i = 0; i < lookups / 4; i++) {
+        found += ptreeSearch(&tree, probes[i]);
+    }
+    poolResetStats(&tree.pool);
+
+    start = now();
+    for (i = 0, found = 0; i < lookups; i++) {
+        found += ptreeSearch(&tree, probes[i]);
+    }
+    lookupNs = now() - start;
+    l = poolStats(&tree.pool);
+    assert(found == lookups);
+
+    /* new keys all over the tree; the evictions now write pages back. */
+    poolResetStats(&tree.pool);
+    start = now();
+    for (i = 0; i < inserts; i++) {
+        added += ptreeInsert(&tree, adds[i]);
+    }
+    insertNs = now() - start;
+    w = poolStats(&tree.pool);
+    assert(added == inserts);
+
+    ptreeClose(&tree);
+
+    printf("%8d %6.1f%% | %10.2f %7.1f%% %10ld | %10.2f %7.1f%% %10ld %10ld\n",
+            frames, 100.0 * frames / npages,
+            lookups / lookupNs * 1e6, 100 * l.hitRate, l.evictions,
+            inserts / insertNs * 1e6, 100 * w.hitRate, w.evictions,
+            w.writebacks);
+}
+
+static void
+benchPaged(const int *keys, const int *probes, long n, long lookups)
+{
+    char path[] = "/tmp/benchpagedXXXXXX";
+    int fractions[] = {1, 2, 4, 16, 64};
+    long inserts = n / NUM_ELEMENTS(fractions);
+    int *adds = malloc(sizeof(int) * n);
+    struct ptree tree;
+    struct ptmeta *meta;
+    uint32_t npages;
+    long i;
+    int f;
+    int fd = mkstemp(path);
+
+    if (fd < 0 || close(fd) || ptreeOpen(&tree, path, PAGE_SIZE, 8192)) {
+        perror(path);
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++) {
+        ptreeInsert(&tree, keys[i]);
+    }
+    meta = poolPin(&tree.pool, 0);
+    npages = meta->npages;
+    poolUnpin(&tree.pool, meta, 0);
+    ptreeClose(&tree);
+
+    printf("%ld keys in %u pages of %d bytes, order %d; Kops/s\n\n",
+            n, npages, PAGE_SIZE, ptreeOrder(PAGE_SIZE));
+    printf("%8s %7s | %10s %8s %10s | %10s %8s %10s %10s\n", "frames",
+            "of tree", "lookup", "hits", "evicted", "insert", "hits",
+            "evicted", "written");
+
+    /* the odd numbers, in shuffled order, a different run for each pool. */
+    for (i = 0; i < n; i++) {
+        adds[i] = keys[i] + 1;
+    }
+    if (inserts > PAGED_INSERTS) {
+        inserts = PAGED_INSERTS;
+    }
+    for (f = 0; f < NUM_ELEMENTS(fractions); f++) {
+        int frames = npages / fractions[f];
+
+        benchPagedPool(path, npages, frames < 32 ? 32 : frames, probes,
+                lookups, adds + f * inserts, inserts);
+    }
+
+    unlink(path);
+    free(adds);
+}
+
+struct walWriter {
+    struct ptree *tree;
+    int first; /* this writer's keys are first, first + step, ... */
+    int step;
+    int ops;
+    int batch; /* inserts per commit. */
+};
+
+static void *
+walWrite(void *arg)
+{
+    struct walWriter *w = arg;
+    int i;
+
+    for (i = 0; i < w->ops; i++) {
+        /* odd multiplier: distinct keys, all over the tree. */
+        unsigned key = (unsigned)(w->first + i * w->step) * 2654435761u;
+
+        if (ptreeInsert(w->tree, (int)key) < 0 ||
+                ((i + 1 == w->ops || (i + 1) % w->batch == 0) &&
+                 ptreeCommit(w->tree) < 0)) {
+            perror("insert");
+            exit(1);
+        }
+    }
+
+    return NULL;
+}
+
+static void
+benchWal(int writers, int batch)
+{
+    char path[] = "/tmp/benchwalXXXXXX";
+    char logPath[sizeof(path) + 4];
+    struct walWriter w[64];
+    pthread_t threads[64];
+    struct ptree tree;
+    double start, ns;
+    long syncs, commits;
+    int t, fd = mkstemp(path);
+
+    assert(writers <= 64);
+    if (fd < 0 || close(fd) ||
+            ptreeOpenLogged(&tree, path, PAGE_SIZE, 1024)) {
+        perror(path);
+        exit(1);
+    }
+
+    start = now();
+    for (t = 0; t < writers; t++) {
+        w[t].tree = &tree;
+        w[t].first = t;
+        w[t].step = writers;
+        w[t].ops = WAL_OPS / writers;
+        w[t].batch = batch;
+        pthread_create(&threads[t], NULL, walWrite, &w[t]);
+    }
+    for (t = 0; t < writers; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    ns = now() - start;
+    syncs = tree.wal->syncs;
+    commits = tree.wal->commits;
+
+    printf("%8d %6d | %10.2f %8ld %10.1f %12.1f\n", writers, batch,
+            WAL_OPS / ns * 1e6, syncs, (double)WAL_OPS / syncs,
+            (double)commits / syncs);
+
+    ptreeClose(&tree);
+    sprintf(logPath, "%s.wal", path);
+    unlink(path);
+    unlink(logPath);
+}
+
+struct sharedRun {
+    struct olctree *olc; /* one or the other. */
+    struct btree *locked;
+    pthread_rwlock_t *lock;
+    long n; /* keys are below 2n. */
+    int writePercent;
+    long ops;
+    uint64_t seed;
+};
+
+/* lookups, and inserts and deletes half and half, of random keys. */
+static void *
+sharedWork(void *arg)
+{
+    struct sharedRun *r = arg;
+    uint64_t x = r->seed;
+    long i, hits = 0;
+
+    for (i = 0; i < r->ops; i++) {
+        uint64_t rnd = xorshift(&x);
+        int key = (rnd >> 8) % (2 * r->n);
+        int op = rnd % 200;
+
+        if (op >= r->writePercent * 2) {
+            if (r->olc) {
+                hits += olcSearch(r->olc, key);
+            } else {
+                pthread_rwlock_rdlock(r->lock);
+                hits += NULL != search(r->locked, key);
+                pthread_rwlock_unlock(r->lock);
+            }
+        } else if (r->olc) {
+            if (op & 1) {
+                olcInsert(r->olc, key);
+            } else {
+                olcDelete(r->olc, key);
+            }
+        } else {
+            pthread_rwlock_wrlock(r->lock);
+            if (op & 1) {
+                insert(r->locked, key);
+            } else {
+                delete(r->locked, key);
+            }
+            pthread_rwlock_unlock(r->lock);
+        }
+    }
+
+    return (void *)hits;
+}
+
+/* @return Mops/s for threads running the mix on whichever tree's given. */
+static double
+benchShared(struct olctree *olc, struct btree *locked, long n, int threads,
+        int writePercent)
+{
+    struct sharedRun runs[64];
+    pthread_t ids[64];
+    pthread_rwlock_t lock;
+    double start, ns;
+    int t;
+
+    pthread_rwlock_init(&lock, NULL);
+
+    start = now();
+    for (t = 0; t < threads; t++) {
+        runs[t].olc = olc;
+        runs[t].locked = locked;
+        runs[t].lock = &lock;
+        runs[t].n = n;
+        runs[t].writePercent = writePercent;
+        runs[t].ops = SHARED_OPS / threads;
+        runs[t].seed = 0x9e3779b97f4a7c15ull * (t + 1);
+        pthread_create(&ids[t], NULL, sharedWork, &runs[t]);
+    }
+    for (t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    ns = now() - start;
+
+    pthread_rwlock_destroy(&lock);
+
+    return SHARED_OPS / ns * 1e3;
+}
+
+static void
+benchConcurrent(const int *keys, long n)
+{
+    int order = orderForBytes(1024);
+    int mixes[] = {5, 50};
+    struct olctree olc;
+    struct btree *locked = newTree(order);
+    long i;
+    int threads, m;
+
+    olcInit(&olc, order);
+    for (i = 0; i < n; i++) {
+        olcInsert(&olc, keys[i]);
+        insert(locked, keys[i]);
+    }
+
+    printf("%8s", "threads");
+    for (m = 0; m < NUM_ELEMENTS(mixes); m++) {
+        printf(" | %2d%% writes %6s %8s", mixes[m], "olc", "rwlock");
+    }
+    printf("\n");
+
+    for (threads = 1; threads <= 64; threads *= 2) {
+        printf("%8d", threads);
+        for (m = 0; m < NUM_ELEMENTS(mixes); m++) {
+            printf(" | %18.2f %8.2f",
+                    benchShared(&olc, NULL, n, threads, mixes[m]),
+                    benchShared(NULL, locked, n, threads, mixes[m]));
+        }
+        printf("\n");
+    }
+
+    olcFree(&olc);
+    depthFirstFree(locked);
+}
+
+struct scanRun {
+    struct cowtree *cow; /* one or the other. */
+    struct btree *locked;
+    pthread_rwlock_t *lock;
+    volatile int stop;
+    long scans;
+    long sum;
+};
+
+static void
+scanVisit(void *ctx, int key)
+{
+    *(long *)ctx += key;
+}
+
+/* an in-order walk of a B-tree, the way a scan would have to. */
+static void
+scanBlock(block_t *b, long *sum)
+{
+    int i;
+
+    for (i = 0; i <= b->used; i++) {
+        if (blockPtrs(b)[0]) {
+            scanBlock(blockPtrs(b)[i], sum);
+        }
+        if (i < b->used) {
+            *sum += blockKeys(b)[i];
+        }
+    }
+}
+
+static void *
+scanWork(void *arg)
+{
+    struct scanRun *r = arg;
+
+    while (!r->stop) {
+        if (r->cow) {
+            cownode_t *snap = cowSnapshot(r->cow);
+
+            cowScan(snap, INT_MIN, INT_MAX, scanVisit, &r->sum);
+            cowRelease(r->cow, snap);
+        } else {
+            pthread_rwlock_rdlock(r->lock);
+            scanBlock(r->locked->root, &r->sum);
+            pthread_rwlock_unlock(r->lock);
+        }
+        r->scans++;
+    }
+
+    return NULL;
+}
+
+/*
+ * Random inserts and deletes on whichever tree's given, with a thread
+ * scanning it meanwhile.  @return the writes' Mops/s, and the scans in
+ * *scans.
+ */
+static double
+benchScanned(struct cowtree *cow, struct btree *locked, long n, long *scans)
+{
+    struct scanRun run = {cow, locked, NULL, 0, 0, 0};
+    pthread_rwlock_t lock;
+    pthread_t scanner;
+    uint64_t x = 42;
+    double start, ns;
+    long i;
+
+    pthread_rwlock_init(&lock, NULL);
+    run.lock = &lock;
+    pthread_create(&scanner, NULL, scanWork, &run);
+
+    start = now();
+    for (i = 0; i < SCANNED_OPS; i++) {
+        uint64_t rnd = xorshift(&x);
+        int key = (rnd >> 8) % (2 * n);
+
+        if (cow) {
+            if (rnd & 1) {
+                cowInsert(cow, key);
+            } else {
+                cowDelete(cow, key);
+            }
+        } else {
+            pthread_rwlock_wrlock(&lock);
+            if (rnd & 1) {
+                insert(locked, key);
+            } else {
+                delete(locked, key);
+            }
+            pthread_rwlock_unlock(&lock);
+        }
+    }
+    ns = now() - start;
+
+    run.stop = 1;
+    pthread_join(scanner, NULL);
+    pthread_rwlock_destroy(&lock);
+
+    *scans = run.scans;
+    return SCANNED_OPS / ns * 1e3;
+}
+
+static void
+benchCow(const int *keys, long n)
+{
+    int snapEvery[] = {0, 1000, 100, 10};
+    int s, order = orderForBytes(1024);
+    struct cowtree cow;
+    struct btree *locked;
+    double start, ns, cowOps, lockedOps;
+    long i, cowScans, lockedScans;
+
+    printf("%10s %10s %10s\n", "snapshot", "insert", "copied");
+    for (s = 0; s < NUM_ELEMENTS(snapEvery); s++) {
+        cownode_t *snap = NULL;
+        long copies = 0;
+
+        cowInit(&cow, order);
+        start = now();
+        for (i = 0; i < n; i++) {
+            if (snapEvery[s] && i % snapEvery[s] == 0) {
+                long before = cow.live;
+
+                if (snap) {
+                    cowRelease(&cow, snap);
+                }
+                copies += before - cow.live;
+                snap = cowSnapshot(&cow);
+            }
+            cowInsert(&cow, keys[i]);
+        }
+        ns = now() - start;
+        if (snap) {
+            cowRelease(&cow, snap);
+        }
+
+        /* each release frees the nodes copied since it was taken. */
+        if (snapEvery[s]) {
+            printf("%10d", snapEvery[s]);
+        } else {
+            printf("%10s", "never");
+        }
+        printf(" %10.2f %10ld\n", n / ns * 1e3, copies);
+        cowFree(&cow);
+    }
+
+    cowInit(&cow, order);
+    locked = newTree(order);
+    for (i = 0; i < n; i++) {
+        cowInsert(&cow, keys[i]);
+        insert(locked, keys[i]);
+    }
+
+    cowOps = benchScanned(&cow, NULL, n, &cowScans);
+    lockedOps = benchScanned(NULL, locked, n, &lockedScans);
+
+    printf("\nwrites while another thread scans: Mops/s, and scans done\n\n");
+    printf("%10s %10s %10s\n", "", "writes", "scans");
+    printf("%10s %10.2f %10ld\n", "snapshots", cowOps, cowScans);
+    printf("%10s %10.2f %10ld\n", "rwlock", lockedOps, lockedScans);
+
+    cowFree(&cow);
+    depthFirstFree(locked);
+}
+
+/*
+ * Build a tree of n keys, paged or B-epsilon, in a fresh file with a pool of
+ * frames, then look up some of them.  @return the pages it took.
+ */
+static uint32_t
+benchBuild(const char *path, int frames, int epsilon, const int *keys,
+        long n, const int *probes, long lookups)
+{
+    struct ptree paged;
+    struct betree bet;
+    struct bufpool *pool = epsilon ? &bet.pool : &paged.pool;
+    struct poolstats w;
+    struct ptmeta *meta;
+    double start, insertNs, lookupNs;
+    uint32_t npages;
+    long i, found = 0;
+
+    unlink(path);
+    if (epsilon ? betOpen(&bet, path, PAGE_SIZE, 0, frames) :
+            ptreeOpen(&paged, path, PAGE_SIZE, frames)) {
+        perror(path);
+        exit(1);
+    }
+    poolResetStats(pool);
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        if (epsilon) {
+            betInsert(&bet, keys[i]);
+        } else {
+            ptreeInsert(&paged, keys[i]);
+        }
+    }
+    insertNs = now() - start;
+    w = poolStats(pool);
+
+    start = now();
+    for (i = 0; i < lookups; i++) {
+        found += epsilon ? betSearch(&bet, probes[i]) :
+            ptreeSearch(&paged, probes[i]);
+    }
+    lookupNs = now() - start;
+    assert(found == lookups);
+
+    if (epsilon) {
+        npages = bet.npages;
+        betClose(&bet);
+    } else {
+        meta = poolPin(pool, 0);
+        npages = meta->npages;
+        poolUnpin(pool, meta, 0);
+        ptreeClose(&paged);
+    }
+
+    printf(" %10s | %10.2f %10.2f %10.2f | %10.2f\n",
+            epsilon ? "b-epsilon" : "paged", n / insertNs * 1e6,
+            1e3 * w.misses / n, 1e3 * w.writebacks / n,
+            lookups / lookupNs * 1e6);
+
+    return npages;
+}
+
+static void
+benchEpsilon(const int *keys, const int *probes, long n, long lookups)
+{
+    char path[] = "/tmp/benchbetreeXXXXXX";
+    int fractions[] = {16, 64, 256};
+    int f, fd = mkstemp(path);
+    struct btree *tree;
+    struct betree bet;
+    double start, insertNs, lookupNs;
+    uint32_t npages;
+    long i, found = 0;
+
+    if (fd < 0 || close(fd) || betOpen(&bet, path, PAGE_SIZE, 0, 32)) {
+        perror(path);
+        exit(1);
+    }
+    printf("b-epsilon order %d with %d messages a buffer, %d keys a leaf; "
+            "paged order %d\n\n", bet.order, bet.cap, bet.leafCap,
+            ptreeOrder(PAGE_SIZE));
+    betClose(&bet);
+
+    printf("%8s %7s %10s | %10s %10s %10s | %10s\n", "frames", "of tree",
+            "", "insert", "reads/K", "writes/K", "lookup");
+
+    tree = newTree(orderForBytes(PAGE_SIZE));
+    start = now();
+    for (i = 0; i < n; i++) {
+        insert(tree, keys[i]);
+    }
+    insertNs = now() - start;
+    start = now();
+    for (i = 0; i < lookups; i++) {
+        found += NULL != search(tree, probes[i]);
+    }
+    lookupNs = now() - start;
+    assert(found == lookups);
+    depthFirstFree(tree);
+    printf("%16s %10s | %10.2f %10s %10s | %10.2f\n", "memory", "b-tree",
+            n / insertNs * 1e6, "", "", lookups / lookupNs * 1e6);
+
+    /* a pool the whole tree fits in, so nothing's read or written. */
+    printf("%8d %7s", 8192, "all");
+    npages = benchBuild(path, 8192, 0, keys, n, probes, lookups);
+    printf("%16s", "");
+    benchBuild(path, 8192, 1, keys, n, probes, lookups);
+
+    for (f = 0; f < NUM_ELEMENTS(fractions); f++) {
+        int frames = npages / fractions[f];
+
+        frames = frames < 32 ? 32 : frames;
+        printf("%8d %6.1f%%", frames, 100.0 * frames / npages);
+        benchBuild(path, frames, 0, keys, n, probes, lookups);
+        printf("%16s", "");
+        benchBuild(path, frames, 1, keys, n, probes, lookups);
+    }
+
+    unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    long i, n, max = 10000000;
+    int s;
+    uint64_t x = 88172645463325252ull;
+
+    if (argc > 1) {
+        max = atol(argv[1]);
+    }
+
+    int *keys = malloc(sizeof(int) * max);
+    int *probes = malloc(sizeof(int) * LOOKUPS);
+
+    assert(LOOKUPS >= RANGES);
+
+    printf("shuffled keys, Mops/s; fill is of order - 1 keys per block\n\n");
+    printf("%10s %6s %6s %6s %7s %8s %10s %10s\n", "keys", "bytes", "order",
+            "depth", "fill", "MB", "insert", "lookup");
+
+    for (n = 1000000; n <= max; n *= 10) {
+        long lookups = n < LOOKUPS ? n : LOOKUPS;
+
+        for (i = 0; i < n; i++) {
+            keys[i] = i * 2;
+        }
+        shuffle(keys, n, &x);
+        for (i = 0; i < lookups; i++) {
+            probes[i] = keys[xorshift(&x) % n];
+        }
+
+        for (s = 0; s < NUM_ELEMENTS(blockSizes); s++) {
+            benchFanout(blockSizes[s], keys, probes, n, lookups);
+        }
+        printf("\n");
+    }
+
+    printf("b+tree, ranges of %d keys; Mops/s for insert, Mkeys/s for "
+            "ranges\n\n", RANGE);
+    printf("%10s %6s %6s %10s %10s %10s\n", "keys", "bytes", "order",
+            "insert", "b+ range", "b lookups");
+
+    for (n = 1000000; n <= max; n *= 10) {
+        for (i = 0; i < n; i++) {
+            keys[i] = i * 2;
+        }
+        shuffle(keys, n, &x);
+        for (i = 0; i < RANGES; i++) {
+            probes[i] = keys[xorshift(&x) % n];
+        }
+
+        for (s = 0; s < NUM_ELEMENTS(blockSizes); s++) {
+            benchRange(blockSizes[s], keys, probes, n);
+        }
+        printf("\n");
+    }
+
+    printf("sorted keys, Mkeys/s; bulk loads at 70%% and 100%% fill\n\n");
+    printf("%10s %6s %6s %10s %10s %10s %8s\n", "keys", "bytes", "order",
+            "insert", "bulk 70%", "bulk 100%", "gain");
+
+    for (i = 0; i < max; i++) {
+        keys[i] = i * 2;
+    }
+    for (s = 0; s < NUM_ELEMENTS(blockSizes); s++) {
+        benchBulk(blockSizes[s], keys, max);
+    }
+
+    n = max < 1000000 ? max : 1000000;
+    for (i = 0; i < n; i++) {
+        keys[i] = i * 2;
+    }
+    shuffle(keys, n, &x);
+    for (i = 0; i < LOOKUPS; i++) {
+        probes[i] = keys[xorshift(&x) % n];
+    }
+
+    printf("\nin-block search: ns per search of a full block, and Mops/s "
+            "looking up %ld keys\n\n", n);
+    printf("%6s %6s |", "bytes", "order");
+    for (s = 0; s < SEARCH_KINDS; s++) {
+        printf(" %8s", searchName(s));
+    }
+    printf(" |");
+    for (s = 0; s < SEARCH_KINDS; s++) {
+        printf(" %8s", searchName(s));
+    }
+    printf("\n");
+
+    for (s = 0; s < NUM_ELEMENTS(blockSizes); s++) {
+        benchSearch(blockSizes[s], keys, probes, n);
+    }
+
+    printf("\npaged tree, through a buffer pool of some of its pages\n\n");
+    benchPaged(keys, probes, n, n < LOOKUPS / 4 ? n : LOOKUPS / 4);
+
+    printf("\nlogged paged tree, %d durable inserts; Kops/s\n\n", WAL_OPS);
+    printf("%8s %6s | %10s %8s %10s %10s\n", "writers", "batch", "insert",
+            "fsyncs", "ops/sync", "commits/sync");
+    for (s = 1; s <= 64; s *= 4) {
+        int batches[] = {1, 8, 64};
+        int b;
+
+        for (b = 0; b < NUM_ELEMENTS(batches); b++) {
+            benchWal(s, batches[b]);
+        }
+    }
+
+    printf("\nshared trees of %ld keys, %d byte nodes, Mops/s\n\n", n,
+            1024);
+    benchConcurrent(keys, n);
+
+    printf("\ncopy-on-write tree of %ld keys, %d byte nodes; inserts in "
+            "Mops/s taking a snapshot every so many\n\n", n, 1024);
+    benchCow(keys, n);
+
+    printf("\nbuilding a tree of %ld keys in %d byte pages; Kops/s, and "
+            "pages read and written per 1000 inserts\n\n", n, PAGE_SIZE);
+    benchEpsilon(keys, probes, n, n < LOOKUPS / 4 ? n : LOOKUPS / 4);
+
+    free(keys);
+    free(probes);
+
+    return 0;
+}
@@ -0,0 +1,584 @@
+/*
+ * B-epsilon tree in fixed size pages of a file, reached through the buffer
+ * pool.
+ *
+ * Pivots work as in bplustree.c: every key is in a leaf, and an internal
+ * node's pivots only steer, with keys equal to a pivot to its right.  The
+ * messages in a buffer go to the child their key steers to.  An insert or a
+ * delete is a message put in the root's buffer, replacing any older one for
+ * the same key; if the buffer is full, it's flushed first: the messages for
+ * the child with the most are merged into that child's buffer, where they
+ * replace older ones, or into the leaf itself.  If the child's buffer hasn't
+ * room for them, it's flushed first in turn, and so on down.
+ *
+ * The splits come from the bottom: a leaf that can't take what's flushed
+ * into it splits, which adds a pivot to its parent; a parent that reaches
+ * order splits once its flush is done, and its buffer is divided at the
+ * pivot that goes up.  A leaf takes at most a buffer at once, and holds more
+ * keys than that, so it splits in two at most.  Every page a split needs is
+ * pinned before anything moves, so one that fails changes nothing, but it
+ * leaves its node with order pivots; the next flush to reach that node
+ * splits it before anything else.
+ *
+ * A flush pins the path down to a leaf and a page for a split, so the tree
+ * is only as deep as the pool's frames can pin: a root that might have to
+ * split past that doesn't flush, and the put fails instead.
+ *
+ * Nothing merges: a delete that empties a leaf leaves it empty.  Pages are
+ * only ever added, at the end of the file.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "betree.h"
+#include "nodesearch.h"
+
+/******************************************************************************
+ * Implementation start
+ *****************************************************************************/
+
+/* messages in an internal node of this order. */
+static int capFor(size_t pageSize, int order)
+{
+    long bytes = (long)pageSize - sizeof(betnode_t) -
+        sizeof(uint32_t) * (order + 1) - sizeof(int) * order;
+
+    return bytes < 0 ? 0 : bytes / (sizeof(int) + sizeof(uint8_t));
+}
+
+int betOrder(size_t pageSize)
+{
+    int order = 3;
+
+    while ((long)(order + 1) * (order + 1) <= capFor(pageSize, order + 1)) {
+        order++;
+    }
+
+    return order;
+}
+
+static inline uint32_t pageOf(struct betree *tree, void *data)
+{
+    return poolPage(&tree->pool, data);
+}
+
+/* a fresh node at the end of the file, pinned. */
+static betnode_t *newNode(struct betree *tree, int leaf)
+{
+    betnode_t *node = poolPinNew(&tree->pool, tree->npages);
+
+    if (!node) {
+        return NULL;
+    }
+    tree->npages++;
+    node->order = tree->order;
+    node->cap = leaf ? 0 : tree->cap;
+
+    return node;
+}
+
+/* which child value is steered to. */
+static inline int childFor(betnode_t *node, int value)
+{
+    int *pivots = betPivots(node);
+    int i = nodeSearch(pivots, node->used, value);
+
+    return i + (i < node->used && pivots[i] == value);
+}
+
+/* where the messages for child index are in node's buffer: [*from, *to). */
+static void messagesFor(betnode_t *node, int index, int *from, int *to)
+{
+    int *keys = betMsgKeys(node);
+
+    *from = index > 0 ?
+        nodeSearch(keys, node->nmsgs, betPivots(node)[index - 1]) : 0;
+    *to = index < node->used ?
+        nodeSearch(keys, node->nmsgs, betPivots(node)[index]) : node->nmsgs;
+}
+
+/*
+ * A new root over node, the root, with no pivots yet, pinned: a split of
+ * node goes up into it.  @return it, or NULL with errno set.
+ */
+static betnode_t *grow(struct betree *tree, betnode_t *node)
+{
+    betnode_t *root = newNode(tree, 0);
+
+    if (!root) {
+        return NULL;
+    }
+    betPtrs(root)[0] = pageOf(tree, node);
+    tree->root = pageOf(tree, root);
+    tree->depth++;
+
+    return root;
+}
+
+/* a new child, right, to the right of child index, with pivot between. */
+static void adopt(betnode_t *parent, int index, int pivot, uint32_t right)
+{
+    int *pivots = betPivots(parent);
+    uint32_t *ptrs = betPtrs(parent);
+
+    memmove(&pivots[index + 1], &pivots[index],
+            sizeof(int) * (parent->used - index));
+    memmove(&ptrs[index + 2], &ptrs[index + 1],
+            sizeof(uint32_t) * (parent->used - index));
+    pivots[index] = pivot;
+    ptrs[index + 1] = right;
+    parent->used++;
+}
+
+/*
+ * Split internal node, child index of parent, or the root if parent is NULL:
+ * the middle pivot goes up, and the pivots, children and messages right of
+ * it go to a new node.
+ * @return 0, or -1 with errno set.
+ */
+static int split(struct betree *tree, betnode_t *parent, int index,
+        betnode_t *node)
+{
+    betnode_t *right = newNode(tree, 0), *root = NULL;
+    int mid = node->used / 2;
+    int pivot = betPivots(node)[mid];
+    int moved = node->used - mid - 1;
+    int at;
+
+    if (!right) {
+        return -1;
+    }
+    if (!parent && !(parent = root = grow(tree, node))) {
+        poolUnpin(&tree->pool, right, 0);
+        return -1;
+    }
+
+    memcpy(betPivots(right), &betPivots(node)[mid + 1], sizeof(int) * moved);
+    memcpy(betPtrs(right), &betPtrs(node)[mid + 1],
+            sizeof(uint32_t) * (moved + 1));
+    right->used = moved;
+    node->used = mid;
+
+    at = nodeSearch(betMsgKeys(node), node->nmsgs, pivot);
+    right->nmsgs = node->nmsgs - at;
+    memcpy(betMsgKeys(right), &betMsgKeys(node)[at],
+            sizeof(int) * right->nmsgs);
+    memcpy(betMsgOps(right), &betMsgOps(node)[at], right->nmsgs);
+    node->nmsgs = at;
+
+    adopt(parent, index, pivot, pageOf(tree, right));
+    poolUnpin(&tree->pool, right, 1);
+    if (root) {
+        poolUnpin(&tree->pool, root, 1);
+    }
+
+    return 0;
+}
+
+/*
+ * Apply n messages to leaf, child index of parent, splitting it in two if
+ * they leave it too many keys.
+ * @return 0, or -1 with errno set.
+ */
+static int applyLeaf(struct betree *tree, betnode_t *parent, int index,
+        betnode_t *leaf, const int *keys, const uint8_t *ops, int n)
+{
+    int *have = betKeys(leaf);
+    int *out = tree->scratch;
+    int i = 0, j = 0, used = 0, half;
+    betnode_t *right, *root = NULL;
+
+    while (i < leaf->used || j < n) {
+        if (j == n || (i < leaf->used && have[i] < keys[j])) {
+            out[used++] = have[i++];
+            continue;
+        }
+        if (i < leaf->used && have[i] == keys[j]) {
+            i++;
+        }
+        if (BET_INSERT == ops[j]) {
+            out[used++] = keys[j];
+        }
+        j++;
+    }
+
+    if (used <= tree->leafCap) {
+        memcpy(have, out, sizeof(int) * used);
+        leaf->used = used;
+        return 0;
+    }
+
+    if (!(right = newNode(tree, 1))) {
+        return -1;
+    }
+    if (!parent && !(parent = root = grow(tree, leaf))) {
+        poolUnpin(&tree->pool, right, 0);
+        return -1;
+    }
+    half = used / 2;
+    memcpy(have, out, sizeof(int) * half);
+    leaf->used = half;
+    memcpy(betKeys(right), &out[half], sizeof(int) * (used - half));
+    right->used = used - half;
+
+    adopt(parent, index, out[half], pageOf(tree, right));
+    poolUnpin(&tree->pool, right, 1);
+    if (root) {
+        poolUnpin(&tree->pool, root, 1);
+    }
+
+    return 0;
+}
+
+/*
+ * Merge n messages into node's buffer, which has room for them all; they're
+ * newer, and replace any there for the same keys.  It's done from the back,
+ * in place, so only the messages after the first new one move: for one new
+ * message, as much as an insert into a sorted array.
+ */
+static void applyBuffer(betnode_t *node, const int *keys, const uint8_t *ops,
+        int n)
+{
+    int *have = betMsgKeys(node);
+    uint8_t *haveOps = betMsgOps(node);
+    int i = node->nmsgs - 1, j = n - 1, end = node->nmsgs + n, at = end;
+
+    assert(end <= node->cap);
+    while (j >= 0) {
+        if (i >= 0 && have[i] > keys[j]) {
+            have[--at] = have[i];
+            haveOps[at] = haveOps[i--];
+            continue;
+        }
+        if (i >= 0 && have[i] == keys[j]) {
+            i--;
+        }
+        have[--at] = keys[j];
+        haveOps[at] = ops[j--];
+    }
+
+    /* replaced messages leave a gap between what didn't move and what did. */
+    if (at > i + 1) {
+        memmove(&have[i + 1], &have[at], sizeof(int) * (end - at));
+        memmove(&haveOps[i + 1], &haveOps[at], end - at);
+    }
+    node->nmsgs = end - (at - i - 1);
+}
+
+/*
+ * Move the messages in node's buffer for the child with the most of them
+ * down into it, or, if that child's buffer hasn't room and has to split to
+ * make it, or it's been left full by a split that failed, just split the
+ * child.  Either way node may be left with order
+ * pivots, to be split by whoever called.
+ * @return 0, or -1 with errno set.
+ */
+static int flush(struct betree *tree, betnode_t *node)
+{
+    int i, from, to, most = -1, index = 0, ret = 0;
+    betnode_t *child;
+
+    for (i = 0; i <= node->used; i++) {
+        messagesFor(node, i, &from, &to);
+        if (to - from > most) {
+            most = to - from;
+            index = i;
+        }
+    }
+    messagesFor(node, index, &from, &to);
+
+    if (!(child = poolPin(&tree->pool, betPtrs(node)[index]))) {
+        return -1;
+    }
+
+    /* a split that failed left it full: finish that before adding to it. */
+    if (!betIsLeaf(child) && child->used == child->order) {
+        ret = split(tree, node, index, child);
+        poolUnpin(&tree->pool, child, 1);
+        return ret;
+    }
+
+    /* each flush of the child frees some of its buffer, or splits one of its
+     * children, and it can only take so many of those before it splits. */
+    while (!betIsLeaf(child) && child->nmsgs + (to - from) > child->cap) {
+        if (flush(tree, child) < 0) {
+            poolUnpin(&tree->pool, child, 1);
+            return -1;
+        }
+        if (child->used == child->order) {
+            /* node's children have changed: it's for the caller to look
+             * again. */
+            ret = split(tree, node, index, child);
+            poolUnpin(&tree->pool, child, 1);
+            return ret;
+        }
+    }
+
+    if (betIsLeaf(child)) {
+        ret = applyLeaf(tree, node, index, child, &betMsgKeys(node)[from],
+                &betMsgOps(node)[from], to - from);
+    } else {
+        applyBuffer(child, &betMsgKeys(node)[from],
+                &betMsgOps(node)[from], to - from);
+    }
+    poolUnpin(&tree->pool, child, 1);
+    if (ret < 0) {
+        return -1;
+    }
+
+    memmove(&betMsgKeys(node)[from], &betMsgKeys(node)[to],
+            sizeof(int) * (node->nmsgs - to));
+    memmove(&betMsgOps(node)[from], &betMsgOps(node)[to],
+            node->nmsgs - to);
+    node->nmsgs -= to - from;
+    tree->flushes++;
+    tree->flushed += to - from;
+
+    return 0;
+}
+
+/* put a message in the root, making room for it. */
+static int put(struct betree *tree, int value, uint8_t op)
+{
+    betnode_t *root;
+    int ret = 0;
+
+    if (!(root = poolPin(&tree->pool, tree->root))) {
+        return -1;
+    }
+
+    if (betIsLeaf(root)) {
+        ret = applyLeaf(tree, NULL, 0, root, &value, &op, 1);
+        poolUnpin(&tree->pool, root, 1);
+        return ret;
+    }
+
+    /* a root left full by a split that failed is split before anything. */
+    while (root->nmsgs == root->cap || root->used == root->order) {
+        /* a flush can add a pivot to the root, and a split of it a level,
+         * which then has to be flushed through with a frame for each and a
+         * frame for a split. */
+        if (root->used >= root->order - 1 &&
+                tree->depth + 2 > tree->pool.nframes) {
+            poolUnpin(&tree->pool, root, 1);
+            errno = ENOBUFS;
+            return -1;
+        }
+        if (root->used < root->order && flush(tree, root) < 0) {
+            poolUnpin(&tree->pool, root, 1);
+            return -1;
+        }
+        if (root->used == root->order) {
+            if (split(tree, NULL, 0, root) < 0) {
+                poolUnpin(&tree->pool, root, 1);
+                return -1;
+            }
+            poolUnpin(&tree->pool, root, 1);
+            if (!(root = poolPin(&tree->pool, tree->root))) {
+                return -1;
+            }
+        }
+    }
+
+    applyBuffer(root, &value, &op, 1);
+    poolUnpin(&tree->pool, root, 1);
+
+    return 0;
+}
+
+int betSearch(struct betree *tree, int value)
+{
+    uint32_t page = tree->root;
+    betnode_t *node;
+    int i, found;
+
+    for (;;) {
+        if (!(node = poolPin(&tree->pool, page))) {
+            return -1;
+        }
+
+        if (betIsLeaf(node)) {
+            i = nodeSearch(betKeys(node), node->used, value);
+            found = i < node->used && betKeys(node)[i] == value;
+            poolUnpin(&tree->pool, node, 0);
+            return found;
+        }
+
+        /* the first message on the way down is the newest. */
+        i = nodeSearch(betMsgKeys(node), node->nmsgs, value);
+        if (i < node->nmsgs && betMsgKeys(node)[i] == value) {
+            found = BET_INSERT == betMsgOps(node)[i];
+            poolUnpin(&tree->pool, node, 0);
+            return found;
+        }
+
+        page = betPtrs(node)[childFor(node, value)];
+        poolUnpin(&tree->pool, node, 0);
+    }
+}
+
+int betInsert(struct betree *tree, int value)
+{
+    return put(tree, value, BET_INSERT);
+}
+
+int betDelete(struct betree *tree, int value)
+{
+    return put(tree, value, BET_DELETE);
+}
+
+int betSync(struct betree *tree)
+{
+    struct betmeta *meta;
+
+    if (!(meta = poolPin(&tree->pool, 0))) {
+        return -1;
+    }
+    meta->root = tree->root;
+    meta->npages = tree->npages;
+    poolUnpin(&tree->pool, meta, 1);
+
+    if (poolFlush(&tree->pool) < 0 || fsync(tree->fd) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* write the first pages of a new tree: the meta page and an empty root. */
+static int create(struct betree *tree, size_t pageSize, int order)
+{
+    struct betmeta *meta;
+    betnode_t *root;
+
+    if (!(meta = poolPinNew(&tree->pool, 0))) {
+        return -1;
+    }
+    meta->magic = BETREE_MAGIC;
+    meta->version = BETREE_VERSION;
+    meta->pageSize = pageSize;
+    meta->order = order;
+    poolUnpin(&tree->pool, meta, 1);
+
+    tree->order = order;
+    tree->npages = 1;
+    if (!(root = newNode(tree, 1))) {
+        return -1;
+    }
+    tree->root = pageOf(tree, root);
+    tree->depth = 1;
+    poolUnpin(&tree->pool, root, 1);
+
+    return betSync(tree);
+}
+
+/*
+ * Read the meta page, if it's one of ours for pages this size.
+ * @return 0, or -1 with errno set.
+ */
+static int load(struct betree *tree, size_t pageSize)
+{
+    struct betmeta *meta;
+    betnode_t *node;
+    uint32_t page;
+    int ok;
+
+    if (!(meta = poolPin(&tree->pool, 0))) {
+        return -1;
+    }
+    ok = BETREE_MAGIC == meta->magic && BETREE_VERSION == meta->version &&
+        pageSize == meta->pageSize && meta->order >= 3 &&
+        meta->order <= 0xffff && capFor(pageSize, meta->order) >= 2 &&
+        meta->root > 0 && meta->root < meta->npages;
+    tree->order = meta->order;
+    tree->root = meta->root;
+    tree->npages = meta->npages;
+    poolUnpin(&tree->pool, meta, 0);
+
+    if (!ok) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* the leaves are all as deep: count down the left edge. */
+    for (page = tree->root, tree->depth = 1;; tree->depth++) {
+        if (!(node = poolPin(&tree->pool, page))) {
+            return -1;
+        }
+        page = betIsLeaf(node) ? 0 : betPtrs(node)[0];
+        poolUnpin(&tree->pool, node, 0);
+        if (!page) {
+            return 0;
+        }
+    }
+}
+
+int betOpen(struct betree *tree, const char *path, size_t pageSize,
+        int order, int frames)
+{
+    struct stat st;
+    int saved;
+
+    memset(tree, 0x00, sizeof(*tree));
+
+    if (0 == order) {
+        order = betOrder(pageSize);
+    }
+    /* counts have to fit a short, and a buffer hold a couple of messages. */
+    if (pageSize < 64 || pageSize > (1 << 16) || order < 3 ||
+            order > 0xffff || capFor(pageSize, order) < 2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((tree->fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+        return -1;
+    }
+
+    if (fstat(tree->fd, &st) < 0 ||
+            poolInit(&tree->pool, tree->fd, pageSize, frames) < 0) {
+        goto fail;
+    }
+
+    if ((0 == st.st_size && create(tree, pageSize, order)) ||
+            load(tree, pageSize)) {
+        saved = errno;
+        poolDestroy(&tree->pool);
+        errno = saved;
+        goto fail;
+    }
+
+    /* a leaf and the most a flush brings it fit in twice a leaf. */
+    tree->cap = capFor(pageSize, tree->order);
+    tree->leafCap = (pageSize - sizeof(betnode_t)) / sizeof(int);
+    tree->scratch = malloc(sizeof(int) * tree->leafCap * 2);
+
+    return 0;
+
+fail:
+    saved = errno;
+    close(tree->fd);
+    errno = saved;
+    return -1;
+}
+
+int betClose(struct betree *tree)
+{
+    int ret = betSync(tree);
+    int saved = errno;
+
+    poolDestroy(&tree->pool);
+    free(tree->scratch);
+    if (close(tree->fd) < 0 && 0 == ret) {
+        return -1;
+    }
+
+    errno = saved;
+    return ret;
+}
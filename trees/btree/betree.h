@@ -0,0 +1,155 @@
+#ifndef _BETREE_H
+#define _BETREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bufpool.h"
+
+/******************************************************************************
+ * Macros
+ *****************************************************************************/
+
+#define BETREE_MAGIC 0x42455452 /* "BETR" */
+#define BETREE_VERSION 1
+
+/* what a message does to its key. */
+#define BET_DELETE 0
+#define BET_INSERT 1
+
+/******************************************************************************
+ * Objects
+ *****************************************************************************/
+
+/* Page 0 of the file. */
+struct betmeta {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pageSize;
+    uint32_t order;
+    uint32_t root;
+    uint32_t npages; /* pages in the file, meta included. */
+};
+
+/*
+ * Every other page is a node.  An internal node is a B+tree node of order
+ * pivots, with a buffer filling the rest of the page: the messages on their
+ * way down to its children, sorted and one per key, keys and what to do with
+ * them in two arrays.
+ *
+ * | header | ptrs[order+1] | pivots[order] | msgKeys[cap] | msgOps[cap] |
+ *
+ * A leaf is only keys, as many as fit.
+ *
+ * | header | keys[] |
+ */
+typedef struct betnode {
+    uint16_t used; /* pivots, or keys in a leaf. */
+    uint16_t order; /* an internal node splits when used reaches this. */
+    uint16_t nmsgs;
+    uint16_t cap; /* messages the buffer holds; 0 in a leaf. */
+} betnode_t;
+
+/*
+ * A B-epsilon tree: inserts and deletes don't go to a leaf, they're put in
+ * the root's buffer as messages.  When a buffer fills, the messages for the
+ * child with the most of them go down into its buffer in one batch, and so
+ * on to the leaves, so each page written on the way takes many keys at
+ * once, not one.  A search reads the buffers on its way down, and the first
+ * message it finds for its key is the newest, and the answer.
+ *
+ * A smaller order leaves more room for buffers, for cheaper inserts and
+ * dearer searches: betOrder() is halfway, with as many children as the
+ * square root of what a page holds.
+ *
+ * One thread at a time.
+ */
+struct betree {
+    int fd;
+    int order;
+    int cap; /* messages in an internal node. */
+    int leafCap; /* keys in a leaf. */
+    uint32_t root; /* the meta page's, written back by betSync(). */
+    uint32_t npages;
+    int depth; /* levels, the leaves' included. */
+    struct bufpool pool;
+    int *scratch; /* a leaf being merged with its messages. */
+    long flushes; /* batches moved down a level, */
+    long flushed; /* and the messages in them. */
+};
+
+static inline uint32_t *betPtrs(betnode_t *node)
+{
+    return (uint32_t *)(node + 1);
+}
+
+static inline int *betPivots(betnode_t *node)
+{
+    return (int *)(betPtrs(node) + node->order + 1);
+}
+
+static inline int *betMsgKeys(betnode_t *node)
+{
+    return betPivots(node) + node->order;
+}
+
+static inline uint8_t *betMsgOps(betnode_t *node)
+{
+    return (uint8_t *)(betMsgKeys(node) + node->cap);
+}
+
+static inline int *betKeys(betnode_t *leaf)
+{
+    return (int *)(leaf + 1);
+}
+
+static inline int betIsLeaf(betnode_t *node)
+{
+    return 0 == node->cap;
+}
+
+/******************************************************************************
+ * Implementation
+ *****************************************************************************/
+
+/* the order with room for about as many messages as the square of it. */
+int betOrder(size_t pageSize);
+
+/*
+ * Open the tree in the file at path, making it if it's missing or empty with
+ * nodes of this order, or betOrder()'s if it's 0; an existing file keeps
+ * its own.  pageSize must be what the file was made with.  A flush pins a
+ * page per level and one more, so frames bounds how deep the tree can grow;
+ * a tree opened with fewer than it has is only good for searches.
+ * @return 0, or -1 with errno set: EINVAL if the file isn't a tree of
+ * pageSize pages, or the order doesn't fit them.
+ */
+int betOpen(struct betree *tree, const char *path, size_t pageSize,
+        int order, int frames);
+/* sync and close.  @return 0, or -1 with errno set; it's closed either way. */
+int betClose(struct betree *tree);
+/*
+ * Write back the meta page and every dirty page, and fsync.
+ * @return 0, or -1 with errno set.
+ */
+int betSync(struct betree *tree);
+
+/*
+ * These all @return -1 with errno set if a page can't be read or written.
+ * The tree is left whole: flushes done on the way stay done, one that fails
+ * changes nothing, and a split that fails is done by the next put to need
+ * it.
+ */
+/* @return 1 if value is in the tree, else 0. */
+int betSearch(struct betree *tree, int value);
+/*
+ * Inserts and deletes are blind: they don't look for the key first, which
+ * is what makes them cheap, so they can't tell whether it was there.
+ * @return 0, or -1 with errno set: ENOBUFS if the root is full and the tree
+ * as deep as the pool's frames let it get.  It's still whole, and it'll
+ * take more if it's opened again with more frames.
+ */
+int betInsert(struct betree *tree, int value);
+int betDelete(struct betree *tree, int value);
+
+#endif
@@ -0,0 +1,480 @@
+/*
+ * B+tree: the B-tree with every key down in the leaves, and the leaves linked
+ * both ways in key order.
+ *
+ * A range is then a descent to its first key and a walk along the leaves,
+ * rather than a walk up and down the tree.  The cost is that internal blocks
+ * repeat some keys, and that a split leaf copies its right half's first key
+ * up instead of moving its middle key.
+ *
+ * Deleting never touches the internal keys unless blocks are rebalanced: a
+ * stale separator is still a correct one.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bplustree.h"
+
+/******************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/* fewest keys a block other than the root may hold. */
+#define MIN_KEYS(B) (((B)->order - 1) / 2)
+
+/******************************************************************************
+ * Implementation start
+ *****************************************************************************/
+
+static void splitInternal(struct bptree *tree, bpblock_t *blk);
+static void fixInternal(struct bptree *tree, bpblock_t *me);
+
+static size_t bpBlockBytes(int order)
+{
+    return sizeof(bpblock_t) + sizeof(bpblock_t *) * (order + 1) +
+        sizeof(int) * order;
+}
+
+static bpblock_t *bpNewBlock(struct bptree *tree)
+{
+    int id;
+    bpblock_t *b = arenaAlloc(&tree->arena, &id);
+
+    b->order = tree->order;
+    b->id = id;
+
+    return b;
+}
+
+static void bpFreeBlock(struct bptree *tree, bpblock_t *blk)
+{
+    arenaFree(&tree->arena, blk->id);
+}
+
+void bpInit(struct bptree *tree, int order)
+{
+    assert(order >= NUM_KEYS && order <= MAX_ORDER);
+
+    tree->order = order;
+    tree->n = 0;
+    arenaInit(&tree->arena, bpBlockBytes(order));
+    tree->root = bpNewBlock(tree);
+}
+
+void bpFree(struct bptree *tree)
+{
+    arenaRelease(&tree->arena);
+    tree->root = NULL;
+}
+
+/* which child of an internal block value is under; equal keys go right. */
+static inline int childFor(bpblock_t *blk, int value)
+{
+    int *keys = bpKeys(blk);
+    int i = nodeSearch(keys, blk->used, value);
+
+    return i + (i < blk->used && keys[i] == value);
+}
+
+static bpblock_t *findLeaf(struct bptree *tree, int value)
+{
+    bpblock_t *where = tree->root;
+
+    while (!bpIsLeaf(where)) {
+        where = bpPtrs(where)[childFor(where, value)];
+    }
+
+    return where;
+}
+
+/* where the pointer to child is in its parent. */
+static int childIndex(bpblock_t *parent, bpblock_t *child)
+{
+    int i;
+    bpblock_t **ptrs = bpPtrs(parent);
+
+    for (i = 0; i <= parent->used; i++) {
+        if (ptrs[i] == child) {
+            return i;
+        }
+    }
+
+    assert(0);
+    return -1;
+}
+
+/* point the children in ptrs[from..to] back at blk. */
+static void adopt(bpblock_t *blk, int from, int to)
+{
+    int i;
+    bpblock_t **ptrs = bpPtrs(blk);
+
+    for (i = from; i <= to; i++) {
+        ptrs[i]->parent = blk;
+    }
+}
+
+int bpSearch(struct bptree *tree, int value)
+{
+    bpblock_t *leaf = findLeaf(tree, value);
+    int *keys = bpKeys(leaf);
+    int i = nodeSearch(keys, leaf->used, value);
+
+    return i < leaf->used && keys[i] == value;
+}
+
+/*
+ * left has just been split, and right holds the upper half; put key, the
+ * lowest key under right, beside left in the parent.
+ */
+static void insertParent(struct bptree *tree, bpblock_t *left, int key,
+        bpblock_t *right)
+{
+    bpblock_t *parent = left->parent;
+    int *keys;
+    bpblock_t **ptrs;
+    int i;
+
+    if (!parent) {
+        /* the root split; the tree gets a level taller. */
+        parent = bpNewBlock(tree);
+        bpKeys(parent)[0] = key;
+        bpPtrs(parent)[0] = left;
+        bpPtrs(parent)[1] = right;
+        parent->used = 1;
+        left->parent = right->parent = parent;
+        tree->root = parent;
+        return;
+    }
+
+    /* key is above everything in left and below everything right of it. */
+    keys = bpKeys(parent);
+    ptrs = bpPtrs(parent);
+    i = nodeSearch(keys, parent->used, key);
+
+    memmove(&keys[i + 1], &keys[i], sizeof(int) * (parent->used - i));
+    memmove(&ptrs[i + 2], &ptrs[i + 1],
+            sizeof(bpblock_t *) * (parent->used - i));
+    keys[i] = key;
+    ptrs[i + 1] = right;
+    right->parent = parent;
+    parent->used++;
+
+    if (parent->used == parent->order) {
+        splitInternal(tree, parent);
+    }
+}
+
+static void splitLeaf(struct bptree *tree, bpblock_t *leaf)
+{
+    int middleIndex = leaf->order / 2;
+    int rightUsed = leaf->used - middleIndex;
+    bpblock_t *right = bpNewBlock(tree);
+
+    /* the middle key and everything after it go right; nothing goes up. */
+    memcpy(bpKeys(right), &bpKeys(leaf)[middleIndex], sizeof(int) * rightUsed);
+    memset(&bpKeys(leaf)[middleIndex], 0x00, sizeof(int) * rightUsed);
+    right->used = rightUsed;
+    leaf->used = middleIndex;
+
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next) {
+        leaf->next->prev = right;
+    }
+    leaf->next = right;
+
+    insertParent(tree, leaf, bpKeys(right)[0], right);
+}
+
+static void splitInternal(struct bptree *tree, bpblock_t *blk)
+{
+    int middleIndex = blk->order / 2;
+    int promote = bpKeys(blk)[middleIndex];
+    int rightUsed = blk->used - middleIndex - 1;
+    bpblock_t *right = bpNewBlock(tree);
+
+    /* as in the B-tree, the middle key moves up. */
+    memcpy(bpKeys(right), &bpKeys(blk)[middleIndex + 1],
+            sizeof(int) * rightUsed);
+    memcpy(bpPtrs(right), &bpPtrs(blk)[middleIndex + 1],
+            sizeof(bpblock_t *) * (rightUsed + 1));
+    right->used = rightUsed;
+    adopt(right, 0, rightUsed);
+
+    memset(&bpKeys(blk)[middleIndex], 0x00, sizeof(int) * (rightUsed + 1));
+    memset(&bpPtrs(blk)[middleIndex + 1], 0x00,
+            sizeof(bpblock_t *) * (rightUsed + 1));
+    blk->used = middleIndex;
+
+    insertParent(tree, blk, promote, right);
+}
+
+void bpInsert(struct bptree *tree, int value)
+{
+    bpblock_t *leaf = findLeaf(tree, value);
+    int *keys = bpKeys(leaf);
+    int i = nodeSearch(keys, leaf->used, value);
+
+    if (i < leaf->used && keys[i] == value) {
+        return;
+    }
+
+    memmove(&keys[i + 1], &keys[i], sizeof(int) * (leaf->used - i));
+    keys[i] = value;
+    leaf->used++;
+    tree->n++;
+
+    if (leaf->used == leaf->order) {
+        splitLeaf(tree, leaf);
+    }
+}
+
+/*
+ * Take keys[sep] and the pointer after it out of parent, whose children on
+ * either side of it were just merged, and fix up the parent in turn.
+ */
+static void removeSeparator(struct bptree *tree, bpblock_t *parent, int sep)
+{
+    int *keys = bpKeys(parent);
+    bpblock_t **ptrs = bpPtrs(parent);
+
+    memmove(&keys[sep], &keys[sep + 1], sizeof(int) * (parent->used - sep - 1));
+    memmove(&ptrs[sep + 1], &ptrs[sep + 2],
+            sizeof(bpblock_t *) * (parent->used - sep - 1));
+    parent->used--;
+    keys[parent->used] = 0;
+    ptrs[parent->used + 1] = NULL;
+
+    if (!parent->parent) {
+        if (0 == parent->used) {
+            /* an empty root with one child; the tree gets a level shorter. */
+            tree->root = ptrs[0];
+            tree->root->parent = NULL;
+            bpFreeBlock(tree, parent);
+        }
+        return;
+    }
+
+    if (parent->used < MIN_KEYS(parent)) {
+        fixInternal(tree, parent);
+    }
+}
+
+/* me is short a key: borrow one from a sibling, or merge with one. */
+static void fixLeaf(struct bptree *tree, bpblock_t *me)
+{
+    bpblock_t *parent = me->parent;
+    int i = childIndex(parent, me);
+    bpblock_t *left = i > 0 ? bpPtrs(parent)[i - 1] : NULL;
+    bpblock_t *right = i < parent->used ? bpPtrs(parent)[i + 1] : NULL;
+    int *keys = bpKeys(me);
+
+    if (left && left->used > MIN_KEYS(left)) {
+        memmove(&keys[1], &keys[0], sizeof(int) * me->used);
+        keys[0] = bpKeys(left)[--left->used];
+        me->used++;
+        bpKeys(parent)[i - 1] = keys[0];
+        return;
+    }
+
+    if (right && right->used > MIN_KEYS(right)) {
+        int *rKeys = bpKeys(right);
+
+        keys[me->used++] = rKeys[0];
+        memmove(&rKeys[0], &rKeys[1], sizeof(int) * (right->used - 1));
+        right->used--;
+        bpKeys(parent)[i] = rKeys[0];
+        return;
+    }
+
+    /* merge the right one of the pair into the left. */
+    if (!left) {
+        left = me;
+        me = right;
+        i++;
+    }
+
+    memcpy(&bpKeys(left)[left->used], bpKeys(me), sizeof(int) * me->used);
+    left->used += me->used;
+    left->next = me->next;
+    if (me->next) {
+        me->next->prev = left;
+    }
+    bpFreeBlock(tree, me);
+
+    removeSeparator(tree, parent, i - 1);
+}
+
+/*
+ * An internal block short a key goes as in the B-tree: rotate a key through
+ * the parent, pointer and all, or pull the parent's key down between it and
+ * a sibling and merge them.
+ */
+static void fixInternal(struct bptree *tree, bpblock_t *me)
+{
+    bpblock_t *parent = me->parent;
+    int i = childIndex(parent, me);
+    bpblock_t *left = i > 0 ? bpPtrs(parent)[i - 1] : NULL;
+    bpblock_t *right = i < parent->used ? bpPtrs(parent)[i + 1] : NULL;
+    int *keys = bpKeys(me);
+    bpblock_t **ptrs = bpPtrs(me);
+    int *pKeys = bpKeys(parent);
+
+    if (left && left->used > MIN_KEYS(left)) {
+        memmove(&keys[1], &keys[0], sizeof(int) * me->used);
+        memmove(&ptrs[1], &ptrs[0], sizeof(bpblock_t *) * (me->used + 1));
+        keys[0] = pKeys[i - 1];
+        ptrs[0] = bpPtrs(left)[left->used];
+        ptrs[0]->parent = me;
+        me->used++;
+
+        pKeys[i - 1] = bpKeys(left)[left->used - 1];
+        bpPtrs(left)[left->used] = NULL;
+        left->used--;
+        return;
+    }
+
+    if (right && right->used > MIN_KEYS(right)) {
+        int *rKeys = bpKeys(right);
+        bpblock_t **rPtrs = bpPtrs(right);
+
+        keys[me->used] = pKeys[i];
+        ptrs[me->used + 1] = rPtrs[0];
+        rPtrs[0]->parent = me;
+        me->used++;
+
+        pKeys[i] = rKeys[0];
+        memmove(&rKeys[0], &rKeys[1], sizeof(int) * (right->used - 1));
+        memmove(&rPtrs[0], &rPtrs[1], sizeof(bpblock_t *) * right->used);
+        right->used--;
+        rPtrs[right->used + 1] = NULL;
+        return;
+    }
+
+    if (!left) {
+        left = me;
+        me = right;
+        i++;
+    }
+
+    bpKeys(left)[left->used] = pKeys[i - 1];
+    memcpy(&bpKeys(left)[left->used + 1], bpKeys(me), sizeof(int) * me->used);
+    memcpy(&bpPtrs(left)[left->used + 1], bpPtrs(me),
+            sizeof(bpblock_t *) * (me->used + 1));
+    adopt(left, left->used + 1, left->used + 1 + me->used);
+    left->used += me->used + 1;
+    bpFreeBlock(tree, me);
+
+    removeSeparator(tree, parent, i - 1);
+}
+
+void bpDelete(struct bptree *tree, int value)
+{
+    bpblock_t *leaf = findLeaf(tree, value);
+    int *keys = bpKeys(leaf);
+    int i = nodeSearch(keys, leaf->used, value);
+
+    if (i == leaf->used || keys[i] != value) {
+        return;
+    }
+
+    memmove(&keys[i], &keys[i + 1], sizeof(int) * (leaf->used - i - 1));
+    leaf->used--;
+    keys[leaf->used] = 0;
+    tree->n--;
+
+    /* the root may be as empty as it likes. */
+    if (leaf->parent && leaf->used < MIN_KEYS(leaf)) {
+        fixLeaf(tree, leaf);
+    }
+}
+
+int bpSeek(struct bptree *tree, bpcursor_t *cursor, int value)
+{
+    bpblock_t *leaf = findLeaf(tree, value);
+
+    cursor->leaf = leaf;
+    cursor->index = nodeSearch(bpKeys(leaf), leaf->used, value);
+
+    /* everything here is smaller; the next leaf starts past value. */
+    if (cursor->index == leaf->used && leaf->next) {
+        cursor->leaf = leaf->next;
+        cursor->index = 0;
+    }
+
+    return bpValid(cursor);
+}
+
+int bpLast(struct bptree *tree, bpcursor_t *cursor)
+{
+    bpblock_t *where = tree->root;
+
+    while (!bpIsLeaf(where)) {
+        where = bpPtrs(where)[where->used];
+    }
+
+    cursor->leaf = where;
+    cursor->index = where->used ? where->used - 1 : 0;
+
+    return bpValid(cursor);
+}
+
+int bpNext(bpcursor_t *cursor)
+{
+    if (cursor->index < cursor->leaf->used) {
+        cursor->index++;
+    }
+
+    if (cursor->index == cursor->leaf->used && cursor->leaf->next) {
+        cursor->leaf = cursor->leaf->next;
+        cursor->index = 0;
+    }
+
+    return bpValid(cursor);
+}
+
+int bpPrev(bpcursor_t *cursor)
+{
+    if (cursor->index > 0) {
+        cursor->index--;
+        return 1;
+    }
+
+    if (cursor->leaf->prev) {
+        cursor->leaf = cursor->leaf->prev;
+        cursor->index = cursor->leaf->used - 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void depthFirstPrintPlus(bpblock_t *blk)
+{
+    int i;
+
+    printf("blk: %d, par: %d, used: %d | ", blk->id,
+            blk->parent ? blk->parent->id : -1, blk->used);
+    for (i = 0; i < blk->used; i++) {
+        printf("%d ", bpKeys(blk)[i]);
+    }
+    if (bpIsLeaf(blk)) {
+        printf("| prev: %d, next: %d\n", blk->prev ? blk->prev->id : -1,
+                blk->next ? blk->next->id : -1);
+        return;
+    }
+    printf("\n");
+
+    for (i = 0; i <= blk->used; i++) {
+        depthFirstPrintPlus(bpPtrs(blk)[i]);
+    }
+}
+
+void bpPrint(struct bptree *tree)
+{
+    depthFirstPrintPlus(tree->root);
+}
@@ -0,0 +1,99 @@
+#ifndef _BPLUSTREE_H
+#define _BPLUSTREE_H
+
+#include "btree.h"
+
+/******************************************************************************
+ * Objects
+ *****************************************************************************/
+
+/*
+ * Laid out like block_t, pointers then keys after the header, with the leaf
+ * chain added.  Every key is in a leaf; the keys in internal blocks are only
+ * copies that say which way to go, child i holding the keys from keys[i-1]
+ * up to but not including keys[i].
+ */
+typedef struct bpblock {
+    int id; /* its slot in the tree's arena. */
+    unsigned short used;
+    unsigned short order; /* split when used reaches this. */
+    struct bpblock *parent;
+    struct bpblock *prev; /* leaves only: the neighbours in key order, */
+    struct bpblock *next; /* whoever's their parent. */
+} bpblock_t;
+
+struct bptree {
+    bpblock_t *root;
+    int order;
+    long n; /* keys. */
+    struct arena arena;
+};
+
+/*
+ * A position in the leaves.  It's on a key while index < leaf->used; seeking
+ * past the last key leaves it just after it, where bpPrev() still works.  Any
+ * insert or delete invalidates it.
+ */
+typedef struct bpcursor {
+    bpblock_t *leaf;
+    int index;
+} bpcursor_t;
+
+static inline bpblock_t **bpPtrs(bpblock_t *blk)
+{
+    return (bpblock_t **)(blk + 1);
+}
+
+static inline int *bpKeys(bpblock_t *blk)
+{
+    return (int *)(bpPtrs(blk) + blk->order + 1);
+}
+
+static inline int bpIsLeaf(bpblock_t *blk)
+{
+    return NULL == bpPtrs(blk)[0];
+}
+
+/******************************************************************************
+ * Implementation
+ *****************************************************************************/
+
+/* an empty tree whose blocks have this order, see orderForBytes(). */
+void bpInit(struct bptree *tree, int order);
+void bpFree(struct bptree *tree);
+
+/* @return 1 if value is in the tree. */
+int bpSearch(struct bptree *tree, int value);
+/* a value that's already there is left alone. */
+void bpInsert(struct bptree *tree, int value);
+void bpDelete(struct bptree *tree, int value);
+
+/* @return 1 if cursor is on a key. */
+static inline int bpValid(bpcursor_t *cursor)
+{
+    return cursor->index < cursor->leaf->used;
+}
+
+/* the key under a valid cursor. */
+static inline int bpKey(bpcursor_t *cursor)
+{
+    return bpKeys(cursor->leaf)[cursor->index];
+}
+
+/*
+ * Put cursor on the first key >= value: one descent, then at most one step
+ * along the leaves.  @return bpValid(cursor).
+ */
+int bpSeek(struct bptree *tree, bpcursor_t *cursor, int value);
+/* Put cursor on the last key.  @return bpValid(cursor). */
+int bpLast(struct bptree *tree, bpcursor_t *cursor);
+/* Step to the next key.  @return bpValid(cursor). */
+int bpNext(bpcursor_t *cursor);
+/*
+ * Step to the previous key.  @return 0, and don't move, if there isn't one.
+ */
+int bpPrev(bpcursor_t *cursor);
+
+void bpPrint(struct bptree *tree);
+
+#endif
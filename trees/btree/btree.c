@@ -4,6 +4,10 @@
  * Just about all my test cases delete the right-most key.  They don't all, but
  * too many do.  I think I favor testing this; so I should be a bit more
  * programmatically thorough. :D
+ *
+ * The order is per tree, set when the tree is made.  Order 3 makes a
+ * 64 byte block; orderForBytes() picks one to fill a page instead, which
+ * keeps the tree a few levels deep for millions of keys.
  */
 
 #include <assert.h>
@@ -20,13 +24,20 @@
 
 #define NUM_ELEMENTS(X) (sizeof(X)/sizeof(*X))
 
+/* fewest keys a block other than the root may hold. */
+#define MIN_KEYS_ORDER(O) (((O) - 1) / 2)
+#define MIN_KEYS(B) MIN_KEYS_ORDER((B)->order)
+
+/* no pointers below a leaf. */
+#define IS_LEAF(B) (NULL == blockPtrs(B)[0])
+
 /******************************************************************************
  * Debug Macros
  *****************************************************************************/
 
 #define INSERT_DEBUG 0
 #define SPLIT_DEBUG 0
-#define DELETE_DEBUG 1
+#define DELETE_DEBUG 0
 
 #if DELETE_DEBUG
 #define DELETE_DPRINTF(...) \
@@ -49,220 +60,224 @@
 #define SPLIT_DPRINTF(...) do { } while (0)
 #endif
 
-/******************************************************************************
- * Program globals.
- *****************************************************************************/
-
-int counter = 0;
-block_t *blockStorage[128];
-
 /******************************************************************************
  * Implementation start
  *****************************************************************************/
 
 /*
- * Append a key into a block's list, always append, newblk can be NULL.
+ * Insert a key, and the child that goes beside it, into a block; split if
+ * that fills it.  The child goes to the right of the key if right is set, or
+ * else the left, and can be NULL.
  */
-static void blockAppend(block_t *insert, key_t *promoted, block_t *newblk);
+static void blockInsert(struct btree *tree, block_t *blk, int key,
+        block_t *child, int right);
 /* split a normal block. */
-static void blockSplit(block_t *blk);
+static void blockSplit(struct btree *tree, block_t *blk);
 /* split the root block */
-static void rootSplit(block_t *root);
-
-/*
- * insert the value into the leaf
- * (could just call insert and specify leaf as root).
- */
-static void insertLeaf(block_t *leaf, int value);
+static void rootSplit(struct btree *tree, block_t *root);
 
 static block_t *findLeftSibling(block_t *me);
-static void rotateRight(block_t *lSibling, block_t *me);
+static void rotateRight(struct btree *tree, block_t *lSibling, block_t *me);
 static block_t *findRightSibling(block_t *me);
-static void rotateLeft(block_t *rSibling, block_t *me);
-static void demoteParent(block_t *me, block_t *sub);
+static void rotateLeft(struct btree *tree, block_t *rSibling, block_t *me);
+static void demoteParent(struct btree *tree, block_t *me);
+static void rebalance(struct btree *tree, block_t *me);
 
-static void deleteLeaf(block_t *where, key_t *curr);
+static void deleteLeaf(struct btree *tree, block_t *where, int index);
 
-block_t *newBlock(void)
+size_t blockBytes(int order)
 {
-    block_t *b = malloc(sizeof(block_t));
-    memset(b, 0x00, sizeof(block_t));
+    return sizeof(block_t) + sizeof(block_t *) * (order + 1) +
+        sizeof(int) * order;
+}
 
-    blockStorage[counter] = b; /* for TDD. */
-    b->id = counter++;
+int orderForBytes(size_t bytes)
+{
+    int order = NUM_KEYS;
+
+    while (order < MAX_ORDER && blockBytes(order + 1) <= bytes) {
+        order++;
+    }
+
+    return order;
+}
+
+static block_t *newBlock(struct btree *tree)
+{
+    int id;
+    block_t *b = arenaAlloc(&tree->arena, &id);
+
+    b->order = tree->order;
+    b->id = id;
 
     return b;
 }
 
-/**
- * @return NULL if not found
- * @return block ptr if found.
- */
-block_t *search(block_t *blk, int value)
+static void freeBlock(struct btree *tree, block_t *blk)
 {
-    block_t *where;
-    key_t *curr;
-    int i;
-    int found = 0;
-
-    where = blk;
-    while (where && !found) {
-        for (i = 0; i < where->used; i++) {
-            curr = &(where->keys[i]);
-            /* If it's less, we try going down the pointer. */
-            if (value < curr->key) {
-                if (curr->ptr) {
-                    where = curr->ptr;
-                    break;
-                } else {
-                    where = NULL;
-                    break;
-                }
-            } else if (value == curr->key) {
-                found = 1;
-                break;
-            } else {
-                /* moving on? */
-
-                if (i == (where->used-1)) {
-                    /* We're greater than the last one. */
-                    curr += 1;
-                    if (curr->ptr) {
-                        where = curr->ptr;
-                        break;
-                    } else {
-                        /*
-                         * If there's nothing beyond it, then it isn't there.
-                         */
-                        where = NULL;
-                        break;
-                    }
-                }
-            }
-        }
-    }
+    arenaFree(&tree->arena, blk->id);
+}
+
+/* a tree with no blocks yet, not even the root. */
+static struct btree *allocTree(int order)
+{
+    struct btree *tree = malloc(sizeof(struct btree));
+
+    assert(order >= NUM_KEYS && order <= MAX_ORDER);
+
+    tree->order = order;
+    tree->root = NULL;
+    arenaInit(&tree->arena, blockBytes(order));
 
-    if (!found) {
+    return tree;
+}
+
+struct btree *newTree(int order)
+{
+    struct btree *tree = allocTree(order);
+
+    tree->root = newBlock(tree);
+
+    return tree;
+}
+
+block_t *treeBlock(struct btree *tree, int id)
+{
+    if (id < 0 || id >= tree->arena.slots) {
         return NULL;
     }
 
-    return where;
+    return arenaBlock(&tree->arena, id);
 }
 
-static void blockAppend(block_t *insert, key_t *promoted, block_t *newblk)
+/* where the pointer to child is in its parent. */
+static int childIndex(block_t *parent, block_t *child)
 {
-    if (newblk) {
-        SPLIT_DPRINTF("blockAppend to blk: %d, key: %d, newblk: %d\n",
-                insert->id,
-                promoted->key,
-                newblk->id);
-    }
+    int i;
+    block_t **ptrs = blockPtrs(parent);
 
-    /* always. */
-    if (newblk) {
-        newblk->parent = insert;
+    for (i = 0; i <= parent->used; i++) {
+        if (ptrs[i] == child) {
+            return i;
+        }
     }
 
-    /*
-     * Convenient we know this will always be to either the beginning or end.
-     * The above is only true on deletion instead of insert. :D  Therefore,
-     * this assumption won't always hold.  Therefore, we need to make the code
-     * generic. :D Which isn't too bad. :D
-     */
-    if (insert->used > 0) {
-        /* Insert before? */
-        if (promoted->key < insert->keys[0].key) {
-            /*
-             * In this insert case, the far right pointer should never be set.
-             */
-            assert(NULL == insert->keys[3].ptr);
+    assert(0); /* it's a child; not really possible. */
+    return -1;
+}
 
-            key_t *start = &(insert->keys[0]);
-            /* Point to the start of the last entry. */
-            key_t *end = &(insert->keys[3]);
-            size_t len = (size_t)end - (size_t)start;
+/* point the children in ptrs[from..to] back at blk. */
+static void adopt(block_t *blk, int from, int to)
+{
+    int i;
+    block_t **ptrs = blockPtrs(blk);
 
-            memmove(&(insert->keys[1]), start, len);
+    for (i = from; i <= to; i++) {
+        if (ptrs[i]) {
+            ptrs[i]->parent = blk;
+        }
+    }
+}
 
-            insert->keys[0].key = promoted->key;
-            insert->keys[0].ptr = newblk;
-            insert->used++;
-            return;
+/**
+ * @return NULL if not found
+ * @return block ptr if found.
+ */
+block_t *search(struct btree *tree, int value)
+{
+    block_t *where = tree->root;
+    int i;
+
+    while (where) {
+        int *keys = blockKeys(where);
+
+        i = nodeSearch(keys, where->used, value);
+        if (i < where->used && keys[i] == value) {
+            return where;
         }
-    } /* append. */
 
-    /* i think this is good.. */
-    insert->keys[insert->used].key = promoted->key;
-    insert->keys[insert->used+1].ptr = newblk;
-    insert->used++;
+        /* If it's less than keys[i], or past the end, go down ptrs[i]. */
+        where = blockPtrs(where)[i];
+    }
 
-    if (NUM_KEYS == insert->used) {
-        SPLIT_DPRINTF("need to split %d\n", insert->id);
+    return NULL;
+}
 
-        if (NULL == insert->parent) {
-            SPLIT_DPRINTF("need to split root variant\n");
-            return rootSplit(insert);
+static void blockInsert(struct btree *tree, block_t *blk, int key,
+        block_t *child, int right)
+{
+    int *keys = blockKeys(blk);
+    block_t **ptrs = blockPtrs(blk);
+    int i = nodeSearch(keys, blk->used, key);
+    int at = i + right; /* where child goes. */
+
+    if (child) {
+        SPLIT_DPRINTF("blockInsert to blk: %d, key: %d, child: %d\n",
+                blk->id,
+                key,
+                child->id);
+
+        /* always. */
+        child->parent = blk;
+    }
+
+    memmove(&keys[i + 1], &keys[i], sizeof(int) * (blk->used - i));
+    memmove(&ptrs[at + 1], &ptrs[at], sizeof(block_t *) * (blk->used + 1 - at));
+    keys[i] = key;
+    ptrs[at] = child;
+    blk->used++;
+
+    if (blk->order == blk->used) {
+        SPLIT_DPRINTF("need to split %d\n", blk->id);
+
+        if (NULL == blk->parent) {
+            /* root split is different. */
+            return rootSplit(tree, blk);
         } else {
-            SPLIT_DPRINTF("need to call normal block split\n");
-            return blockSplit(insert);
+            /*
+             * Blocks know who their parents are, because that tiny amount
+             * of bookkeeping simplifies the implementation.  without it, I'd
+             * have to do some tracking and unwinding.
+             */
+            return blockSplit(tree, blk);
         }
     }
 
-    /*
-     * This could need to be split; if so, I believe the promoted item changes.
-     */
-
     return;
 }
 
-static void blockSplit(block_t *blk)
+static void blockSplit(struct btree *tree, block_t *blk)
 {
     /* We've received blk, which is full, and we need to split it. */
 
-    int i;
     SPLIT_DPRINTF("blockSplit on %d\n", blk->id);
 #if SPLIT_DEBUG
     blockPrint(blk);
 #endif
 
-    /*
-     * XXX: This code is for splitting a leaf at present but I can likely make
-     * it more generic by some more bookkeeping. :D
-     */
-
-    int middleIndex = NUM_KEYS / 2;
-    key_t *middle = &(blk->keys[middleIndex]); /* this guy will be promoted. */
-
-    /* can make generic. */
-    key_t middleSave;
-    middleSave.ptr = middle->ptr;
-    key_t promote;
-    promote.key = middle->key;
+    int middleIndex = blk->order / 2; /* this guy will be promoted. */
+    int promote = blockKeys(blk)[middleIndex];
+    /* keys after the middle, and the pointers beside them, go right. */
+    int rightUsed = blk->used - middleIndex - 1;
 
-    /* these will be copied into a new block. */
-    key_t *rightStart = middle + 1;
-    key_t *end = &(blk->keys[blk->used+1]);
-    size_t rightSize = (size_t)end - (size_t)rightStart;
+    block_t *newRight = newBlock(tree);
 
-    block_t *newRight = newBlock();
-    key_t *newRightStart = &(newRight->keys[0]);
-
-    memcpy(newRightStart, rightStart, rightSize);
-    newRight->used = (rightSize / sizeof(key_t)) - 1; /* to correct for far reach. */
+    memcpy(blockKeys(newRight), &blockKeys(blk)[middleIndex + 1],
+            sizeof(int) * rightUsed);
+    memcpy(blockPtrs(newRight), &blockPtrs(blk)[middleIndex + 1],
+            sizeof(block_t *) * (rightUsed + 1));
+    newRight->used = rightUsed;
     newRight->parent = blk->parent;
 
     /* bookkeeping. */
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (newRight->keys[i].ptr) {
-            newRight->keys[i].ptr->parent = newRight;
-        }
-    }
+    adopt(newRight, 0, rightUsed);
 
-    memset(middle, 0x00, rightSize + sizeof(key_t)); /* clear them off. */
-    blk->used = middleIndex; /* used is index+1 */
-    if (middleSave.ptr) {
-        blk->keys[blk->used].ptr = middleSave.ptr;
-    }
+    /* clear them off. */
+    memset(&blockKeys(blk)[middleIndex], 0x00,
+            sizeof(int) * (rightUsed + 1));
+    memset(&blockPtrs(blk)[middleIndex + 1], 0x00,
+            sizeof(block_t *) * (rightUsed + 1));
+    blk->used = middleIndex;
 
 #if SPLIT_DEBUG
     {
@@ -274,85 +289,57 @@ static void blockSplit(block_t *blk)
     }
 #endif
 
-    return blockAppend(blk->parent, &promote, newRight);
+    return blockInsert(tree, blk->parent, promote, newRight, 1);
 }
 
 /*
- * Splitting the root block is presently done as a special edge case.
+ * Splitting the root block is presently done as a special edge case.  The
+ * root block stays put, so whoever holds it still holds the tree, and both
+ * halves move into new blocks below it.
  */
-static void rootSplit(block_t *root)
+static void rootSplit(struct btree *tree, block_t *root)
 {
-    int i;
-    /* find middle key in block. */
-    int middleIndex = NUM_KEYS / 2;
+    /* find middle key in block; it's the one that will remain. */
+    int middleIndex = root->order / 2;
+    int middleValue = blockKeys(root)[middleIndex];
+    int leftUsed = middleIndex;
+    int rightUsed = root->used - middleIndex - 1;
 
     SPLIT_DPRINTF("rootSplit...\n");
 #if SPLIT_DEBUG
     blockPrint(root);
 #endif
 
-    /* pointer to the middle key, the one that will remain. */
-    key_t *middle = &(root->keys[middleIndex]);
-
-    /* start at the beginning of the keys. */
-    key_t *leftStart = &(root->keys[0]);
-    key_t *leftEnd = middle;
-    size_t leftSize = (size_t)leftEnd - (size_t)leftStart;
-
-    /* starts immediately following the middle. */
-    key_t *rightStart = middle + 1;
-    key_t *end = &(root->keys[root->used+1]); /* to include last ptr regardless */
-    size_t rightSize = (size_t)end - (size_t)rightStart;
-
-    block_t *newLeft = newBlock();
-    block_t *newRight = newBlock();
-
-    key_t *newLeftStart = &(newLeft->keys[0]);
-    key_t *newRightStart = &(newRight->keys[0]);
-
-    /*
-     * int specific, but could be generalized and stored on the stack
-     * (or heap).
-     */
-    int middleValue = middle->key;
-
-    int leftUsed = leftSize / sizeof(key_t);
-    /* rightUsed-1, because end includes the next entry. */
-    int rightUsed = (rightSize / sizeof(key_t)) - 1;
+    block_t *newLeft = newBlock(tree);
+    block_t *newRight = newBlock(tree);
 
     /* Set up new left. */
-    memcpy(newLeftStart, leftStart, leftSize);
+    memcpy(blockKeys(newLeft), blockKeys(root), sizeof(int) * leftUsed);
+    memcpy(blockPtrs(newLeft), blockPtrs(root),
+            sizeof(block_t *) * (leftUsed + 1));
     newLeft->used = leftUsed;
     newLeft->parent = root;
-    if (middle->ptr) {
-        newLeft->keys[newLeft->used].ptr = middle->ptr;
-    }
 
     /* bookkeeping. */
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (newLeft->keys[i].ptr) {
-            newLeft->keys[i].ptr->parent = newLeft;
-        }
-    }
+    adopt(newLeft, 0, leftUsed);
 
     /* Set up new right. */
-    memcpy(newRightStart, rightStart, rightSize);
+    memcpy(blockKeys(newRight), &blockKeys(root)[middleIndex + 1],
+            sizeof(int) * rightUsed);
+    memcpy(blockPtrs(newRight), &blockPtrs(root)[middleIndex + 1],
+            sizeof(block_t *) * (rightUsed + 1));
     newRight->used = rightUsed;
     newRight->parent = root;
 
     /* bookkeeping. */
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (newRight->keys[i].ptr) {
-            newRight->keys[i].ptr->parent = newRight;
-        }
-    }
+    adopt(newRight, 0, rightUsed);
 
     /* Rebuild root block. */
-    memset(root, 0x00, sizeof(block_t));
+    memset(blockPtrs(root), 0x00, blockBytes(root->order) - sizeof(block_t));
     root->used = 1;
-    root->keys[0].key = middleValue;
-    root->keys[0].ptr = newLeft;
-    root->keys[1].ptr = newRight;
+    blockKeys(root)[0] = middleValue;
+    blockPtrs(root)[0] = newLeft;
+    blockPtrs(root)[1] = newRight;
 
     return;
 }
@@ -364,387 +351,278 @@ static void rootSplit(block_t *root)
  */
 static block_t *findLeftSibling(block_t *me)
 {
-    int i;
-    block_t *parent = me->parent;
+    int i = childIndex(me->parent, me);
 
-    /* Check all possible pointers, which includes one after ->used */
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (parent->keys[i].ptr == me) {
-            if (i == 0) {
-                return NULL; /* no left sibling. */
-            } else {
-                return parent->keys[i-1].ptr;
-            }
-        }
+    if (i == 0) {
+        return NULL; /* no left sibling. */
     }
 
-    return NULL; /* weird, not really possible. */
+    return blockPtrs(me->parent)[i - 1];
 }
 
-static void rotateRight(block_t *lSibling, block_t *me)
+static block_t *findRightSibling(block_t *me)
 {
-    int i;
-    block_t *parent = me->parent;
-    /*
-     * XXX: yes, b-tree of integers for now, but this is easy to generalize.
-     */
-    int promote;
-    key_t demote;
+    int i = childIndex(me->parent, me);
 
-    /* We need to pull the last key from lSibling, and erase it.  Nothing
-     * fancy required here because it's always the last key and it's a leaf.
-     *
-     * XXX: Later, if I need to use a rotateRight in another case, say, for
-     * internal node, it might _not_ be a leaf, and this code would then be
-     * incorrect.  I could do a quick check for now and assert that lSibling
-     * and me are leaves, but for now, I'll just review these todos when I
-     * start working on internal node deletion.
-     */
-
-    /* decrement before retrieval (for slickness :P). */
-    promote = lSibling->keys[--lSibling->used].key;
-    lSibling->keys[lSibling->used].key = 0; /* set value to 0; just in case. */
-
-    /* Because we know that we're simply rotating from a left sibling, we
-     * know that the key that points to the left sibling.
-     *
-     * Basic cases: 3, 6, 7, 8
-     *
-     * So we don't need to worry about the case where the pointer is after the
-     * value we need to pull, that's only for rotateLeft. ;)
-     */
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (parent->keys[i].ptr == lSibling) {
-            demote.key = parent->keys[i].key;
-            demote.ptr = NULL;
-            parent->keys[i].key = promote;
-            break;
-        }
+    if (i == me->parent->used) {
+        return NULL;
     }
 
-    /* insert it into the suddenly empty leaf node. */
-    blockAppend(me, &demote, NULL);
-
-    return;
+    return blockPtrs(me->parent)[i + 1];
 }
 
-static block_t *findRightSibling(block_t *me)
+/*
+ * Pull the last key up from lSibling into the parent, and the parent's key
+ * down to the front of me.  The pointer after lSibling's last key (only
+ * there if these are internal blocks) goes along to become me's first.
+ */
+static void rotateRight(struct btree *tree, block_t *lSibling, block_t *me)
 {
-    int i;
     block_t *parent = me->parent;
+    int i = childIndex(parent, lSibling);
+    int *keys = blockKeys(lSibling);
+    block_t **ptrs = blockPtrs(lSibling);
+    block_t *moved = ptrs[lSibling->used];
 
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (parent->keys[i].ptr == me) {
-            if (i == NUM_KEYS) {
-                return NULL;
-            } else {
-                return parent->keys[i+1].ptr;
-            }
-        }
-    }
+    /* decrement before retrieval (for slickness :P). */
+    int promote = keys[--lSibling->used];
+    keys[lSibling->used] = 0; /* set value to 0; just in case. */
+    ptrs[lSibling->used + 1] = NULL;
+
+    /* Because we're rotating from a left sibling, keys[i] sits between us. */
+    int demote = blockKeys(parent)[i];
+    blockKeys(parent)[i] = promote;
 
-    return NULL; /* where, not really possible. */
+    /* insert it at the front of the suddenly short block. */
+    blockInsert(tree, me, demote, moved, 0);
+
+    return;
 }
 
-static void rotateLeft(block_t *rSibling, block_t *me)
+/*
+ * The mirror of rotateRight: rSibling's first key goes up and the parent's
+ * comes down onto the end of me, along with rSibling's first pointer.
+ */
+static void rotateLeft(struct btree *tree, block_t *rSibling, block_t *me)
 {
-    int i;
     block_t *parent = me->parent;
-    /*
-     * XXX: yes, b-tree of integers for now, but this is easy to generalize.
-     */
-    int promote;
-    key_t demote;
+    int i = childIndex(parent, rSibling);
+    int *keys = blockKeys(rSibling);
+    block_t **ptrs = blockPtrs(rSibling);
+    block_t *moved = ptrs[0];
 
     /*
      * We want the 0th entry from the right sibling to be promoted, however,
      * this does require slightly more effort because we basically need to then
      * shift the block contents left (like we do in some of the split code.
      */
-
-    promote = rSibling->keys[0].key;
+    int promote = keys[0];
 
     /* fix rSibling. */
-    key_t *start = &(rSibling->keys[1]);
-    block_t *end = rSibling + 1; /* points immediately after block's end. */
-    size_t len = (size_t)end - (size_t)start;
-    memcpy(&(rSibling->keys[0]), start, len);
+    memmove(&keys[0], &keys[1], sizeof(int) * (rSibling->used - 1));
+    memmove(&ptrs[0], &ptrs[1], sizeof(block_t *) * rSibling->used);
     rSibling->used--;
+    keys[rSibling->used] = 0;
+    ptrs[rSibling->used + 1] = NULL;
 
     /*
      * The pointer to the right sibling will sit immediately to the right of
-     * the key we need to demote into block "me."
+     * the key we need to demote into block "me", and it will never be the 0th
+     * pointer.
      */
+    int demote = blockKeys(parent)[i - 1];
+    blockKeys(parent)[i - 1] = promote;
 
-    /* Because we are rotating left, the rightSibling could be beyond the keys,
-     * and it will never be the 0th key. :D  It could be the pointer to the
-     * right of the 0th key, which is held within the 1st key. :D  So, we're
-     * good.
-     */
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (parent->keys[i].ptr == rSibling) {
-            demote.key = parent->keys[i-1].key;
-            demote.ptr = NULL;
-            parent->keys[i-1].key = promote;
-            break;
-        }
-    }
-
-    /* insert it into the suddenly empty leaf node. */
-    blockAppend(me, &demote, NULL);
+    /* append it to the suddenly short block. */
+    blockInsert(tree, me, demote, moved, 1);
 
     return;
 }
 
-static void demoteParent(block_t *me, block_t *sub)
+/*
+ * me is short a key and neither sibling can spare one, so merge it with a
+ * sibling: the parent's key between them comes down, and me's keys and
+ * pointers go with it.  If me is the far left block it's pushed into its
+ * right sibling, otherwise into its left.  me is freed.
+ *
+ * The merged block holds at most MIN_KEYS - 1 + 1 + MIN_KEYS keys, which is
+ * less than the order, so this never splits.
+ */
+static void demoteParent(struct btree *tree, block_t *me)
 {
-    int i;
-
     /*
      * The following are just ya know, if we get here and these fail it's a
      * serious non-recoverable issue.
      */
-
-    /*
-     * XXX: If we get here and me is root, and it's empty, could we have gotten
-     * here?
-     */
     assert(me->parent);
 
     block_t *parent = me->parent;
-    block_t *pushedHere = NULL;
+    int i = childIndex(parent, me);
+    /* the parent's key between the two. */
+    int sep = (i == 0) ? 0 : i - 1;
+    int demote = blockKeys(parent)[sep];
+    block_t *left = (i == 0) ? me : blockPtrs(parent)[i - 1];
+    block_t *right = (i == 0) ? blockPtrs(parent)[i + 1] : me;
+    block_t *pushedHere = (i == 0) ? right : left;
+    int *lKeys = blockKeys(left), *rKeys = blockKeys(right);
+    block_t **lPtrs = blockPtrs(left), **rPtrs = blockPtrs(right);
+    int moved;
 
 #if DELETE_DEBUG
     {
-        int subid = -1;
-        if (sub) {
-            subid = sub->id;
-        }
-
-        DELETE_DPRINTF("demoteParent: me %d, my parent: %d, sub: %d\n",
+        DELETE_DPRINTF("demoteParent: me %d, my parent: %d, into: %d\n",
                 me->id,
                 parent->id,
-                subid);
+                pushedHere->id);
 
         DELETE_DPRINTF("\nme: ");
         blockPrint(me);
 
         DELETE_DPRINTF("my parent: ");
         blockPrint(parent);
-
-        if (sub) {
-            DELETE_DPRINTF("my sub: ");
-            blockPrint(sub);
-        }
     }
 #endif
 
-    /*
-     * Find whomever points to me, may be left or right pointer, and demote
-     * them into the corresponding neighbor block.
-     */
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (parent->keys[i].ptr == me) {
-            if (i == 0) {
-                pushedHere = parent->keys[i+1].ptr;
-
-                if (sub) {
-                    key_t k;
-                    k.key = parent->keys[i].key;
-
-                    DELETE_DPRINTF("trying to append key: %d, with a pointer to: %d into %d\n",
-                            k.key,
-                            sub->id,
-                            parent->keys[i+1].ptr->id);
-
-                    blockAppend(parent->keys[i+1].ptr, &k, sub);
-                } else {
-                    insertLeaf(parent->keys[i+1].ptr, parent->keys[i].key);
-                }
-
-                block_t *end = parent + 1;
-                size_t len = (size_t)end - (size_t)&(parent->keys[i+1]);
-                memcpy(&(parent->keys[0]), &(parent->keys[i+1]), len);
-            } else {
-                pushedHere = parent->keys[i-1].ptr;
-
-                if (sub) {
-                    key_t k;
-                    k.key = parent->keys[i-1].key;
-
-                    DELETE_DPRINTF("trying to append key: %d, with a pointer to: %d into %d\n",
-                            k.key,
-                            sub->id,
-                            parent->keys[i-1].ptr->id);
-
-                    blockAppend(parent->keys[i-1].ptr, &k, sub);
-                } else {
-                    insertLeaf(parent->keys[i-1].ptr, parent->keys[i-1].key);
-                }
-
-                parent->keys[i].ptr = parent->keys[i-1].ptr;
-
-                /* now move it to the left. */
-                block_t *end = parent + 1;
-                size_t len = (size_t)end - (size_t)&(parent->keys[i]);
-                memcpy(&(parent->keys[i-1]), &(parent->keys[i]), len);
-            }
+    if (pushedHere == right) {
+        /* make room at the front of right for left, then the demoted key. */
+        moved = left->used + 1;
+        memmove(&rKeys[moved], &rKeys[0], sizeof(int) * right->used);
+        memmove(&rPtrs[moved], &rPtrs[0], sizeof(block_t *) * (right->used + 1));
+        memcpy(&rKeys[0], &lKeys[0], sizeof(int) * left->used);
+        memcpy(&rPtrs[0], &lPtrs[0], sizeof(block_t *) * (left->used + 1));
+        rKeys[left->used] = demote;
+        right->used += moved;
+        adopt(right, 0, moved - 1);
+    } else {
+        /* append the demoted key, then right's keys, to left. */
+        moved = right->used + 1;
+        lKeys[left->used] = demote;
+        memcpy(&lKeys[left->used + 1], &rKeys[0], sizeof(int) * right->used);
+        memcpy(&lPtrs[left->used + 1], &rPtrs[0],
+                sizeof(block_t *) * (right->used + 1));
+        left->used += moved;
+        adopt(left, left->used - moved + 1, left->used);
+    }
 
-            break;
-        }
+    /* now take key sep and the pointer to me out of the parent. */
+    {
+        int *pKeys = blockKeys(parent);
+        block_t **pPtrs = blockPtrs(parent);
+
+        memmove(&pKeys[sep], &pKeys[sep + 1],
+                sizeof(int) * (parent->used - sep - 1));
+        memmove(&pPtrs[i], &pPtrs[i + 1],
+                sizeof(block_t *) * (parent->used - i));
+        parent->used--;
+        pKeys[parent->used] = 0;
+        pPtrs[parent->used + 1] = NULL;
     }
 
-    parent->used--;
+    freeBlock(tree, me);
 
 #if DELETE_DEBUG
     DELETE_DPRINTF("parent demoted here: blk %d\n", pushedHere->id);
     blockPrint(pushedHere);
 #endif
 
-    if (parent->used > 0) {
-        return; /* yay, bail. */
-    }
-
-    /* Ok, now the parent block is empty! */
-    block_t *carry = parent->keys[0].ptr;
-
-    /* just for fun. */
-    memset(&parent->keys[0], 0x00, (NUM_KEYS+1) * sizeof(key_t));
-
     /* was my parent the root block? */
     if (NULL == parent->parent) {
-        /* this isn't an object where I can cleanly just replace the root;
-         * without adding in a context structure that gets passed around
-         * or something along those lines.
-         */
-        memcpy(parent, carry, sizeof(block_t));
-        {
-            int i;
-            for (i = 0; i <= NUM_KEYS; i++) {
-                if (parent->keys[i].ptr) {
-                    parent->keys[i].ptr->parent = parent; /* fix backlinks. */
-                }
-            }
+        if (parent->used > 0) {
+            return; /* yay, bail. */
         }
 
+        /*
+         * The root is empty, with one child.  this isn't an object where I
+         * can cleanly just replace the root; without adding in a context
+         * structure that gets passed around or something along those lines.
+         * So the child moves up into it, all but its id, which is where it
+         * lives in the arena.
+         */
+        block_t *carry = blockPtrs(parent)[0];
+        int id = parent->id;
+
+        memcpy(parent, carry, blockBytes(carry->order));
+        parent->id = id;
         parent->parent = NULL;
-        free(carry);
+        adopt(parent, 0, parent->used); /* fix backlinks. */
+        freeBlock(tree, carry);
 
         return;
     }
 
+    if (parent->used >= MIN_KEYS(parent)) {
+        return; /* yay, bail. */
+    }
+
 #if DELETE_DEBUG
-    DELETE_DPRINTF("\n\nparent (%d) is empty\n", parent->id);
+    DELETE_DPRINTF("\n\nparent (%d) is short\n", parent->id);
     blockPrint(parent);
-    DELETE_DPRINTF("don't abandon: %d, \n", carry->id);
-    blockPrint(carry);
 #endif
 
-    block_t *lSib = findLeftSibling(parent);
-    block_t *rSib = findRightSibling(parent);
-
-    DELETE_DPRINTF("left sib: 0x%p, right sib: 0x%p\n", lSib, rSib);
-
-    /* You only have a left sibling and it's insufficient. */
-    if (lSib && !rSib && lSib->used == 1) {
-#if DELETE_DEBUG
-        DELETE_DPRINTF("lSib insufficient (no rSib):\n");
-        blockPrint(lSib);
-#endif
+    return rebalance(tree, parent);
+}
 
-        demoteParent(parent, carry);
-        free(parent);
-        return;
-    }
+/*
+ * me has one key fewer than it may; borrow from a sibling or merge with one.
+ */
+static void rebalance(struct btree *tree, block_t *me)
+{
+    block_t *lSib, *rSib;
 
-    /* You only have a right sibling and it's insufficient. */
-    if (rSib && !lSib && rSib->used == 1) {
-#if DELETE_DEBUG
-        fprintf(stderr, "rSib insufficient (no lSib):\n");
-        blockPrint(rSib);
-#endif
+    /*
+     * Find siblings, you seriously will have at least one, we know that by the
+     * balanced tree properties.
+     */
+    lSib = findLeftSibling(me);
+    rSib = findRightSibling(me);
 
-        demoteParent(parent, carry);
-        free(parent);
-        return;
-    }
+    DELETE_DPRINTF("left sib: 0x%p, right sib: 0x%p\n", lSib, rSib);
 
-    /* Both siblings are valid, but insufficient */
-    if ((lSib && lSib->used == 1) && (rSib && rSib->used == 1)) {
-#if DELETE_DEBUG
-        fprintf(stderr, "both valid, insufficient:\n");
-        blockPrint(lSib);
-        blockPrint(rSib);
-#endif
+    if (lSib && lSib->used > MIN_KEYS(lSib)) {
+        /*
+         * If there is a left sibling and it's valid, we don't care about the
+         * right.
+         */
 
-        demoteParent(parent, carry);
-        free(parent);
-        return;
+        /* rotate right. */
+        return rotateRight(tree, lSib, me);
     }
 
-    if (lSib && lSib->used > 1) {
-#if DELETE_DEBUG
-        fprintf(stderr, "lSib is sufficient, so probably rotate:\n");
-        blockPrint(lSib);
-#endif
-
-    } else {
-#if DELETE_DEBUG
-        fprintf(stderr, "rSib is sufficient, so probably rotate:\n");
-        blockPrint(rSib);
-#endif
+    if (rSib && rSib->used > MIN_KEYS(rSib)) {
+        /* rotate left. */
+        return rotateLeft(tree, rSib, me);
     }
 
-    assert(0);
-
-    return;
+    /* Every sibling there is, is insufficient. */
+    return demoteParent(tree, me);
 }
 
-static void deleteLeaf(block_t *where, key_t *curr)
+static void deleteLeaf(struct btree *tree, block_t *where, int index)
 {
-    block_t *lSib, *rSib;
+    int *keys = blockKeys(where);
 
     /*
-     * We know it's a leaf, so we delete it, then, we need to check if that was
-     * the last item in the block.
+     * We know it's a leaf, so we delete it, then, we need to check if that
+     * left the block short.
      */
-
-    /*
-     * A leaf cannot have all three, A, B, and C, because it would be split
-     * if the block holds maximum 3.  So, this can be expanded generically
-     * easily (and is done so below).
-     *
-     * -----------------
-     * | A | B | C | X |
-     * -----------------
-     *
-     * If curr is C, then we want to copy X over it, which we know will be
-     * empty.  If curr is B, or A, we want to copy from the next to the end
-     * over it.
-     *
-     * curr cannot be X. :D  Which is a handy thing to know.
-     */
-    key_t *start = curr + 1;
-    block_t *end = where + 1; /* points immediately after X's end. */
-    size_t len = (size_t)end - (size_t)start;
-    memcpy(curr, start, len);
+    memmove(&keys[index], &keys[index + 1],
+            sizeof(int) * (where->used - index - 1));
     where->used--;
+    keys[where->used] = 0;
 
-    if (where->used) {
+    if (where->used >= MIN_KEYS(where)) {
         return; /* yay, bail! */
     }
 
-    /* if this is root. */
+    /* if this is root, it may be as empty as it likes. */
     if (!where->parent) {
-        DELETE_DPRINTF("root node is empty!\n");
-        assert(0);
         return;
     }
 
-    DELETE_DPRINTF("the leaf block is now empty!\n");
+    DELETE_DPRINTF("the leaf block is now short!\n");
 
     /*
-     * Ok, so we now have an empty block, so we need to recursively try to
+     * Ok, so we now have a short block, so we need to recursively try to
      * merge and re-balance the tree.
      *
      * This could just mean a pull or a rotate depending, and that might be the
@@ -756,9 +634,9 @@ static void deleteLeaf(block_t *where, key_t *curr)
      *
      * Basically, the parent block is either sufficiently filled, or
      * insufficiently filled and the sibling or siblings can be sufficient or
-     * insufficient.  The definition here for insufficient means, that there is
-     * only one key in the block, and therefore moving that key or promoting it
-     * will leave us with an empty block.
+     * insufficient.  The definition here for insufficient means, that the
+     * block holds only the fewest keys it may, and therefore moving one or
+     * promoting it will leave us with a short block.
      */
 
     /*
@@ -789,9 +667,9 @@ static void deleteLeaf(block_t *where, key_t *curr)
      * -----------------------------------------------
      * | 8    | Y      | Y       | Y       | rot. -> |
      * -----------------------------------------------
-     * | 9 ... (not yet documented, will document when I handle it)
      *
-     * + more complex; detailed later (as case 11, lol).
+     * + push neighbor down, then the parent is short, which recurses up to
+     * re-balance it the same way (cases 10 and 11).
      * ++ push neighbor down, free block, three variations for immediate
      * siblings (4a, 4b,4c).
      *
@@ -803,283 +681,186 @@ static void deleteLeaf(block_t *where, key_t *curr)
      * is faster only because it doesn't waste time flipping coins and produces
      * the same balanced tree.
      *
-     * There are other interesting cases for leaf deletion based on case 1
-     * above, which recurses up to re-balance.
-     *
-     * | case | parent | left    | right   | action  |
-     * |      | suff.  | sibling | sibling |         |
-     * |      |        | suff.   | suff.   |         |
-     * -----------------------------------------------
-     * | 10   |
-     * -----------------------------------------------
-     * | 11   |
-     * -----------------------------------------------
-     * | 12   |
-     * -----------------------------------------------
-     * | 13   |
-     * -----------------------------------------------
+     * Internal blocks that come up short go through the same table, with the
+     * pointers moving along with the keys.
      *
-     */
-
-    /* Determine if immediate siblings are sufficient. */
-
-    /*
      * XXX: This code only checks immediate siblings for rotation, whereas
      * really; to be generic, it could roll siblings along if any sibling has
-     * > 1 key in it.
+     * a key to spare.
      */
-
-    /*
-     * Find siblings, you seriously will have at least one, we know that by the
-     * balanced tree properties.
-     */
-    lSib = findLeftSibling(where);
-    rSib = findRightSibling(where);
-
-    DELETE_DPRINTF("left sib: 0x%p, right sib: 0x%p\n", lSib, rSib);
-
-    /*
-     * This code is going to be effectively in two places, which means maybe
-     * I can balance it more nicely; I'll refactor later.
-     */
-
-    /* You only have a left sibling and it's insufficient. */
-    if (lSib && !rSib && lSib->used == 1) {
-        demoteParent(where, NULL);
-        free(where);
-        return;
-    }
-
-    /* You only have a right sibling and it's insufficient. */
-    if (rSib && !lSib && rSib->used == 1) {
-        demoteParent(where, NULL);
-        free(where);
-        return;
-    }
-
-    /* Both siblings are valid, but insufficient */
-    if ((lSib && lSib->used == 1) && (rSib && rSib->used == 1)) {
-        demoteParent(where, NULL);
-        free(where);
-        return;
-    }
-
-    if (lSib && lSib->used > 1) {
-        /*
-         * If there is a left sibling and it's valid, we don't care about the
-         * right.
-         */
-
-        /* rotate right. */
-        return rotateRight(lSib, where);
-    } else {
-        /*
-         * If no left sibling, or left sibling not valid, the right sibling
-         * exists and is valid.
-         */
-
-        /* rotate left. */
-        return rotateLeft(rSib, where);
-    }
-
-    return;
+    return rebalance(tree, where);
 }
 
-void delete(block_t *root, int value)
+void delete(struct btree *tree, int value)
 {
     int i;
-    key_t *curr;
-    int leaf = 0;
 
     DELETE_DPRINTF("deleting: %d\n", value);
 
     /* 1. Find the block. */
-    block_t *where = search(root, value);
+    block_t *where = search(tree, value);
 
     if (!where) {
         return;
     }
 
     /* 2. Find the key, check if it's a leaf. */
-    for (i = 0; i < where->used; i++) {
-        curr = &(where->keys[i]);
-
-        if (value == curr->key) {
-            if (!curr->ptr) {
-                leaf = 1;
-            }
-            break;
-        }
-    }
+    i = nodeSearch(blockKeys(where), where->used, value);
 
-    if (leaf) {
+    if (IS_LEAF(where)) {
         /* 3a. Handle leaf deletion. */
-        deleteLeaf(where, curr);
+        deleteLeaf(tree, where, i);
     } else {
-        /* 3b. Handle parent deletion. */
+        /*
+         * 3b. Handle parent deletion: its predecessor, the largest key under
+         * the pointer to its left, is in a leaf; move that up over it and
+         * delete it from the leaf instead.
+         */
         DELETE_DPRINTF("this node has children!\n");
-        assert(0);
-        //deleteInternal();
-    }
-}
 
-static void insertLeaf(block_t *leaf, int value)
-{
-    int i;
-    key_t *curr;
-
-    /*
-     * This is identical to code inside insert, so that can just call this;
-     * once I have fuller regression testing in place.
-     */
-    for (i = 0; i < leaf->used; i++) {
-        curr = &(leaf->keys[i]);
-
-        if (value < curr->key) {
-            /* it goes here. */
-            /* we need to shift everything to the right by one. */
-
-            /* point immediately after the last memory slot. */
-            key_t *end = &(leaf->keys[leaf->used]);
-            size_t len = (size_t)end - (size_t)curr;
-
-            (void)memmove(curr + 1, curr, len);
-            curr->key = value;
-            leaf->used++;
-            break;
-        } else {
-            /* we're greater */
-            if (i == (leaf->used-1)) {
-                /* we're at the last slot in use; so we can just set after. */
-                leaf->keys[leaf->used].key = value;
-                leaf->used++;
-                break;
-            }
+        block_t *leaf = blockPtrs(where)[i];
+        while (!IS_LEAF(leaf)) {
+            leaf = blockPtrs(leaf)[leaf->used];
         }
+
+        blockKeys(where)[i] = blockKeys(leaf)[leaf->used - 1];
+        deleteLeaf(tree, leaf, leaf->used - 1);
     }
 }
 
 /*
- * Insert was designed by introducing keys in monotonically increasing order.
- *
- * There are other interesting cases, that will require some modifications.
- *
- *
+ * Descend to the leaf where value belongs and put it there, splitting up the
+ * tree as far as needed.  A value that's already in the tree is left alone.
  */
-void insert(block_t *root, int value)
+void insert(struct btree *tree, int value)
 {
-    block_t *where;
-    key_t *curr;
+    block_t *where = tree->root;
     int i;
-    int found = 0;
 
     INSERT_DPRINTF("\nentered insert: %d\n", value);
 
-    /* first dude ever; could be called if all deleted. */
-    if (0 == root->used) {
-        root->used++;
-        root->keys[0].key = value;
+    /* could do this recursively, but meh. */
+    for (;;) {
+        int *keys = blockKeys(where);
+        block_t *next;
 
-        INSERT_DPRINTF("placed 0th root entry\n");
-        return;
-    }
+        i = nodeSearch(keys, where->used, value);
+        if (i < where->used && keys[i] == value) {
+            return;
+        }
 
-    /* could do this recursively, but meh. */
-    where = root;
-    while (!found) {
-        for (i = 0; i < where->used; i++) {
-            curr = &(where->keys[i]);
-
-            /* If the value is less, we follow the link. */
-            if (value < curr->key) {
-                if (curr->ptr) {
-                    where = curr->ptr;
-                } else {
-                    found = 1; /* we're at the lowest block. */
-                }
-                break;
-            } else {
-                /*
-                 * We're greater than the key; check if we're after the last
-                 * one.
-                 */
-                if (i == (where->used-1)) {
-                    /* we're at the last one, and we're greater, use pointer
-                     * to the right.
-                     */
-                    curr += 1;
-                    if (curr->ptr) {
-                        where = curr->ptr;
-                    } else {
-                        found = 1;
-                    }
-                    break;
-                }
-            }
+        next = blockPtrs(where)[i];
+        if (!next) {
+            break; /* we're at the lowest block. */
         }
+        where = next;
     }
 
     INSERT_DPRINTF("found block: %d\n", where->id);
 
     /*
-     * let's check this block to see if it goes there.
-     *
      * we know that all the slots aren't in use yet or it would already be
      * split, so we can guarantee placement, then split.
      */
+    return blockInsert(tree, where, value, NULL, 1);
+}
 
-    /*
-     * Really don't need to find this again; except later i may split up
-     * finding the block and finding where it goes.
-     *
-     * XXX: Could do this via insertblock if I upgrade that code to not always
-     * just append into the block; making it more general should be helpful
-     * regardless.
-     */
-    for (i = 0; i < where->used; i++) {
-        curr = &(where->keys[i]);
+/*
+ * Cut keys[0..n) into blocks of about cap keys, with one key between each
+ * pair that goes up a level, spread evenly so none is short.  Below an
+ * internal level, children[0..n] are split along with the keys.
+ *
+ * @return how many blocks, which go in blocks[], and the keys between them in
+ * up[].
+ */
+static int loadLevel(struct btree *tree, int cap, const int *keys, int n,
+        block_t **children, block_t **blocks, int *up)
+{
+    int order = tree->order;
+    /* every block hangs n + 1 pointers below it, NULL or not, between them. */
+    long gaps = (long)n + 1;
+    long count = (gaps + cap) / (cap + 1);
+    long at = 0;
+    int b, i;
+
+    if (count > 1 && gaps < count * (MIN_KEYS_ORDER(order) + 1)) {
+        count = gaps / (MIN_KEYS_ORDER(order) + 1);
+    }
+    if (count < 1) {
+        count = 1;
+    }
+    assert(gaps <= count * order);
+
+    for (b = 0; b < count; b++) {
+        block_t *blk = newBlock(tree);
+        int used = gaps / count + (b < gaps % count) - 1;
+
+        memcpy(blockKeys(blk), &keys[at], sizeof(int) * used);
+        if (children) {
+            memcpy(blockPtrs(blk), &children[at], sizeof(block_t *) * (used + 1));
+            for (i = 0; i <= used; i++) {
+                blockPtrs(blk)[i]->parent = blk;
+            }
+        }
+        blk->used = used;
+        blocks[b] = blk;
 
-        if (value < curr->key) {
-            /* it goes here. */
-            /* we need to shift everything to the right by one. */
+        at += used;
+        if (b < count - 1) {
+            up[b] = keys[at++];
+        }
+    }
 
-            /* point immediately after the last memory slot. */
-            key_t *end = &(where->keys[where->used]);
-            size_t len = (size_t)end - (size_t)curr;
+    return count;
+}
 
-            (void)memmove(curr + 1, curr, len);
-            curr->key = value;
-            where->used++;
-            break;
-        } else {
-            /* we're greater */
-            if (i == (where->used-1)) {
-                /* we're at the last slot in use; so we can just set after. */
-                where->keys[where->used].key = value;
-                where->used++;
-                break;
-            }
-        }
+struct btree *bulkLoad(int order, const int *keys, int n, double fill)
+{
+    struct btree *tree = allocTree(order);
+    int cap = fill * (order - 1) + 0.5;
+    int count, i;
+    int *up, *level = (int *)keys;
+    block_t **blocks, **below = NULL;
+
+    if (cap < MIN_KEYS_ORDER(order)) {
+        cap = MIN_KEYS_ORDER(order);
+    }
+    if (cap > order - 1) {
+        cap = order - 1;
     }
 
-    /* ok, now do we need to split where? */
-    if (NUM_KEYS == where->used) {
-        INSERT_DPRINTF("need to split\n");
+    for (i = 1; i < n; i++) {
+        assert(keys[i - 1] < keys[i]);
+    }
 
-        if (NULL == where->parent) {
-            /* root split is different. */
-            return rootSplit(root);
-        } else {
-            /*
-             * Blocks know who their parents are, because that tiny amount
-             * of bookkeeping simplifies the implementation.  without it, I'd
-             * have to do some tracking and unwinding.
-             */
-            return blockSplit(where);
+    /* the leaves, then each level from the keys between the one below. */
+    for (;;) {
+        count = (n + 1L + MIN_KEYS_ORDER(order)) / (MIN_KEYS_ORDER(order) + 1);
+        blocks = malloc(sizeof(block_t *) * (count + 1));
+        up = malloc(sizeof(int) * (count + 1));
+
+        count = loadLevel(tree, cap, level, n, below, blocks, up);
+
+        if (level != keys) {
+            free(level);
+        }
+        free(below);
+
+        if (1 == count) {
+            break;
         }
+
+        level = up;
+        n = count - 1;
+        below = blocks;
     }
 
-    return;
+    tree->root = blocks[0];
+
+    free(up);
+    free(blocks);
+
+    return tree;
 }
 
 void blockPrint(block_t *blk)
@@ -1087,15 +868,14 @@ void blockPrint(block_t *blk)
     int i;
     block_t *b;
 
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (blk->keys[i].ptr) {
-            b = blk->keys[i].ptr;
+    for (i = 0; i <= blk->used; i++) {
+        if ((b = blockPtrs(blk)[i])) {
             printf("ptr->%d ", b->id);
         } else {
             printf("-- ");
         }
         if (i < blk->used) {
-            printf("val: %d | ", blk->keys[i].key);
+            printf("val: %d | ", blockKeys(blk)[i]);
         } else {
             printf("| ");
         }
@@ -1109,7 +889,6 @@ void blockPrint(block_t *blk)
 void depthFirstPrint(block_t *blk)
 {
     int i;
-    block_t *b;
 
     if (blk->parent == NULL) {
         printf("root: %d, used: %d | ", blk->id, blk->used);
@@ -1120,50 +899,29 @@ void depthFirstPrint(block_t *blk)
                 blk->used);
     }
 
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (blk->keys[i].ptr) {
-            b = blk->keys[i].ptr;
-            printf("ptr->%d ", b->id);
-        } else {
-            printf("-- ");
-        }
-        if (i < blk->used) {
-            printf("val: %d | ", blk->keys[i].key);
-        } else {
-            printf("| ");
-        }
-    }
-    printf("\n");
+    blockPrint(blk);
 
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (blk->keys[i].ptr) {
-            depthFirstPrint(blk->keys[i].ptr);
+    for (i = 0; i <= blk->used; i++) {
+        if (blockPtrs(blk)[i]) {
+            depthFirstPrint(blockPtrs(blk)[i]);
         }
     }
 
     return;
 }
 
-void printTree(const char *lead, block_t *blk)
+void printTree(const char *lead, struct btree *tree)
 {
     printf("%s", lead);
-    depthFirstPrint(blk);
+    depthFirstPrint(tree->root);
 
     return;
 }
 
-void depthFirstFree(block_t *blk)
+void depthFirstFree(struct btree *tree)
 {
-    int i;
-
-    for (i = 0; i <= NUM_KEYS; i++) {
-        if (blk->keys[i].ptr) {
-            depthFirstFree(blk->keys[i].ptr);
-        }
-    }
-
-    free(blk);
+    arenaRelease(&tree->arena);
+    free(tree);
 
     return;
 }
-
@@ -1,50 +1,101 @@
-
 #ifndef _BTREE_H
 #define _BTREE_H
 
+#include <stddef.h>
+
+#include "arena.h"
+#include "nodesearch.h"
+
 /******************************************************************************
  * Macros
  *****************************************************************************/
 
 /*
- * I'm just going to implement this to store up to three keys per block.
+ * The order the tests use: a block splits when it reaches three keys, and
+ * that makes a 64 byte block.  Any other order is picked when the tree is
+ * made, see newTree() and orderForBytes().
  */
 #define NUM_KEYS 3
 
+/* used and order are shorts. */
+#define MAX_ORDER 0xffff
+
 /******************************************************************************
  * Objects
  *****************************************************************************/
 
-struct block;
-
-typedef struct key {
-    struct block *ptr; /* child block. */
-    int key; /* the value. */
-} key_t;
-
+/*
+ * The keys and child pointers are kept in two arrays after the header,
+ * rather than as (pointer, key) pairs, so a search within a block only
+ * touches the keys:
+ *
+ * | header | ptrs[order+1] | keys[order] |
+ *
+ * There's room for order keys, so that a block can hold the one that makes it
+ * split, and one more pointer than keys, so that there's a trailing pointer.
+ */
 typedef struct block {
-    int id; /* for humans. */
-    int used;
+    int id; /* its slot in the tree's arena; for humans, too. */
+    unsigned short used;
+    unsigned short order; /* split when used reaches this. */
     struct block *parent; /* back-link to make splitting and so on easier */
-    key_t keys[NUM_KEYS+1]; /* so that there's a trailing pointer. */
 } block_t;
 
+/*
+ * The tree: its root, which stays the same block for the tree's life, and the
+ * arena all its blocks come from.
+ */
+struct btree {
+    block_t *root;
+    int order;
+    struct arena arena;
+};
+
+static inline block_t **blockPtrs(block_t *blk)
+{
+    return (block_t **)(blk + 1);
+}
+
+static inline int *blockKeys(block_t *blk)
+{
+    return (int *)(blockPtrs(blk) + blk->order + 1);
+}
+
 /******************************************************************************
  * Implementation
  *****************************************************************************/
 
-/* create a new empty block. */
-block_t *newBlock(void);
+/* bytes in a block of this order. */
+size_t blockBytes(int order);
+/* the largest order whose blocks fit in bytes, never less than 3. */
+int orderForBytes(size_t bytes);
 
-block_t *search(block_t *blk, int value);
-void delete(block_t *root, int value);
-/* insert the value into the tree starting at the specified block. */
-void insert(block_t *root, int value);
+/* create a new empty tree whose blocks have this order. */
+struct btree *newTree(int order);
+/* the block in slot id, or NULL past the last; for tests. */
+block_t *treeBlock(struct btree *tree, int id);
+
+/*
+ * Build a tree of this order from keys[0..n), which must be sorted and
+ * distinct, in one pass: the leaves are packed left to right, fill of the way
+ * full, then each level above is packed from the keys left between the
+ * blocks of the one below.
+ */
+struct btree *bulkLoad(int order, const int *keys, int n, double fill);
+
+block_t *search(struct btree *tree, int value);
+void delete(struct btree *tree, int value);
+/* insert the value into the tree. */
+void insert(struct btree *tree, int value);
 /* print one block. */
 void blockPrint(block_t *blk);
 /* print each block in a dfs pattern. */
 void depthFirstPrint(block_t *blk);
-void printTree(const char *lead, block_t *blk);
-void depthFirstFree(block_t *blk);
+void printTree(const char *lead, struct btree *tree);
+/*
+ * free the tree and all its blocks; that's a free per arena chunk, not a walk
+ * over the blocks, whatever the name says.
+ */
+void depthFirstFree(struct btree *tree);
 
 #endif
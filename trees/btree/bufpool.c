@@ -0,0 +1,306 @@
+/*
+ * Buffer pool: page-sized frames over a file, read with pread and written
+ * back with pwrite, evicted by CLOCK.
+ *
+ * A page is found in the frames through a small open addressing table from
+ * page number to frame, twice the frames in size so it never fills.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bufpool.h"
+
+#define FRAME_DATA(P, I) ((P)->memory + (size_t)(I) * (P)->pageSize)
+
+static inline int slotFor(struct bufpool *pool, uint32_t page)
+{
+    /* Fibonacci hashing; neighbouring pages scatter. */
+    return (page * 2654435769u) >> 7 & pool->mask;
+}
+
+/* @return the frame holding page, or -1. */
+static int lookup(struct bufpool *pool, uint32_t page)
+{
+    int i = slotFor(pool, page);
+
+    while (pool->table[i] >= 0) {
+        if (pool->frames[pool->table[i]].page == page) {
+            return pool->table[i];
+        }
+        i = (i + 1) & pool->mask;
+    }
+
+    return -1;
+}
+
+static void tableAdd(struct bufpool *pool, uint32_t page, int frame)
+{
+    int i = slotFor(pool, page);
+
+    while (pool->table[i] >= 0) {
+        i = (i + 1) & pool->mask;
+    }
+    pool->table[i] = frame;
+}
+
+/* take page out, shifting back any entry that probed past it. */
+static void tableRemove(struct bufpool *pool, uint32_t page)
+{
+    int i = slotFor(pool, page);
+    int j;
+
+    while (pool->frames[pool->table[i]].page != page) {
+        i = (i + 1) & pool->mask;
+    }
+
+    for (j = (i + 1) & pool->mask; pool->table[j] >= 0;
+            j = (j + 1) & pool->mask) {
+        int home = slotFor(pool, pool->frames[pool->table[j]].page);
+
+        /* can the entry at j live at the hole i?  Only if home isn't in (i, j]. */
+        if (((j - home) & pool->mask) >= ((j - i) & pool->mask)) {
+            pool->table[i] = pool->table[j];
+            i = j;
+        }
+    }
+    pool->table[i] = -1;
+}
+
+int poolInit(struct bufpool *pool, int fd, size_t pageSize, int nframes)
+{
+    int i, slots = 1;
+
+    if (nframes < POOL_MIN_FRAMES) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    while (slots < nframes * 2) {
+        slots <<= 1;
+    }
+
+    memset(pool, 0x00, sizeof(*pool));
+    pool->fd = fd;
+    pool->pageSize = pageSize;
+    pool->nframes = nframes;
+    pool->frames = calloc(nframes, sizeof(struct frame));
+    pool->memory = aligned_alloc(4096,
+            ((size_t)nframes * pageSize + 4095) & ~(size_t)4095);
+    pool->table = malloc(sizeof(int) * slots);
+    pool->mask = slots - 1;
+    for (i = 0; i < slots; i++) {
+        pool->table[i] = -1;
+    }
+
+    return 0;
+}
+
+void poolDestroy(struct bufpool *pool)
+{
+    free(pool->frames);
+    free(pool->memory);
+    free(pool->table);
+    memset(pool, 0x00, sizeof(*pool));
+}
+
+static int writeBack(struct bufpool *pool, int frame)
+{
+    struct frame *f = &pool->frames[frame];
+    const char *data = FRAME_DATA(pool, frame);
+    off_t at = (off_t)f->page * pool->pageSize;
+    size_t done = 0;
+
+    if (pool->beforeWrite && f->lsn && pool->beforeWrite(pool->ctx, f->lsn)) {
+        return -1;
+    }
+
+    while (done < pool->pageSize) {
+        ssize_t w = pwrite(pool->fd, data + done, pool->pageSize - done,
+                at + done);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += w;
+    }
+
+    f->dirty = 0;
+    pool->stats.writebacks++;
+
+    return 0;
+}
+
+static int readIn(struct bufpool *pool, int frame)
+{
+    char *data = FRAME_DATA(pool, frame);
+    off_t at = (off_t)pool->frames[frame].page * pool->pageSize;
+    size_t done = 0;
+
+    while (done < pool->pageSize) {
+        ssize_t r = pread(pool->fd, data + done, pool->pageSize - done,
+                at + done);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (r == 0) {
+            /* past the end: a page nobody's written yet. */
+            memset(data + done, 0x00, pool->pageSize - done);
+            break;
+        }
+        done += r;
+    }
+
+    return 0;
+}
+
+/* @return a free frame, evicting if need be, or -1. */
+static int victim(struct bufpool *pool)
+{
+    int sweeps;
+
+    /* twice round: once to clear the bits, once to find one clear. */
+    for (sweeps = 0; sweeps < pool->nframes * 2; sweeps++) {
+        int i = pool->hand;
+        struct frame *f = &pool->frames[i];
+
+        pool->hand = (pool->hand + 1) % pool->nframes;
+
+        if (!f->valid) {
+            return i;
+        }
+        if (f->pins) {
+            continue;
+        }
+        if (f->ref) {
+            f->ref = 0;
+            continue;
+        }
+
+        if (f->dirty && writeBack(pool, i) < 0) {
+            return -1;
+        }
+        tableRemove(pool, f->page);
+        f->valid = 0;
+        pool->stats.evictions++;
+
+        return i;
+    }
+
+    errno = ENOBUFS;
+    return -1;
+}
+
+static void *pin(struct bufpool *pool, uint32_t page, int fresh)
+{
+    int i = lookup(pool, page);
+    struct frame *f;
+
+    if (i >= 0) {
+        f = &pool->frames[i];
+        pool->stats.hits++;
+        if (fresh) {
+            memset(FRAME_DATA(pool, i), 0x00, pool->pageSize);
+        }
+    } else {
+        if ((i = victim(pool)) < 0) {
+            return NULL;
+        }
+        f = &pool->frames[i];
+        f->page = page;
+        f->dirty = 0;
+        f->lsn = 0;
+        pool->stats.misses++;
+
+        if (fresh) {
+            memset(FRAME_DATA(pool, i), 0x00, pool->pageSize);
+        } else if (readIn(pool, i) < 0) {
+            return NULL;
+        }
+
+        f->valid = 1;
+        tableAdd(pool, page, i);
+    }
+
+    f->pins++;
+    f->ref = 1;
+    if (fresh) {
+        f->dirty = 1;
+    }
+
+    return FRAME_DATA(pool, i);
+}
+
+void *poolPin(struct bufpool *pool, uint32_t page)
+{
+    return pin(pool, page, 0);
+}
+
+void *poolPinNew(struct bufpool *pool, uint32_t page)
+{
+    return pin(pool, page, 1);
+}
+
+static inline int frameOf(struct bufpool *pool, void *data)
+{
+    return ((char *)data - pool->memory) / pool->pageSize;
+}
+
+void poolUnpin(struct bufpool *pool, void *data, int dirty)
+{
+    struct frame *f = &pool->frames[frameOf(pool, data)];
+
+    assert(f->valid && f->pins > 0);
+
+    f->pins--;
+    if (dirty) {
+        f->dirty = 1;
+    }
+}
+
+uint32_t poolPage(struct bufpool *pool, void *data)
+{
+    return pool->frames[frameOf(pool, data)].page;
+}
+
+void poolSetLsn(struct bufpool *pool, void *data, uint64_t lsn)
+{
+    pool->frames[frameOf(pool, data)].lsn = lsn;
+}
+
+int poolFlush(struct bufpool *pool)
+{
+    int i;
+
+    for (i = 0; i < pool->nframes; i++) {
+        if (pool->frames[i].valid && pool->frames[i].dirty &&
+                writeBack(pool, i) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+struct poolstats poolStats(struct bufpool *pool)
+{
+    struct poolstats stats = pool->stats;
+    long pins = stats.hits + stats.misses;
+
+    stats.hitRate = pins ? (double)stats.hits / pins : 0;
+
+    return stats;
+}
+
+void poolResetStats(struct bufpool *pool)
+{
+    memset(&pool->stats, 0x00, sizeof(pool->stats));
+}
@@ -0,0 +1,85 @@
+#ifndef _BUFPOOL_H
+#define _BUFPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* fewer frames than this and a tree can't pin what one change needs. */
+#define POOL_MIN_FRAMES 8
+
+struct frame {
+    uint32_t page; /* which page it holds, if valid. */
+    int pins;
+    char valid;
+    char dirty;
+    char ref; /* CLOCK: used since the hand last passed. */
+    uint64_t lsn; /* the log record that last changed it; 0 if none. */
+};
+
+struct poolstats {
+    long hits; /* pins of a page already in a frame. */
+    long misses; /* pins that had to read, or make, the page. */
+    long evictions;
+    long writebacks; /* dirty pages written, on eviction or flush. */
+    double hitRate;
+};
+
+/*
+ * A fixed number of page-sized frames over a file.  Pages are pinned while
+ * they're used, and a frame whose page isn't pinned can be taken for another
+ * one, chosen by CLOCK: the hand goes round the frames clearing reference
+ * bits, and takes the first unpinned frame whose bit was already clear, so
+ * a page survives as long as it's used at least once a lap.
+ */
+struct bufpool {
+    int fd;
+    size_t pageSize;
+    int nframes;
+    struct frame *frames;
+    char *memory; /* nframes pages, frame i's at i * pageSize. */
+    int hand;
+    int *table; /* page to frame, linear probing; -1 is empty. */
+    int mask;
+    struct poolstats stats;
+    /*
+     * The write-ahead rule: if set, called before a page is written back to
+     * make the log durable up to the page's lsn.
+     */
+    int (*beforeWrite)(void *ctx, uint64_t lsn);
+    void *ctx;
+};
+
+/*
+ * Frames for the file open on fd, which the pool doesn't close.
+ * @return 0, or -1 with errno set.
+ */
+int poolInit(struct bufpool *pool, int fd, size_t pageSize, int nframes);
+void poolDestroy(struct bufpool *pool);
+
+/*
+ * Pin page, reading it if it isn't in a frame.  Reading past the end of the
+ * file gives zeroes.
+ * @return its bytes, valid until unpinned, or NULL with errno set: ENOBUFS
+ * if every frame is pinned, or whatever the read said.
+ */
+void *poolPin(struct bufpool *pool, uint32_t page);
+/* Pin a page that's about to be written from scratch: zeroed, not read. */
+void *poolPinNew(struct bufpool *pool, uint32_t page);
+/* Let go of a pinned page, marking it dirty if it was changed. */
+void poolUnpin(struct bufpool *pool, void *data, int dirty);
+/* The page number of pinned data. */
+uint32_t poolPage(struct bufpool *pool, void *data);
+/* Pinned data was changed by the log record ending at lsn. */
+void poolSetLsn(struct bufpool *pool, void *data, uint64_t lsn);
+
+/*
+ * Write back every dirty page, pinned or not.  Doesn't fsync.
+ * @return 0, or -1 with errno set.
+ */
+int poolFlush(struct bufpool *pool);
+
+/* the counters, with hitRate filled in. */
+struct poolstats poolStats(struct bufpool *pool);
+void poolResetStats(struct bufpool *pool);
+
+#endif
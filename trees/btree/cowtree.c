@@ -0,0 +1,426 @@
+/*
+ * Copy-on-write B-tree.
+ *
+ * The algorithms are btree.c's: split when used reaches order, moving the
+ * middle key up; delete an internal key by swapping in its predecessor; a
+ * node that runs short borrows from its left sibling, then its right, then
+ * merges.  What's different is that nothing links back to a parent, so a
+ * change writes down the path it came down, as pagedtree.c does, and that
+ * each node on that path, and each sibling it borrows from or merges with,
+ * is unshared first: copied if anyone else holds a reference to it.
+ *
+ * When nobody holds a snapshot, nothing is shared and a change is made in
+ * place, as in btree.c.  Once one is taken, the first change after copies
+ * its whole path, and later changes copy only what they reach that's still
+ * shared.
+ *
+ * Reference counts are changed with atomics, since a snapshot can be let go
+ * of from any thread while the tree changes.  A node's count can only go up
+ * under the tree's lock, so a change that sees a count of 1 knows the node
+ * is its own.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cowtree.h"
+#include "nodesearch.h"
+
+/******************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/* fewest keys a node other than the root may hold. */
+#define MIN_KEYS(N) (((N)->order - 1) / 2)
+
+/* no tree deeper than this fits in memory. */
+#define MAX_DEPTH 64
+
+/******************************************************************************
+ * Implementation start
+ *****************************************************************************/
+
+/* a step down: the node, and which child of it was taken. */
+struct step {
+    cownode_t *node;
+    int index;
+};
+
+static size_t nodeBytes(int order)
+{
+    return sizeof(cownode_t) + sizeof(cownode_t *) * (order + 1) +
+        sizeof(int) * order;
+}
+
+static cownode_t *newNode(struct cowtree *tree)
+{
+    cownode_t *node = calloc(1, nodeBytes(tree->order));
+
+    node->refs = 1;
+    node->order = tree->order;
+    __atomic_add_fetch(&tree->live, 1, __ATOMIC_RELAXED);
+
+    return node;
+}
+
+/* free a node whose children have gone elsewhere. */
+static void freeNode(struct cowtree *tree, cownode_t *node)
+{
+    free(node);
+    __atomic_sub_fetch(&tree->live, 1, __ATOMIC_RELAXED);
+}
+
+/* let go of a reference; the last one frees the node and lets go of its. */
+static void drop(struct cowtree *tree, cownode_t *node)
+{
+    int i;
+
+    if (__atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    if (!cowIsLeaf(node)) {
+        for (i = 0; i <= node->used; i++) {
+            drop(tree, cowPtrs(node)[i]);
+        }
+    }
+    freeNode(tree, node);
+}
+
+/*
+ * @return *slot, or if anyone else can see it, a copy of it, which is put in
+ * *slot.  The copy is a new parent to the children, and *slot isn't a
+ * parent of the original any more.
+ */
+static cownode_t *unshare(struct cowtree *tree, cownode_t **slot)
+{
+    cownode_t *node = *slot, *copy;
+    int i;
+
+    if (1 == __atomic_load_n(&node->refs, __ATOMIC_ACQUIRE)) {
+        return node;
+    }
+
+    copy = newNode(tree);
+    memcpy(copy + 1, node + 1, nodeBytes(tree->order) - sizeof(cownode_t));
+    copy->used = node->used;
+    if (!cowIsLeaf(copy)) {
+        for (i = 0; i <= copy->used; i++) {
+            __atomic_add_fetch(&cowPtrs(copy)[i]->refs, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    *slot = copy;
+    drop(tree, node);
+
+    return copy;
+}
+
+void cowInit(struct cowtree *tree, int order)
+{
+    assert(order >= 3 && order <= 0xffff);
+
+    tree->order = order;
+    tree->live = 0;
+    pthread_mutex_init(&tree->lock, NULL);
+    tree->root = newNode(tree);
+}
+
+void cowFree(struct cowtree *tree)
+{
+    drop(tree, tree->root);
+    tree->root = NULL;
+    assert(0 == tree->live);
+    pthread_mutex_destroy(&tree->lock);
+}
+
+int cowFind(cownode_t *snap, int value)
+{
+    cownode_t *node = snap;
+
+    for (;;) {
+        int i = nodeSearch(cowKeys(node), node->used, value);
+
+        if (i < node->used && cowKeys(node)[i] == value) {
+            return 1;
+        }
+        if (cowIsLeaf(node)) {
+            return 0;
+        }
+        node = cowPtrs(node)[i];
+    }
+}
+
+long cowScan(cownode_t *snap, int lo, int hi,
+        void (*visit)(void *ctx, int key), void *ctx)
+{
+    int *keys = cowKeys(snap);
+    int i = nodeSearch(keys, snap->used, lo);
+    long n = 0;
+
+    /* child i holds the keys between keys[i-1] and keys[i]. */
+    for (;; i++) {
+        if (!cowIsLeaf(snap)) {
+            n += cowScan(cowPtrs(snap)[i], lo, hi, visit, ctx);
+        }
+        if (i == snap->used || keys[i] > hi) {
+            break;
+        }
+        visit(ctx, keys[i]);
+        n++;
+    }
+
+    return n;
+}
+
+cownode_t *cowSnapshot(struct cowtree *tree)
+{
+    cownode_t *snap;
+
+    pthread_mutex_lock(&tree->lock);
+    snap = tree->root;
+    __atomic_add_fetch(&snap->refs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&tree->lock);
+
+    return snap;
+}
+
+void cowRelease(struct cowtree *tree, cownode_t *snap)
+{
+    drop(tree, snap);
+}
+
+int cowSearch(struct cowtree *tree, int value)
+{
+    int found;
+
+    pthread_mutex_lock(&tree->lock);
+    found = cowFind(tree->root, value);
+    pthread_mutex_unlock(&tree->lock);
+
+    return found;
+}
+
+/* put key, and the child to its right, in at index. */
+static void nodeInsert(cownode_t *node, int index, int key, cownode_t *right)
+{
+    int *keys = cowKeys(node);
+    cownode_t **ptrs = cowPtrs(node);
+
+    memmove(&keys[index + 1], &keys[index],
+            sizeof(int) * (node->used - index));
+    memmove(&ptrs[index + 2], &ptrs[index + 1],
+            sizeof(cownode_t *) * (node->used - index));
+    keys[index] = key;
+    ptrs[index + 1] = right;
+    node->used++;
+}
+
+/* take out key index and the child to its right. */
+static void nodeRemove(cownode_t *node, int index)
+{
+    int *keys = cowKeys(node);
+    cownode_t **ptrs = cowPtrs(node);
+
+    memmove(&keys[index], &keys[index + 1],
+            sizeof(int) * (node->used - index - 1));
+    memmove(&ptrs[index + 1], &ptrs[index + 2],
+            sizeof(cownode_t *) * (node->used - index - 1));
+    node->used--;
+}
+
+/*
+ * Come down to where value is or would be, unsharing every node on the
+ * way, writing down the path.
+ *
+ * @return the node value's in, or the leaf it belongs in, with the index in
+ * *index.
+ */
+static cownode_t *descend(struct cowtree *tree, int value, struct step *path,
+        int *depth, int *index)
+{
+    cownode_t *node = unshare(tree, &tree->root);
+    int i;
+
+    *depth = 0;
+    for (;;) {
+        i = nodeSearch(cowKeys(node), node->used, value);
+        if ((i < node->used && cowKeys(node)[i] == value) ||
+                cowIsLeaf(node)) {
+            break;
+        }
+
+        assert(*depth < MAX_DEPTH);
+        path[*depth].node = node;
+        path[*depth].index = i;
+        (*depth)++;
+        node = unshare(tree, &cowPtrs(node)[i]);
+    }
+
+    *index = i;
+    return node;
+}
+
+int cowInsert(struct cowtree *tree, int value)
+{
+    struct step path[MAX_DEPTH];
+    cownode_t *node;
+    int depth, index;
+
+    pthread_mutex_lock(&tree->lock);
+
+    /* look first, so a key that's there copies nothing. */
+    if (cowFind(tree->root, value)) {
+        pthread_mutex_unlock(&tree->lock);
+        return 0;
+    }
+
+    node = descend(tree, value, path, &depth, &index);
+    nodeInsert(node, index, value, NULL);
+
+    while (node->used == node->order) {
+        int mid = node->used / 2;
+        int up = cowKeys(node)[mid];
+        int moved = node->used - mid - 1;
+        cownode_t *right = newNode(tree);
+
+        memcpy(cowKeys(right), &cowKeys(node)[mid + 1], sizeof(int) * moved);
+        memcpy(cowPtrs(right), &cowPtrs(node)[mid + 1],
+                sizeof(cownode_t *) * (moved + 1));
+        memset(&cowPtrs(node)[mid + 1], 0x00,
+                sizeof(cownode_t *) * (moved + 1));
+        right->used = moved;
+        node->used = mid;
+
+        if (0 == depth) {
+            cownode_t *root = newNode(tree);
+
+            cowPtrs(root)[0] = node;
+            nodeInsert(root, 0, up, right);
+            tree->root = root;
+            break;
+        }
+
+        depth--;
+        nodeInsert(path[depth].node, path[depth].index, up, right);
+        node = path[depth].node;
+    }
+
+    pthread_mutex_unlock(&tree->lock);
+    return 1;
+}
+
+/*
+ * me, child index of parent, is short a key: borrow one through the parent
+ * from a sibling that can spare it, left first, else merge with one.  Both
+ * parent and me are unshared already; a sibling is unshared here only once
+ * it's certain to be written, so a look at one that can't spare a key
+ * doesn't copy it.
+ */
+static void rebalance(struct cowtree *tree, cownode_t *me, cownode_t *parent,
+        int index)
+{
+    int *pkeys = cowKeys(parent);
+    cownode_t **ptrs = cowPtrs(parent);
+    cownode_t *left, *right;
+
+    if (index > 0 && ptrs[index - 1]->used > MIN_KEYS(ptrs[index - 1])) {
+        /* rotate right: parent's key down to me, left's last key up. */
+        left = unshare(tree, &ptrs[index - 1]);
+        nodeInsert(me, 0, pkeys[index - 1], cowPtrs(me)[0]);
+        cowPtrs(me)[0] = cowPtrs(left)[left->used];
+        pkeys[index - 1] = cowKeys(left)[left->used - 1];
+        cowPtrs(left)[left->used] = NULL;
+        left->used--;
+        return;
+    }
+
+    if (index < parent->used
+            && ptrs[index + 1]->used > MIN_KEYS(ptrs[index + 1])) {
+        /* rotate left: parent's key down to me, right's first key up. */
+        right = unshare(tree, &ptrs[index + 1]);
+        nodeInsert(me, me->used, pkeys[index], cowPtrs(right)[0]);
+        pkeys[index] = cowKeys(right)[0];
+        cowPtrs(right)[0] = cowPtrs(right)[1];
+        nodeRemove(right, 0);
+        cowPtrs(right)[right->used + 1] = NULL;
+        return;
+    }
+
+    /*
+     * merge the right one of the pair into the left, with the key between.
+     * The sibling is unshared either way: it's written to if it's the left,
+     * and freed with its children moved if it's the right.
+     */
+    if (index > 0) {
+        left = unshare(tree, &ptrs[index - 1]);
+        right = me;
+        index--;
+    } else {
+        left = me;
+        right = unshare(tree, &ptrs[index + 1]);
+    }
+
+    nodeInsert(left, left->used, pkeys[index], cowPtrs(right)[0]);
+    memcpy(&cowKeys(left)[left->used], cowKeys(right),
+            sizeof(int) * right->used);
+    memcpy(&cowPtrs(left)[left->used + 1], &cowPtrs(right)[1],
+            sizeof(cownode_t *) * right->used);
+    left->used += right->used;
+    nodeRemove(parent, index);
+    cowPtrs(parent)[parent->used + 1] = NULL;
+    /* its children are left's now. */
+    freeNode(tree, right);
+}
+
+int cowDelete(struct cowtree *tree, int value)
+{
+    struct step path[MAX_DEPTH];
+    cownode_t *node, *leaf, *root;
+    int depth, index;
+
+    pthread_mutex_lock(&tree->lock);
+
+    if (!cowFind(tree->root, value)) {
+        pthread_mutex_unlock(&tree->lock);
+        return 0;
+    }
+
+    node = descend(tree, value, path, &depth, &index);
+
+    if (cowIsLeaf(node)) {
+        leaf = node;
+        nodeRemove(leaf, index);
+    } else {
+        /* swap in the predecessor: the last key of the left subtree. */
+        path[depth].node = node;
+        path[depth].index = index;
+        depth++;
+        leaf = unshare(tree, &cowPtrs(node)[index]);
+        while (!cowIsLeaf(leaf)) {
+            assert(depth < MAX_DEPTH);
+            path[depth].node = leaf;
+            path[depth].index = leaf->used;
+            depth++;
+            leaf = unshare(tree, &cowPtrs(leaf)[leaf->used]);
+        }
+        cowKeys(node)[index] = cowKeys(leaf)[leaf->used - 1];
+        leaf->used--;
+    }
+
+    for (node = leaf; depth > 0 && node->used < MIN_KEYS(node); depth--) {
+        rebalance(tree, node, path[depth - 1].node, path[depth - 1].index);
+        node = path[depth - 1].node;
+    }
+
+    /* a root merged down to no keys hands over to its only child. */
+    root = tree->root;
+    if (0 == root->used && !cowIsLeaf(root)) {
+        tree->root = cowPtrs(root)[0];
+        freeNode(tree, root);
+    }
+
+    pthread_mutex_unlock(&tree->lock);
+    return 1;
+}
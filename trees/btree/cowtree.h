@@ -0,0 +1,90 @@
+#ifndef _COWTREE_H
+#define _COWTREE_H
+
+#include <pthread.h>
+
+/******************************************************************************
+ * Objects
+ *****************************************************************************/
+
+/*
+ * Laid out like block_t, but where block_t has a back-link this has a count
+ * of who points here: parents, the tree, and snapshots.  A node can have
+ * several parents, one in each version of the tree that shares it, so there
+ * is no one parent to link back to.
+ *
+ * | header | ptrs[order+1] | keys[order] |
+ */
+typedef struct cownode {
+    int refs;
+    unsigned short used;
+    unsigned short order; /* split when used reaches this. */
+} cownode_t;
+
+/*
+ * A copy-on-write B-tree.  A change never writes to a node anyone else can
+ * see: a node with other references is copied first, and the copy put in
+ * its place in its parent, which has already been through the same, up to
+ * the root; so a change makes a new path from the root down, and every
+ * other node is shared with the versions before.
+ *
+ * A snapshot is a reference to a root.  Anyone holding one can read it, for
+ * as long as they like, while changes go on; changes are serialized by the
+ * tree's lock, which snapshots take only to count their reference.
+ */
+struct cowtree {
+    cownode_t *root;
+    int order;
+    pthread_mutex_t lock;
+    long live; /* nodes not yet freed, the snapshots' included. */
+};
+
+static inline cownode_t **cowPtrs(cownode_t *node)
+{
+    return (cownode_t **)(node + 1);
+}
+
+static inline int *cowKeys(cownode_t *node)
+{
+    return (int *)(cowPtrs(node) + node->order + 1);
+}
+
+static inline int cowIsLeaf(cownode_t *node)
+{
+    return NULL == cowPtrs(node)[0];
+}
+
+/******************************************************************************
+ * Implementation
+ *****************************************************************************/
+
+/* an empty tree whose nodes have this order, see orderForBytes(). */
+void cowInit(struct cowtree *tree, int order);
+/* free the tree; its snapshots must have been released. */
+void cowFree(struct cowtree *tree);
+
+/* @return 1 if value is in the tree. */
+int cowSearch(struct cowtree *tree, int value);
+/* @return 1 if value went in, 0 if it was already there. */
+int cowInsert(struct cowtree *tree, int value);
+/* @return 1 if value came out, 0 if it wasn't there. */
+int cowDelete(struct cowtree *tree, int value);
+
+/*
+ * The tree as it is now, unchanged by whatever's done to it later, until
+ * it's released.  Any thread may take one.
+ */
+cownode_t *cowSnapshot(struct cowtree *tree);
+/* Let go of a snapshot, from any thread. */
+void cowRelease(struct cowtree *tree, cownode_t *snap);
+
+/* @return 1 if value is in the snapshot. */
+int cowFind(cownode_t *snap, int value);
+/*
+ * Call visit on each key from lo to hi, inclusive, in the snapshot, in
+ * order.  @return the keys visited.
+ */
+long cowScan(cownode_t *snap, int lo, int hi,
+        void (*visit)(void *ctx, int key), void *ctx);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * In-block key search kernels, picked at run time.
+ *
+ * Binary search all the way down costs a dependent load and compare per
+ * step, log2(n) of them, and those last few steps are all within a cache line
+ * or two.  The vector kernels stop halving at a window of SEARCH_WINDOW keys
+ * and finish by counting: every key in the window is compared at once, so
+ * there's no chain of loads left, and no branch on the keys at all.
+ *
+ * The kernels are built for their instruction sets whatever the compiler is
+ * told, and nodeSearchFn is pointed at the best one the cpu has when the
+ * program starts.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_X86 1
+#endif
+
+#include "nodesearch.h"
+
+/* keys left when the vector kernels stop halving: 4 vectors' worth. */
+#define SSE4_WINDOW 16
+#define AVX2_WINDOW 32
+
+static const char *searchNames[SEARCH_KINDS] = {
+    [SEARCH_SCALAR] = "scalar",
+    [SEARCH_SSE4] = "sse4",
+    [SEARCH_AVX2] = "avx2",
+};
+
+/*
+ * Halve keys[0..n) until there are at most window left.  The window halves
+ * every step whatever the comparison says, so there's nothing for the branch
+ * predictor to get wrong; the comparison just picks which half with a
+ * conditional move.
+ *
+ * @return the start of what's left, with its size in *n; the answer is in
+ * [base, base + *n], and everything before base is < value.
+ */
+static inline const int *narrow(const int *keys, int *n, int value, int window)
+{
+    const int *base = keys;
+    int left = *n;
+
+    while (left > window) {
+        int half = left / 2;
+        base = (base[half - 1] < value) ? base + half : base;
+        left -= half;
+    }
+
+    *n = left;
+    return base;
+}
+
+static int searchScalar(const int *keys, int n, int value)
+{
+    const int *base;
+
+    if (0 == n) {
+        return 0;
+    }
+
+    base = narrow(keys, &n, value, 1);
+
+    return (base - keys) + (*base < value);
+}
+
+#if SEARCH_X86
+__attribute__((target("sse4.2,popcnt")))
+static int searchSse4(const int *keys, int n, int value)
+{
+    const int *base = narrow(keys, &n, value, SSE4_WINDOW);
+    __m128i v = _mm_set1_epi32(value);
+    int i = 0, below = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i k = _mm_loadu_si128((const __m128i *)&base[i]);
+        /* all ones in every lane where the key is < value. */
+        __m128i lt = _mm_cmpgt_epi32(v, k);
+        below += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(lt)));
+    }
+    for (; i < n; i++) {
+        below += base[i] < value;
+    }
+
+    return (base - keys) + below;
+}
+
+__attribute__((target("avx2,popcnt")))
+static int searchAvx2(const int *keys, int n, int value)
+{
+    const int *base = narrow(keys, &n, value, AVX2_WINDOW);
+    __m256i v = _mm256_set1_epi32(value);
+    int i = 0, below = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i k = _mm256_loadu_si256((const __m256i *)&base[i]);
+        __m256i lt = _mm256_cmpgt_epi32(v, k);
+        below += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+    }
+    if (i + 4 <= n) {
+        __m128i k = _mm_loadu_si128((const __m128i *)&base[i]);
+        __m128i lt = _mm_cmpgt_epi32(_mm256_castsi256_si128(v), k);
+        below += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(lt)));
+        i += 4;
+    }
+    for (; i < n; i++) {
+        below += base[i] < value;
+    }
+
+    return (base - keys) + below;
+}
+#endif
+
+int searchSupported(enum searchkind kind)
+{
+    switch (kind) {
+    case SEARCH_SCALAR:
+        return 1;
+#if SEARCH_X86
+    case SEARCH_SSE4:
+        return __builtin_cpu_supports("sse4.2") &&
+            __builtin_cpu_supports("popcnt");
+    case SEARCH_AVX2:
+        return __builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("popcnt");
+#endif
+    default:
+        return 0;
+    }
+}
+
+enum searchkind searchBest(void)
+{
+    int kind;
+
+    for (kind = SEARCH_KINDS - 1; kind > SEARCH_SCALAR; kind--) {
+        if (searchSupported(kind)) {
+            break;
+        }
+    }
+
+    return kind;
+}
+
+nodesearch_t searchKernel(enum searchkind kind)
+{
+    switch (kind) {
+#if SEARCH_X86
+    case SEARCH_SSE4:
+        return searchSse4;
+    case SEARCH_AVX2:
+        return searchAvx2;
+#endif
+    default:
+        return searchScalar;
+    }
+}
+
+nodesearch_t nodeSearchFn = searchScalar;
+
+void searchUse(enum searchkind kind)
+{
+    assert(searchSupported(kind));
+
+    nodeSearchFn = searchKernel(kind);
+}
+
+const char *searchName(enum searchkind kind)
+{
+    return searchNames[kind];
+}
+
+__attribute__((constructor))
+static void searchInit(void)
+{
+#if SEARCH_X86
+    __builtin_cpu_init();
+#endif
+    nodeSearchFn = searchKernel(searchBest());
+}
@@ -0,0 +1,41 @@
+#ifndef _NODESEARCH_H
+#define _NODESEARCH_H
+
+/*
+ * Searching the keys of one block, with whatever the cpu has.  The vector
+ * kernels binary search down to a window of a few vectors, then count the
+ * keys in it that are below the value, which in a sorted block is where it
+ * goes: compare a vector's worth at once, movemask, popcount.
+ */
+
+enum searchkind {
+    SEARCH_SCALAR, /* branch-free binary search. */
+    SEARCH_SSE4, /* 4 keys per compare. */
+    SEARCH_AVX2, /* 8 keys per compare. */
+    SEARCH_KINDS,
+};
+
+typedef int (*nodesearch_t)(const int *keys, int n, int value);
+
+/* set to the best kernel the cpu runs, before main. */
+extern nodesearch_t nodeSearchFn;
+
+/*
+ * @return the index of the first of keys[0..n) that is >= value, n if none.
+ */
+static inline int nodeSearch(const int *keys, int n, int value)
+{
+    return nodeSearchFn(keys, n, value);
+}
+
+/* @return 1 if this cpu can run kind. */
+int searchSupported(enum searchkind kind);
+/* the best kind this cpu can run. */
+enum searchkind searchBest(void);
+/* kind's kernel, whether the cpu runs it or not. */
+nodesearch_t searchKernel(enum searchkind kind);
+/* make nodeSearch() use kind, which must be supported; for benchmarks. */
+void searchUse(enum searchkind kind);
+const char *searchName(enum searchkind kind);
+
+#endif
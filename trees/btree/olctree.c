@@ -0,0 +1,336 @@
+/*
+ * Concurrent B+tree with optimistic lock coupling.
+ *
+ * Coming down, a thread holds no locks at all, only the version it saw of
+ * the node it's in and of its parent.  Before following a pointer it checks
+ * the node's version again, so the pointer was read from a node nobody was
+ * changing; having read the child's version it checks the parent's once
+ * more, so the child wasn't split meanwhile and is still the one for the
+ * key.  Any check that fails starts the whole descent again from the root.
+ *
+ * A writer upgrades the versions it's holding to locks with a compare and
+ * swap, which fails, and restarts it, if the node changed since.  Full nodes
+ * are split on the way down, with only the node and its parent locked,
+ * which can't be full; so a split never has to go back up the tree, and an
+ * insert into a leaf that isn't full locks just the leaf.
+ */
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodesearch.h"
+#include "olctree.h"
+
+/******************************************************************************
+ * Macros
+ *****************************************************************************/
+
+#define LOCKED 1ull
+/* spins on a locked node before giving the cpu to whoever holds it. */
+#define SPINS 64
+
+/******************************************************************************
+ * Implementation start
+ *****************************************************************************/
+
+/* @return the node's version, once it isn't locked. */
+static inline uint64_t awaitUnlocked(olcnode_t *node)
+{
+    uint64_t version;
+    int spins = 0;
+
+    while ((version = __atomic_load_n(&node->version, __ATOMIC_ACQUIRE)) &
+            LOCKED) {
+        if (++spins == SPINS) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+
+    return version;
+}
+
+/* @return 1 if nothing's changed the node since it was at version. */
+static inline int unchanged(olcnode_t *node, uint64_t version)
+{
+    /* the reads before can't be put off until after the check. */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&node->version, __ATOMIC_RELAXED) == version;
+}
+
+/* lock the node if it's still at version.  @return 1 if it's locked. */
+static inline int upgrade(olcnode_t *node, uint64_t version)
+{
+    return __atomic_compare_exchange_n(&node->version, &version,
+            version + LOCKED, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/* unlock, which moves the version on. */
+static inline void unlock(olcnode_t *node)
+{
+    __atomic_fetch_add(&node->version, LOCKED, __ATOMIC_RELEASE);
+}
+
+static inline olcnode_t *rootOf(struct olctree *tree)
+{
+    return __atomic_load_n(&tree->root, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * The keys in use.  A reader can see used mid-change, but it's always
+ * below order, so what's read is in the node even if it's nonsense.
+ */
+static inline int usedOf(olcnode_t *node)
+{
+    return __atomic_load_n(&node->used, __ATOMIC_RELAXED);
+}
+
+static olcnode_t *newNode(struct olctree *tree, int leaf)
+{
+    size_t bytes = sizeof(olcnode_t) +
+        sizeof(olcnode_t *) * (tree->order + 1) + sizeof(int) * tree->order;
+    olcnode_t *node;
+
+    /* nodes don't share cache lines, so a lock only bounces its own. */
+    bytes = (bytes + 63) & ~(size_t)63;
+    node = aligned_alloc(64, bytes);
+    memset(node, 0x00, bytes);
+    node->order = tree->order;
+    node->leaf = leaf;
+
+    node->all = __atomic_load_n(&tree->all, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&tree->all, &node->all, node, 1,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+    return node;
+}
+
+void olcInit(struct olctree *tree, int order)
+{
+    assert(order >= OLC_MIN_ORDER && order <= 0xffff);
+
+    tree->order = order;
+    tree->all = NULL;
+    tree->root = newNode(tree, 1);
+}
+
+void olcFree(struct olctree *tree)
+{
+    olcnode_t *node, *next;
+
+    for (node = tree->all; node; node = next) {
+        next = node->all;
+        free(node);
+    }
+    tree->all = NULL;
+    tree->root = NULL;
+}
+
+/* which child of an internal node value is under; equal keys go right. */
+static inline int childFor(olcnode_t *node, int used, int value)
+{
+    int *keys = olcKeys(node);
+    int i = nodeSearch(keys, used, value);
+
+    return i + (i < used && keys[i] == value);
+}
+
+/*
+ * Come down to the leaf value belongs in, for reading it.
+ * @return the leaf, with the version it was read at in *version.
+ */
+static olcnode_t *findLeaf(struct olctree *tree, int value, uint64_t *version)
+{
+    olcnode_t *node, *child;
+    uint64_t v, cv;
+
+restart:
+    node = rootOf(tree);
+    v = awaitUnlocked(node);
+    if (node != rootOf(tree)) {
+        goto restart;
+    }
+
+    while (!node->leaf) {
+        child = olcPtrs(node)[childFor(node, usedOf(node), value)];
+        if (!unchanged(node, v)) {
+            goto restart;
+        }
+        cv = awaitUnlocked(child);
+        if (!unchanged(node, v)) {
+            goto restart;
+        }
+        node = child;
+        v = cv;
+    }
+
+    *version = v;
+    return node;
+}
+
+int olcSearch(struct olctree *tree, int value)
+{
+    olcnode_t *leaf;
+    uint64_t v;
+    int used, i, found;
+
+    do {
+        leaf = findLeaf(tree, value, &v);
+        used = usedOf(leaf);
+        i = nodeSearch(olcKeys(leaf), used, value);
+        found = i < used && olcKeys(leaf)[i] == value;
+    } while (!unchanged(leaf, v));
+
+    return found;
+}
+
+/*
+ * Split full node, which is locked, as is its parent unless it's the root:
+ * the upper half goes to a new node on its right.  A leaf copies the right
+ * half's first key up; an internal node moves its middle key up.
+ */
+static void split(struct olctree *tree, olcnode_t *node, olcnode_t *parent)
+{
+    olcnode_t *right = newNode(tree, node->leaf);
+    int mid = node->used / 2;
+    int sep = olcKeys(node)[mid];
+    int moved;
+
+    if (node->leaf) {
+        moved = node->used - mid;
+        memcpy(olcKeys(right), &olcKeys(node)[mid], sizeof(int) * moved);
+    } else {
+        moved = node->used - mid - 1;
+        memcpy(olcKeys(right), &olcKeys(node)[mid + 1], sizeof(int) * moved);
+        memcpy(olcPtrs(right), &olcPtrs(node)[mid + 1],
+                sizeof(olcnode_t *) * (moved + 1));
+    }
+    right->used = moved;
+    __atomic_store_n(&node->used, mid, __ATOMIC_RELAXED);
+
+    if (parent) {
+        int *keys = olcKeys(parent);
+        olcnode_t **ptrs = olcPtrs(parent);
+        int i = nodeSearch(keys, parent->used, sep);
+
+        memmove(&keys[i + 1], &keys[i], sizeof(int) * (parent->used - i));
+        memmove(&ptrs[i + 2], &ptrs[i + 1],
+                sizeof(olcnode_t *) * (parent->used - i));
+        keys[i] = sep;
+        ptrs[i + 1] = right;
+        __atomic_store_n(&parent->used, parent->used + 1, __ATOMIC_RELAXED);
+    } else {
+        olcnode_t *root = newNode(tree, 0);
+
+        olcPtrs(root)[0] = node;
+        olcPtrs(root)[1] = right;
+        olcKeys(root)[0] = sep;
+        root->used = 1;
+        __atomic_store_n(&tree->root, root, __ATOMIC_RELEASE);
+    }
+}
+
+int olcInsert(struct olctree *tree, int value)
+{
+    olcnode_t *node, *parent, *child;
+    uint64_t v, pv = 0, cv;
+    int *keys, used, i;
+
+restart:
+    parent = NULL;
+    node = rootOf(tree);
+    v = awaitUnlocked(node);
+    if (node != rootOf(tree)) {
+        goto restart;
+    }
+
+    for (;;) {
+        if (usedOf(node) == node->order - 1) {
+            /* full: split it, with its parent, then come down again. */
+            if (parent && !upgrade(parent, pv)) {
+                goto restart;
+            }
+            if (!upgrade(node, v)) {
+                if (parent) {
+                    unlock(parent);
+                }
+                goto restart;
+            }
+            if (!parent && node != rootOf(tree)) {
+                unlock(node);
+                goto restart;
+            }
+            split(tree, node, parent);
+            unlock(node);
+            if (parent) {
+                unlock(parent);
+            }
+            goto restart;
+        }
+
+        if (node->leaf) {
+            break;
+        }
+
+        child = olcPtrs(node)[childFor(node, usedOf(node), value)];
+        if (!unchanged(node, v)) {
+            goto restart;
+        }
+        cv = awaitUnlocked(child);
+        if (!unchanged(node, v)) {
+            goto restart;
+        }
+        parent = node;
+        pv = v;
+        node = child;
+        v = cv;
+    }
+
+    if (!upgrade(node, v)) {
+        goto restart;
+    }
+
+    keys = olcKeys(node);
+    used = node->used;
+    i = nodeSearch(keys, used, value);
+    if (i < used && keys[i] == value) {
+        unlock(node);
+        return 0;
+    }
+
+    memmove(&keys[i + 1], &keys[i], sizeof(int) * (used - i));
+    keys[i] = value;
+    __atomic_store_n(&node->used, used + 1, __ATOMIC_RELAXED);
+    unlock(node);
+
+    return 1;
+}
+
+int olcDelete(struct olctree *tree, int value)
+{
+    olcnode_t *leaf;
+    uint64_t v;
+    int *keys, used, i;
+
+    do {
+        leaf = findLeaf(tree, value, &v);
+    } while (!upgrade(leaf, v));
+
+    keys = olcKeys(leaf);
+    used = leaf->used;
+    i = nodeSearch(keys, used, value);
+    if (i == used || keys[i] != value) {
+        unlock(leaf);
+        return 0;
+    }
+
+    memmove(&keys[i], &keys[i + 1], sizeof(int) * (used - i - 1));
+    __atomic_store_n(&leaf->used, used - 1, __ATOMIC_RELAXED);
+    unlock(leaf);
+
+    return 1;
+}
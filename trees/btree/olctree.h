@@ -0,0 +1,86 @@
+#ifndef _OLCTREE_H
+#define _OLCTREE_H
+
+#include <stdint.h>
+
+/******************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/*
+ * Nodes are split when they're full on the way down, not when they overflow,
+ * so a full internal node of order 3 has just two keys: one would go up and
+ * leave the other half with none.
+ */
+#define OLC_MIN_ORDER 4
+
+/******************************************************************************
+ * Objects
+ *****************************************************************************/
+
+/*
+ * A B+tree node for many threads at once, laid out like bpblock_t but with
+ * no back-links, and a version lock in place of the id:
+ *
+ * | header | ptrs[order+1] | keys[order] |
+ *
+ * The version's low bit is the write lock; unlocking bumps it, so the
+ * version changes whenever the node does.  A node has room for order keys
+ * but never holds more than order - 1: a full one is split on the way down,
+ * before anything is put in it.
+ */
+typedef struct olcnode {
+    uint64_t version;
+    uint16_t used;
+    uint16_t order;
+    uint16_t leaf;
+    struct olcnode *all; /* the node made before this one, for olcFree(). */
+} olcnode_t;
+
+/*
+ * Readers take no locks and write nothing shared: they note each node's
+ * version, read it, and check the version's still the same before trusting
+ * what they read, starting again from the root if it isn't.  Writers come
+ * down the same way, and lock only the nodes they change: the leaf, or a
+ * full node being split and its parent.
+ *
+ * Deletes never merge, so nodes are never freed while the tree is in use,
+ * and a reader can't land in one that's gone.
+ */
+struct olctree {
+    olcnode_t *root;
+    int order;
+    olcnode_t *all; /* every node, newest first. */
+};
+
+static inline olcnode_t **olcPtrs(olcnode_t *node)
+{
+    return (olcnode_t **)(node + 1);
+}
+
+static inline int *olcKeys(olcnode_t *node)
+{
+    return (int *)(olcPtrs(node) + node->order + 1);
+}
+
+/******************************************************************************
+ * Implementation
+ *****************************************************************************/
+
+/*
+ * an empty tree whose nodes have this order, at least OLC_MIN_ORDER; see
+ * orderForBytes().
+ */
+void olcInit(struct olctree *tree, int order);
+/* free every node; nobody may be using the tree. */
+void olcFree(struct olctree *tree);
+
+/* These may all be called from any number of threads at once. */
+/* @return 1 if value is in the tree. */
+int olcSearch(struct olctree *tree, int value);
+/* @return 1 if value went in, 0 if it was already there. */
+int olcInsert(struct olctree *tree, int value);
+/* @return 1 if value came out, 0 if it wasn't there. */
+int olcDelete(struct olctree *tree, int value);
+
+#endif
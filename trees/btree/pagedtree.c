@@ -0,0 +1,859 @@
+/*
+ * B-tree in fixed size pages of a file, reached through the buffer pool.
+ *
+ * Nodes name their children by page number and have no parent pointers, so
+ * an insert or delete writes down the page numbers and child indexes it went
+ * through on the way down, and walks that path back up to split or
+ * rebalance.  Every page a change touches stays pinned until the change is
+ * done, so nothing half changed gets written back mid-way by an eviction,
+ * and a copy is kept of each as it was when first pinned: if a page the
+ * change needs can't be had, because every frame is pinned, the pages it
+ * has changed are put back from the copies and it fails having done
+ * nothing.
+ *
+ * Otherwise it's btree.c: a node splits when used reaches order, moving its
+ * middle key up; an internal key that's deleted is replaced by its
+ * predecessor; a node that runs short borrows from its left sibling, then
+ * its right, then merges.  Unlike btree.c the root moves when it splits or
+ * collapses, and the meta page keeps track of it.
+ *
+ * A logged tree keeps a copy of each page it holds as it was, and when the
+ * change is done logs, for each page it changed, the run of bytes from the
+ * first it changed to the last: a redo record per change, covering every
+ * page of a split or merge at once, so a change is in the log whole or not
+ * at all.  Replaying the records in order from the last checkpoint copies
+ * them back in; a page the file already has newer is put right by the
+ * records after.  The pool won't write a page back before the log holds the
+ * change that dirtied it, so the file never has a change the log doesn't.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nodesearch.h"
+#include "pagedtree.h"
+
+/******************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/* fewest keys a node other than the root may hold. */
+#define MIN_KEYS(N) (((N)->order - 1) / 2)
+
+/******************************************************************************
+ * Implementation start
+ *****************************************************************************/
+
+/* a step down: the page, and which child of it was taken. */
+struct step {
+    uint32_t page;
+    int index;
+};
+
+/* in a log record, before the bytes: where they go. */
+struct ptchange {
+    uint32_t page;
+    uint32_t offset;
+    uint32_t bytes;
+};
+
+int ptreeOrder(size_t pageSize)
+{
+    return (pageSize - sizeof(ptnode_t) - sizeof(uint32_t)) /
+        (sizeof(uint32_t) + sizeof(int));
+}
+
+/*
+ * Pin page for the current change, once however often it's asked for; fresh
+ * if it's past the end of the file, so there's nothing to read.
+ */
+static void *holdPage(struct ptree *tree, uint32_t page, int fresh)
+{
+    int i;
+    void *data;
+
+    for (i = 0; i < tree->nheld; i++) {
+        if (tree->held[i].page == page) {
+            return tree->held[i].node;
+        }
+    }
+
+    assert(tree->nheld < PTREE_MAX_HELD);
+    data = fresh ? poolPinNew(&tree->pool, page) : poolPin(&tree->pool, page);
+    if (!data) {
+        return NULL;
+    }
+    memcpy(tree->before + tree->nheld * tree->pool.pageSize, data,
+            tree->pool.pageSize);
+
+    tree->held[tree->nheld].page = page;
+    tree->held[tree->nheld].node = data;
+    tree->held[tree->nheld].dirty = 0;
+    tree->nheld++;
+
+    return data;
+}
+
+static inline void *hold(struct ptree *tree, uint32_t page)
+{
+    return holdPage(tree, page, 0);
+}
+
+/* mark a held page changed. */
+static void touch(struct ptree *tree, void *data)
+{
+    int i;
+
+    for (i = 0; i < tree->nheld; i++) {
+        if (tree->held[i].node == data) {
+            tree->held[i].dirty = 1;
+            return;
+        }
+    }
+    assert(0);
+}
+
+/*
+ * Write what the change did to held page i into out: its first to last
+ * changed bytes.
+ * @return the bytes written, 0 if it didn't really change.
+ */
+static size_t logChange(struct ptree *tree, int i, char *out)
+{
+    size_t size = tree->pool.pageSize;
+    const char *was = tree->before + i * size;
+    const char *now = (const char *)tree->held[i].node;
+    struct ptchange change;
+    size_t first = 0, last = size;
+
+    while (first < size && was[first] == now[first]) {
+        first++;
+    }
+    if (first == size) {
+        return 0;
+    }
+    while (was[last - 1] == now[last - 1]) {
+        last--;
+    }
+
+    change.page = tree->held[i].page;
+    change.offset = first;
+    change.bytes = last - first;
+    memcpy(out, &change, sizeof(change));
+    memcpy(out + sizeof(change), now + first, change.bytes);
+
+    return sizeof(change) + change.bytes;
+}
+
+/*
+ * The change failed part way, most likely for want of a frame: put every
+ * page it held back as it was, and unpin them unchanged, as if it had never
+ * started.
+ */
+static void abandon(struct ptree *tree)
+{
+    int i;
+
+    for (i = 0; i < tree->nheld; i++) {
+        if (tree->held[i].dirty) {
+            memcpy(tree->held[i].node,
+                    tree->before + i * tree->pool.pageSize,
+                    tree->pool.pageSize);
+        }
+        poolUnpin(&tree->pool, tree->held[i].node, 0);
+    }
+    tree->nheld = 0;
+}
+
+/*
+ * The change is done: log it if need be, and unpin everything it held.  A
+ * change that can't be logged is abandoned, so nothing reaches the pages
+ * that isn't in the log.
+ * @return 0, or -1 with errno set.
+ */
+static int release(struct ptree *tree)
+{
+    size_t bytes = 0;
+    uint64_t lsn = 0;
+    int i;
+
+    if (tree->wal) {
+        for (i = 0; i < tree->nheld; i++) {
+            if (tree->held[i].dirty) {
+                bytes += logChange(tree, i, tree->record + bytes);
+            }
+        }
+        if (bytes && !(lsn = walAppend(tree->wal, tree->record, bytes))) {
+            abandon(tree);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < tree->nheld; i++) {
+        if (lsn && tree->held[i].dirty) {
+            poolSetLsn(&tree->pool, tree->held[i].node, lsn);
+        }
+        poolUnpin(&tree->pool, tree->held[i].node, tree->held[i].dirty);
+    }
+    tree->nheld = 0;
+
+    return 0;
+}
+
+static inline uint32_t pageOf(struct ptree *tree, void *data)
+{
+    return poolPage(&tree->pool, data);
+}
+
+/* a fresh node, off the free list if there's one there. */
+static ptnode_t *newNode(struct ptree *tree, struct ptmeta *meta)
+{
+    uint32_t page;
+    ptnode_t *node;
+
+    if (meta->freeHead) {
+        page = meta->freeHead;
+        if (!(node = hold(tree, page))) {
+            return NULL;
+        }
+        meta->freeHead = node->next;
+    } else {
+        page = meta->npages++;
+        if (!(node = holdPage(tree, page, 1))) {
+            return NULL;
+        }
+    }
+
+    memset(node, 0x00, tree->pool.pageSize);
+    node->order = tree->order;
+    touch(tree, node);
+    touch(tree, meta);
+
+    return node;
+}
+
+static void freeNode(struct ptree *tree, struct ptmeta *meta, ptnode_t *node)
+{
+    node->used = 0;
+    node->next = meta->freeHead;
+    meta->freeHead = pageOf(tree, node);
+    touch(tree, node);
+    touch(tree, meta);
+}
+
+/*
+ * Put key, and the child to its right, in at index.  The child pointer is
+ * 0 in a leaf, where they all are.
+ */
+static void nodeInsert(ptnode_t *node, int index, int key, uint32_t right)
+{
+    int *keys = ptKeys(node);
+    uint32_t *ptrs = ptPtrs(node);
+
+    memmove(&keys[index + 1], &keys[index],
+            sizeof(int) * (node->used - index));
+    memmove(&ptrs[index + 2], &ptrs[index + 1],
+            sizeof(uint32_t) * (node->used - index));
+    keys[index] = key;
+    ptrs[index + 1] = right;
+    node->used++;
+}
+
+/* take out key index and the child to its right. */
+static void nodeRemove(ptnode_t *node, int index)
+{
+    int *keys = ptKeys(node);
+    uint32_t *ptrs = ptPtrs(node);
+
+    memmove(&keys[index], &keys[index + 1],
+            sizeof(int) * (node->used - index - 1));
+    memmove(&ptrs[index + 1], &ptrs[index + 2],
+            sizeof(uint32_t) * (node->used - index - 1));
+    node->used--;
+}
+
+/*
+ * Come down from the root to where value is or would be, writing down the
+ * internal nodes passed.
+ *
+ * @return the node value's in, or the leaf it belongs in, with the index in
+ * *index and 1 in *found if it's there; or NULL with errno set.
+ */
+static ptnode_t *descend(struct ptree *tree, struct ptmeta *meta, int value,
+        struct step *path, int *depth, int *index, int *found)
+{
+    uint32_t page = meta->root;
+    ptnode_t *node;
+    int i;
+
+    *depth = 0;
+    for (;;) {
+        if (!(node = hold(tree, page))) {
+            return NULL;
+        }
+
+        i = nodeSearch(ptKeys(node), node->used, value);
+        if (i < node->used && ptKeys(node)[i] == value) {
+            *found = 1;
+            break;
+        }
+        if (ptIsLeaf(node)) {
+            *found = 0;
+            break;
+        }
+
+        assert(*depth < PTREE_MAX_DEPTH);
+        path[*depth].page = page;
+        path[*depth].index = i;
+        (*depth)++;
+        page = ptPtrs(node)[i];
+    }
+
+    *index = i;
+    return node;
+}
+
+static int treeSearch(struct ptree *tree, int value)
+{
+    struct ptmeta *meta;
+    ptnode_t *node;
+    int found = -1;
+
+    if ((meta = hold(tree, 0))) {
+        uint32_t page = meta->root;
+
+        while ((node = hold(tree, page))) {
+            int i = nodeSearch(ptKeys(node), node->used, value);
+
+            if (i < node->used && ptKeys(node)[i] == value) {
+                found = 1;
+                break;
+            }
+            if (ptIsLeaf(node)) {
+                found = 0;
+                break;
+            }
+            page = ptPtrs(node)[i];
+        }
+    }
+
+    release(tree);
+    return found;
+}
+
+/*
+ * Split a full node: it keeps the lower half, the upper half goes to a new
+ * node to its right, and the middle key goes up to the parent, or to a new
+ * root if it was the root.
+ *
+ * @return the parent, which may be full now, or NULL if the split made a new
+ * root, and in *err, -1 with errno set if a page couldn't be had.
+ */
+static ptnode_t *nodeSplit(struct ptree *tree, struct ptmeta *meta,
+        ptnode_t *node, struct step *path, int depth, int *err)
+{
+    int mid = node->used / 2;
+    int up = ptKeys(node)[mid];
+    int moved = node->used - mid - 1;
+    ptnode_t *right, *parent;
+
+    if (!(right = newNode(tree, meta))) {
+        *err = -1;
+        return NULL;
+    }
+
+    memcpy(ptKeys(right), &ptKeys(node)[mid + 1], sizeof(int) * moved);
+    memcpy(ptPtrs(right), &ptPtrs(node)[mid + 1],
+            sizeof(uint32_t) * (moved + 1));
+    right->used = moved;
+    node->used = mid;
+    touch(tree, node);
+
+    if (0 == depth) {
+        if (!(parent = newNode(tree, meta))) {
+            *err = -1;
+            return NULL;
+        }
+        ptPtrs(parent)[0] = pageOf(tree, node);
+        nodeInsert(parent, 0, up, pageOf(tree, right));
+        meta->root = pageOf(tree, parent);
+        return NULL;
+    }
+
+    if (!(parent = hold(tree, path[depth - 1].page))) {
+        *err = -1;
+        return NULL;
+    }
+    nodeInsert(parent, path[depth - 1].index, up, pageOf(tree, right));
+    touch(tree, parent);
+
+    return parent;
+}
+
+static int treeInsert(struct ptree *tree, int value)
+{
+    struct step path[PTREE_MAX_DEPTH];
+    struct ptmeta *meta;
+    ptnode_t *node;
+    int depth, index, found, err = 0;
+
+    if (!(meta = hold(tree, 0)) ||
+            !(node = descend(tree, meta, value, path, &depth, &index,
+                    &found))) {
+        abandon(tree);
+        return -1;
+    }
+
+    if (found) {
+        release(tree);
+        return 0;
+    }
+
+    nodeInsert(node, index, value, 0);
+    touch(tree, node);
+
+    while (node && node->used == node->order) {
+        node = nodeSplit(tree, meta, node, path, depth--, &err);
+    }
+
+    if (err) {
+        abandon(tree);
+        return -1;
+    }
+
+    return release(tree) ? -1 : 1;
+}
+
+/*
+ * me, child index of parent, is short a key: borrow one through the parent
+ * from a sibling that can spare it, left first, else merge with one.
+ *
+ * @return 0, or -1 with errno set.
+ */
+static int rebalance(struct ptree *tree, struct ptmeta *meta, ptnode_t *me,
+        ptnode_t *parent, int index)
+{
+    int *pkeys = ptKeys(parent);
+    ptnode_t *left = NULL, *right = NULL;
+
+    if (index > 0) {
+        if (!(left = hold(tree, ptPtrs(parent)[index - 1]))) {
+            return -1;
+        }
+        if (left->used > MIN_KEYS(left)) {
+            /* rotate right: parent's key down to me, left's last key up. */
+            nodeInsert(me, 0, pkeys[index - 1], ptPtrs(me)[0]);
+            ptPtrs(me)[0] = ptPtrs(left)[left->used];
+            pkeys[index - 1] = ptKeys(left)[left->used - 1];
+            left->used--;
+            touch(tree, me);
+            touch(tree, left);
+            touch(tree, parent);
+            return 0;
+        }
+    }
+
+    if (index < parent->used) {
+        if (!(right = hold(tree, ptPtrs(parent)[index + 1]))) {
+            return -1;
+        }
+        if (right->used > MIN_KEYS(right)) {
+            /* rotate left: parent's key down to me, right's first key up. */
+            nodeInsert(me, me->used, pkeys[index], ptPtrs(right)[0]);
+            pkeys[index] = ptKeys(right)[0];
+            ptPtrs(right)[0] = ptPtrs(right)[1];
+            nodeRemove(right, 0);
+            touch(tree, me);
+            touch(tree, right);
+            touch(tree, parent);
+            return 0;
+        }
+    }
+
+    /* merge the right one of the pair into the left, with the key between. */
+    if (left) {
+        right = me;
+        index--;
+    } else {
+        left = me;
+    }
+
+    nodeInsert(left, left->used, pkeys[index], ptPtrs(right)[0]);
+    memcpy(&ptKeys(left)[left->used], ptKeys(right),
+            sizeof(int) * right->used);
+    memcpy(&ptPtrs(left)[left->used + 1], &ptPtrs(right)[1],
+            sizeof(uint32_t) * right->used);
+    left->used += right->used;
+    nodeRemove(parent, index);
+    freeNode(tree, meta, right);
+    touch(tree, left);
+    touch(tree, parent);
+
+    return 0;
+}
+
+static int treeDelete(struct ptree *tree, int value)
+{
+    struct step path[PTREE_MAX_DEPTH];
+    struct ptmeta *meta;
+    ptnode_t *node, *leaf, *root;
+    int depth, index, found;
+
+    if (!(meta = hold(tree, 0)) ||
+            !(node = descend(tree, meta, value, path, &depth, &index,
+                    &found))) {
+        goto fail;
+    }
+
+    if (!found) {
+        release(tree);
+        return 0;
+    }
+
+    if (ptIsLeaf(node)) {
+        leaf = node;
+        nodeRemove(leaf, index);
+    } else {
+        /* swap in the predecessor: the last key of the left subtree. */
+        uint32_t page = ptPtrs(node)[index];
+
+        path[depth].page = pageOf(tree, node);
+        path[depth].index = index;
+        depth++;
+        for (;;) {
+            if (!(leaf = hold(tree, page))) {
+                goto fail;
+            }
+            if (ptIsLeaf(leaf)) {
+                break;
+            }
+            assert(depth < PTREE_MAX_DEPTH);
+            path[depth].page = page;
+            path[depth].index = leaf->used;
+            depth++;
+            page = ptPtrs(leaf)[leaf->used];
+        }
+        ptKeys(node)[index] = ptKeys(leaf)[leaf->used - 1];
+        leaf->used--;
+        touch(tree, node);
+    }
+    touch(tree, leaf);
+
+    for (node = leaf; depth > 0 && node->used < MIN_KEYS(node); depth--) {
+        ptnode_t *parent = hold(tree, path[depth - 1].page);
+
+        if (!parent ||
+                rebalance(tree, meta, node, parent, path[depth - 1].index)) {
+            goto fail;
+        }
+        node = parent;
+    }
+
+    /* a root merged down to no keys hands over to its only child. */
+    if (!(root = hold(tree, meta->root))) {
+        goto fail;
+    }
+    if (0 == root->used && !ptIsLeaf(root)) {
+        meta->root = ptPtrs(root)[0];
+        freeNode(tree, meta, root);
+    }
+
+    return release(tree) ? -1 : 1;
+
+fail:
+    abandon(tree);
+    return -1;
+}
+
+/*
+ * Write back every dirty page and fsync, and then nothing in the log is
+ * needed any more.
+ */
+static int checkpoint(struct ptree *tree)
+{
+    if (poolFlush(&tree->pool) < 0 || fsync(tree->fd) < 0) {
+        return -1;
+    }
+    if (tree->wal && walReset(tree->wal) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int ptreeSearch(struct ptree *tree, int value)
+{
+    int ret;
+
+    pthread_mutex_lock(&tree->lock);
+    ret = treeSearch(tree, value);
+    pthread_mutex_unlock(&tree->lock);
+
+    return ret;
+}
+
+/* after a change: checkpoint if the log's grown too long. */
+static int changed(struct ptree *tree, int ret)
+{
+    if (ret > 0 && tree->wal &&
+            walBytes(tree->wal) > tree->checkpointBytes &&
+            checkpoint(tree) < 0) {
+        return -1;
+    }
+
+    return ret;
+}
+
+int ptreeInsert(struct ptree *tree, int value)
+{
+    int ret;
+
+    pthread_mutex_lock(&tree->lock);
+    ret = changed(tree, treeInsert(tree, value));
+    pthread_mutex_unlock(&tree->lock);
+
+    return ret;
+}
+
+int ptreeDelete(struct ptree *tree, int value)
+{
+    int ret;
+
+    pthread_mutex_lock(&tree->lock);
+    ret = changed(tree, treeDelete(tree, value));
+    pthread_mutex_unlock(&tree->lock);
+
+    return ret;
+}
+
+/* write the first pages of a new tree: the meta page and an empty root. */
+static int create(struct ptree *tree, size_t pageSize)
+{
+    struct ptmeta *meta;
+    ptnode_t *root;
+
+    if (!(meta = poolPinNew(&tree->pool, 0))) {
+        return -1;
+    }
+    meta->magic = PTREE_MAGIC;
+    meta->version = PTREE_VERSION;
+    meta->pageSize = pageSize;
+    meta->order = tree->order;
+    meta->root = 1;
+    meta->npages = 2;
+    poolUnpin(&tree->pool, meta, 1);
+
+    if (!(root = poolPinNew(&tree->pool, 1))) {
+        return -1;
+    }
+    root->order = tree->order;
+    poolUnpin(&tree->pool, root, 1);
+
+    return checkpoint(tree);
+}
+
+/* @return 0 if the meta page is one of ours for pages this size. */
+static int check(struct ptree *tree, size_t pageSize)
+{
+    struct ptmeta *meta;
+    int ok;
+
+    if (!(meta = poolPin(&tree->pool, 0))) {
+        return -1;
+    }
+    ok = PTREE_MAGIC == meta->magic && PTREE_VERSION == meta->version &&
+        pageSize == meta->pageSize && tree->order == meta->order &&
+        meta->root > 0 && meta->root < meta->npages;
+    poolUnpin(&tree->pool, meta, 0);
+
+    if (!ok) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* copy one logged change back into its pages. */
+static int replay(void *ctx, const char *data, size_t bytes)
+{
+    struct ptree *tree = ctx;
+    struct ptchange change;
+    size_t at = 0;
+    char *page;
+
+    while (at < bytes) {
+        memcpy(&change, data + at, sizeof(change));
+        at += sizeof(change);
+        if (change.offset + (size_t)change.bytes > tree->pool.pageSize ||
+                change.bytes > bytes - at) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (!(page = poolPin(&tree->pool, change.page))) {
+            return -1;
+        }
+        memcpy(page + change.offset, data + at, change.bytes);
+        poolUnpin(&tree->pool, page, 1);
+        at += change.bytes;
+    }
+
+    return 0;
+}
+
+static int logBefore(void *ctx, uint64_t lsn)
+{
+    return walSync(ctx, lsn);
+}
+
+/* open the log, and replay and empty it. */
+static int openLog(struct ptree *tree, const char *path)
+{
+    size_t size = tree->pool.pageSize;
+    char *logPath = malloc(strlen(path) + sizeof(".wal"));
+    int fd;
+
+    if (!logPath) {
+        return -1;
+    }
+    snprintf(logPath, strlen(path) + sizeof(".wal"), "%s.wal", path);
+    fd = open(logPath, O_RDWR | O_CREAT, 0644);
+    free(logPath);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (!(tree->wal = malloc(sizeof(struct wal)))) {
+        close(fd);
+        return -1;
+    }
+    walInit(tree->wal, fd);
+    if (!(tree->record =
+                malloc(PTREE_MAX_HELD * (size + sizeof(struct ptchange))))) {
+        return -1;
+    }
+    tree->checkpointBytes = PTREE_CHECKPOINT_BYTES;
+
+    if (walReplay(fd, replay, tree) < 0 || checkpoint(tree) < 0) {
+        return -1;
+    }
+
+    tree->pool.beforeWrite = logBefore;
+    tree->pool.ctx = tree->wal;
+
+    return 0;
+}
+
+static int closeLog(struct ptree *tree)
+{
+    int ret = 0;
+
+    if (tree->wal) {
+        ret = walClose(tree->wal);
+        free(tree->wal);
+    }
+    free(tree->record);
+
+    return ret;
+}
+
+static int openTree(struct ptree *tree, const char *path, size_t pageSize,
+        int frames, int logged)
+{
+    struct stat st;
+    int saved;
+
+    memset(tree, 0x00, sizeof(*tree));
+
+    /* the order has to fit a short, and be at least three. */
+    if (pageSize < 64 || pageSize > (1 << 16)) {
+        errno = EINVAL;
+        return -1;
+    }
+    tree->order = ptreeOrder(pageSize);
+
+    if ((tree->fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+        return -1;
+    }
+
+    if (fstat(tree->fd, &st) < 0 ||
+            !(tree->before = malloc(PTREE_MAX_HELD * pageSize)) ||
+            poolInit(&tree->pool, tree->fd, pageSize, frames) < 0) {
+        goto fail;
+    }
+    pthread_mutex_init(&tree->lock, NULL);
+
+    if ((0 == st.st_size && create(tree, pageSize)) ||
+            (logged && openLog(tree, path)) || check(tree, pageSize)) {
+        saved = errno;
+        closeLog(tree);
+        poolDestroy(&tree->pool);
+        pthread_mutex_destroy(&tree->lock);
+        errno = saved;
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    saved = errno;
+    free(tree->before);
+    close(tree->fd);
+    errno = saved;
+    return -1;
+}
+
+int ptreeOpen(struct ptree *tree, const char *path, size_t pageSize,
+        int frames)
+{
+    return openTree(tree, path, pageSize, frames, 0);
+}
+
+int ptreeOpenLogged(struct ptree *tree, const char *path, size_t pageSize,
+        int frames)
+{
+    return openTree(tree, path, pageSize, frames, 1);
+}
+
+int ptreeSync(struct ptree *tree)
+{
+    int ret;
+
+    pthread_mutex_lock(&tree->lock);
+    ret = checkpoint(tree);
+    pthread_mutex_unlock(&tree->lock);
+
+    return ret;
+}
+
+int ptreeCommit(struct ptree *tree)
+{
+    return tree->wal ? walCommit(tree->wal) : 0;
+}
+
+int ptreeClose(struct ptree *tree)
+{
+    int ret = ptreeSync(tree);
+    int saved = errno;
+
+    if (closeLog(tree) < 0 && 0 == ret) {
+        saved = errno;
+        ret = -1;
+    }
+    poolDestroy(&tree->pool);
+    pthread_mutex_destroy(&tree->lock);
+    free(tree->before);
+    if (close(tree->fd) < 0 && 0 == ret) {
+        return -1;
+    }
+
+    errno = saved;
+    return ret;
+}
@@ -0,0 +1,154 @@
+#ifndef _PAGEDTREE_H
+#define _PAGEDTREE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bufpool.h"
+#include "wal.h"
+
+/******************************************************************************
+ * Macros
+ *****************************************************************************/
+
+#define PTREE_MAGIC 0x50425452 /* "PBTR" */
+#define PTREE_VERSION 1
+
+/* deep enough for a billion keys in the smallest pages. */
+#define PTREE_MAX_DEPTH 32
+/*
+ * pages one change can hold pinned: a node, its parent and a sibling per
+ * level, the new root and the meta page.  A change the pool hasn't that
+ * many frames for, for the tree's depth, fails and is undone.
+ */
+#define PTREE_MAX_HELD (3 * PTREE_MAX_DEPTH + 2)
+
+/* a logged tree checkpoints when its log grows past this. */
+#define PTREE_CHECKPOINT_BYTES (16 << 20)
+
+/******************************************************************************
+ * Objects
+ *****************************************************************************/
+
+/*
+ * Page 0 of the file.  Pages are numbered from the start of the file, so
+ * page 0 can't be anyone's child, and a 0 pointer means none.
+ */
+struct ptmeta {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pageSize;
+    uint32_t order;
+    uint32_t root;
+    uint32_t npages; /* pages in the file, meta included. */
+    uint32_t freeHead; /* first page of the free list, 0 if it's empty. */
+};
+
+/*
+ * Every other page is a node, laid out like block_t but with page numbers
+ * for pointers and no back-link: a change remembers the path it came down
+ * instead.
+ *
+ * | header | ptrs[order+1] | keys[order] |
+ */
+typedef struct ptnode {
+    uint16_t used;
+    uint16_t order;
+    uint32_t next; /* free pages only: the next free page. */
+} ptnode_t;
+
+struct ptheld {
+    uint32_t page;
+    ptnode_t *node;
+    char dirty;
+};
+
+/*
+ * One change at a time, under the lock; logged trees then commit outside it,
+ * so that concurrent writers' commits share fsyncs.
+ */
+struct ptree {
+    int fd;
+    int order;
+    pthread_mutex_t lock;
+    struct bufpool pool;
+    struct ptheld held[PTREE_MAX_HELD]; /* pinned by the current change. */
+    int nheld;
+    struct wal *wal; /* NULL if it isn't logged. */
+    /*
+     * The held pages as they were when first held: what a failed change is
+     * undone from, and what a logged one's record is the difference from.
+     */
+    char *before;
+    char *record; /* logged: room to log what each change did. */
+    size_t checkpointBytes;
+};
+
+static inline uint32_t *ptPtrs(ptnode_t *node)
+{
+    return (uint32_t *)(node + 1);
+}
+
+static inline int *ptKeys(ptnode_t *node)
+{
+    return (int *)(ptPtrs(node) + node->order + 1);
+}
+
+static inline int ptIsLeaf(ptnode_t *node)
+{
+    return 0 == ptPtrs(node)[0];
+}
+
+/******************************************************************************
+ * Implementation
+ *****************************************************************************/
+
+/* the order of the nodes in pages this size. */
+int ptreeOrder(size_t pageSize);
+
+/*
+ * Open the tree in the file at path, making it if it's missing or empty, with
+ * a pool of frames pages.  pageSize must be what the file was made with.
+ * @return 0, or -1 with errno set: EINVAL if the file isn't a tree of
+ * pageSize pages.
+ */
+int ptreeOpen(struct ptree *tree, const char *path, size_t pageSize,
+        int frames);
+/*
+ * ptreeOpen(), with a write-ahead log in path.wal: every change is logged as
+ * the bytes it left in each page it touched, and is durable once
+ * ptreeCommit() returns.  The pages themselves only reach the file when
+ * they're evicted, and at checkpoints.  Opening replays whatever the log
+ * holds from before a crash.
+ */
+int ptreeOpenLogged(struct ptree *tree, const char *path, size_t pageSize,
+        int frames);
+/* sync and close.  @return 0, or -1 with errno set; it's closed either way. */
+int ptreeClose(struct ptree *tree);
+/*
+ * Write back every dirty page and fsync.  A logged tree then empties its
+ * log: a checkpoint.
+ * @return 0, or -1 with errno set.
+ */
+int ptreeSync(struct ptree *tree);
+/*
+ * Make every change so far durable, sharing the fsync with whoever else
+ * commits meanwhile.  Nothing to do if the tree isn't logged.
+ * @return 0, or -1 with errno set.
+ */
+int ptreeCommit(struct ptree *tree);
+
+/*
+ * These all @return -1 with errno set if a page can't be read or written,
+ * having undone whatever they'd changed, so the tree is as it was: ENOBUFS
+ * if the pool hasn't the frames the change needs for the tree's depth.
+ */
+/* @return 1 if value is in the tree, else 0. */
+int ptreeSearch(struct ptree *tree, int value);
+/* @return 1 if value went in, 0 if it was already there. */
+int ptreeInsert(struct ptree *tree, int value);
+/* @return 1 if value came out, 0 if it wasn't there. */
+int ptreeDelete(struct ptree *tree, int value);
+
+#endif
@@ -1,18 +1,24 @@
 
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "betree.h"
 #include "btree.h"
-
-/******************************************************************************
- * Globals
- *****************************************************************************/
-
-extern int counter;
-extern block_t *blockStorage[128];
+#include "bplustree.h"
+#include "cowtree.h"
+#include "olctree.h"
+#include "pagedtree.h"
 
 /******************************************************************************
  * Macros
@@ -25,12 +31,13 @@ extern block_t *blockStorage[128];
  *****************************************************************************/
 
 #define VERIFY_BLOCK(ID, VALUES) \
-    test_verifyBlock((ID), (VALUES), NUM_ELEMENTS((VALUES)))
+    test_verifyBlock(root, (ID), (VALUES), NUM_ELEMENTS((VALUES)))
 
+/* checks the block with this id in the tree called root. */
 #define VERIFY_BLOCK2(ID, ...) \
     do { \
         int X[] = {__VA_ARGS__}; \
-        test_verifyBlock((ID), X, NUM_ELEMENTS(X)); \
+        test_verifyBlock(root, (ID), X, NUM_ELEMENTS(X)); \
     } while (0)
 
 #define VERIFY_DELETE(ROOT, INPUT, X) \
@@ -42,17 +49,18 @@ extern block_t *blockStorage[128];
 
 typedef void (*test_ptr_t)(void);
 
-static block_t *test_buildTree(block_t *root, int *input, int count);
+static struct btree *test_buildTree(struct btree *root, int *input, int count);
 /* deleted is the value you expect to be missing, not the index in input */
-static void test_verifyDeletion(block_t *root, int *input, int count, int deleted);
-static void test_verifyTree(block_t *root, int *input, int count);
-static int test_verifyBlock(int block, int *values, int count);
+static void test_verifyDeletion(struct btree *root, int *input, int count, int deleted);
+static void test_verifyTree(struct btree *root, int *input, int count);
+static int test_verifyBlock(struct btree *root, int block, int *values,
+        int count);
 
-static block_t *test_buildTree(block_t *root, int *input, int count)
+static struct btree *test_buildTree(struct btree *root, int *input, int count)
 {
     int i;
 
-    root = newBlock();
+    root = newTree(NUM_KEYS);
     assert(root);
 
     for (i = 0; i < count; i++) {
@@ -64,7 +72,7 @@ static block_t *test_buildTree(block_t *root, int *input, int count)
     return root;
 }
 
-static void test_verifyDeletion(block_t *root, int *input, int count, int deleted)
+static void test_verifyDeletion(struct btree *root, int *input, int count, int deleted)
 {
     int i;
     block_t *f;
@@ -79,7 +87,7 @@ static void test_verifyDeletion(block_t *root, int *input, int count, int delete
     }
 }
 
-static void test_verifyTree(block_t *root, int *input, int count)
+static void test_verifyTree(struct btree *root, int *input, int count)
 {
     int i;
     block_t *f;
@@ -90,10 +98,11 @@ static void test_verifyTree(block_t *root, int *input, int count)
     }
 }
 
-static int test_verifyBlock(int block, int *values, int count)
+static int test_verifyBlock(struct btree *root, int block, int *values,
+        int count)
 {
     int i, ret;
-    block_t *blk = blockStorage[block];
+    block_t *blk = treeBlock(root, block);
 
     if (blk->used != count) {
         ret = 0;
@@ -101,7 +110,7 @@ static int test_verifyBlock(int block, int *values, int count)
     }
 
     for (i = 0; i < blk->used; i++) {
-        if (blk->keys[i].key != values[i]) {
+        if (blockKeys(blk)[i] != values[i]) {
             ret = 0;
             goto check;
         }
@@ -130,14 +139,14 @@ check:
 static void test_insertDescending1(void)
 {
     int input[] = {9, 8, 7, 6, 5, 4, 3, 2};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing insert descending\n");
 
     {
         int i;
 
-        root = newBlock();
+        root = newTree(NUM_KEYS);
         assert(root);
 
         for (i = 0; i < NUM_ELEMENTS(input); i++) {
@@ -164,7 +173,7 @@ static void test_insertBalance(void)
 {
     int i;
     int input[50];
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing insert with double split\n");
 
@@ -175,7 +184,7 @@ static void test_insertBalance(void)
     root = test_buildTree(root, input, NUM_ELEMENTS(input));
 
     printf("\n\n");
-    depthFirstPrint(root);
+    printTree("", root);
 
     depthFirstFree(root);
 
@@ -196,7 +205,7 @@ static void test_insertBalance(void)
 static void test_deleteLeafFirstSimple(void)
 {
     int input[] = {1, 2, 3, 4};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf basic\n");
 
@@ -236,7 +245,7 @@ static void test_deleteLeafFirstSimple(void)
 static void test_deleteLeafEndSimple(void)
 {
     int input[] = {1, 2, 3, 4};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf basic\n");
 
@@ -278,7 +287,7 @@ static void test_deleteLeafEndSimple(void)
 static void test_deleteCase2(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 2\n");
 
@@ -324,7 +333,7 @@ static void test_deleteCase2(void)
 static void test_deleteCase3(void)
 {
     int input[] = {1, 2, 3, 4, 5, 8, 9, 6};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 3\n");
 
@@ -373,7 +382,7 @@ static void test_deleteCase3(void)
 static void test_deleteCase4a(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 4a\n");
 
@@ -422,7 +431,7 @@ static void test_deleteCase4a(void)
 static void test_deleteCase4b(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 4b\n");
 
@@ -471,7 +480,7 @@ static void test_deleteCase4b(void)
 static void test_deleteCase4c(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 4c\n");
 
@@ -517,7 +526,7 @@ static void test_deleteCase4c(void)
 static void test_deleteCase5a(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 5a\n");
 
@@ -564,7 +573,7 @@ static void test_deleteCase5a(void)
 static void test_deleteCase5b(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 9, 11, 8};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 5b\n");
 
@@ -611,7 +620,7 @@ static void test_deleteCase5b(void)
 static void test_deleteCase6(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 10, 9, 8};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 6\n");
 
@@ -658,7 +667,7 @@ static void test_deleteCase6(void)
 static void test_deleteCase7(void)
 {
     int input[] = {1, 2, 3, 4, 10, 15, 20, 25, 30, 14};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 7\n");
 
@@ -705,7 +714,7 @@ static void test_deleteCase7(void)
 static void test_deleteCase8(void)
 {
     int input[] = {1, 2, 3, 4, 10, 15, 20, 25, 30, 14, 31};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 8\n");
 
@@ -755,7 +764,7 @@ static void test_deleteCase8(void)
 static void test_deleteCase10a(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 10a\n");
 
@@ -804,7 +813,7 @@ static void test_deleteCase10a(void)
 static void test_deleteCase10b(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 10b\n");
 
@@ -856,7 +865,7 @@ static void test_deleteCase10b(void)
 static void test_deleteCase10c(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 10c\n");
 
@@ -908,7 +917,7 @@ static void test_deleteCase10c(void)
 static void test_deleteCase10d(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 10d\n");
 
@@ -960,7 +969,7 @@ static void test_deleteCase10d(void)
 static void test_deleteCase11a(void)
 {
     int input[] = {1, 2, 3, 4, 5, 6, 7};
-    block_t *root = NULL;
+    struct btree *root = NULL;
 
     printf("testing delete leaf case 11a\n");
 
@@ -989,6 +998,1453 @@ static void test_deleteCase11a(void)
     return;
 }
 
+/*
+ * Check the shape of the whole tree: keys in order and within the bounds the
+ * parent gives, every block but the root at least half full, back-links
+ * right, and all the leaves at one depth.
+ *
+ * @return the depth of the leaves below blk.
+ */
+static int test_verifyShape(block_t *blk, long lo, long hi)
+{
+    int i, depth = -1;
+    int *keys = blockKeys(blk);
+    block_t **ptrs = blockPtrs(blk);
+
+    assert(blk->used < blk->order);
+    if (blk->parent) {
+        assert(blk->used >= (blk->order - 1) / 2);
+    }
+
+    for (i = 0; i < blk->used; i++) {
+        assert(keys[i] > lo && keys[i] < hi);
+        if (i > 0) {
+            assert(keys[i - 1] < keys[i]);
+        }
+    }
+
+    if (!ptrs[0]) {
+        for (i = 0; i <= blk->used; i++) {
+            assert(NULL == ptrs[i]);
+        }
+        return 0;
+    }
+
+    for (i = 0; i <= blk->used; i++) {
+        int d;
+
+        assert(ptrs[i]->parent == blk);
+        d = test_verifyShape(ptrs[i],
+                i == 0 ? lo : keys[i - 1],
+                i == blk->used ? hi : keys[i]);
+        assert(depth == -1 || d == depth);
+        depth = d;
+    }
+
+    return depth + 1;
+}
+
+/*
+ * Insert shuffled keys into trees of several orders, the page sized ones
+ * included, then delete half of them, which takes keys out of internal
+ * blocks as well as leaves.
+ */
+static void test_orders(void)
+{
+    int orders[] = {NUM_KEYS, 4, 5, 8, orderForBytes(4096),
+        orderForBytes(16384)};
+    int i, o, n = 20000;
+    int *input = malloc(sizeof(int) * n);
+    unsigned x = 12345;
+    struct btree *tree;
+
+    printf("testing orders\n");
+
+    assert(orderForBytes(64) == NUM_KEYS);
+    assert(blockBytes(orderForBytes(4096)) <= 4096);
+    assert(blockBytes(orderForBytes(4096) + 1) > 4096);
+
+    for (o = 0; o < NUM_ELEMENTS(orders); o++) {
+        for (i = 0; i < n; i++) {
+            input[i] = i * 2;
+        }
+        for (i = n - 1; i > 0; i--) {
+            int j, t;
+
+            x = x * 1103515245 + 12345;
+            j = (x >> 8) % (i + 1);
+            t = input[i];
+            input[i] = input[j];
+            input[j] = t;
+        }
+
+        tree = newTree(orders[o]);
+        for (i = 0; i < n; i++) {
+            insert(tree, input[i]);
+        }
+        insert(tree, input[0]); /* already there, so ignored. */
+
+        test_verifyShape(tree->root, -1, 2L * n);
+        for (i = 0; i < n; i++) {
+            assert(search(tree, i * 2));
+            assert(!search(tree, i * 2 + 1));
+        }
+
+        for (i = 0; i < n / 2; i++) {
+            delete(tree, input[i]);
+        }
+
+        test_verifyShape(tree->root, -1, 2L * n);
+        for (i = 0; i < n; i++) {
+            assert((NULL == search(tree, input[i])) == (i < n / 2));
+        }
+
+        /* and down to nothing. */
+        for (i = n / 2; i < n; i++) {
+            delete(tree, input[i]);
+        }
+        assert(0 == tree->root->used && NULL == blockPtrs(tree->root)[0]);
+        assert(1 == tree->arena.live);
+
+        depthFirstFree(tree);
+    }
+
+    free(input);
+}
+
+/* like test_verifyShape, and every leaf is linked to the next. */
+static int test_verifyPlus(bpblock_t *blk, long lo, long hi, bpblock_t **prev)
+{
+    int i, depth = -1;
+    int *keys = bpKeys(blk);
+
+    assert(blk->used < blk->order);
+    if (blk->parent) {
+        assert(blk->used >= (blk->order - 1) / 2);
+    }
+
+    for (i = 0; i < blk->used; i++) {
+        /* leaves hold their lower bound; it's a copy of one of theirs. */
+        assert(keys[i] >= lo && keys[i] < hi);
+        if (i > 0) {
+            assert(keys[i - 1] < keys[i]);
+        }
+    }
+
+    if (bpIsLeaf(blk)) {
+        assert(blk->prev == *prev);
+        if (*prev) {
+            assert((*prev)->next == blk);
+        }
+        *prev = blk;
+        return 0;
+    }
+
+    for (i = 0; i <= blk->used; i++) {
+        int d;
+
+        assert(bpPtrs(blk)[i]->parent == blk);
+        d = test_verifyPlus(bpPtrs(blk)[i],
+                i == 0 ? lo : keys[i - 1],
+                i == blk->used ? hi : keys[i], prev);
+        assert(depth == -1 || d == depth);
+        depth = d;
+    }
+
+    return depth + 1;
+}
+
+/*
+ * Shuffled inserts and deletes in B+trees of a few orders, checking the
+ * cursors against what should be there: a full walk both ways, and seeks to
+ * keys that are there, gone, and off either end.
+ */
+static void test_bplustree(void)
+{
+    int orders[] = {NUM_KEYS, 4, 5, 16, orderForBytes(4096)};
+    int i, o, n = 20000;
+    int *input = malloc(sizeof(int) * n);
+    char *present = calloc(2 * n, 1);
+    unsigned x = 54321;
+    struct bptree tree;
+    bpcursor_t c;
+
+    printf("testing b+tree\n");
+
+    for (o = 0; o < NUM_ELEMENTS(orders); o++) {
+        bpblock_t *last = NULL;
+        long count;
+
+        for (i = 0; i < n; i++) {
+            input[i] = i * 2;
+        }
+        for (i = n - 1; i > 0; i--) {
+            int j, t;
+
+            x = x * 1103515245 + 12345;
+            j = (x >> 8) % (i + 1);
+            t = input[i];
+            input[i] = input[j];
+            input[j] = t;
+        }
+
+        bpInit(&tree, orders[o]);
+        assert(!bpSeek(&tree, &c, 0));
+        assert(!bpLast(&tree, &c));
+        assert(!bpPrev(&c));
+
+        for (i = 0; i < n; i++) {
+            bpInsert(&tree, input[i]);
+            present[input[i]] = 1;
+        }
+        bpInsert(&tree, input[0]);
+        assert(tree.n == n);
+
+        /* delete a third, from all over. */
+        for (i = 0; i < n / 3; i++) {
+            bpDelete(&tree, input[i]);
+            present[input[i]] = 0;
+        }
+        bpDelete(&tree, 1);
+        assert(tree.n == n - n / 3);
+
+        test_verifyPlus(tree.root, -1, 2L * n, &last);
+        assert(NULL == last->next);
+
+        for (i = 0; i < 2 * n; i++) {
+            assert(bpSearch(&tree, i) == present[i]);
+        }
+
+        /* forwards. */
+        count = 0;
+        for (bpSeek(&tree, &c, -5), i = 0; bpValid(&c); bpNext(&c)) {
+            while (!present[i]) {
+                i++;
+            }
+            assert(bpKey(&c) == i);
+            i++;
+            count++;
+        }
+        assert(count == tree.n);
+
+        /* backwards. */
+        count = 0;
+        i = 2 * n - 1;
+        if (bpLast(&tree, &c)) {
+            do {
+                while (!present[i]) {
+                    i--;
+                }
+                assert(bpKey(&c) == i);
+                i--;
+                count++;
+            } while (bpPrev(&c));
+        }
+        assert(count == tree.n);
+
+        /* lower bounds. */
+        for (i = 0; i < 2 * n; i += 7) {
+            int want = i;
+
+            while (want < 2 * n && !present[want]) {
+                want++;
+            }
+            if (want == 2 * n) {
+                assert(!bpSeek(&tree, &c, i));
+                /* just past the end, so one step back is the last key. */
+                assert(bpPrev(&c));
+            } else {
+                assert(bpSeek(&tree, &c, i));
+                assert(bpKey(&c) == want);
+            }
+        }
+        assert(!bpSeek(&tree, &c, 2 * n));
+
+        for (i = n / 3; i < n; i++) {
+            bpDelete(&tree, input[i]);
+            present[input[i]] = 0;
+        }
+        assert(0 == tree.n && bpIsLeaf(tree.root) && 0 == tree.root->used);
+
+        bpFree(&tree);
+    }
+
+    free(present);
+    free(input);
+}
+
+/*
+ * Bulk load sorted keys at several orders and fills, including the tiny
+ * counts where the last blocks could come out short, then check the tree
+ * still takes inserts and deletes.
+ */
+static void test_bulkLoad(void)
+{
+    int orders[] = {NUM_KEYS, 4, 5, 8, orderForBytes(4096)};
+    double fills[] = {0.0, 0.5, 0.7, 1.0};
+    int counts[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 100, 1000, 54321};
+    int o, f, c, i, n;
+    int *input = malloc(sizeof(int) * 54321);
+    struct btree *tree;
+
+    printf("testing bulk load\n");
+
+    for (i = 0; i < 54321; i++) {
+        input[i] = i * 2;
+    }
+
+    for (o = 0; o < NUM_ELEMENTS(orders); o++) {
+        for (f = 0; f < NUM_ELEMENTS(fills); f++) {
+            for (c = 0; c < NUM_ELEMENTS(counts); c++) {
+                n = counts[c];
+                tree = bulkLoad(orders[o], input, n, fills[f]);
+
+                assert(NULL == tree->root->parent);
+                assert(tree->root->order == orders[o]);
+                test_verifyShape(tree->root, -1, 2L * n + 2);
+                for (i = 0; i < n; i++) {
+                    assert(search(tree, i * 2));
+                    assert(!search(tree, i * 2 + 1));
+                }
+
+                /* a full load splits at the first insert. */
+                for (i = 0; i < n; i += 3) {
+                    insert(tree, i * 2 + 1);
+                    delete(tree, i * 2);
+                }
+                test_verifyShape(tree->root, -1, 2L * n + 2);
+                for (i = 0; i < n; i++) {
+                    assert((NULL == search(tree, i * 2)) == (i % 3 == 0));
+                }
+
+                depthFirstFree(tree);
+            }
+        }
+    }
+
+    /* full leaves of an order 3 tree are two keys apiece. */
+    tree = bulkLoad(NUM_KEYS, input, 8, 1.0);
+    assert(2 == blockPtrs(tree->root)[0]->used);
+    depthFirstFree(tree);
+
+    free(input);
+}
+
+/*
+ * Two trees at once, each with its own ids, more blocks than the old global
+ * table had room for, and blocks freed by deletes handed out again.
+ */
+static void test_arena(void)
+{
+    struct btree *a = newTree(NUM_KEYS);
+    struct btree *b = newTree(orderForBytes(4096));
+    long slots;
+    int i;
+
+    printf("testing arena\n");
+
+    assert(0 == a->root->id && 0 == b->root->id);
+    assert(treeBlock(a, 0) == a->root && NULL == treeBlock(a, 1));
+    assert(0 == ((size_t)a->root & (ARENA_ALIGN - 1)));
+
+    for (i = 0; i < 100000; i++) {
+        insert(a, i);
+        insert(b, -i);
+    }
+    assert(a->arena.live > 128 && a->arena.nchunks > 1);
+    for (i = 0; i < a->arena.slots; i++) {
+        assert(treeBlock(a, i)->id == i);
+    }
+
+    for (i = 0; i < 100000; i += 2) {
+        delete(a, i);
+    }
+    slots = a->arena.slots;
+    assert(a->arena.live < slots);
+
+    /* the blocks the deletes freed come back before new slots do. */
+    for (i = 0; i < 100000; i += 2) {
+        insert(a, i);
+    }
+    assert(a->arena.slots <= slots + a->arena.perChunk);
+    for (i = 0; i < 100000; i++) {
+        assert(search(a, i) && search(b, -i));
+    }
+
+    depthFirstFree(a);
+    depthFirstFree(b);
+}
+
+/*
+ * Every kernel the cpu runs against a plain scan, for every size up to past
+ * a few vector windows, and values below, between, on and above the keys.
+ */
+static void test_nodeSearch(void)
+{
+    int keys[300];
+    int kind, n, i, v;
+    unsigned x = 777;
+
+    printf("testing node search, best is %s\n", searchName(searchBest()));
+
+    assert(nodeSearchFn == searchKernel(searchBest()));
+
+    for (kind = 0; kind < SEARCH_KINDS; kind++) {
+        nodesearch_t fn = searchKernel(kind);
+
+        if (!searchSupported(kind)) {
+            continue;
+        }
+
+        for (n = 0; n <= 300; n++) {
+            /* sorted, distinct, and next to the extremes at the ends. */
+            for (i = 0, v = INT_MIN + 1; i < n; i++) {
+                x = x * 1103515245 + 12345;
+                keys[i] = v;
+                v += 1 + (x >> 16) % 1000;
+            }
+            if (n > 1) {
+                keys[n - 1] = INT_MAX - 1;
+            }
+
+            for (i = 0; i < n; i++) {
+                int want;
+                int probes[] = {keys[i], keys[i] - 1, keys[i] + 1};
+                int p;
+
+                for (p = 0; p < NUM_ELEMENTS(probes); p++) {
+                    for (want = 0; want < n && keys[want] < probes[p];
+                            want++) {
+                    }
+                    assert(fn(keys, n, probes[p]) == want);
+                }
+            }
+            assert(0 == fn(keys, n, INT_MIN));
+            assert(n == fn(keys, n, INT_MAX));
+        }
+    }
+}
+
+/*
+ * The shape checks of test_verifyShape() for a paged tree, reading the pages
+ * straight from the pool, and a count of the keys in *keys.
+ *
+ * @return the depth of the leaves below page.
+ */
+static int test_verifyPaged(struct ptree *tree, uint32_t page, long lo,
+        long hi, int root, long *keys)
+{
+    ptnode_t *node = poolPin(&tree->pool, page);
+    int i, depth = -1;
+
+    assert(node);
+    assert(node->order == tree->order && node->used < node->order);
+    if (!root) {
+        assert(node->used >= (node->order - 1) / 2);
+    }
+
+    for (i = 0; i < node->used; i++) {
+        assert(ptKeys(node)[i] > lo && ptKeys(node)[i] < hi);
+        if (i > 0) {
+            assert(ptKeys(node)[i - 1] < ptKeys(node)[i]);
+        }
+    }
+    *keys += node->used;
+
+    if (ptIsLeaf(node)) {
+        for (i = 0; i <= node->used; i++) {
+            assert(0 == ptPtrs(node)[i]);
+        }
+        depth = 0;
+    } else {
+        for (i = 0; i <= node->used; i++) {
+            int d = test_verifyPaged(tree, ptPtrs(node)[i],
+                    i == 0 ? lo : ptKeys(node)[i - 1],
+                    i == node->used ? hi : ptKeys(node)[i], 0, keys);
+
+            assert(depth == -1 || d + 1 == depth);
+            depth = d + 1;
+        }
+    }
+
+    poolUnpin(&tree->pool, node, 0);
+    return depth;
+}
+
+static void test_verifyPagedTree(struct ptree *tree, long count)
+{
+    struct ptmeta *meta = poolPin(&tree->pool, 0);
+    long keys = 0;
+
+    assert(meta);
+    test_verifyPaged(tree, meta->root, INT_MIN - 1L, INT_MAX + 1L, 1, &keys);
+    assert(keys == count);
+    poolUnpin(&tree->pool, meta, 0);
+}
+
+/*
+ * A paged tree in small pages with a pool far smaller than it, so pages go
+ * in and out all the time: insert, delete half, and check it all survives
+ * being closed and opened again.
+ */
+static void test_paged(void)
+{
+    char path[] = "/tmp/pagedtreeXXXXXX";
+    int count = 20000;
+    int *input = malloc(sizeof(int) * count);
+    struct ptree tree;
+    struct poolstats stats;
+    struct ptmeta *meta;
+    uint32_t npages;
+    char *in = calloc(count, 1);
+    long have = 0, failed = 0;
+    int fd, i;
+
+    printf("testing paged tree\n");
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    for (i = 0; i < count; i++) {
+        input[i] = i * 3;
+    }
+    for (i = count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = input[i];
+
+        input[i] = input[j];
+        input[j] = t;
+    }
+
+    assert(0 == ptreeOpen(&tree, path, 128, 32));
+    assert(14 == tree.order);
+
+    for (i = 0; i < count; i++) {
+        assert(1 == ptreeInsert(&tree, input[i]));
+    }
+    assert(0 == ptreeInsert(&tree, input[0]));
+    test_verifyPagedTree(&tree, count);
+
+    for (i = 0; i < count; i++) {
+        assert(1 == ptreeSearch(&tree, input[i]));
+        assert(0 == ptreeSearch(&tree, input[i] + 1));
+    }
+
+    stats = poolStats(&tree.pool);
+    assert(stats.evictions > 0 && stats.writebacks > 0);
+    assert(stats.hitRate > 0 && stats.hitRate < 1);
+
+    for (i = 0; i < count; i += 2) {
+        assert(1 == ptreeDelete(&tree, input[i]));
+    }
+    assert(0 == ptreeDelete(&tree, input[0]));
+    test_verifyPagedTree(&tree, count / 2);
+    assert(0 == ptreeClose(&tree));
+
+    /* wrong page size. */
+    assert(-1 == ptreeOpen(&tree, path, 256, 32) && EINVAL == errno);
+
+    assert(0 == ptreeOpen(&tree, path, 128, 32));
+    test_verifyPagedTree(&tree, count / 2);
+    for (i = 0; i < count; i++) {
+        assert(ptreeSearch(&tree, input[i]) == (i % 2));
+    }
+
+    /* the pages the deletes freed are used again before the file grows. */
+    meta = poolPin(&tree.pool, 0);
+    npages = meta->npages;
+    poolUnpin(&tree.pool, meta, 0);
+    for (i = 0; i < count; i += 2) {
+        assert(1 == ptreeInsert(&tree, input[i]));
+    }
+    test_verifyPagedTree(&tree, count);
+    assert(0 == ptreeSync(&tree));
+    assert(lseek(tree.fd, 0, SEEK_END) <= (off_t)npages * 128 * 11 / 10);
+
+    /* and empty, down to a leaf root again. */
+    for (i = 0; i < count; i++) {
+        assert(1 == ptreeDelete(&tree, input[i]));
+    }
+    test_verifyPagedTree(&tree, 0);
+    assert(0 == ptreeClose(&tree));
+    unlink(path);
+
+    /*
+     * Tiny pages and the fewest frames a pool takes: once the tree's deep
+     * enough, changes can't pin all they need, and must fail having done
+     * nothing, and leave the tree fit for the next.
+     */
+    assert(0 == ptreeOpen(&tree, path, 64, POOL_MIN_FRAMES));
+    for (i = 0; i < count; i++) {
+        int ret = ptreeInsert(&tree, input[i]);
+
+        if (ret < 0) {
+            assert(ENOBUFS == errno);
+            failed++;
+        } else {
+            assert(1 == ret);
+            in[i] = 1;
+            have++;
+        }
+    }
+    for (i = 0; i < count; i += 3) {
+        int ret = ptreeDelete(&tree, input[i]);
+
+        if (ret < 0) {
+            assert(ENOBUFS == errno);
+            failed++;
+        } else {
+            assert(ret == in[i]);
+            have -= in[i];
+            in[i] = 0;
+        }
+    }
+    assert(failed > 0 && have > 0);
+    assert(0 == ptreeClose(&tree));
+
+    assert(0 == ptreeOpen(&tree, path, 64, 256));
+    test_verifyPagedTree(&tree, have);
+    for (i = 0; i < count; i++) {
+        assert(ptreeSearch(&tree, input[i]) == in[i]);
+    }
+    assert(0 == ptreeClose(&tree));
+
+    unlink(path);
+    free(in);
+    free(input);
+}
+
+#define CRASH_KEYS 3000
+
+/* the key op j toggles: in if it's out, out if it's in. */
+static int test_crashKey(long j)
+{
+    return (j * 2654435761u) % CRASH_KEYS;
+}
+
+/*
+ * Kill a process changing a logged tree at random points, over and over, and
+ * check every time that what's opened again is the tree as it was after
+ * some op from the last it committed on: nothing committed lost, and no
+ * change half there.  Each round carries on from where the last one was
+ * recovered to, so recovery gets recovered from too, and the log is kept
+ * short so the kills land in checkpoints as well.
+ */
+static void test_walCrash(void)
+{
+    char path[] = "/tmp/waltreeXXXXXX";
+    char logPath[sizeof(path) + 4];
+    char *want = calloc(CRASH_KEYS, 1);
+    char *got = calloc(CRASH_KEYS, 1);
+    /* shared with the child: ops done, and ops committed. */
+    volatile long *shared = mmap(NULL, 2 * sizeof(long),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    /* and which keys the child got in. */
+    volatile char *inserted = mmap(NULL, CRASH_KEYS, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    struct ptree tree;
+    long from = 0, recovered = 0, j, count;
+    int fd, round, k;
+
+    printf("testing wal crash recovery\n");
+
+    fd = mkstemp(path);
+    assert(fd >= 0 && shared != MAP_FAILED && inserted != MAP_FAILED);
+    close(fd);
+    sprintf(logPath, "%s.wal", path);
+    srand(time(NULL));
+
+    for (round = 0; round < 30; round++) {
+        pid_t pid;
+        int status;
+
+        shared[0] = shared[1] = from;
+        if (0 == (pid = fork())) {
+            assert(0 == ptreeOpenLogged(&tree, path, 128, 16));
+            tree.checkpointBytes = 16 << 10;
+            for (j = from;; j++) {
+                int key = test_crashKey(j);
+
+                if (ptreeSearch(&tree, key)) {
+                    assert(1 == ptreeDelete(&tree, key));
+                } else {
+                    assert(1 == ptreeInsert(&tree, key));
+                }
+                shared[0] = j + 1;
+                if (rand() % 8 == 0) {
+                    assert(0 == ptreeCommit(&tree));
+                    shared[1] = j + 1;
+                }
+            }
+        }
+        assert(pid > 0);
+
+        usleep(rand() % 40000);
+        kill(pid, SIGKILL);
+        assert(pid == waitpid(pid, &status, 0));
+        /* killed mid run, not aborted by an assert of its own. */
+        assert(WIFSIGNALED(status) && SIGKILL == WTERMSIG(status));
+
+        assert(0 == ptreeOpenLogged(&tree, path, 128, 16));
+        for (k = 0, count = 0; k < CRASH_KEYS; k++) {
+            got[k] = ptreeSearch(&tree, k);
+            count += got[k];
+        }
+        test_verifyPagedTree(&tree, count);
+
+        /*
+         * want is the tree after op from; find the op it matches, which can
+         * be the one that was under way when the child was killed.
+         */
+        for (j = from; j < shared[1]; j++) {
+            want[test_crashKey(j)] ^= 1;
+        }
+        for (;;) {
+            if (0 == memcmp(want, got, CRASH_KEYS)) {
+                break;
+            }
+            assert(j <= shared[0]);
+            want[test_crashKey(j)] ^= 1;
+            j++;
+        }
+        recovered += j - shared[1];
+        from = j;
+
+        assert(0 == ptreeClose(&tree));
+    }
+    printf("%ld ops, %ld uncommitted found on disk\n", from, recovered);
+
+    /*
+     * Changes that fail for want of frames are undone and never logged:
+     * a crash after committing the rest replays exactly the ones that
+     * worked, into a tree of the right shape.
+     */
+    unlink(path);
+    unlink(logPath);
+    memset((void *)inserted, 0x00, CRASH_KEYS);
+    if (0 == fork()) {
+        long failed = 0;
+
+        assert(0 == ptreeOpenLogged(&tree, path, 64, POOL_MIN_FRAMES));
+        tree.checkpointBytes = 1l << 40;
+        for (j = 0; j < CRASH_KEYS; j++) {
+            int ret = ptreeInsert(&tree, test_crashKey(j));
+
+            assert(1 == ret || (-1 == ret && ENOBUFS == errno));
+            inserted[test_crashKey(j)] = 1 == ret;
+            failed += ret < 0;
+        }
+        assert(failed > 0);
+        assert(0 == ptreeCommit(&tree));
+        _exit(0);
+    }
+    assert(wait(&k) > 0 && WIFEXITED(k) && 0 == WEXITSTATUS(k));
+
+    assert(0 == ptreeOpenLogged(&tree, path, 64, 256));
+    for (k = 0, count = 0; k < CRASH_KEYS; k++) {
+        assert(ptreeSearch(&tree, k) == inserted[k]);
+        count += inserted[k];
+    }
+    test_verifyPagedTree(&tree, count);
+    assert(0 == ptreeClose(&tree));
+
+    unlink(path);
+    unlink(logPath);
+    munmap((void *)shared, 2 * sizeof(long));
+    munmap((void *)inserted, CRASH_KEYS);
+    free(want);
+    free(got);
+}
+
+/*
+ * The concurrent tree's shape, once nobody's using it: as test_verifyPlus(),
+ * but no minimum fill, since deletes don't merge, and no versions left
+ * locked.  The keys are counted into *keys.
+ *
+ * @return the depth of the leaves below node.
+ */
+static int test_verifyOlc(olcnode_t *node, long lo, long hi, long *keys)
+{
+    int i, depth = -1;
+
+    assert(0 == (node->version & 1));
+    assert(node->used < node->order);
+
+    for (i = 0; i < node->used; i++) {
+        assert(olcKeys(node)[i] >= lo && olcKeys(node)[i] < hi);
+        if (i > 0) {
+            assert(olcKeys(node)[i - 1] < olcKeys(node)[i]);
+        }
+    }
+
+    if (node->leaf) {
+        *keys += node->used;
+        return 0;
+    }
+
+    for (i = 0; i <= node->used; i++) {
+        int d = test_verifyOlc(olcPtrs(node)[i],
+                i == 0 ? lo : olcKeys(node)[i - 1],
+                i == node->used ? hi : olcKeys(node)[i], keys);
+
+        assert(depth == -1 || d == depth);
+        depth = d;
+    }
+
+    return depth + 1;
+}
+
+#define OLC_WRITERS 4
+#define OLC_KEYS 40000
+
+struct test_olcArgs {
+    struct olctree *tree;
+    int id;
+    volatile int *stop;
+};
+
+/*
+ * Writer id owns the keys that are id mod OLC_WRITERS: it puts them all in,
+ * takes out the ones that are odd, and checks its own as it goes.
+ */
+static void *test_olcWriter(void *arg)
+{
+    struct test_olcArgs *a = arg;
+    int k;
+
+    for (k = a->id; k < OLC_KEYS; k += OLC_WRITERS) {
+        assert(1 == olcInsert(a->tree, k * 2));
+        assert(0 == olcInsert(a->tree, k * 2));
+    }
+    for (k = a->id; k < OLC_KEYS; k += OLC_WRITERS) {
+        assert(olcSearch(a->tree, k * 2));
+        if (k & 1) {
+            assert(1 == olcDelete(a->tree, k * 2));
+            assert(0 == olcDelete(a->tree, k * 2));
+        }
+    }
+
+    return NULL;
+}
+
+/* the odd numbers below zero are there from the start, and stay. */
+static void *test_olcReader(void *arg)
+{
+    struct test_olcArgs *a = arg;
+    int k = 0;
+
+    while (!*a->stop) {
+        assert(olcSearch(a->tree, -(k % 1000) * 2 - 1));
+        assert(!olcSearch(a->tree, k % OLC_KEYS * 2 + 1));
+        k++;
+    }
+
+    return NULL;
+}
+
+/*
+ * The concurrent tree: one thread against a plain array, then writers
+ * splitting the same small nodes over and over under readers that check
+ * keys that never move are always found.
+ */
+static void test_olc(void)
+{
+    int orders[] = {OLC_MIN_ORDER, 5, 8, orderForBytes(4096)};
+    char *present = calloc(OLC_KEYS, 1);
+    struct test_olcArgs args[OLC_WRITERS + 2];
+    pthread_t threads[OLC_WRITERS + 2];
+    volatile int stop;
+    struct olctree tree;
+    long keys;
+    int o, i, k;
+
+    printf("testing concurrent tree\n");
+
+    for (o = 0; o < NUM_ELEMENTS(orders); o++) {
+        olcInit(&tree, orders[o]);
+        memset(present, 0x00, OLC_KEYS);
+
+        for (i = 0; i < OLC_KEYS * 2; i++) {
+            k = rand() % OLC_KEYS;
+            if (rand() % 3) {
+                assert(olcInsert(&tree, k) == !present[k]);
+                present[k] = 1;
+            } else {
+                assert(olcDelete(&tree, k) == present[k]);
+                present[k] = 0;
+            }
+        }
+        for (k = 0, keys = 0; k < OLC_KEYS; k++) {
+            assert(olcSearch(&tree, k) == present[k]);
+        }
+        test_verifyOlc(tree.root, INT_MIN, INT_MAX + 1L, &keys);
+        for (k = 0; k < OLC_KEYS; k++) {
+            keys -= present[k];
+        }
+        assert(0 == keys);
+
+        olcFree(&tree);
+    }
+
+    for (o = 0; o < NUM_ELEMENTS(orders); o++) {
+        olcInit(&tree, orders[o]);
+        for (k = 0; k < 1000; k++) {
+            olcInsert(&tree, -k * 2 - 1);
+        }
+
+        stop = 0;
+        for (i = 0; i < OLC_WRITERS + 2; i++) {
+            args[i].tree = &tree;
+            args[i].id = i;
+            args[i].stop = &stop;
+            assert(0 == pthread_create(&threads[i], NULL,
+                        i < OLC_WRITERS ? test_olcWriter : test_olcReader,
+                        &args[i]));
+        }
+        for (i = 0; i < OLC_WRITERS; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        stop = 1;
+        for (; i < OLC_WRITERS + 2; i++) {
+            pthread_join(threads[i], NULL);
+        }
+
+        for (k = 0; k < OLC_KEYS; k++) {
+            assert(olcSearch(&tree, k * 2) == !(k & 1));
+        }
+        keys = 0;
+        test_verifyOlc(tree.root, INT_MIN, INT_MAX + 1L, &keys);
+        assert(keys == 1000 + OLC_KEYS / 2);
+
+        olcFree(&tree);
+    }
+
+    free(present);
+}
+
+/*
+ * test_verifyShape() for a copy-on-write tree, which has counts where the
+ * back-links were.  The keys are counted into *keys.
+ *
+ * @return the depth of the leaves below node.
+ */
+static int test_verifyCow(cownode_t *node, long lo, long hi, int root,
+        long *keys)
+{
+    int i, depth = -1;
+
+    assert(node->refs >= 1);
+    assert(node->used < node->order);
+    if (!root) {
+        assert(node->used >= (node->order - 1) / 2);
+    }
+
+    for (i = 0; i < node->used; i++) {
+        assert(cowKeys(node)[i] > lo && cowKeys(node)[i] < hi);
+        if (i > 0) {
+            assert(cowKeys(node)[i - 1] < cowKeys(node)[i]);
+        }
+    }
+    *keys += node->used;
+
+    if (cowIsLeaf(node)) {
+        for (i = 0; i <= node->used; i++) {
+            assert(NULL == cowPtrs(node)[i]);
+        }
+        return 0;
+    }
+
+    for (i = 0; i <= node->used; i++) {
+        int d = test_verifyCow(cowPtrs(node)[i],
+                i == 0 ? lo : cowKeys(node)[i - 1],
+                i == node->used ? hi : cowKeys(node)[i], 0, keys);
+
+        assert(depth == -1 || d == depth);
+        depth = d;
+    }
+
+    return depth + 1;
+}
+
+struct test_cowScan {
+    int *keys;
+    long n;
+};
+
+static void test_cowVisit(void *ctx, int key)
+{
+    struct test_cowScan *scan = ctx;
+
+    scan->keys[scan->n++] = key;
+}
+
+#define COW_KEYS 20000
+#define COW_SNAPS 10
+
+struct test_cowArgs {
+    struct cowtree *tree;
+    volatile int *stop;
+};
+
+/*
+ * Snapshots are taken while the writer goes through its keys in order, in
+ * then out, so every snapshot is a run of them, starting at the first or
+ * ending at the last.  A snapshot scanned twice must come out the same,
+ * however much the tree changes meanwhile.
+ */
+static void *test_cowReader(void *arg)
+{
+    struct test_cowArgs *a = arg;
+    struct cowtree *tree = a->tree;
+    struct test_cowScan scan = {malloc(sizeof(int) * COW_KEYS), 0};
+    long scans = 0;
+
+    do {
+        cownode_t *snap = cowSnapshot(tree);
+        long n, i;
+
+        scan.n = 0;
+        n = cowScan(snap, INT_MIN, INT_MAX, test_cowVisit, &scan);
+        assert(n == scan.n);
+        for (i = 1; i < n; i++) {
+            assert(scan.keys[i] == scan.keys[i - 1] + 1);
+        }
+        assert(0 == n || 0 == scan.keys[0] || COW_KEYS - 1 == scan.keys[n - 1]);
+
+        scan.n = 0;
+        assert(n == cowScan(snap, INT_MIN, INT_MAX, test_cowVisit, &scan));
+        if (n) {
+            assert(cowFind(snap, scan.keys[n / 2]));
+        }
+        cowRelease(tree, snap);
+        scans++;
+    } while (!*a->stop);
+
+    free(scan.keys);
+    return (void *)scans;
+}
+
+/*
+ * The copy-on-write tree: shuffled inserts and deletes against a plain
+ * array, with snapshots taken along the way that must still hold what the
+ * array did then, and every node freed once they're let go of.  Then
+ * readers scanning snapshots while a writer changes the tree under them.
+ */
+static void test_cow(void)
+{
+    int orders[] = {NUM_KEYS, 4, 5, 16, orderForBytes(4096)};
+    char *present = calloc(COW_KEYS, 1);
+    char *saved[COW_SNAPS];
+    cownode_t *snaps[COW_SNAPS];
+    struct test_cowScan scan = {malloc(sizeof(int) * COW_KEYS), 0};
+    struct test_cowArgs args[2];
+    pthread_t threads[2];
+    volatile int stop = 0;
+    struct cowtree tree;
+    long keys, live;
+    int o, i, k, s;
+
+    printf("testing copy-on-write tree\n");
+
+    for (o = 0; o < NUM_ELEMENTS(orders); o++) {
+        cowInit(&tree, orders[o]);
+        memset(present, 0x00, COW_KEYS);
+
+        for (s = 0; s < COW_SNAPS; s++) {
+            for (i = 0; i < COW_KEYS / 2; i++) {
+                k = rand() % COW_KEYS;
+                if (rand() % 3) {
+                    assert(cowInsert(&tree, k) == !present[k]);
+                    present[k] = 1;
+                } else {
+                    assert(cowDelete(&tree, k) == present[k]);
+                    present[k] = 0;
+                }
+            }
+            snaps[s] = cowSnapshot(&tree);
+            saved[s] = malloc(COW_KEYS);
+            memcpy(saved[s], present, COW_KEYS);
+
+            keys = 0;
+            test_verifyCow(tree.root, -1, COW_KEYS, 1, &keys);
+        }
+
+        /* every snapshot is as it was, whatever came after. */
+        for (s = 0; s < COW_SNAPS; s++) {
+            keys = 0;
+            test_verifyCow(snaps[s], -1, COW_KEYS, 1, &keys);
+            scan.n = 0;
+            assert(keys == cowScan(snaps[s], INT_MIN, INT_MAX,
+                        test_cowVisit, &scan));
+            for (i = 0; i < scan.n; i++) {
+                assert(saved[s][scan.keys[i]]);
+                keys -= saved[s][scan.keys[i]];
+            }
+            assert(0 == keys);
+            for (k = 0; k < COW_KEYS; k++) {
+                assert(cowFind(snaps[s], k) == saved[s][k]);
+            }
+
+            /* and a range out of the middle. */
+            scan.n = 0;
+            cowScan(snaps[s], COW_KEYS / 4, COW_KEYS / 2, test_cowVisit,
+                    &scan);
+            for (k = COW_KEYS / 4, i = 0; k <= COW_KEYS / 2; k++) {
+                if (saved[s][k]) {
+                    assert(scan.keys[i++] == k);
+                }
+            }
+            assert(i == scan.n);
+        }
+
+        /* letting go of them frees what only they held, in any order. */
+        live = tree.live;
+        for (s = 0; s < COW_SNAPS; s += 2) {
+            cowRelease(&tree, snaps[s]);
+            free(saved[s]);
+        }
+        assert(tree.live < live);
+        for (s = COW_SNAPS - 1; s > 0; s -= 2) {
+            cowRelease(&tree, snaps[s]);
+            free(saved[s]);
+        }
+        for (k = 0; k < COW_KEYS; k++) {
+            assert(cowSearch(&tree, k) == present[k]);
+        }
+
+        cowFree(&tree);
+    }
+
+    /*
+     * a leaf with no key to spare, between two with none either, merges
+     * with the left one under a snapshot: the right one is only looked at,
+     * so it stays shared, not copied.
+     */
+    cowInit(&tree, 5);
+    for (k = 0; k < COW_KEYS / 40; k++) {
+        assert(1 == cowInsert(&tree, k));
+    }
+    for (snaps[0] = tree.root; !cowIsLeaf(cowPtrs(snaps[0])[0]);) {
+        snaps[0] = cowPtrs(snaps[0])[1];
+    }
+    for (i = 0; i < 3; i++) {
+        assert(2 == cowPtrs(snaps[0])[i]->used);
+    }
+    snaps[1] = cowPtrs(snaps[0])[2];
+    k = cowKeys(cowPtrs(snaps[0])[1])[0];
+    snaps[0] = cowSnapshot(&tree);
+    assert(1 == cowDelete(&tree, k));
+    assert(2 == snaps[1]->refs);
+    keys = 0;
+    test_verifyCow(tree.root, -1, COW_KEYS, 1, &keys);
+    assert(COW_KEYS / 40 - 1 == keys);
+    cowRelease(&tree, snaps[0]);
+    cowFree(&tree);
+
+    cowInit(&tree, 8);
+    for (i = 0; i < 2; i++) {
+        args[i].tree = &tree;
+        args[i].stop = &stop;
+        assert(0 == pthread_create(&threads[i], NULL, test_cowReader,
+                    &args[i]));
+    }
+    for (k = 0; k < COW_KEYS; k++) {
+        assert(1 == cowInsert(&tree, k));
+    }
+    for (k = 0; k < COW_KEYS; k++) {
+        assert(1 == cowDelete(&tree, k));
+    }
+    stop = 1;
+    for (i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(1 == tree.live);
+    cowFree(&tree);
+
+    free(scan.keys);
+    free(present);
+}
+
+/*
+ * The shape of a B-epsilon tree below page: pivots, buffers and leaves
+ * sorted, each inside the range its parent steers to it, [lo, hi), and the
+ * leaves all at the same depth.
+ *
+ * @return the depth of the leaves below page.
+ */
+static int test_verifyBet(struct betree *tree, uint32_t page, long lo,
+        long hi, long *leaves)
+{
+    betnode_t *node = poolPin(&tree->pool, page);
+    int i, depth = -1;
+
+    assert(node);
+
+    if (betIsLeaf(node)) {
+        assert(node->used <= tree->leafCap);
+        for (i = 0; i < node->used; i++) {
+            assert(betKeys(node)[i] >= lo && betKeys(node)[i] < hi);
+            assert(i == 0 || betKeys(node)[i - 1] < betKeys(node)[i]);
+        }
+        *leaves += node->used;
+        poolUnpin(&tree->pool, node, 0);
+        return 0;
+    }
+
+    assert(node->order == tree->order && node->cap == tree->cap);
+    /* order pivots is a split that failed, to be done when it's next used. */
+    assert(node->used > 0 && node->used <= node->order);
+    assert(node->nmsgs <= node->cap);
+    for (i = 0; i < node->used; i++) {
+        assert(betPivots(node)[i] > lo && betPivots(node)[i] < hi);
+        assert(i == 0 || betPivots(node)[i - 1] < betPivots(node)[i]);
+    }
+    for (i = 0; i < node->nmsgs; i++) {
+        assert(betMsgKeys(node)[i] >= lo && betMsgKeys(node)[i] < hi);
+        assert(i == 0 || betMsgKeys(node)[i - 1] < betMsgKeys(node)[i]);
+        assert(BET_INSERT == betMsgOps(node)[i] ||
+                BET_DELETE == betMsgOps(node)[i]);
+    }
+
+    for (i = 0; i <= node->used; i++) {
+        int d = test_verifyBet(tree, betPtrs(node)[i],
+                i == 0 ? lo : betPivots(node)[i - 1],
+                i == node->used ? hi : betPivots(node)[i], leaves);
+
+        assert(depth == -1 || d + 1 == depth);
+        depth = d + 1;
+    }
+
+    poolUnpin(&tree->pool, node, 0);
+    return depth;
+}
+
+/*
+ * @return the depth of the tree, with the keys in its leaves, some maybe
+ * deleted by messages still on their way, in *leaves.
+ */
+static int test_verifyBetTree(struct betree *tree, long *leaves)
+{
+    *leaves = 0;
+    return test_verifyBet(tree, tree->root, INT_MIN, INT_MAX + 1L, leaves);
+}
+
+/* @return the nodes under page left full by a split that failed. */
+static int test_betFull(struct betree *tree, uint32_t page)
+{
+    betnode_t *node = poolPin(&tree->pool, page);
+    int i, full = 0;
+
+    assert(node);
+    if (!betIsLeaf(node)) {
+        full = node->used == node->order;
+        for (i = 0; i <= node->used; i++) {
+            full += test_betFull(tree, betPtrs(node)[i]);
+        }
+    }
+    poolUnpin(&tree->pool, node, 0);
+
+    return full;
+}
+
+struct test_betFail {
+    struct betree *tree;
+    uint32_t npages; /* once there are more than this, writes fail. */
+};
+
+/* a write back that fails once a split has taken a page. */
+static int test_betFailWrite(void *ctx, uint64_t lsn)
+{
+    struct test_betFail *fail = ctx;
+
+    (void)lsn;
+    if (fail->tree->npages > fail->npages) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+/* distinct for I up to the prime. */
+#define DEEP_KEY(I) ((int)((long)(I) * 40503 % 1000003))
+
+/*
+ * A B-epsilon tree in small pages with a pool smaller than it, against an
+ * array of what should be there: inserts, then deletes and inserts again of
+ * keys whose messages may still be in the buffers, and a reopen.  Then one
+ * that outgrows its pool, and one whose writes fail halfway through
+ * splits.  Then a tree whose buffers outnumber its keys, so
+ * messages keep replacing each other on the way down.
+ */
+static void test_betree(void)
+{
+    char path[] = "/tmp/betreeXXXXXX";
+    int count = 20000;
+    int *input = malloc(sizeof(int) * count);
+    char *present = calloc(100000, 1);
+    struct betree tree;
+    struct poolstats stats;
+    struct test_betFail fail;
+    long leaves;
+    int fd, i, k, depth;
+
+    printf("testing b-epsilon tree\n");
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    for (i = 0; i < count; i++) {
+        input[i] = i * 3;
+    }
+    for (i = count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = input[i];
+
+        input[i] = input[j];
+        input[j] = t;
+    }
+
+    /* too big an order leaves no room for a buffer. */
+    assert(-1 == betOpen(&tree, path, 128, 14, 16) && EINVAL == errno);
+
+    assert(0 == betOpen(&tree, path, 128, 0, 16));
+    assert(4 == tree.order && 16 == tree.cap && 30 == tree.leafCap);
+
+    for (i = 0; i < count; i++) {
+        assert(0 == betInsert(&tree, input[i]));
+    }
+    depth = test_verifyBetTree(&tree, &leaves);
+    assert(depth > 2);
+    /* most of the keys are down, and went down in batches. */
+    assert(leaves < count && leaves > count / 2);
+    assert(tree.flushed > tree.flushes * 2);
+
+    for (i = 0; i < count; i++) {
+        assert(1 == betSearch(&tree, input[i]));
+        assert(0 == betSearch(&tree, input[i] + 1));
+    }
+
+    stats = poolStats(&tree.pool);
+    assert(stats.evictions > 0 && stats.writebacks > 0);
+
+    /* the most recent messages win wherever they are. */
+    for (i = 0; i < count; i += 2) {
+        assert(0 == betDelete(&tree, input[i]));
+    }
+    for (i = 0; i < count; i += 4) {
+        assert(0 == betInsert(&tree, input[i]));
+        assert(0 == betDelete(&tree, input[i] + 1));
+    }
+    for (i = 0; i < count; i++) {
+        assert(betSearch(&tree, input[i]) == (i % 2 || i % 4 == 0));
+        assert(0 == betSearch(&tree, input[i] + 1));
+    }
+    test_verifyBetTree(&tree, &leaves);
+    assert(0 == betClose(&tree));
+
+    /* wrong page size. */
+    assert(-1 == betOpen(&tree, path, 256, 0, 16) && EINVAL == errno);
+
+    /* the file keeps its order. */
+    assert(0 == betOpen(&tree, path, 128, 3, 16));
+    assert(4 == tree.order);
+    assert(test_verifyBetTree(&tree, &leaves) >= depth);
+    for (i = 0; i < count; i++) {
+        assert(betSearch(&tree, input[i]) == (i % 2 || i % 4 == 0));
+    }
+    assert(0 == betClose(&tree));
+    unlink(path);
+
+    /*
+     * as few frames as a pool can have: the tree grows as deep as they can
+     * flush, then puts fail, and it's whole, and grows again with more.
+     */
+    assert(0 == betOpen(&tree, path, 128, 0, POOL_MIN_FRAMES));
+    for (i = 0; 0 == betInsert(&tree, DEEP_KEY(i)); i++) {
+        assert(i < 1000003);
+    }
+    assert(ENOBUFS == errno && POOL_MIN_FRAMES == tree.depth + 1);
+    assert(-1 == betInsert(&tree, DEEP_KEY(i)) && ENOBUFS == errno);
+    assert(-1 == betDelete(&tree, DEEP_KEY(0)) && ENOBUFS == errno);
+    assert(test_verifyBetTree(&tree, &leaves) + 1 == tree.depth);
+    for (count = i, i = 0; i < count; i++) {
+        assert(1 == betSearch(&tree, DEEP_KEY(i)));
+    }
+    assert(0 == betSearch(&tree, DEEP_KEY(count)));
+    assert(0 == betClose(&tree));
+
+    assert(0 == betOpen(&tree, path, 128, 0, 64));
+    assert(POOL_MIN_FRAMES == tree.depth + 1);
+    for (i = count; i < count * 2; i++) {
+        assert(0 == betInsert(&tree, DEEP_KEY(i)));
+    }
+    assert(test_verifyBetTree(&tree, &leaves) + 1 == tree.depth);
+    for (i = 0; i < count * 2; i++) {
+        assert(1 == betSearch(&tree, DEEP_KEY(i)));
+    }
+    assert(0 == betClose(&tree));
+    unlink(path);
+
+    /*
+     * writes that fail as soon as a put has split something, so the split
+     * above it fails, and leaves its node full for the next put to finish.
+     * Every frame has an lsn so the pool asks before writing any of them.
+     */
+    assert(0 == betOpen(&tree, path, 128, 0, 16));
+    fail.tree = &tree;
+    tree.pool.ctx = &fail;
+    for (count = 0, i = 0; i < 100000; i++) {
+        for (k = 0; k < tree.pool.nframes; k++) {
+            tree.pool.frames[k].lsn = 1;
+        }
+        fail.npages = tree.npages;
+        tree.pool.beforeWrite = test_betFailWrite;
+        present[i] = 0 == betInsert(&tree, DEEP_KEY(i));
+        assert(present[i] || EIO == errno);
+        tree.pool.beforeWrite = NULL;
+        if (i % 1000 == 0) {
+            count += test_betFull(&tree, tree.root);
+        }
+    }
+    assert(count > 0);
+    test_verifyBetTree(&tree, &leaves);
+    for (i = 0; i < 100000; i++) {
+        assert(betSearch(&tree, DEEP_KEY(i)) == present[i]);
+    }
+    assert(0 == betClose(&tree));
+    unlink(path);
+
+    /* a few keys, over and over, in and out. */
+    memset(present, 0x00, 5000);
+    assert(0 == betOpen(&tree, path, 512, 3, 64));
+    for (i = 0; i < 200000; i++) {
+        int key = rand() % 5000;
+
+        if (rand() % 3) {
+            assert(0 == betInsert(&tree, key));
+            present[key] = 1;
+        } else {
+            assert(0 == betDelete(&tree, key));
+            present[key] = 0;
+        }
+        if (i % 1000 == 0) {
+            key = rand() % 5000;
+            assert(betSearch(&tree, key) == present[key]);
+        }
+    }
+    test_verifyBetTree(&tree, &leaves);
+    for (i = 0; i < 5000; i++) {
+        assert(betSearch(&tree, i) == present[i]);
+    }
+    assert(0 == betClose(&tree));
+
+    unlink(path);
+    free(present);
+    free(input);
+}
+
 int main(void)
 {
     int i;
@@ -997,8 +2453,8 @@ int main(void)
      * Prevent innocuous code changes from breaking code that made reasonable
      * assumptions.
      */
-    assert(80 == sizeof(block_t));
-    assert(16 == offsetof(block_t, keys));
+    assert(16 == sizeof(block_t));
+    assert(64 >= blockBytes(NUM_KEYS));
 
     test_ptr_t tests[] = {
             test_insertBalance,
@@ -1020,11 +2476,19 @@ int main(void)
             test_deleteCase10d,
             test_deleteCase11a,
             test_insertDescending1,
+            test_orders,
+            test_bplustree,
+            test_bulkLoad,
+            test_arena,
+            test_nodeSearch,
+            test_paged,
+            test_walCrash,
+            test_olc,
+            test_cow,
+            test_betree,
     };
 
     for (i = 0; i < NUM_ELEMENTS(tests); i++) {
-        counter = 0; /* to make it easier on humans. */
-        memset(blockStorage, 0x00, sizeof(blockStorage));
         printf("-----------------------------------------------------------\n");
         tests[i]();
     }
@@ -0,0 +1,273 @@
+/*
+ * Write-ahead log with group commit.
+ *
+ * The lock only covers the buffer and the counters; the leader lets go of it
+ * while it writes and fsyncs, having swapped in the spare buffer, so appends
+ * carry on meanwhile and are what the next leader writes.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wal.h"
+
+/*
+ * Each record is framed with its length and a checksum of its bytes, and
+ * padded to 8, so a record that was only partly written when the machine
+ * went down fails the check.
+ */
+struct walrec {
+    uint32_t bytes; /* in data, not counting the padding. */
+    uint32_t zero;
+    uint64_t sum;
+};
+
+#define PADDED(N) (((N) + 7) & ~(size_t)7)
+
+/* FNV-1a, seeded with the length so a run of zeroes isn't a valid record. */
+static uint64_t checksum(const char *data, size_t bytes)
+{
+    uint64_t h = 0xcbf29ce484222325ull ^ bytes;
+    size_t i;
+
+    for (i = 0; i < bytes; i++) {
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ull;
+    }
+
+    return h;
+}
+
+void walInit(struct wal *wal, int fd)
+{
+    struct stat st;
+
+    memset(wal, 0x00, sizeof(*wal));
+    wal->fd = fd;
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->synced, NULL);
+
+    if (0 == fstat(fd, &st)) {
+        wal->lsn = wal->durable = st.st_size;
+    }
+}
+
+int walClose(struct wal *wal)
+{
+    int ret = walCommit(wal);
+    int saved = errno;
+
+    if (close(wal->fd) < 0 && 0 == ret) {
+        saved = errno;
+        ret = -1;
+    }
+    pthread_mutex_destroy(&wal->lock);
+    pthread_cond_destroy(&wal->synced);
+    free(wal->buf);
+    free(wal->spare);
+
+    errno = saved;
+    return ret;
+}
+
+uint64_t walAppend(struct wal *wal, const void *data, size_t bytes)
+{
+    struct walrec rec = {bytes, 0, checksum(data, bytes)};
+    size_t need = sizeof(rec) + PADDED(bytes);
+    uint64_t lsn;
+
+    pthread_mutex_lock(&wal->lock);
+
+    if (wal->used + need > wal->cap) {
+        size_t cap = (wal->used + need) * 2;
+        char *buf = realloc(wal->buf, cap);
+
+        if (!buf) {
+            pthread_mutex_unlock(&wal->lock);
+            errno = ENOMEM;
+            return 0;
+        }
+        wal->buf = buf;
+        wal->cap = cap;
+    }
+    memcpy(wal->buf + wal->used, &rec, sizeof(rec));
+    memcpy(wal->buf + wal->used + sizeof(rec), data, bytes);
+    memset(wal->buf + wal->used + sizeof(rec) + bytes, 0x00,
+            PADDED(bytes) - bytes);
+    wal->used += need;
+    wal->lsn += need;
+    lsn = wal->lsn;
+
+    pthread_mutex_unlock(&wal->lock);
+
+    return lsn;
+}
+
+static int writeAll(int fd, const char *data, size_t bytes, off_t at)
+{
+    while (bytes > 0) {
+        ssize_t w = pwrite(fd, data, bytes, at);
+
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += w;
+        bytes -= w;
+        at += w;
+    }
+
+    return 0;
+}
+
+/* called, and returns, with the lock held; lets go of it to write. */
+static void lead(struct wal *wal)
+{
+    char *data = wal->buf;
+    size_t bytes = wal->used, dataCap = wal->cap;
+    uint64_t end = wal->lsn;
+    off_t at = wal->lsn - wal->used - wal->start;
+    int err = 0;
+
+    wal->buf = wal->spare;
+    wal->cap = wal->spareCap;
+    wal->used = 0;
+    wal->flushing = 1;
+    pthread_mutex_unlock(&wal->lock);
+
+    if (writeAll(wal->fd, data, bytes, at) < 0 || fdatasync(wal->fd) < 0) {
+        err = errno;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    wal->spare = data;
+    wal->spareCap = dataCap;
+    wal->flushing = 0;
+    wal->syncs++;
+    if (err) {
+        wal->error = err;
+    } else {
+        wal->durable = end;
+    }
+    pthread_cond_broadcast(&wal->synced);
+}
+
+int walSync(struct wal *wal, uint64_t lsn)
+{
+    int err;
+
+    pthread_mutex_lock(&wal->lock);
+
+    while (wal->durable < lsn && !wal->error) {
+        if (wal->flushing) {
+            pthread_cond_wait(&wal->synced, &wal->lock);
+        } else {
+            lead(wal);
+        }
+    }
+    err = wal->error;
+
+    pthread_mutex_unlock(&wal->lock);
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+int walCommit(struct wal *wal)
+{
+    uint64_t lsn;
+
+    pthread_mutex_lock(&wal->lock);
+    lsn = wal->lsn;
+    wal->commits++;
+    pthread_mutex_unlock(&wal->lock);
+
+    return walSync(wal, lsn);
+}
+
+int walReset(struct wal *wal)
+{
+    if (walSync(wal, wal->lsn) < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    while (wal->flushing) {
+        pthread_cond_wait(&wal->synced, &wal->lock);
+    }
+    if (ftruncate(wal->fd, 0) < 0 || fdatasync(wal->fd) < 0) {
+        wal->error = errno;
+        pthread_mutex_unlock(&wal->lock);
+        return -1;
+    }
+    wal->start = wal->lsn;
+    pthread_mutex_unlock(&wal->lock);
+
+    return 0;
+}
+
+int walReplay(int fd, int (*apply)(void *ctx, const char *data, size_t bytes),
+        void *ctx)
+{
+    struct stat st;
+    char *log;
+    size_t at = 0, size;
+    ssize_t r;
+    int saved, ret = 0;
+
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    size = st.st_size;
+    if (0 == size) {
+        return 0;
+    }
+
+    if (!(log = malloc(size))) {
+        return -1;
+    }
+    while (at < size) {
+        if ((r = pread(fd, log + at, size - at, at)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            saved = errno;
+            free(log);
+            errno = saved;
+            return -1;
+        }
+        if (0 == r) {
+            break;
+        }
+        at += r;
+    }
+    size = at;
+
+    for (at = 0; at + sizeof(struct walrec) <= size;) {
+        struct walrec rec;
+        const char *data = log + at + sizeof(rec);
+
+        memcpy(&rec, log + at, sizeof(rec));
+        if (rec.zero || rec.bytes > size - at - sizeof(rec) ||
+                checksum(data, rec.bytes) != rec.sum) {
+            break;
+        }
+        if ((ret = apply(ctx, data, rec.bytes)) < 0) {
+            break;
+        }
+        at += sizeof(rec) + PADDED(rec.bytes);
+    }
+
+    saved = errno;
+    free(log);
+    errno = saved;
+    return ret;
+}
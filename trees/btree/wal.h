@@ -0,0 +1,81 @@
+#ifndef _WAL_H
+#define _WAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A redo log.  Records are appended to a buffer in memory and reach the file
+ * when someone asks for them to be durable; whoever asks first while nobody
+ * else is writing becomes the leader, and writes and fsyncs everything
+ * appended so far, for themselves and everyone who asks while they're at it.
+ * Those that asked meanwhile find their records already there, or wait for
+ * the next leader, so a crowd of committers shares each fsync: group commit.
+ *
+ * Positions in the log are lsns: the bytes ever appended, across resets, so
+ * an lsn never goes back.  The file holds the records from the last reset
+ * on, each with its length and a checksum, so a torn tail is seen and
+ * ignored.
+ */
+struct wal {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t synced;
+    char *buf; /* appended, not yet written. */
+    size_t used;
+    size_t cap;
+    char *spare; /* what the leader swaps for buf while it writes. */
+    size_t spareCap;
+    uint64_t lsn; /* the end of what's been appended. */
+    uint64_t durable; /* the end of what's been fsynced. */
+    uint64_t start; /* the lsn at the start of the file. */
+    int flushing; /* there's a leader. */
+    int error; /* the errno that broke the log; it stays broken. */
+    long syncs;
+    long commits; /* asked for, whether they made a sync or shared one. */
+};
+
+/*
+ * A log in the file open on fd, which it takes over, appending after
+ * whatever's there.
+ */
+void walInit(struct wal *wal, int fd);
+/* @return 0, or -1 with errno set; the file is closed either way. */
+int walClose(struct wal *wal);
+
+/*
+ * Append one record.  @return the lsn of its end, or 0 with errno set if
+ * there's no memory for it.
+ */
+uint64_t walAppend(struct wal *wal, const void *data, size_t bytes);
+/*
+ * Wait until everything up to lsn is on disk, writing it if nobody else is.
+ * @return 0, or -1 with errno set.
+ */
+int walSync(struct wal *wal, uint64_t lsn);
+/* walSync() everything appended so far, as a commit. */
+int walCommit(struct wal *wal);
+/*
+ * Empty the file, once everything it held is in the pages.  Nobody may
+ * append meanwhile.
+ * @return 0, or -1 with errno set.
+ */
+int walReset(struct wal *wal);
+
+/* bytes in the file, or that will be once they're written. */
+static inline uint64_t walBytes(struct wal *wal)
+{
+    return wal->lsn - wal->start;
+}
+
+/*
+ * Read the records in the file open on fd, calling apply on each intact one
+ * in order, up to the first that's torn or short.  apply returns 0, or -1
+ * with errno set to stop.
+ * @return 0, or -1 with errno set.
+ */
+int walReplay(int fd, int (*apply)(void *ctx, const char *data, size_t bytes),
+        void *ctx);
+
+#endif